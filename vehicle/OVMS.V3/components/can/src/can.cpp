@@ -45,6 +45,7 @@ static const char *TAG = "can";
 #include <ctype.h>
 #include <string.h>
 #include <iomanip>
+#include "esp_timer.h"
 #include "ovms_config.h"
 #include "ovms_command.h"
 #include "metrics_standard.h"
@@ -347,13 +348,220 @@ void can_set_register(int verbosity, OvmsWriter* writer, OvmsCommand* cmd, int a
   sbus->WriteReg(addr,value);
   }
 
+// Former canfilter implementation (list walk), for benchmark comparison:
+static bool can_filter_legacy(std::list<CAN_filter_t*>& filters, const CAN_frame_t* p_frame)
+  {
+  if (filters.size() == 0) return true;
+  char buskey = '0';
+  if (p_frame->origin) buskey = p_frame->origin->m_busnumber + '1';
+  for (CAN_filter_t* filter : filters)
+    {
+    if ((filter->bus)&&(filter->bus != buskey)) continue;
+    if ((p_frame->MsgID >= filter->id_from) && (p_frame->MsgID <= filter->id_to))
+      return true;
+    }
+  return false;
+  }
+
+void can_filter_benchmark(int verbosity, OvmsWriter* writer, OvmsCommand* cmd, int argc, const char* const* argv)
+  {
+  int count = (argc > 0) ? atoi(argv[0]) : 20000;
+  if (count < 1)
+    {
+    writer->puts("Error: invalid frame count");
+    return;
+    }
+
+  // Test frames: random standard & extended IDs on buses 1 & 2
+  const int nframes = 256;
+  CAN_frame_t* frames = new CAN_frame_t[nframes];
+  uint32_t seed = 12345;
+  auto rnd = [&seed]() -> uint32_t { seed = seed * 1103515245 + 12345; return (seed >> 1); };
+  for (int i = 0; i < nframes; i++)
+    {
+    memset(&frames[i], 0, sizeof(CAN_frame_t));
+    frames[i].origin = MyCan.GetBus(rnd() % 2);
+    if (rnd() % 2)
+      {
+      frames[i].FIR.B.FF = CAN_frame_std;
+      frames[i].MsgID = rnd() % 0x800;
+      }
+    else
+      {
+      frames[i].FIR.B.FF = CAN_frame_ext;
+      frames[i].MsgID = 0x18da0000 + (rnd() % 0x20000);
+      }
+    }
+
+  writer->printf("Checking %d frames per filter size (range terms, a quarter bus specific):\n", count);
+  writer->puts("Terms  List frames/s  Compiled frames/s  Passed list/compiled  Mismatches");
+
+  static const int termcounts[] = { 1, 5, 10, 20, 50 };
+  for (int termcount : termcounts)
+    {
+    canfilter filter;
+    std::list<CAN_filter_t*> legacy;
+    for (int t = 0; t < termcount; t++)
+      {
+      CAN_filter_t* f = new CAN_filter_t;
+      memset(f, 0, sizeof(CAN_filter_t));
+      f->bus = (rnd() % 4 == 0) ? '1' + (rnd() % 2) : 0;
+      f->type = CAN_FilterRange;
+      if (t % 2)
+        {
+        f->id_from = rnd() % 0x800;
+        f->id_to = f->id_from + (rnd() % 16);
+        }
+      else
+        {
+        f->id_from = 0x18da0000 + (rnd() % 0x20000);
+        f->id_to = f->id_from + (rnd() % 256);
+        }
+      legacy.push_back(f);
+      filter.AddFilter(f->bus, f->id_from, f->id_to);
+      }
+
+    int passed_list = 0, passed = 0, mismatches = 0;
+    int64_t start = esp_timer_get_time();
+    for (int i = 0; i < count; i++)
+      passed_list += can_filter_legacy(legacy, &frames[i % nframes]);
+    int64_t time_list = esp_timer_get_time() - start;
+
+    start = esp_timer_get_time();
+    for (int i = 0; i < count; i++)
+      passed += filter.IsFiltered(&frames[i % nframes]);
+    int64_t time_compiled = esp_timer_get_time() - start;
+
+    for (int i = 0; i < nframes; i++)
+      {
+      if (can_filter_legacy(legacy, &frames[i]) != filter.IsFiltered(&frames[i]))
+        mismatches++;
+      }
+
+    writer->printf("%5d %16lld %18lld %10d/%-10d %10d\n",
+      termcount,
+      time_list ? (long long)count * 1000000LL / time_list : 0LL,
+      time_compiled ? (long long)count * 1000000LL / time_compiled : 0LL,
+      passed_list, passed, mismatches);
+
+    for (CAN_filter_t* f : legacy)
+      delete f;
+    }
+
+  delete [] frames;
+  }
+
 ////////////////////////////////////////////////////////////////////////
 // CAN Filtering (software based filter)
 // The canfilter object encapsulates the filtering of CAN frames
 ////////////////////////////////////////////////////////////////////////
 
+typedef std::pair<uint32_t,uint32_t> CAN_idpair_t;
+typedef std::vector<CAN_idpair_t> CAN_idpair_list_t;
+
+// Sort ranges by start & merge overlapping/adjacent ranges
+static void CanMergeRanges(CAN_idpair_list_t& ranges)
+  {
+  std::sort(ranges.begin(), ranges.end());
+  CAN_idpair_list_t merged;
+  for (auto& r : ranges)
+    {
+    if (!merged.empty() && r.first <= (uint64_t)merged.back().second + 1)
+      merged.back().second = std::max(merged.back().second, r.second);
+    else
+      merged.push_back(r);
+    }
+  ranges.swap(merged);
+  }
+
+// Binary search in sorted & merged ranges
+static inline bool CanInRanges(const CAN_idpair_list_t& ranges, uint32_t id)
+  {
+  // find last range starting at or before id:
+  auto it = std::upper_bound(ranges.begin(), ranges.end(), CAN_idpair_t(id, UINT32_MAX));
+  return (it != ranges.begin() && id <= (--it)->second);
+  }
+
+static inline bool CanInMasks(const CAN_idpair_list_t& masks, uint32_t id)
+  {
+  for (auto& m : masks)
+    {
+    if ((id & m.second) == m.first)
+      return true;
+    }
+  return false;
+  }
+
+canfilterset::canfilterset()
+  {
+  memset(m_stdmap, 0, sizeof(m_stdmap));
+  }
+
+void canfilterset::Add(const CAN_filter_t& filter, uint32_t* stdexcl)
+  {
+  uint32_t* stdmap = filter.exclude ? stdexcl : m_stdmap;
+  CAN_idpair_list_t& extranges = filter.exclude ? m_extxranges : m_extranges;
+  CAN_idpair_list_t& extmasks = filter.exclude ? m_extxmasks : m_extmasks;
+
+  if (filter.type == CAN_FilterMask)
+    {
+    uint32_t mask = filter.id_to;
+    uint32_t value = filter.id_from & mask;
+    for (uint32_t id = 0; id <= 0x7ff; id++)
+      {
+      if ((id & mask) == value)
+        stdmap[id >> 5] |= (1u << (id & 31));
+      }
+    if (value > 0x1fffffff)
+      return; // cannot match any extended ID
+    // a mask leaving only low order bits open is a range:
+    uint32_t open = ~mask & 0x1fffffff;
+    if ((open & (open+1)) == 0)
+      extranges.push_back(CAN_idpair_t(value, value | open));
+    else
+      extmasks.push_back(CAN_idpair_t(value, mask & 0x1fffffff));
+    }
+  else
+    {
+    if (filter.id_to < filter.id_from)
+      return;
+    if (filter.id_from <= 0x7ff)
+      {
+      uint32_t to = std::min(filter.id_to, (uint32_t)0x7ff);
+      for (uint32_t id = filter.id_from; id <= to; id++)
+        stdmap[id >> 5] |= (1u << (id & 31));
+      }
+    extranges.push_back(CAN_idpair_t(filter.id_from, filter.id_to));
+    }
+  }
+
+void canfilterset::Finish(const uint32_t* stdexcl)
+  {
+  for (int k = 0; k < 2048/32; k++)
+    m_stdmap[k] &= ~stdexcl[k];
+  CanMergeRanges(m_extranges);
+  CanMergeRanges(m_extxranges);
+  }
+
+bool canfilterset::Match(const CAN_frame_t* p_frame) const
+  {
+  uint32_t id = p_frame->MsgID;
+  if (p_frame->FIR.B.FF == CAN_frame_std)
+    {
+    return (id <= 0x7ff) && (m_stdmap[id >> 5] & (1u << (id & 31)));
+    }
+  else
+    {
+    if (CanInRanges(m_extxranges, id) || CanInMasks(m_extxmasks, id))
+      return false;
+    return CanInRanges(m_extranges, id) || CanInMasks(m_extmasks, id);
+    }
+  }
+
 canfilter::canfilter()
   {
+  for (int k = 0; k <= CAN_MAXBUSES; k++)
+    m_busset[k] = NULL;
   }
 
 canfilter::~canfilter()
@@ -363,28 +571,50 @@ canfilter::~canfilter()
 
 void canfilter::ClearFilters()
   {
-  for (CAN_filter_t* filter : m_filters)
-    {
-    delete filter;
-    }
   m_filters.clear();
+  ClearCompiled();
+  }
+
+void canfilter::AddFilter(uint8_t bus, uint32_t id_from, uint32_t id_to, bool exclude)
+  {
+  CAN_filter_t f;
+  f.bus = bus;
+  f.type = CAN_FilterRange;
+  f.exclude = exclude;
+  f.id_from = id_from;
+  f.id_to = id_to;
+  m_filters.push_back(f);
+  Compile();
   }
 
-void canfilter::AddFilter(uint8_t bus, uint32_t id_from, uint32_t id_to)
+void canfilter::AddFilterMask(uint8_t bus, uint32_t value, uint32_t mask, bool exclude)
   {
-  CAN_filter_t* f = new CAN_filter_t;
-  f->bus = bus;
-  f->id_from = id_from;
-  f->id_to = id_to;
+  CAN_filter_t f;
+  f.bus = bus;
+  f.type = CAN_FilterMask;
+  f.exclude = exclude;
+  f.id_from = value & mask;
+  f.id_to = mask;
   m_filters.push_back(f);
+  Compile();
   }
 
 void canfilter::AddFilter(const char* filterstring)
   {
   char* fs = (char*)filterstring;
-  if (fs[1] == 0)
+  bool exclude = false;
+  if (fs[0] == '!')
+    {
+    exclude = true;
+    fs++;
+    }
+  if (fs[0] == 0)
     {
-    AddFilter((uint8_t)fs[0]);
+    return;
+    }
+  else if (fs[1] == 0)
+    {
+    AddFilter((uint8_t)fs[0], 0, UINT32_MAX, exclude);
     }
   else
     {
@@ -396,80 +626,242 @@ void canfilter::AddFilter(const char* filterstring)
       bus = fs[0];
       fs += 2;
       }
-    id_from = strtol(fs, &fs, 16);
+    id_from = strtoul(fs, &fs, 16);
+    if (*fs == '/')
+      {
+      AddFilterMask(bus, id_from, strtoul(fs+1, NULL, 16), exclude); // id/mask
+      return;
+      }
     if (*fs)
-      id_to = strtol(fs+1, NULL, 16); // id range
+      id_to = strtoul(fs+1, NULL, 16); // id range
     else
       id_to = id_from; // single id
-    AddFilter(bus,id_from,id_to);
+    AddFilter(bus,id_from,id_to,exclude);
     }
   }
 
 bool canfilter::RemoveFilter(uint8_t bus, uint32_t id_from, uint32_t id_to)
   {
-  for (CAN_filter_t* filter : m_filters)
+  for (auto it = m_filters.begin(); it != m_filters.end(); ++it)
     {
-    if ((filter->bus == bus)&&
-        (filter->id_from == id_from)&&
-        (filter->id_to == id_to))
+    if ((it->type == CAN_FilterRange)&&
+        (it->bus == bus)&&
+        (it->id_from == id_from)&&
+        (it->id_to == id_to))
       {
-      delete filter;
+      m_filters.erase(it);
+      Compile();
       return true;
       }
     }
   return false;
   }
 
+void canfilter::ClearCompiled()
+  {
+  for (int k = 0; k <= CAN_MAXBUSES; k++)
+    m_busset[k] = NULL;
+  for (canfilterset* set : m_sets)
+    delete set;
+  m_sets.clear();
+  }
+
+// Map filter bus key to compiled set index, -1 = no bus
+static int CanFilterBusSlot(uint8_t bus)
+  {
+  if (bus == '0')
+    return 0; // frames without origin
+  if (bus >= '1' && bus < '1'+CAN_MAXBUSES)
+    return bus - '1' + 1;
+  return -1;
+  }
+
+void canfilter::Compile()
+  {
+  ClearCompiled();
+  if (m_filters.empty())
+    return;
+
+  bool include = false;
+  bool busterms[CAN_MAXBUSES+1] = { false };
+  for (auto& f : m_filters)
+    {
+    if (!f.exclude)
+      include = true;
+    if (f.bus)
+      {
+      int slot = CanFilterBusSlot(f.bus);
+      if (slot >= 0) busterms[slot] = true;
+      }
+    }
+
+  // Buses without specific terms share the set compiled from the generic terms:
+  canfilterset* generic = NULL;
+  CAN_filter_t all = { 0, CAN_FilterRange, false, 0, UINT32_MAX };
+  for (int slot = 0; slot <= CAN_MAXBUSES; slot++)
+    {
+    if (!busterms[slot] && generic)
+      {
+      m_busset[slot] = generic;
+      continue;
+      }
+    uint32_t stdexcl[2048/32];
+    memset(stdexcl, 0, sizeof(stdexcl));
+    canfilterset* set = new canfilterset();
+    if (!include)
+      set->Add(all, stdexcl); // exclusions only
+    for (auto& f : m_filters)
+      {
+      if (f.bus == 0 || (busterms[slot] && CanFilterBusSlot(f.bus) == slot))
+        set->Add(f, stdexcl);
+      }
+    set->Finish(stdexcl);
+    m_sets.push_back(set);
+    m_busset[slot] = set;
+    if (!busterms[slot])
+      generic = set;
+    }
+  }
+
 bool canfilter::IsFiltered(const CAN_frame_t* p_frame)
   {
-  if (m_filters.size() == 0) return true;
+  if (m_filters.empty()) return true;
   if (! p_frame) return false;
 
-  char buskey = '0';
-  if (p_frame->origin) buskey = p_frame->origin->m_busnumber + '1';
-
-  for (CAN_filter_t* filter : m_filters)
+  int slot = 0;
+  if (p_frame->origin)
     {
-    if ((filter->bus)&&(filter->bus != buskey)) continue;
-    if ((p_frame->MsgID >= filter->id_from) && (p_frame->MsgID <= filter->id_to))
-      return true;
+    slot = p_frame->origin->m_busnumber + 1;
+    if (slot > CAN_MAXBUSES) return false;
     }
 
-  return false;
+  const canfilterset* set = m_busset[slot];
+  return (set != NULL) && set->Match(p_frame);
   }
 
 bool canfilter::IsFiltered(canbus* bus)
   {
-  if (m_filters.size() == 0) return true;
+  if (m_filters.empty()) return true;
   if (bus == NULL) return true;
 
   char buskey = bus->GetName()[3];
+  bool include = false;
 
-  for (CAN_filter_t* filter : m_filters)
+  for (auto& f : m_filters)
     {
-    if ((filter->bus)&&(filter->bus == buskey)) return true;
+    if (f.exclude)
+      {
+      // bus excluded completely?
+      if ((f.bus == buskey)&&(f.type == CAN_FilterRange)&&
+          (f.id_from == 0)&&(f.id_to == UINT32_MAX))
+        return false;
+      continue;
+      }
+    include = true;
+    if ((f.bus)&&(f.bus == buskey)) return true;
     }
 
-  return false;
+  return !include;
   }
 
 std::string canfilter::Info()
   {
   std::ostringstream buf;
 
-  for (CAN_filter_t* filter : m_filters)
+  for (auto& f : m_filters)
     {
-    if (filter->bus > 0) buf << std::setfill(' ') << std::dec << filter->bus << ':';
+    if (f.exclude) buf << '!';
+    if (f.bus > 0) buf << std::setfill(' ') << std::dec << f.bus << ':';
     buf << std::setfill('0') << std::setw(3) << std::hex;
-    if (filter->id_from == filter->id_to)
-      { buf << filter->id_from << ' '; }
+    if (f.type == CAN_FilterMask)
+      { buf << f.id_from << '/' << f.id_to << ' '; }
+    else if (f.id_from == f.id_to)
+      { buf << f.id_from << ' '; }
     else
-      { buf << filter->id_from << '-' << filter->id_to << ' '; }
+      { buf << f.id_from << '-' << f.id_to << ' '; }
     }
 
   return buf.str();
   }
 
+////////////////////////////////////////////////////////////////////////
+// CAN ID match set (compiled filter)
+////////////////////////////////////////////////////////////////////////
+
+canmatch::canmatch()
+  {
+  Clear();
+  }
+
+canmatch::~canmatch()
+  {
+  }
+
+void canmatch::Clear()
+  {
+  m_busmask = 0;
+  m_idfilter = false;
+  memset(m_stdmap, 0, sizeof(m_stdmap));
+  m_extranges.clear();
+  m_extmasks.clear();
+  }
+
+void canmatch::AddBus(canbus* bus)
+  {
+  if (bus)
+    m_busmask |= (1 << bus->m_busnumber);
+  }
+
+void canmatch::AddStd(uint32_t id_from, uint32_t id_to)
+  {
+  m_idfilter = true;
+  if (id_to > 0x7ff) id_to = 0x7ff;
+  for (uint32_t id = id_from; id <= id_to; id++)
+    m_stdmap[id >> 5] |= (1u << (id & 31));
+  }
+
+void canmatch::AddStdMask(uint32_t id, uint32_t mask)
+  {
+  m_idfilter = true;
+  for (uint32_t k = 0; k <= 0x7ff; k++)
+    {
+    if ((k & mask) == (id & mask))
+      m_stdmap[k >> 5] |= (1u << (k & 31));
+    }
+  }
+
+void canmatch::AddExt(uint32_t id_from, uint32_t id_to)
+  {
+  m_idfilter = true;
+  if (id_to < id_from) return;
+  m_extranges.push_back(idpair_t(id_from, id_to));
+  CanMergeRanges(m_extranges);
+  }
+
+void canmatch::AddExtMask(uint32_t id, uint32_t mask)
+  {
+  m_idfilter = true;
+  m_extmasks.push_back(idpair_t(id & mask, mask));
+  }
+
+bool canmatch::Match(const CAN_frame_t* p_frame) const
+  {
+  if (m_busmask && p_frame->origin && !(m_busmask & (1 << p_frame->origin->m_busnumber)))
+    return false;
+  if (!m_idfilter)
+    return true;
+
+  uint32_t id = p_frame->MsgID;
+  if (p_frame->FIR.B.FF == CAN_frame_std)
+    {
+    return (id <= 0x7ff) && (m_stdmap[id >> 5] & (1u << (id & 31)));
+    }
+  else
+    {
+    return CanInRanges(m_extranges, id) || CanInMasks(m_extmasks, id);
+    }
+  }
+
 ////////////////////////////////////////////////////////////////////////
 // CAN logging and tracing
 // These structures are involved in formatting, logging and tracing of
@@ -495,34 +887,63 @@ const char* GetCanLogTypeName(CAN_log_type_t type)
 
 void can::LogFrame(canbus* bus, CAN_log_type_t type, const CAN_frame_t* frame)
   {
+  if (!m_logring || !bus || !frame) return;
   OvmsMutexLock lock(&m_loggermap_mutex);
+  if (!m_logring) return;
 
-  for (canlog_map_t::iterator it=m_loggermap.begin(); it!=m_loggermap.end(); ++it)
-    {
-    it->second->LogFrame(bus, type, frame);
-    }
+  CAN_log_message_t* msg = m_logring->BeginPut();
+  msg->type = type;
+  gettimeofday(&msg->timestamp,NULL);
+  memcpy(&msg->frame,frame,sizeof(CAN_frame_t));
+  msg->frame.origin = bus;
+  m_logring->EndPut();
+  NotifyLoggers();
   }
 
 void can::LogStatus(canbus* bus, CAN_log_type_t type, const CAN_status_t* status)
   {
+  if (!m_logring || !bus) return;
   OvmsMutexLock lock(&m_loggermap_mutex);
+  if (!m_logring) return;
 
-  for (canlog_map_t::iterator it=m_loggermap.begin(); it!=m_loggermap.end(); ++it)
-    {
-    it->second->LogStatus(bus, type, status);
-    }
+  CAN_log_message_t* msg = m_logring->BeginPut();
+  msg->type = type;
+  gettimeofday(&msg->timestamp,NULL);
+  msg->origin = bus;
+  memcpy(&msg->status,status,sizeof(CAN_status_t));
+  m_logring->EndPut();
+  NotifyLoggers();
   }
 
 void can::LogInfo(canbus* bus, CAN_log_type_t type, const char* text)
   {
+  if (!m_logring || !text) return;
   OvmsMutexLock lock(&m_loggermap_mutex);
+  if (!m_logring) return;
+
+  CAN_log_message_t* msg = m_logring->BeginPut();
+  msg->type = type;
+  gettimeofday(&msg->timestamp,NULL);
+  msg->origin = bus;
+  msg->text = NULL;
+  m_logring->EndPut(text);
+  NotifyLoggers();
+  }
 
+void can::NotifyLoggers()
+  {
   for (canlog_map_t::iterator it=m_loggermap.begin(); it!=m_loggermap.end(); ++it)
     {
-    it->second->LogInfo(bus, type, text);
+    it->second->Notify();
     }
   }
 
+void can::LogEventListener(event_id_t id, const char* event, void* data)
+  {
+  if (strncmp(event, "vehicle", 7) == 0)
+    LogInfo(NULL, CAN_LogInfo_Event, event);
+  }
+
 void canbus::LogFrame(CAN_log_type_t type, const CAN_frame_t* frame)
   {
   MyCan.LogFrame(this, type, frame);
@@ -579,12 +1000,32 @@ uint32_t can::AddLogger(canlog* logger, int filterc, const char* const* filterv)
     }
 
   OvmsMutexLock lock(&m_loggermap_mutex);
+  if (m_logring == NULL)
+    {
+    m_logring = new canlogring(MyConfig.GetParamValueInt("can", "log.queuesize", 100));
+    using std::placeholders::_1;
+    using std::placeholders::_2;
+    using std::placeholders::_3;
+    MyEvents.RegisterEvent("can.log", EVENT_ID_ANY, std::bind(&can::LogEventListener, this, _1, _2, _3));
+    }
   uint32_t id = m_logger_id++;
   m_loggermap[id] = logger;
+  logger->Attach(m_logring);
 
   return id;
   }
 
+void can::ReleaseLogRing()
+  {
+  // called with m_loggermap_mutex held
+  if (m_loggermap.empty() && m_loggers_stopping == 0 && m_logring)
+    {
+    MyEvents.DeregisterEvent("can.log");
+    delete m_logring;
+    m_logring = NULL;
+    }
+  }
+
 bool can::HasLogger()
   {
   return (m_loggermap.size() != 0);
@@ -601,33 +1042,55 @@ canlog* can::GetLogger(uint32_t id)
     return NULL;
   }
 
+/**
+ * RemoveLogger(s): the loggers are taken out of the map under the mutex, but
+ *  stopped, closed & deleted without holding it: a logger task or a logger's
+ *  network handler may be waiting for the mutex (frame logging) while holding
+ *  a logger lock needed to shut down. The ring is kept until all tasks of
+ *  removed loggers have stopped.
+ */
 bool can::RemoveLogger(uint32_t id)
   {
-  OvmsMutexLock lock(&m_loggermap_mutex);
-
-  auto k = m_loggermap.find(id);
-  if (k != m_loggermap.end())
+  canlog* logger;
     {
-    k->second->Close();
-    vTaskDelay(pdMS_TO_TICKS(100)); // give logger task time to finish
-    delete k->second;
+    OvmsMutexLock lock(&m_loggermap_mutex);
+    auto k = m_loggermap.find(id);
+    if (k == m_loggermap.end())
+      return false;
+    logger = k->second;
     m_loggermap.erase(k);
-    return true;
+    m_loggers_stopping++;
     }
-  return false;
+
+  logger->StopTask();
+  logger->Close();
+  delete logger;
+
+  OvmsMutexLock lock(&m_loggermap_mutex);
+  m_loggers_stopping--;
+  ReleaseLogRing();
+  return true;
   }
 
 void can::RemoveLoggers()
   {
-  OvmsMutexLock lock(&m_loggermap_mutex);
+  canlog_map_t loggers;
+    {
+    OvmsMutexLock lock(&m_loggermap_mutex);
+    loggers.swap(m_loggermap);
+    m_loggers_stopping += loggers.size();
+    }
 
-  for (canlog_map_t::iterator it=m_loggermap.begin(); it!=m_loggermap.end();)
+  for (canlog_map_t::iterator it=loggers.begin(); it!=loggers.end(); ++it)
     {
+    it->second->StopTask();
     it->second->Close();
-    vTaskDelay(pdMS_TO_TICKS(100)); // give logger task time to finish
     delete it->second;
-    it = m_loggermap.erase(it);
     }
+
+  OvmsMutexLock lock(&m_loggermap_mutex);
+  m_loggers_stopping -= loggers.size();
+  ReleaseLogRing();
   }
 
 uint32_t can::AddPlayer(canplay* player, int filterc, const char* const* filterv)
@@ -645,6 +1108,7 @@ uint32_t can::AddPlayer(canplay* player, int filterc, const char* const* filterv
   OvmsMutexLock lock(&m_playermap_mutex);
   uint32_t id = m_player_id++;
   m_playermap[id] = player;
+  player->Start();
 
   return id;
   }
@@ -752,6 +1216,8 @@ can::can()
   ESP_LOGI(TAG, "Initialising CAN (4510)");
 
   m_logger_id = 1;
+  m_loggers_stopping = 0;
+  m_logring = NULL;
   m_player_id = 1;
 
   MyConfig.RegisterParam("can", "CAN Configuration", true, true);
@@ -784,6 +1250,8 @@ can::can()
     }
 
   cmd_can->RegisterCommand("list", "List CAN buses", can_list);
+  OvmsCommand* cmd_canfilter = cmd_can->RegisterCommand("filter", "CAN filter framework");
+  cmd_canfilter->RegisterCommand("benchmark", "Benchmark CAN filter matching", can_filter_benchmark, "[<frames>]", 0, 1);
 
   m_rxqueue = xQueueCreate(CONFIG_OVMS_HW_CAN_RX_QUEUE_SIZE,sizeof(CAN_queue_msg_t));
   xTaskCreatePinnedToCore(CAN_rxtask, "OVMS CanRx", 2*2048, (void*)this, 23, &m_rxtask, CORE(0));
@@ -822,13 +1290,18 @@ void can::IncomingFrame(CAN_frame_t* p_frame)
   NotifyListeners(p_frame, false);
   }
 
-void can::RegisterListener(QueueHandle_t queue, bool txfeedback)
+void can::RegisterListener(QueueHandle_t queue, bool txfeedback, const canmatch* filter)
   {
-  m_listeners[queue] = txfeedback;
+  CanListenerEntry entry;
+  entry.m_txfeedback = txfeedback;
+  if (filter) entry.m_filter = *filter;
+  OvmsMutexLock lock(&m_listeners_mutex);
+  m_listeners[queue] = entry;
   }
 
 void can::DeregisterListener(QueueHandle_t queue)
   {
+  OvmsMutexLock lock(&m_listeners_mutex);
   auto it = m_listeners.find(queue);
   if (it != m_listeners.end())
     m_listeners.erase(it);
@@ -836,9 +1309,12 @@ void can::DeregisterListener(QueueHandle_t queue)
 
 void can::NotifyListeners(const CAN_frame_t* frame, bool tx)
   {
+  OvmsMutexLock lock(&m_listeners_mutex);
   for (CanListenerMap_t::iterator it = m_listeners.begin(); it != m_listeners.end(); ++it)
     {
-    if (!tx || (tx && it->second))
+    if (tx && !it->second.m_txfeedback)
+      continue;
+    if (it->second.m_filter.Match(frame))
       xQueueSend(it->first,frame,0);
     }
   }
@@ -42,6 +42,7 @@
 #include <stdint.h>
 #include <functional>
 #include <list>
+#include <vector>
 #include "pcp.h"
 #include <esp_err.h>
 #include "ovms_events.h"
@@ -62,6 +63,7 @@
 #define CAN_MAXBUSES 5            // Limit of number of CAN buses supported
 
 class canbus; // Forward definition
+class canlogring; // Forward definition
 
 // CAN mode
 typedef enum
@@ -184,16 +186,49 @@ typedef struct
 ////////////////////////////////////////////////////////////////////////
 // CAN Filtering (software based filter)
 // The canfilter object encapsulates the filtering of CAN frames
+// Filter terms are ID ranges or ID/mask pairs, optionally bound to a bus,
+// and either inclusive or exclusive. A frame passes if it matches any
+// inclusive term (or there are none) and no exclusive term.
+// Terms are compiled into a canfilterset per bus whenever they change:
+// a bitmap for the 2048 standard IDs, and sorted & merged ID ranges plus
+// remaining ID/mask pairs for extended IDs.
 ////////////////////////////////////////////////////////////////////////
 
+typedef enum
+  {
+  CAN_FilterRange = 0,        // id_from <= ID <= id_to
+  CAN_FilterMask              // (ID & id_to) == id_from (id_to is the mask)
+  } CAN_filter_type_t;
+
 typedef struct
   {
-  uint8_t bus;
-  uint32_t id_from;
-  uint32_t id_to;
+  uint8_t bus;                // bus key ('1'...), 0 = any bus
+  uint8_t type;               // CAN_filter_type_t
+  bool exclude;               // true = reject matching frames
+  uint32_t id_from;           // range start / mask value
+  uint32_t id_to;             // range end / mask
   } CAN_filter_t;
 
-typedef std::list<CAN_filter_t*> CAN_filter_list_t;
+typedef std::vector<CAN_filter_t> CAN_filter_list_t;
+
+class canfilterset
+  {
+  public:
+    canfilterset();
+
+  public:
+    void Add(const CAN_filter_t& filter, uint32_t* stdexcl);
+    void Finish(const uint32_t* stdexcl);
+    bool Match(const CAN_frame_t* p_frame) const;
+
+  protected:
+    typedef std::pair<uint32_t,uint32_t> idpair_t;
+    uint32_t m_stdmap[2048/32];           // standard IDs passing (exclusions applied)
+    std::vector<idpair_t> m_extranges;    // extended ID ranges included, sorted & merged
+    std::vector<idpair_t> m_extmasks;     // extended ID (value,mask) pairs included
+    std::vector<idpair_t> m_extxranges;   // extended ID ranges excluded, sorted & merged
+    std::vector<idpair_t> m_extxmasks;    // extended ID (value,mask) pairs excluded
+  };
 
 class canfilter
   {
@@ -203,7 +238,8 @@ class canfilter
 
   public:
     void ClearFilters();
-    void AddFilter(uint8_t bus=0, uint32_t id_from=0, uint32_t id_to=UINT32_MAX);
+    void AddFilter(uint8_t bus=0, uint32_t id_from=0, uint32_t id_to=UINT32_MAX, bool exclude=false);
+    void AddFilterMask(uint8_t bus, uint32_t value, uint32_t mask, bool exclude=false);
     void AddFilter(const char* filterstring);
     bool RemoveFilter(uint8_t bus=0, uint32_t id_from=0, uint32_t id_to=UINT32_MAX);
 
@@ -212,8 +248,50 @@ class canfilter
     bool IsFiltered(canbus* bus);
     std::string Info();
 
+  protected:
+    void Compile();
+    void ClearCompiled();
+
   protected:
     CAN_filter_list_t m_filters;
+    std::vector<canfilterset*> m_sets;          // compiled sets (owned)
+    canfilterset* m_busset[CAN_MAXBUSES+1];     // [0] = no origin, [n+1] = bus n
+  };
+
+////////////////////////////////////////////////////////////////////////
+// CAN ID match set (compiled filter)
+// The canmatch object is a compiled set of buses and IDs, for fast
+// matching of frames in hot paths (i.e. listener dispatch).
+// Standard IDs are held in a bitmap, extended IDs as a sorted list of
+// ranges plus optional id/mask pairs. An empty set matches all frames,
+// a set with IDs only matches frames of a type (std/ext) added.
+////////////////////////////////////////////////////////////////////////
+
+class canmatch
+  {
+  public:
+    canmatch();
+    ~canmatch();
+
+  public:
+    void Clear();
+    void AddBus(canbus* bus);
+    void AddStd(uint32_t id_from, uint32_t id_to);
+    void AddStdMask(uint32_t id, uint32_t mask);
+    void AddExt(uint32_t id_from, uint32_t id_to);
+    void AddExtMask(uint32_t id, uint32_t mask);
+
+  public:
+    bool Match(const CAN_frame_t* p_frame) const;
+    bool IsEmpty() const { return (m_busmask == 0 && !m_idfilter); }
+
+  protected:
+    typedef std::pair<uint32_t,uint32_t> idpair_t;
+    uint8_t m_busmask;                    // bit per bus number, 0 = all
+    bool m_idfilter;                      // false = all IDs
+    uint32_t m_stdmap[2048/32];           // standard ID bitmap
+    std::vector<idpair_t> m_extranges;    // extended ID ranges (from,to), sorted & merged
+    std::vector<idpair_t> m_extmasks;     // extended ID (id,mask) pairs
   };
 
 ////////////////////////////////////////////////////////////////////////
@@ -321,7 +399,16 @@ class canbus : public pcp, public InternalRamAllocated
 // can - the CAN system controller
 ////////////////////////////////////////////////////////////////////////
 
-typedef std::map<QueueHandle_t, bool> CanListenerMap_t;
+class CanListenerEntry
+  {
+  public:
+    CanListenerEntry() { m_txfeedback = false; }
+    ~CanListenerEntry() {}
+  public:
+    bool m_txfeedback;
+    canmatch m_filter;
+  };
+typedef std::map<QueueHandle_t, CanListenerEntry> CanListenerMap_t;
 
 
 class CanFrameCallbackEntry
@@ -352,7 +439,7 @@ class can : public InternalRamAllocated
     QueueHandle_t m_rxqueue;
 
   public:
-    void RegisterListener(QueueHandle_t queue, bool txfeedback=false);
+    void RegisterListener(QueueHandle_t queue, bool txfeedback=false, const canmatch* filter=NULL);
     void DeregisterListener(QueueHandle_t queue);
     void NotifyListeners(const CAN_frame_t* frame, bool tx);
 
@@ -379,6 +466,11 @@ class can : public InternalRamAllocated
     void LogFrame(canbus* bus, CAN_log_type_t type, const CAN_frame_t* frame);
     void LogStatus(canbus* bus, CAN_log_type_t type, const CAN_status_t* status);
     void LogInfo(canbus* bus, CAN_log_type_t type, const char* text);
+    void LogEventListener(event_id_t id, const char* event, void* data);
+
+  protected:
+    void NotifyLoggers();
+    void ReleaseLogRing();
 
   public:
     canbus* GetBus(int busnumber);
@@ -388,6 +480,8 @@ class can : public InternalRamAllocated
     canlog_map_t m_loggermap;
     OvmsMutex m_loggermap_mutex;
     uint32_t m_logger_id;
+    int m_loggers_stopping;               // removed from the map, task not yet stopped
+    canlogring* m_logring;                // shared capture ring, exists while loggers are attached
 
   public:
     typedef std::map<uint32_t, canplay*> canplay_map_t;
@@ -398,6 +492,7 @@ class can : public InternalRamAllocated
   private:
     canbus* m_buslist[CAN_MAXBUSES];
     CanListenerMap_t m_listeners;
+    OvmsMutex m_listeners_mutex;      // listeners may (de)register while frames are dispatched
     CanFrameCallbackList_t m_rxcallbacks;
     CanFrameCallbackList_t m_txcallbacks;
     TaskHandle_t m_rxtask;            // Task to handle reception
@@ -80,6 +80,7 @@ canformat::canformat(const char* type, canformat_serve_mode_t mode)
   m_servemode = mode;
   m_servediscarding = false;
   m_putcallback_fn = NULL;
+  m_bufstuffed = 0;
   }
 
 canformat::~canformat()
@@ -101,6 +102,16 @@ std::string canformat::getheader(struct timeval *time)
   return std::string("");
   }
 
+std::string canformat::getfooter()
+  {
+  return std::string("");
+  }
+
+std::string canformat::getflush()
+  {
+  return std::string("");
+  }
+
 size_t canformat::put(CAN_log_message_t* message, uint8_t *buffer, size_t len, void* userdata)
   {
   return 0;
@@ -131,34 +142,119 @@ size_t canformat::Serve(uint8_t *buffer, size_t len, void* userdata)
       len = 0;
       }
 
-    if (msg.frame.origin != NULL)
-      {
-      switch (m_servemode)
-        {
-        case Simulate:
-          MyCan.IncomingFrame(&msg.frame);
-          break;
-        case Transmit:
-          msg.frame.origin->Write(&msg.frame);
-          break;
-        default:
-          break;
-        }
-      }
+    ServeMsg(&msg);
     }
 
   return consumed;
   }
 
+void canformat::ServeMsg(CAN_log_message_t* message)
+  {
+  if (message->frame.origin == NULL)
+    return;
+
+  switch (message->type)
+    {
+    case CAN_LogFrame_RX:
+    case CAN_LogFrame_TX:
+      break;
+    default:
+      return;
+    }
+
+  switch (m_servemode)
+    {
+    case Simulate:
+      MyCan.IncomingFrame(&message->frame);
+      break;
+    case Transmit:
+      message->frame.origin->Write(&message->frame);
+      break;
+    default:
+      break;
+    }
+  }
+
 size_t canformat::Stuff(uint8_t *buffer, size_t len)
   {
   // Stuff incoming data into the put buffer
   if (len==0) return 0;
   size_t consumed = (len>m_buf.FreeSpace())?m_buf.FreeSpace():len;
   m_buf.Push(buffer,consumed);
+  m_bufstuffed += consumed;
   return consumed;
   }
 
+/**
+ * DecodeNext: feed put() from the reader until it delivers the next message
+ *  (any type, having an origin). put() parses one record per call, so it's
+ *  called with len=0 as long as it makes progress on buffered input. The put
+ *  buffer is never filled up completely (formats would switch to discarding).
+ *  Returns false on end of input, or if the input cannot be parsed (sets
+ *  reader.m_error).
+ */
+bool canformat::DecodeNext(CAN_log_message_t* message, canformat_reader& reader)
+  {
+  while (1)
+    {
+    memset(message, 0, sizeof(*message));
+    size_t buffered = GetPutBufferUsed();
+    uint32_t progress = GetPutProgress();
+    size_t room = (buffered < CANFORMAT_SERVE_BUFFERSIZE) ? CANFORMAT_SERVE_BUFFERSIZE - buffered : 0;
+    size_t len = reader.m_len - reader.m_pos;
+    if (len >= room) len = (room > 0) ? room-1 : 0;
+
+    size_t used = put(message, reader.m_buf + reader.m_pos, len);
+    reader.m_pos += used;
+    if (message->origin != NULL)
+      return true;
+    if (used > 0 || GetPutProgress() != progress)
+      continue; // progress, but no message (i.e. a file header)
+
+    if (reader.m_pos < reader.m_len)
+      {
+      reader.m_error = true;
+      return false;
+      }
+    if (!reader.m_read)
+      return false; // end of data
+    reader.m_pos = 0;
+    reader.m_len = reader.m_read(reader.m_buf, reader.m_size);
+    if (reader.m_len == 0)
+      return false; // end of input
+    }
+  }
+
+/**
+ * DecodeStream: decode messages until end of input or the callback returns false
+ *  Returns the number of messages passed to the callback.
+ */
+size_t canformat::DecodeStream(canformat_reader& reader, canformat_msg_fn callback)
+  {
+  size_t count = 0;
+  CAN_log_message_t message;
+  while (DecodeNext(&message, reader))
+    {
+    count++;
+    if (!callback(&message))
+      break;
+    }
+  return count;
+  }
+
+size_t canformat::GetPutBufferUsed()
+  {
+  return m_buf.UsedSpace();
+  }
+
+uint32_t canformat::GetPutProgress()
+  {
+  // Progress indicator for put() loops: changes whenever put() has processed
+  // (delivered or discarded) buffered input, even if it consumed no new input.
+  // Base formats parse from m_buf, so this is the total of bytes taken out:
+  return m_bufstuffed - m_buf.UsedSpace();
+  }
+
 canformat::canformat_serve_mode_t canformat::GetServeMode()
   {
   return m_servemode;
@@ -31,6 +31,7 @@
 #include <sys/time.h>
 #include <string.h>
 #include <map>
+#include <functional>
 #include "can.h"
 #include "ovms_utils.h"
 #include "ovms_command.h"
@@ -40,6 +41,31 @@ using namespace std;
 #define CANFORMAT_SERVE_BUFFERSIZE 1024
 
 typedef void (*canformat_put_write_fn)(uint8_t *buffer, size_t len, void* data);
+typedef std::function<size_t(uint8_t* buffer, size_t size)> canformat_read_fn;
+typedef std::function<bool(CAN_log_message_t* message)> canformat_msg_fn;
+
+/**
+ * canformat_reader: input buffer for canformat::DecodeNext() / DecodeStream()
+ *  Either wraps a data block in memory, or a buffer refilled by a read
+ *  function (returning the number of bytes read, 0 = end of input).
+ */
+class canformat_reader
+  {
+  public:
+    canformat_reader(const uint8_t* data, size_t len)
+      : m_buf((uint8_t*)data), m_size(len), m_pos(0), m_len(len), m_error(false) {}
+    canformat_reader(uint8_t* buf, size_t size, canformat_read_fn read)
+      : m_buf(buf), m_size(size), m_pos(0), m_len(0), m_read(read), m_error(false) {}
+    void Reset() { m_pos = 0; m_len = (m_read) ? 0 : m_size; m_error = false; }
+
+  public:
+    uint8_t*            m_buf;
+    size_t              m_size;
+    size_t              m_pos;
+    size_t              m_len;
+    canformat_read_fn   m_read;
+    bool                m_error;        // input could not be parsed
+  };
 
 class canformat
   {
@@ -56,9 +82,13 @@ class canformat
   public: // Conversion from OVMS CAN log messages to specific format
     virtual std::string get(CAN_log_message_t* message);
     virtual std::string getheader(struct timeval *time = NULL);
+    virtual std::string getfooter();
+    virtual std::string getflush();     // pending output on idle input
 
   public: // Conversion from specific format to OVMS CAN log messages
     virtual size_t put(CAN_log_message_t* message, uint8_t *buffer, size_t len, void* userdata=NULL);
+    bool DecodeNext(CAN_log_message_t* message, canformat_reader& reader);
+    size_t DecodeStream(canformat_reader& reader, canformat_msg_fn callback);
 
   private:
     const char* m_type;
@@ -72,12 +102,18 @@ class canformat
     void SetPutCallback(canformat_put_write_fn callback);
     virtual size_t Serve(uint8_t *buffer, size_t len, void* userdata=NULL);
     virtual size_t Stuff(uint8_t *buffer, size_t len);
+    virtual size_t GetPutBufferUsed();
+    virtual uint32_t GetPutProgress();
+
+  protected:
+    void ServeMsg(CAN_log_message_t* message);
 
   protected:
     canformat_put_write_fn m_putcallback_fn;
     canformat_serve_mode_t m_servemode;
     bool m_servediscarding;
     OvmsBuffer m_buf;
+    uint32_t m_bufstuffed;      // total bytes stuffed into m_buf
   };
 
 template<typename Type> canformat* CreateCanFormat(const char* type)
@@ -0,0 +1,803 @@
+/*
+;    Project:       Open Vehicle Monitor System
+;    Module:        CAN dump OVMS binary log format
+;    Date:          16th October 2026
+;
+;    (C) 2026       Mark Webb-Johnson
+;
+; Permission is hereby granted, free of charge, to any person obtaining a copy
+; of this software and associated documentation files (the "Software"), to deal
+; in the Software without restriction, including without limitation the rights
+; to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+; copies of the Software, and to permit persons to whom the Software is
+; furnished to do so, subject to the following conditions:
+;
+; The above copyright notice and this permission notice shall be included in
+; all copies or substantial portions of the Software.
+;
+; THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+; IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+; FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+; AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+; LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+; OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+; THE SOFTWARE.
+*/
+
+
+#include "ovms_log.h"
+static const char *TAG = "canformat-obl";
+
+#include "canformat_obl.h"
+#include "ovms_malloc.h"
+#ifdef CONFIG_OVMS_SC_ZIP
+#include "zlib.h"
+#endif // CONFIG_OVMS_SC_ZIP
+
+class OvmsCanFormatOBLInit
+  {
+  public: OvmsCanFormatOBLInit();
+} MyOvmsCanFormatOBLInit  __attribute__ ((init_priority (4505)));
+
+OvmsCanFormatOBLInit::OvmsCanFormatOBLInit()
+  {
+  ESP_LOGI(TAG, "Registering CAN Format: OBL (4505)");
+
+  MyCanFormatFactory.RegisterCanFormat<canformat_obl>("obl");
+  }
+
+static inline uint8_t* PutVarint(uint8_t* p, uint32_t v)
+  {
+  while (v >= 0x80)
+    {
+    *p++ = (v & 0x7f) | 0x80;
+    v >>= 7;
+    }
+  *p++ = v;
+  return p;
+  }
+
+static inline bool GetVarint(const uint8_t*& p, const uint8_t* end, uint32_t& v)
+  {
+  v = 0;
+  for (int shift = 0; shift < 35; shift += 7)
+    {
+    if (p >= end) return false;
+    uint8_t b = *p++;
+    v |= (uint32_t)(b & 0x7f) << shift;
+    if ((b & 0x80) == 0) return true;
+    }
+  return false;
+  }
+
+#ifdef CONFIG_OVMS_SC_ZIP
+static voidpf obl_zalloc(voidpf opaque, uInt items, uInt size)
+  {
+  return ExternalRamCalloc(items, size);
+  }
+
+static void obl_zfree(voidpf opaque, voidpf address)
+  {
+  free(address);
+  }
+#endif // CONFIG_OVMS_SC_ZIP
+
+canformat_obl::canformat_obl(const char *type)
+  : canformat(type)
+  {
+  memset(&m_enc, 0, sizeof(m_enc));
+  m_hash = NULL;
+  m_zbuf = NULL;
+  m_written = 0;
+  m_totalrecords = 0;
+  m_blockno = 0;
+  m_index = NULL;
+  m_indexcount = 0;
+  m_indexstride = 1;
+
+  memset(&m_dec, 0, sizeof(m_dec));
+  m_in = NULL;
+  m_inlen = 0;
+  m_skip = 0;
+  m_decoded = 0;
+  m_progress = 0;
+  m_text[0] = 0;
+  }
+
+canformat_obl::~canformat_obl()
+  {
+#ifdef CONFIG_OVMS_SC_ZIP
+  if (m_enc.zstream)
+    {
+    deflateEnd((z_stream*)m_enc.zstream);
+    free(m_enc.zstream);
+    }
+  if (m_dec.zstream)
+    {
+    inflateEnd((z_stream*)m_dec.zstream);
+    free(m_dec.zstream);
+    }
+#endif // CONFIG_OVMS_SC_ZIP
+  if (m_enc.dict) free(m_enc.dict);
+  if (m_enc.raw) free(m_enc.raw);
+  if (m_hash) free(m_hash);
+  if (m_zbuf) free(m_zbuf);
+  if (m_index) free(m_index);
+  if (m_dec.dict) free(m_dec.dict);
+  if (m_dec.raw) free(m_dec.raw);
+  if (m_in) free(m_in);
+  }
+
+void canformat_obl::ResetBlock(blockstate_t& blk, uint64_t base)
+  {
+  blk.dictcount = 0;
+  blk.base = base;
+  blk.lastts = base;
+  blk.records = 0;
+  blk.rawlen = 0;
+  blk.rawpos = 0;
+  }
+
+uint8_t canformat_obl::BusFlags(canbus* bus, bool ext)
+  {
+  uint8_t flags = (bus != NULL) ? (bus->m_busnumber & 0x07) : CANFORMAT_OBL_BUS_NONE;
+  if (ext) flags |= CANFORMAT_OBL_BUS_EXT;
+  return flags;
+  }
+
+canbus* canformat_obl::BusFromFlags(uint8_t busflags)
+  {
+  int busnumber = busflags & 0x07;
+  if (busnumber == CANFORMAT_OBL_BUS_NONE) return NULL;
+  return MyCan.GetBus(busnumber);
+  }
+
+////////////////////////////////////////////////////////////////////////
+// Encoder
+
+bool canformat_obl::EncodeInit()
+  {
+  m_enc.dict = (dictentry_t*)ExternalRamMalloc(sizeof(dictentry_t) * CANFORMAT_OBL_MAXDICT);
+  m_enc.raw = (uint8_t*)ExternalRamMalloc(CANFORMAT_OBL_BLOCKMAX);
+  m_hash = (uint16_t*)ExternalRamCalloc(CANFORMAT_OBL_HASHSIZE, sizeof(uint16_t));
+  m_zbuf = (uint8_t*)ExternalRamMalloc(CANFORMAT_OBL_BLOCKMAX);
+  m_index = (obl_indexentry_t*)ExternalRamMalloc(sizeof(obl_indexentry_t) * CANFORMAT_OBL_MAXINDEX);
+  if (!m_enc.dict || !m_enc.raw || !m_hash || !m_zbuf || !m_index)
+    {
+    ESP_LOGE(TAG, "EncodeInit: out of memory");
+    if (m_enc.dict) { free(m_enc.dict); m_enc.dict = NULL; }
+    if (m_enc.raw) { free(m_enc.raw); m_enc.raw = NULL; }
+    if (m_hash) { free(m_hash); m_hash = NULL; }
+    if (m_zbuf) { free(m_zbuf); m_zbuf = NULL; }
+    if (m_index) { free(m_index); m_index = NULL; }
+    return false;
+    }
+  ResetBlock(m_enc, 0);
+
+#ifdef CONFIG_OVMS_SC_ZIP
+  z_stream* zs = (z_stream*)ExternalRamCalloc(1, sizeof(z_stream));
+  if (zs)
+    {
+    zs->zalloc = obl_zalloc;
+    zs->zfree = obl_zfree;
+    if (deflateInit2(zs, CANFORMAT_OBL_LEVEL, Z_DEFLATED, -CANFORMAT_OBL_WINDOWBITS,
+                     CANFORMAT_OBL_MEMLEVEL, Z_DEFAULT_STRATEGY) == Z_OK)
+      {
+      m_enc.zstream = zs;
+      }
+    else
+      {
+      free(zs);
+      }
+    }
+  if (!m_enc.zstream)
+    ESP_LOGW(TAG, "EncodeInit: deflate init failed, writing uncompressed blocks");
+#endif // CONFIG_OVMS_SC_ZIP
+
+  return true;
+  }
+
+int canformat_obl::DictLookup(uint32_t id, uint8_t busflags)
+  {
+  // Returns hash slot of entry, m_hash[slot]==0 if not found
+  uint32_t h = ((id ^ ((uint32_t)busflags << 29)) * 2654435761u) >> 16;
+  for (;;)
+    {
+    h &= (CANFORMAT_OBL_HASHSIZE-1);
+    uint16_t e = m_hash[h];
+    if (e == 0) return h;
+    dictentry_t* entry = &m_enc.dict[e-1];
+    if (entry->id == id && entry->busflags == busflags) return h;
+    h++;
+    }
+  }
+
+bool canformat_obl::EncodeRecord(CAN_log_message_t* message, uint64_t ts)
+  {
+  uint8_t* p = m_enc.raw + m_enc.rawlen;
+  uint8_t* tag = p++;
+  *tag = message->type & 0x0f;
+  p = PutVarint(p, (uint32_t)(ts - m_enc.lastts));
+
+  switch (message->type)
+    {
+    case CAN_LogFrame_RX:
+    case CAN_LogFrame_TX:
+    case CAN_LogFrame_TX_Queue:
+    case CAN_LogFrame_TX_Fail:
+      {
+      CAN_frame_t* frame = &message->frame;
+      uint32_t id = frame->MsgID & 0x1fffffff;
+      uint8_t busflags = BusFlags(frame->origin, frame->FIR.B.FF == CAN_frame_ext);
+      int dlc = (frame->FIR.B.DLC > 8) ? 8 : frame->FIR.B.DLC;
+      int slot = DictLookup(id, busflags);
+      dictentry_t* entry;
+      if (m_hash[slot] == 0)
+        {
+        if (m_enc.dictcount >= CANFORMAT_OBL_MAXDICT)
+          return false; // dictionary full, start new block
+        entry = &m_enc.dict[m_enc.dictcount++];
+        m_hash[slot] = m_enc.dictcount;
+        entry->id = id;
+        entry->busflags = busflags;
+        entry->dlc = 0xff; // no payload yet
+        *tag |= CANFORMAT_OBL_TAG_NEWDICT;
+        *p++ = busflags;
+        p = PutVarint(p, id);
+        }
+      else
+        {
+        entry = &m_enc.dict[m_hash[slot]-1];
+        *p++ = m_hash[slot]-1;
+        }
+
+      if (frame->FIR.B.RTR)
+        {
+        *tag |= CANFORMAT_OBL_TAG_RTR;
+        *p++ = dlc;
+        }
+      else if (dlc > 0 && entry->dlc == dlc)
+        {
+        *tag |= CANFORMAT_OBL_TAG_DELTA;
+        uint8_t* changes = p++;
+        *changes = 0;
+        for (int k=0; k<dlc; k++)
+          {
+          if (frame->data.u8[k] != entry->data[k])
+            {
+            *changes |= (1 << k);
+            *p++ = entry->data[k] = frame->data.u8[k];
+            }
+          }
+        }
+      else
+        {
+        *p++ = dlc;
+        memcpy(p, frame->data.u8, dlc);
+        p += dlc;
+        entry->dlc = dlc;
+        memcpy(entry->data, frame->data.u8, dlc);
+        }
+      }
+      break;
+
+    case CAN_LogStatus_Error:
+    case CAN_LogStatus_Statistics:
+      {
+      CAN_status_t* status = &message->status;
+      *p++ = BusFlags(message->origin, false);
+      p = PutVarint(p, status->interrupts);
+      p = PutVarint(p, status->packets_rx);
+      p = PutVarint(p, status->packets_tx);
+      p = PutVarint(p, status->txbuf_delay);
+      p = PutVarint(p, status->rxbuf_overflow);
+      p = PutVarint(p, status->txbuf_overflow);
+      p = PutVarint(p, status->error_flags);
+      p = PutVarint(p, status->errors_rx);
+      p = PutVarint(p, status->errors_tx);
+      p = PutVarint(p, status->watchdog_resets);
+      p = PutVarint(p, status->error_resets);
+      }
+      break;
+
+    default:
+      {
+      size_t len = (message->text) ? strnlen(message->text, CANFORMAT_OBL_MAXTEXT) : 0;
+      *p++ = BusFlags(message->origin, false);
+      p = PutVarint(p, len);
+      memcpy(p, message->text, len);
+      p += len;
+      }
+      break;
+    }
+
+  m_enc.rawlen = p - m_enc.raw;
+  m_enc.lastts = ts;
+  m_enc.records++;
+  return true;
+  }
+
+void canformat_obl::FlushBlock(std::string& out)
+  {
+  if (m_enc.records == 0) return;
+
+  obl_blockhdr_t hdr;
+  memcpy(hdr.magic, "OB", 2);
+  hdr.flags = 0;
+  hdr.reserved = 0;
+  hdr.records = m_enc.records;
+  hdr.rawlen = m_enc.rawlen;
+  hdr.tv_sec = m_enc.base / 1000000;
+  hdr.tv_usec = m_enc.base % 1000000;
+
+  uint8_t* data = m_enc.raw;
+  size_t stored = m_enc.rawlen;
+#ifdef CONFIG_OVMS_SC_ZIP
+  if (m_enc.zstream)
+    {
+    // Compress into m_zbuf, store uncompressed if that doesn't save anything:
+    z_stream* zs = (z_stream*)m_enc.zstream;
+    deflateReset(zs);
+    zs->next_in = m_enc.raw;
+    zs->avail_in = m_enc.rawlen;
+    zs->next_out = m_zbuf;
+    zs->avail_out = m_enc.rawlen;
+    if (deflate(zs, Z_FINISH) == Z_STREAM_END && zs->total_out < m_enc.rawlen)
+      {
+      data = m_zbuf;
+      stored = zs->total_out;
+      hdr.flags |= CANFORMAT_OBL_FL_DEFLATE;
+      }
+    }
+#endif // CONFIG_OVMS_SC_ZIP
+  hdr.storedlen = stored;
+
+  // Index the block, thin out the index if full:
+  if ((m_blockno % m_indexstride) == 0 && m_indexcount == CANFORMAT_OBL_MAXINDEX)
+    {
+    for (int i=0; i<CANFORMAT_OBL_MAXINDEX/2; i++)
+      m_index[i] = m_index[i*2];
+    m_indexcount = CANFORMAT_OBL_MAXINDEX/2;
+    m_indexstride *= 2;
+    }
+  if ((m_blockno % m_indexstride) == 0)
+    {
+    obl_indexentry_t* ie = &m_index[m_indexcount++];
+    ie->offset = m_written;
+    ie->tv_sec = hdr.tv_sec;
+    ie->tv_usec = hdr.tv_usec;
+    ie->records = m_totalrecords;
+    }
+
+  out.append((const char*)&hdr, sizeof(hdr));
+  out.append((const char*)data, stored);
+  m_written += sizeof(hdr) + stored;
+  m_totalrecords += m_enc.records;
+  m_blockno++;
+  m_enc.records = 0;
+  m_enc.rawlen = 0;
+  }
+
+std::string canformat_obl::get(CAN_log_message_t* message)
+  {
+  std::string out;
+  if (message->type > CAN_LogInfo_Event) return out;
+  if (!m_enc.raw && !EncodeInit()) return out;
+
+  uint64_t ts = (uint64_t)message->timestamp.tv_sec * 1000000 + message->timestamp.tv_usec;
+
+  // Start a new block if the timestamp cannot be delta encoded:
+  if (m_enc.records > 0 && (ts < m_enc.lastts || ts - m_enc.base >= CANFORMAT_OBL_BLOCKTIME))
+    FlushBlock(out);
+  if (m_enc.records == 0)
+    {
+    ResetBlock(m_enc, ts);
+    memset(m_hash, 0, CANFORMAT_OBL_HASHSIZE * sizeof(uint16_t));
+    }
+
+  if (!EncodeRecord(message, ts))
+    {
+    FlushBlock(out);
+    ResetBlock(m_enc, ts);
+    memset(m_hash, 0, CANFORMAT_OBL_HASHSIZE * sizeof(uint16_t));
+    EncodeRecord(message, ts);
+    }
+
+  if (m_enc.rawlen >= CANFORMAT_OBL_BLOCKSIZE)
+    FlushBlock(out);
+
+  return out;
+  }
+
+std::string canformat_obl::getheader(struct timeval *time)
+  {
+  struct timeval t;
+  if (time == NULL)
+    {
+    gettimeofday(&t,NULL);
+    time = &t;
+    }
+
+  if (!m_enc.raw) EncodeInit();
+  m_written = sizeof(obl_filehdr_t);
+  m_totalrecords = 0;
+  m_blockno = 0;
+  m_indexcount = 0;
+  m_indexstride = 1;
+
+  obl_filehdr_t hdr;
+  memcpy(hdr.magic, "OBL1", 4);
+  hdr.version = CANFORMAT_OBL_VERSION;
+  hdr.flags = (m_enc.zstream) ? CANFORMAT_OBL_FL_DEFLATE : 0;
+  hdr.reserved = 0;
+  hdr.tv_sec = time->tv_sec;
+  hdr.tv_usec = time->tv_usec;
+  return std::string((const char*)&hdr, sizeof(hdr));
+  }
+
+std::string canformat_obl::getfooter()
+  {
+  std::string out;
+  if (!m_enc.raw) return out;
+
+  FlushBlock(out);
+
+  obl_indexhdr_t ih;
+  memcpy(ih.magic, "OI", 2);
+  ih.stride = m_indexstride;
+  ih.entries = m_indexcount;
+  obl_trailer_t tr;
+  tr.offset = m_written;
+  memcpy(tr.magic, "OBLX", 4);
+
+  out.append((const char*)&ih, sizeof(ih));
+  out.append((const char*)m_index, m_indexcount * sizeof(obl_indexentry_t));
+  out.append((const char*)&tr, sizeof(tr));
+  m_written += sizeof(ih) + m_indexcount * sizeof(obl_indexentry_t) + sizeof(tr);
+  return out;
+  }
+
+std::string canformat_obl::getflush()
+  {
+  std::string out;
+  if (!m_enc.raw || m_enc.records == 0) return out;
+
+  // Emit the partial block when it reaches the block time span without
+  // new records, so an idle bus does not hold back the last records:
+  struct timeval t;
+  gettimeofday(&t,NULL);
+  uint64_t now = (uint64_t)t.tv_sec * 1000000 + t.tv_usec;
+  if (now < m_enc.base || now - m_enc.base >= CANFORMAT_OBL_BLOCKTIME)
+    FlushBlock(out);
+  return out;
+  }
+
+////////////////////////////////////////////////////////////////////////
+// Decoder
+
+bool canformat_obl::DecodeInit()
+  {
+  m_dec.dict = (dictentry_t*)ExternalRamMalloc(sizeof(dictentry_t) * CANFORMAT_OBL_MAXDICT);
+  m_dec.raw = (uint8_t*)ExternalRamMalloc(CANFORMAT_OBL_BLOCKMAX);
+  m_in = (uint8_t*)ExternalRamMalloc(sizeof(obl_blockhdr_t) + CANFORMAT_OBL_BLOCKMAX);
+  if (!m_dec.dict || !m_dec.raw || !m_in)
+    {
+    ESP_LOGE(TAG, "DecodeInit: out of memory");
+    if (m_dec.dict) { free(m_dec.dict); m_dec.dict = NULL; }
+    if (m_dec.raw) { free(m_dec.raw); m_dec.raw = NULL; }
+    if (m_in) { free(m_in); m_in = NULL; }
+    return false;
+    }
+  ResetBlock(m_dec, 0);
+  m_inlen = 0;
+  m_skip = 0;
+
+#ifdef CONFIG_OVMS_SC_ZIP
+  z_stream* zs = (z_stream*)ExternalRamCalloc(1, sizeof(z_stream));
+  if (zs)
+    {
+    zs->zalloc = obl_zalloc;
+    zs->zfree = obl_zfree;
+    if (inflateInit2(zs, -CANFORMAT_OBL_WINDOWBITS) == Z_OK)
+      m_dec.zstream = zs;
+    else
+      free(zs);
+    }
+  if (!m_dec.zstream)
+    ESP_LOGW(TAG, "DecodeInit: inflate init failed, cannot read compressed blocks");
+#endif // CONFIG_OVMS_SC_ZIP
+
+  return true;
+  }
+
+void canformat_obl::DropInput(size_t len)
+  {
+  m_progress += (len > m_inlen) ? m_inlen : len;
+  if (len >= m_inlen)
+    {
+    m_inlen = 0;
+    return;
+    }
+  memmove(m_in, m_in+len, m_inlen-len);
+  m_inlen -= len;
+  }
+
+bool canformat_obl::DecodeBlock(const obl_blockhdr_t* hdr, uint8_t* data)
+  {
+  if (hdr->flags & CANFORMAT_OBL_FL_DEFLATE)
+    {
+#ifdef CONFIG_OVMS_SC_ZIP
+    z_stream* zs = (z_stream*)m_dec.zstream;
+    if (!zs) return false;
+    inflateReset(zs);
+    zs->next_in = data;
+    zs->avail_in = hdr->storedlen;
+    zs->next_out = m_dec.raw;
+    zs->avail_out = hdr->rawlen;
+    if (inflate(zs, Z_FINISH) != Z_STREAM_END || zs->total_out != hdr->rawlen)
+      return false;
+#else
+    return false;
+#endif // CONFIG_OVMS_SC_ZIP
+    }
+  else
+    {
+    if (hdr->storedlen != hdr->rawlen) return false;
+    memcpy(m_dec.raw, data, hdr->rawlen);
+    }
+
+  ResetBlock(m_dec, (uint64_t)hdr->tv_sec * 1000000 + hdr->tv_usec);
+  m_dec.rawlen = hdr->rawlen;
+  return true;
+  }
+
+bool canformat_obl::DecodeRecord(CAN_log_message_t* message)
+  {
+  const uint8_t* p = m_dec.raw + m_dec.rawpos;
+  const uint8_t* end = m_dec.raw + m_dec.rawlen;
+  uint32_t v;
+
+  uint8_t tag = *p++;
+  if (!GetVarint(p, end, v)) return false;
+  uint64_t ts = m_dec.lastts + v;
+  message->type = (CAN_log_type_t)(tag & 0x0f);
+  message->timestamp.tv_sec = ts / 1000000;
+  message->timestamp.tv_usec = ts % 1000000;
+
+  switch (message->type)
+    {
+    case CAN_LogFrame_RX:
+    case CAN_LogFrame_TX:
+    case CAN_LogFrame_TX_Queue:
+    case CAN_LogFrame_TX_Fail:
+      {
+      dictentry_t* entry;
+      if (tag & CANFORMAT_OBL_TAG_NEWDICT)
+        {
+        if (p >= end || m_dec.dictcount >= CANFORMAT_OBL_MAXDICT) return false;
+        entry = &m_dec.dict[m_dec.dictcount];
+        entry->busflags = *p++;
+        if (!GetVarint(p, end, v)) return false;
+        entry->id = v;
+        entry->dlc = 0xff;
+        m_dec.dictcount++;
+        }
+      else
+        {
+        if (p >= end || *p >= m_dec.dictcount) return false;
+        entry = &m_dec.dict[*p++];
+        }
+
+      CAN_frame_t* frame = &message->frame;
+      frame->origin = BusFromFlags(entry->busflags);
+      frame->FIR.U = 0;
+      frame->FIR.B.FF = (entry->busflags & CANFORMAT_OBL_BUS_EXT) ? CAN_frame_ext : CAN_frame_std;
+      frame->MsgID = entry->id;
+      memset(frame->data.u8, 0, 8);
+
+      if (tag & CANFORMAT_OBL_TAG_RTR)
+        {
+        if (p >= end || *p > 8) return false;
+        frame->FIR.B.RTR = 1;
+        frame->FIR.B.DLC = *p++;
+        }
+      else if (tag & CANFORMAT_OBL_TAG_DELTA)
+        {
+        if (p >= end || entry->dlc > 8) return false;
+        uint8_t changes = *p++;
+        for (int k=0; k<entry->dlc; k++)
+          {
+          if (changes & (1 << k))
+            {
+            if (p >= end) return false;
+            entry->data[k] = *p++;
+            }
+          }
+        frame->FIR.B.DLC = entry->dlc;
+        memcpy(frame->data.u8, entry->data, entry->dlc);
+        }
+      else
+        {
+        if (p >= end || *p > 8) return false;
+        uint8_t dlc = *p++;
+        if (end - p < dlc) return false;
+        memcpy(entry->data, p, dlc);
+        p += dlc;
+        entry->dlc = dlc;
+        frame->FIR.B.DLC = dlc;
+        memcpy(frame->data.u8, entry->data, dlc);
+        }
+      }
+      break;
+
+    case CAN_LogStatus_Error:
+    case CAN_LogStatus_Statistics:
+      {
+      if (p >= end) return false;
+      message->origin = BusFromFlags(*p++);
+      CAN_status_t* status = &message->status;
+      uint32_t val[11];
+      for (int i=0; i<11; i++)
+        {
+        if (!GetVarint(p, end, val[i])) return false;
+        }
+      status->interrupts = val[0];
+      status->packets_rx = val[1];
+      status->packets_tx = val[2];
+      status->txbuf_delay = val[3];
+      status->rxbuf_overflow = val[4];
+      status->txbuf_overflow = val[5];
+      status->error_flags = val[6];
+      status->errors_rx = val[7];
+      status->errors_tx = val[8];
+      status->watchdog_resets = val[9];
+      status->error_resets = val[10];
+      }
+      break;
+
+    case CAN_LogInfo_Comment:
+    case CAN_LogInfo_Config:
+    case CAN_LogInfo_Event:
+      {
+      if (p >= end) return false;
+      message->origin = BusFromFlags(*p++);
+      if (!GetVarint(p, end, v)) return false;
+      if (v > CANFORMAT_OBL_MAXTEXT || end - p < (int)v) return false;
+      memcpy(m_text, p, v);
+      m_text[v] = 0;
+      p += v;
+      message->text = m_text;
+      }
+      break;
+
+    default:
+      return false;
+    }
+
+  m_dec.rawpos = p - m_dec.raw;
+  m_dec.lastts = ts;
+  m_dec.records++;
+  m_decoded++;
+  m_progress++;
+  return true;
+  }
+
+size_t canformat_obl::put(CAN_log_message_t* message, uint8_t *buffer, size_t len, void* userdata)
+  {
+  if (!m_in && !DecodeInit()) return len; // discard
+
+  // Take as much input as we can buffer:
+  size_t insize = sizeof(obl_blockhdr_t) + CANFORMAT_OBL_BLOCKMAX;
+  size_t consumed = (len > insize - m_inlen) ? insize - m_inlen : len;
+  if (consumed > 0)
+    {
+    memcpy(m_in + m_inlen, buffer, consumed);
+    m_inlen += consumed;
+    }
+
+  // Decode the next block if the current one is done:
+  while (m_dec.rawpos >= m_dec.rawlen)
+    {
+    if (m_skip > 0)
+      {
+      size_t n = (m_skip > m_inlen) ? m_inlen : m_skip;
+      DropInput(n);
+      m_skip -= n;
+      if (m_skip > 0) return consumed;
+      }
+    if (m_inlen < 4) return consumed;
+
+    if (memcmp(m_in, "OBL1", 4) == 0)
+      {
+      // File header:
+      if (m_inlen < sizeof(obl_filehdr_t)) return consumed;
+      DropInput(sizeof(obl_filehdr_t));
+      continue;
+      }
+    else if (m_in[0] == 'O' && m_in[1] == 'B' && m_in[2] <= CANFORMAT_OBL_FL_DEFLATE)
+      {
+      // Block:
+      if (m_inlen < sizeof(obl_blockhdr_t)) return consumed;
+      obl_blockhdr_t hdr;
+      memcpy(&hdr, m_in, sizeof(hdr));
+      if (hdr.rawlen <= CANFORMAT_OBL_BLOCKMAX && hdr.storedlen <= CANFORMAT_OBL_BLOCKMAX)
+        {
+        if (m_inlen < sizeof(hdr) + hdr.storedlen) return consumed;
+        if (!DecodeBlock(&hdr, m_in + sizeof(hdr)))
+          ESP_LOGW(TAG, "Invalid block (%d records) skipped", hdr.records);
+        DropInput(sizeof(hdr) + hdr.storedlen);
+        continue;
+        }
+      }
+    else if (m_in[0] == 'O' && m_in[1] == 'I')
+      {
+      // Index, skip including trailer:
+      if (m_inlen < sizeof(obl_indexhdr_t)) return consumed;
+      obl_indexhdr_t ih;
+      memcpy(&ih, m_in, sizeof(ih));
+      if (ih.entries <= CANFORMAT_OBL_MAXINDEX)
+        {
+        DropInput(sizeof(ih));
+        m_skip = ih.entries * sizeof(obl_indexentry_t) + sizeof(obl_trailer_t);
+        continue;
+        }
+      }
+
+    // Invalid data, resync at next 'O':
+    uint8_t* next = (uint8_t*)memchr(m_in+1, 'O', m_inlen-1);
+    DropInput((next) ? (next - m_in) : m_inlen);
+    }
+
+  if (!DecodeRecord(message))
+    {
+    ESP_LOGW(TAG, "Invalid record at block offset %d, rest of block skipped", m_dec.rawpos);
+    memset(message, 0, sizeof(*message));
+    m_dec.rawpos = m_dec.rawlen;
+    m_progress++;
+    }
+
+  return consumed;
+  }
+
+size_t canformat_obl::GetPutBufferUsed()
+  {
+  // Decoded data not yet delivered; input buffer may hold up to one block
+  return m_dec.rawlen - m_dec.rawpos;
+  }
+
+uint32_t canformat_obl::GetPutProgress()
+  {
+  // Input is buffered in m_in and decoded blockwise, so neither the bytes
+  // consumed nor GetPutBufferUsed() tell if put() made progress:
+  return m_progress;
+  }
+
+size_t canformat_obl::Serve(uint8_t *buffer, size_t len, void* userdata)
+  {
+  if (IsServeDiscarding())
+    {
+    return len; // Simply discard...
+    }
+
+  // put() delivers one record per call, we need to continue until all
+  // input has been consumed and all decoded records have been served:
+  size_t consumed = 0;
+  while (1)
+    {
+    CAN_log_message_t msg;
+    memset(&msg,0,sizeof(msg));
+
+    uint32_t decoded = m_decoded;
+    size_t used = put(&msg, buffer, len, userdata);
+    consumed += used;
+    buffer += used;
+    len -= used;
+
+    if (m_decoded != decoded)
+      ServeMsg(&msg);
+    else if (used == 0)
+      break;
+    }
+
+  return consumed;
+  }
@@ -0,0 +1,230 @@
+/*
+;    Project:       Open Vehicle Monitor System
+;    Module:        CAN dump OVMS binary log format
+;    Date:          16th October 2026
+;
+;    (C) 2026       Mark Webb-Johnson
+;
+; Permission is hereby granted, free of charge, to any person obtaining a copy
+; of this software and associated documentation files (the "Software"), to deal
+; in the Software without restriction, including without limitation the rights
+; to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+; copies of the Software, and to permit persons to whom the Software is
+; furnished to do so, subject to the following conditions:
+;
+; The above copyright notice and this permission notice shall be included in
+; all copies or substantial portions of the Software.
+;
+; THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+; IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+; FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+; AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+; LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+; OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+; THE SOFTWARE.
+*/
+
+
+#ifndef __CANFORMAT_OBL_H__
+#define __CANFORMAT_OBL_H__
+
+#include "canformat.h"
+
+/**
+ * OBL: OVMS binary log format
+ *
+ * File layout (all integers little endian):
+ *
+ *  file header     obl_filehdr_t
+ *  block 1..n      obl_blockhdr_t + data (raw deflate compressed if flagged)
+ *  index           obl_indexhdr_t + obl_indexentry_t[entries]
+ *  trailer         obl_trailer_t
+ *
+ * Index and trailer are written on close (see getfooter()), a reader
+ *  seeks to the end, reads the trailer and can then locate blocks by
+ *  time. Files without index (i.e. after a crash) are still readable
+ *  sequentially. The index is thinned out (every 2nd, 4th, … block) if
+ *  the file has more than CANFORMAT_OBL_MAXINDEX blocks.
+ *
+ * Blocks are independent of each other: timestamp base and the bus+ID
+ *  dictionary are reset for every block. A block holds the records of up
+ *  to CANFORMAT_OBL_BLOCKSIZE bytes (uncompressed) or CANFORMAT_OBL_BLOCKTIME
+ *  microseconds, whatever comes first. On idle input, getflush() emits a
+ *  partial block once it has reached CANFORMAT_OBL_BLOCKTIME age.
+ *
+ * Record encoding (varint = unsigned LEB128):
+ *
+ *  uint8_t   tag         bits 0-3: CAN_log_type_t
+ *                        bit 4: frame: new dictionary entry
+ *                        bit 5: frame: payload delta
+ *                        bit 6: frame: RTR
+ *  varint    timedelta   µs since previous record (first: since block base)
+ *
+ *  Frames:
+ *    new dictionary entry:
+ *      uint8_t   busflags    bits 0-2: bus number (7 = none), bit 3: extended ID
+ *      varint    id
+ *    else:
+ *      uint8_t   index       dictionary index (entries numbered in order of appearance)
+ *    payload delta:
+ *      uint8_t   changes     bit n set = byte n changed from previous frame of this entry
+ *      uint8_t   data[]      changed bytes (DLC unchanged)
+ *    else:
+ *      uint8_t   dlc
+ *      uint8_t   data[dlc]   (none for RTR)
+ *
+ *  Status:
+ *    uint8_t   busflags
+ *    varint    interrupts, packets_rx, packets_tx, txbuf_delay, rxbuf_overflow,
+ *              txbuf_overflow, error_flags, errors_rx, errors_tx,
+ *              watchdog_resets, error_resets
+ *
+ *  Info:
+ *    uint8_t   busflags
+ *    varint    length
+ *    char      text[length]
+ */
+
+#define CANFORMAT_OBL_VERSION       1
+#define CANFORMAT_OBL_BLOCKSIZE     8192            // uncompressed block size to flush at
+#define CANFORMAT_OBL_BLOCKMAX      (CANFORMAT_OBL_BLOCKSIZE+512) // block size incl. last record
+#define CANFORMAT_OBL_BLOCKTIME     10000000        // max block time span [µs]
+#define CANFORMAT_OBL_MAXDICT       255             // dictionary entries per block
+#define CANFORMAT_OBL_HASHSIZE      512             // dictionary hash table size (power of 2)
+#define CANFORMAT_OBL_MAXTEXT       255             // max info text length stored
+#define CANFORMAT_OBL_MAXINDEX      512             // max index entries kept
+#define CANFORMAT_OBL_WINDOWBITS    12              // deflate window size (4K)
+#define CANFORMAT_OBL_MEMLEVEL      5               // deflate memory level
+#define CANFORMAT_OBL_LEVEL         5               // deflate compression level
+
+#define CANFORMAT_OBL_FL_DEFLATE    0x01            // file & block: deflate compression
+
+#define CANFORMAT_OBL_TAG_NEWDICT   0x10
+#define CANFORMAT_OBL_TAG_DELTA     0x20
+#define CANFORMAT_OBL_TAG_RTR       0x40
+#define CANFORMAT_OBL_BUS_NONE      0x07
+#define CANFORMAT_OBL_BUS_EXT       0x08
+
+typedef struct __attribute__ ((__packed__))
+  {
+  char magic[4];          /* "OBL1" */
+  uint8_t version;        /* format version */
+  uint8_t flags;          /* CANFORMAT_OBL_FL_* */
+  uint16_t reserved;
+  uint32_t tv_sec;        /* file creation time */
+  uint32_t tv_usec;
+  } obl_filehdr_t;
+
+typedef struct __attribute__ ((__packed__))
+  {
+  char magic[2];          /* "OB" */
+  uint8_t flags;          /* CANFORMAT_OBL_FL_* */
+  uint8_t reserved;
+  uint16_t records;       /* number of records in block */
+  uint16_t rawlen;        /* uncompressed data length */
+  uint32_t storedlen;     /* stored data length */
+  uint32_t tv_sec;        /* timestamp base */
+  uint32_t tv_usec;
+  } obl_blockhdr_t;
+
+typedef struct __attribute__ ((__packed__))
+  {
+  char magic[2];          /* "OI" */
+  uint16_t stride;        /* index entry every <stride> blocks */
+  uint32_t entries;       /* number of index entries following */
+  } obl_indexhdr_t;
+
+typedef struct __attribute__ ((__packed__))
+  {
+  uint32_t offset;        /* file offset of block header */
+  uint32_t tv_sec;        /* block timestamp base */
+  uint32_t tv_usec;
+  uint32_t records;       /* records in file preceding this block */
+  } obl_indexentry_t;
+
+typedef struct __attribute__ ((__packed__))
+  {
+  uint32_t offset;        /* file offset of index header */
+  char magic[4];          /* "OBLX" */
+  } obl_trailer_t;
+
+class canformat_obl : public canformat
+  {
+  public:
+    canformat_obl(const char* type);
+    virtual ~canformat_obl();
+
+  public:
+    virtual std::string get(CAN_log_message_t* message);
+    virtual std::string getheader(struct timeval *time);
+    virtual std::string getfooter();
+    virtual std::string getflush();
+    virtual size_t put(CAN_log_message_t* message, uint8_t *buffer, size_t len, void* userdata=NULL);
+    virtual size_t Serve(uint8_t *buffer, size_t len, void* userdata=NULL);
+    virtual size_t GetPutBufferUsed();
+    virtual uint32_t GetPutProgress();
+
+  protected:
+    typedef struct
+      {
+      uint32_t id;
+      uint8_t busflags;
+      uint8_t dlc;
+      uint8_t data[8];
+      } dictentry_t;
+
+    typedef struct
+      {
+      dictentry_t*  dict;             // [CANFORMAT_OBL_MAXDICT]
+      int           dictcount;
+      uint64_t      base;             // block timestamp base [µs]
+      uint64_t      lastts;           // previous record timestamp [µs]
+      int           records;          // records in block
+      uint8_t*      raw;              // [CANFORMAT_OBL_BLOCKMAX] uncompressed block
+      size_t        rawlen;
+      size_t        rawpos;           // decoder: next record
+      void*         zstream;          // z_stream, NULL = no compression
+      } blockstate_t;
+
+  protected:
+    // Encoder:
+    bool EncodeInit();
+    bool EncodeRecord(CAN_log_message_t* message, uint64_t ts);
+    int DictLookup(uint32_t id, uint8_t busflags);
+    void FlushBlock(std::string& out);
+
+  protected:
+    // Decoder:
+    bool DecodeInit();
+    bool DecodeBlock(const obl_blockhdr_t* hdr, uint8_t* data);
+    bool DecodeRecord(CAN_log_message_t* message);
+    void DropInput(size_t len);
+
+  protected:
+    static void ResetBlock(blockstate_t& blk, uint64_t base);
+    static uint8_t BusFlags(canbus* bus, bool ext);
+    static canbus* BusFromFlags(uint8_t busflags);
+
+  protected:
+    // Encoder state (get):
+    blockstate_t        m_enc;
+    uint16_t*           m_hash;           // [CANFORMAT_OBL_HASHSIZE] dict index+1, 0=free
+    uint8_t*            m_zbuf;           // [CANFORMAT_OBL_BLOCKMAX] compression output
+    uint32_t            m_written;        // bytes output since header
+    uint32_t            m_totalrecords;   // records output since header
+    uint32_t            m_blockno;        // blocks output since header
+    obl_indexentry_t*   m_index;          // [CANFORMAT_OBL_MAXINDEX]
+    int                 m_indexcount;
+    int                 m_indexstride;
+
+    // Decoder state (put):
+    blockstate_t        m_dec;
+    uint8_t*            m_in;             // [sizeof(obl_blockhdr_t)+CANFORMAT_OBL_BLOCKMAX] input
+    size_t              m_inlen;
+    size_t              m_skip;           // input bytes to skip (index)
+    uint32_t            m_decoded;        // records decoded
+    uint32_t            m_progress;       // input bytes dropped + records processed
+    char                m_text[CANFORMAT_OBL_MAXTEXT+1];
+  };
+
+#endif // __CANFORMAT_OBL_H__
@@ -40,6 +40,8 @@ static const char *TAG = "canlog";
 #include "ovms_command.h"
 #include "ovms_events.h"
 #include "ovms_peripherals.h"
+#include "ovms_malloc.h"
+#include "esp_timer.h"
 #include "metrics_standard.h"
 
 ////////////////////////////////////////////////////////////////////////
@@ -125,6 +127,102 @@ void can_log_list(int verbosity, OvmsWriter* writer, OvmsCommand* cmd, int argc,
     }
   }
 
+#define CANLOG_BENCHMARK_MAXFRAMES 2000
+
+// Decode a log from memory, return number of frames
+static int can_log_benchmark_decode(canformat* formatter, const std::string& data)
+  {
+  int frames = 0;
+  canformat_reader reader((const uint8_t*)data.data(), data.size());
+  formatter->DecodeStream(reader, [&frames](CAN_log_message_t* msg)
+    {
+    if (msg->type == CAN_LogFrame_RX || msg->type == CAN_LogFrame_TX)
+      frames++;
+    return true;
+    });
+  return frames;
+  }
+
+
+void can_log_benchmark(int verbosity, OvmsWriter* writer, OvmsCommand* cmd, int argc, const char* const* argv)
+  {
+  const char* format = (argc > 1) ? argv[1] : "crtd";
+  canformat* formatter = MyCanFormatFactory.NewFormat(format);
+  if (formatter == NULL)
+    {
+    writer->printf("Error: Unknown CAN log format: %s\n",format);
+    return;
+    }
+  if (MyConfig.ProtectedPath(argv[0]))
+    {
+    writer->puts("Error: protected path");
+    delete formatter;
+    return;
+    }
+  FILE* fd = fopen(argv[0], "r");
+  if (fd == NULL)
+    {
+    writer->printf("Error: Cannot open %s\n",argv[0]);
+    delete formatter;
+    return;
+    }
+
+  // Read frames from the log:
+  std::vector<CAN_log_message_t> msgs;
+  msgs.reserve(CANLOG_BENCHMARK_MAXFRAMES);
+  uint8_t buf[512];
+  canformat_reader reader(buf, sizeof(buf),
+    [fd](uint8_t* buffer, size_t size) { return fread(buffer, 1, size, fd); });
+  formatter->DecodeStream(reader, [&msgs](CAN_log_message_t* msg)
+    {
+    if (msg->type == CAN_LogFrame_RX || msg->type == CAN_LogFrame_TX)
+      msgs.push_back(*msg);
+    return (msgs.size() < CANLOG_BENCHMARK_MAXFRAMES);
+    });
+  fclose(fd);
+  delete formatter;
+
+  if (msgs.empty())
+    {
+    writer->printf("Error: No frames read from %s (format %s)\n",argv[0],format);
+    return;
+    }
+
+  writer->printf("Frames: %d (note: frames on buses not configured are skipped)\n", msgs.size());
+  writer->puts("Format      Bytes   Bytes/frame  Encode us/frame  Decode us/frame");
+
+  struct timeval start = msgs.front().timestamp;
+  OvmsCanFormatFactory::map_can_format_t::iterator it;
+  for (it = MyCanFormatFactory.m_fmap.begin(); it != MyCanFormatFactory.m_fmap.end(); ++it)
+    {
+    // Encode:
+    formatter = MyCanFormatFactory.NewFormat(it->first);
+    std::string data;
+    int64_t started = esp_timer_get_time();
+    data.append(formatter->getheader(&start));
+    for (CAN_log_message_t& m : msgs)
+      data.append(formatter->get(&m));
+    data.append(formatter->getfooter());
+    int64_t time_encode = esp_timer_get_time() - started;
+    delete formatter;
+    if (data.empty()) continue;
+
+    // Decode:
+    formatter = MyCanFormatFactory.NewFormat(it->first);
+    started = esp_timer_get_time();
+    int decoded = can_log_benchmark_decode(formatter, data);
+    int64_t time_decode = esp_timer_get_time() - started;
+    delete formatter;
+
+    writer->printf("%-10s %6d %10.1f %14.2f", it->first, data.size(),
+      (double)data.size() / msgs.size(), (double)time_encode / msgs.size());
+    if (decoded == (int)msgs.size())
+      writer->printf(" %16.2f\n", (double)time_decode / msgs.size());
+    else
+      writer->printf(" %16s\n", "-");
+    }
+  }
+
 ////////////////////////////////////////////////////////////////////////
 // CAN Logging System initialisation
 ////////////////////////////////////////////////////////////////////////
@@ -149,9 +247,150 @@ OvmsCanLogInit::OvmsCanLogInit()
   cmd_canlog->RegisterCommand("stop", "Stop logging", can_log_stop,"[<id>]",0,1);
   cmd_canlog->RegisterCommand("status", "Logging status", can_log_status,"[<id>]",0,1);
   cmd_canlog->RegisterCommand("list", "Logging list", can_log_list);
+  cmd_canlog->RegisterCommand("benchmark", "Compare log formats", can_log_benchmark,
+    "<path> [<format>]\n"
+    "Reads up to 2000 frames from the log file (default format crtd),\n"
+    "encodes & decodes them with all formats and shows size and time per frame.",
+    1, 2);
   cmd_canlog->RegisterCommand("start", "CAN logging start framework");
   }
 
+////////////////////////////////////////////////////////////////////////
+// CAN Log capture ring
+////////////////////////////////////////////////////////////////////////
+
+canlogring::canlogring(int size)
+  {
+  uint32_t n = 16;
+  while (n < (uint32_t)size && n < 8192) n <<= 1;
+  m_mask = n-1;
+  m_slots = (slot_t*)ExternalRamCalloc(n, sizeof(slot_t));
+  m_head = 0;
+  memset(m_texts, 0, sizeof(m_texts));
+  m_texthead = 0;
+  m_textbuf = (char*)ExternalRamMalloc(CANLOG_RING_TEXTBUF);
+  m_textpos = 0;
+  }
+
+canlogring::~canlogring()
+  {
+  free(m_slots);
+  free(m_textbuf);
+  }
+
+CAN_log_message_t* canlogring::BeginPut()
+  {
+  slot_t* slot = &m_slots[m_head & m_mask];
+  slot->seq_begin = m_head;
+  __sync_synchronize();
+  return &slot->msg;
+  }
+
+void canlogring::EndPut(const char* text /*=NULL*/)
+  {
+  slot_t* slot = &m_slots[m_head & m_mask];
+  if (text)
+    {
+    textslot_t* ts = &m_texts[m_texthead % CANLOG_RING_TEXTSLOTS];
+    uint32_t pos = m_textpos;
+    uint32_t len = m_textbuf ? strnlen(text, CANLOG_RING_TEXTMAX) : 0;
+    ts->seq_begin = m_texthead;
+    // reserve the bytes before writing, so readers can detect overwrites:
+    m_textpos = pos + len;
+    __sync_synchronize();
+    uint32_t ofs = pos & (CANLOG_RING_TEXTBUF-1);
+    uint32_t len1 = (len < CANLOG_RING_TEXTBUF-ofs) ? len : CANLOG_RING_TEXTBUF-ofs;
+    if (len > 0)
+      {
+      memcpy(m_textbuf+ofs, text, len1);
+      memcpy(m_textbuf, text+len1, len-len1);
+      }
+    ts->pos = pos;
+    ts->len = len;
+    __sync_synchronize();
+    ts->seq_end = m_texthead;
+    slot->textseq = m_texthead++;
+    }
+  __sync_synchronize();
+  slot->seq_end = m_head;
+  __sync_synchronize();
+  m_head = m_head + 1;
+  }
+
+bool canlogring::Get(uint32_t& cursor, CAN_log_message_t& msg, std::string& textbuf, uint32_t& dropped)
+  {
+  while (1)
+    {
+    uint32_t head = m_head;
+    __sync_synchronize();
+    uint32_t avail = head - cursor;
+    if (avail == 0)
+      return false;
+    if (avail > m_mask+1)
+      {
+      // overrun: skip to the oldest record available
+      dropped += avail - (m_mask+1);
+      cursor = head - (m_mask+1);
+      }
+
+    slot_t* slot = &m_slots[cursor & m_mask];
+    uint32_t seq_end = slot->seq_end;
+    __sync_synchronize();
+    memcpy(&msg, &slot->msg, sizeof(msg));
+    uint32_t textseq = slot->textseq;
+    __sync_synchronize();
+    if (seq_end != cursor || slot->seq_begin != cursor)
+      {
+      // overwritten while reading:
+      dropped++;
+      cursor++;
+      continue;
+      }
+
+    switch (msg.type)
+      {
+      case CAN_LogInfo_Comment:
+      case CAN_LogInfo_Config:
+      case CAN_LogInfo_Event:
+        {
+        textslot_t* ts = &m_texts[textseq % CANLOG_RING_TEXTSLOTS];
+        seq_end = ts->seq_end;
+        __sync_synchronize();
+        uint32_t pos = ts->pos, len = ts->len;
+        __sync_synchronize();
+        bool valid = (seq_end == textseq && ts->seq_begin == textseq);
+        if (valid && m_textbuf)
+          {
+          uint32_t ofs = pos & (CANLOG_RING_TEXTBUF-1);
+          uint32_t len1 = (len < CANLOG_RING_TEXTBUF-ofs) ? len : CANLOG_RING_TEXTBUF-ofs;
+          textbuf.assign(m_textbuf+ofs, len1);
+          textbuf.append(m_textbuf, len-len1);
+          __sync_synchronize();
+          // text bytes overwritten while copying?
+          valid = (m_textpos - pos <= CANLOG_RING_TEXTBUF);
+          }
+        else
+          textbuf.clear();
+        if (!valid)
+          textbuf = "(text lost)";
+        msg.text = textbuf.c_str();
+        }
+        break;
+      default:
+        break;
+      }
+
+    cursor++;
+    return true;
+    }
+  }
+
+uint32_t canlogring::GetWaiting(uint32_t cursor)
+  {
+  uint32_t avail = m_head - cursor;
+  return (avail > m_mask+1) ? m_mask+1 : avail;
+  }
+
 ////////////////////////////////////////////////////////////////////////
 // CAN Logger class
 ////////////////////////////////////////////////////////////////////////
@@ -168,48 +407,19 @@ canlog::canlog(const char* type, std::string format, canformat::canformat_serve_
   m_dropcount = 0;
   m_filtercount = 0;
 
-  using std::placeholders::_1;
-  using std::placeholders::_2;
-  MyEvents.RegisterEvent(IDTAG, "*", std::bind(&canlog::EventListener, this, _1, _2));
-
-  int queuesize = MyConfig.GetParamValueInt("can", "log.queuesize",100);
-  m_queue = xQueueCreate(queuesize, sizeof(CAN_log_message_t));
+  m_ring = NULL;
+  m_cursor = 0;
+  m_waiting = false;
+  m_stopping = false;
+  m_stopped = xSemaphoreCreateBinary();
   xTaskCreatePinnedToCore(RxTask, "OVMS CanLog", 4096, (void*)this, 10, &m_task, CORE(1));
   }
 
 canlog::~canlog()
   {
-  MyEvents.DeregisterEvent(IDTAG);
-
-  if (m_task)
-    {
-    TaskHandle_t t = m_task;
-    m_task = NULL;
-
-    vTaskDelete(t);
-    }
-
-  if (m_queue)
-    {
-    QueueHandle_t q = m_queue;
-    m_queue = NULL;
-
-    CAN_log_message_t msg;
-    while (xQueueReceive(q, &msg, 0) == pdTRUE)
-      {
-      switch (msg.type)
-        {
-        case CAN_LogInfo_Comment:
-        case CAN_LogInfo_Config:
-        case CAN_LogInfo_Event:
-          free(msg.text);
-          break;
-        default:
-          break;
-        }
-      }
-    vQueueDelete(q);
-    }
+  StopTask();
+  vSemaphoreDelete(m_stopped);
+  m_ring = NULL;
 
   if (m_formatter)
     {
@@ -228,30 +438,100 @@ void canlog::RxTask(void *context)
   {
   canlog* me = (canlog*) context;
   CAN_log_message_t msg;
-  while (1)
+  std::string text;
+  while (!me->m_stopping)
     {
-    if (xQueueReceive(me->m_queue, &msg, (portTickType)portMAX_DELAY) == pdTRUE)
+    canlogring* ring = me->m_ring;
+    if (ring)
       {
-      switch (msg.type)
+      uint32_t dropped = 0;
+      bool got = ring->Get(me->m_cursor, msg, text, dropped);
+      if (dropped)
+        {
+        me->m_msgcount += dropped;
+        me->m_dropcount += dropped;
+        }
+      if (got)
         {
-        case CAN_LogInfo_Comment:
-        case CAN_LogInfo_Config:
-        case CAN_LogInfo_Event:
-          me->OutputMsg(msg);
-          free(msg.text);
-          break;
-        default:
-          me->OutputMsg(msg);
-          break;
+        me->ProcessMsg(msg);
+        continue;
         }
       }
+
+    // Ring empty, let the logger flush batched output, then wait for
+    // notification by the writer:
+    me->OutputFlush();
+    me->m_waiting = true;
+    __sync_synchronize();
+    if (ring && ring->GetWaiting(me->m_cursor) > 0)
+      {
+      me->m_waiting = false;
+      continue;
+      }
+    if (me->m_stopping) break;
+    ulTaskNotifyTake(pdTRUE, pdMS_TO_TICKS(1000));
+    me->m_waiting = false;
+    }
+
+  xSemaphoreGive(me->m_stopped);
+  vTaskDelete(NULL);
+  }
+
+void canlog::Attach(canlogring* ring)
+  {
+  m_cursor = ring->GetHead();
+  m_ring = ring;
+  Notify();
+  }
+
+void canlog::Notify()
+  {
+  if (m_waiting && m_task)
+    {
+    m_waiting = false;
+    xTaskNotifyGive(m_task);
     }
   }
 
-void canlog::EventListener(std::string event, void* data)
+void canlog::StopTask()
   {
-  if (startsWith(event, "vehicle"))
-    LogInfo(NULL, CAN_LogInfo_Event, event.c_str());
+  // Stop the logger task and wait for it to finish the current message
+  // (a lossless output flush may take a while), so the logger and the
+  // ring can safely be torn down afterwards.
+  if (m_task == NULL) return;
+  m_stopping = true;
+  xTaskNotifyGive(m_task);
+  xSemaphoreTake(m_stopped, portMAX_DELAY);
+  m_task = NULL;
+  }
+
+void canlog::ProcessMsg(CAN_log_message_t& msg)
+  {
+  if (!IsOpen()) return;
+
+  bool pass;
+  switch (msg.type)
+    {
+    case CAN_LogFrame_RX:
+    case CAN_LogFrame_TX:
+    case CAN_LogFrame_TX_Queue:
+    case CAN_LogFrame_TX_Fail:
+      pass = (m_filter == NULL) || m_filter->IsFiltered(&msg.frame);
+      break;
+    default:
+      pass = (m_filter == NULL) || m_filter->IsFiltered(msg.origin);
+      break;
+    }
+
+  if (pass)
+    {
+    m_msgcount++;
+    OutputMsg(msg);
+    }
+  else
+    {
+    m_filtercount++;
+    }
   }
 
 const char* canlog::GetType()
@@ -268,6 +548,10 @@ void canlog::OutputMsg(CAN_log_message_t& msg)
   {
   }
 
+void canlog::OutputFlush()
+  {
+  }
+
 std::string canlog::GetInfo()
   {
   std::ostringstream buf;
@@ -297,7 +581,7 @@ std::string canlog::GetStats()
   std::ostringstream buf;
 
   float droprate = (m_msgcount > 0) ? ((float) m_dropcount/m_msgcount*100) : 0;
-  uint32_t waiting = uxQueueMessagesWaiting(m_queue);
+  uint32_t waiting = m_ring ? m_ring->GetWaiting(m_cursor) : 0;
 
   buf << "total messages: " << m_msgcount
     << ", dropped: " << m_dropcount
@@ -327,63 +611,3 @@ void canlog::ClearFilter()
     m_filter = NULL;
     }
   }
-
-void canlog::LogFrame(canbus* bus, CAN_log_type_t type, const CAN_frame_t* frame)
-  {
-  if (!IsOpen() || !bus || !frame) return;
-
-  if (((m_filter == NULL)||(m_filter->IsFiltered(frame)))&&(m_queue))
-    {
-    CAN_log_message_t msg;
-    msg.type = type;
-    gettimeofday(&msg.timestamp,NULL);
-    memcpy(&msg.frame,frame,sizeof(CAN_frame_t));
-    msg.frame.origin = bus;
-    m_msgcount++;
-    if (xQueueSend(m_queue, &msg, 0) != pdTRUE) m_dropcount++;
-    }
-  else
-    {
-    m_filtercount++;
-    }
-  }
-
-void canlog::LogStatus(canbus* bus, CAN_log_type_t type, const CAN_status_t* status)
-  {
-  if (!IsOpen() || !bus) return;
-
-  if (((m_filter == NULL)||(m_filter->IsFiltered(bus)))&&(m_queue))
-    {
-    CAN_log_message_t msg;
-    msg.type = type;
-    gettimeofday(&msg.timestamp,NULL);
-    msg.origin = bus;
-    memcpy(&msg.status,status,sizeof(CAN_status_t));
-    m_msgcount++;
-    if (xQueueSend(m_queue, &msg, 0) != pdTRUE) m_dropcount++;
-    }
-  else
-    {
-    m_filtercount++;
-    }
-  }
-
-void canlog::LogInfo(canbus* bus, CAN_log_type_t type, const char* text)
-  {
-  if (!IsOpen() || !text) return;
-
-  if (((m_filter == NULL)||(m_filter->IsFiltered(bus)))&&(m_queue))
-    {
-    CAN_log_message_t msg;
-    msg.type = type;
-    gettimeofday(&msg.timestamp,NULL);
-    msg.origin = bus;
-    msg.text = strdup(text);
-    m_msgcount++;
-    if (xQueueSend(m_queue, &msg, 0) != pdTRUE) m_dropcount++;
-    }
-  else
-    {
-    m_filtercount++;
-    }
-  }
@@ -31,6 +31,67 @@
 #include "can.h"
 #include "canformat.h"
 
+#define CANLOG_RING_TEXTSLOTS   8     // Info texts held in the ring (events, comments)
+#define CANLOG_RING_TEXTBUF     2048  // Info text buffer size [bytes] (power of 2)
+#define CANLOG_RING_TEXTMAX     1024  // Max info text length (longer texts are truncated)
+
+/**
+ * canlogring is the capture ring shared by all loggers.
+ *  Log records are timestamped & copied once by the CAN framework (can::LogFrame
+ *  etc.), each logger consumes them with its own read cursor. Writers are
+ *  serialized by the caller (can::m_loggermap_mutex), readers don't lock:
+ *  every slot carries begin/end sequence numbers, so a reader detects slots
+ *  overwritten while copying them. A reader falling behind by more than the
+ *  ring size loses the oldest records (counted as drops for that reader only).
+ *
+ * Info texts are stored with their length in a separate byte ring, so they
+ *  only take the space needed. A reader that falls behind by more than
+ *  CANLOG_RING_TEXTSLOTS info records or CANLOG_RING_TEXTBUF text bytes
+ *  gets "(text lost)".
+ */
+class canlogring
+  {
+  public:
+    canlogring(int size);
+    ~canlogring();
+
+  public:
+    // Writer API (serialized by caller):
+    CAN_log_message_t* BeginPut();
+    void EndPut(const char* text=NULL);
+
+  public:
+    // Reader API (lock free):
+    bool Get(uint32_t& cursor, CAN_log_message_t& msg, std::string& textbuf, uint32_t& dropped);
+    uint32_t GetHead() { return m_head; }
+    uint32_t GetWaiting(uint32_t cursor);
+    int GetSize() { return m_mask+1; }
+
+  protected:
+    typedef struct
+      {
+      volatile uint32_t seq_begin;
+      CAN_log_message_t msg;
+      uint32_t textseq;
+      volatile uint32_t seq_end;
+      } slot_t;
+    typedef struct
+      {
+      volatile uint32_t seq_begin;
+      uint32_t pos;                     // m_textbuf position (m_textpos sequence)
+      uint32_t len;
+      volatile uint32_t seq_end;
+      } textslot_t;
+
+    slot_t*             m_slots;
+    uint32_t            m_mask;         // size-1 (size is a power of 2)
+    volatile uint32_t   m_head;         // sequence of next record
+    textslot_t          m_texts[CANLOG_RING_TEXTSLOTS];
+    uint32_t            m_texthead;
+    char*               m_textbuf;      // [CANLOG_RING_TEXTBUF]
+    volatile uint32_t   m_textpos;      // end of text bytes written (incl. reserved)
+  };
+
 /**
  * canlog is the general interface and base implementation for all can loggers.
  *  It provides standard methods to open files and configure message filters
@@ -40,9 +101,10 @@
  *  to the type list & method Instantiate(). See canlog_trace & canlog_crtd
  *  for examples & reference.
  *
- * Log messages are sent to a canlog through a queue handled by a separate
- *  task for the logger, so logging doesn't affect CAN framework speed and
- *  a log can be written/streamed to a slow medium.
+ * Log messages are captured once into the shared canlogring and read by a
+ *  separate task for each logger, so logging doesn't affect CAN framework
+ *  speed and a log can be written/streamed to a slow medium. Filters are
+ *  applied by the logger task.
  *
  * Log entries can be frames, status or info messages (see CAN_LogEntry_t).
  * The timestamp of the original event is preserved.
@@ -59,7 +121,9 @@ class canlog : public InternalRamAllocated
 
   public:
     static void RxTask(void* context);
-    void EventListener(std::string event, void* data);
+    void Attach(canlogring* ring);
+    void Notify();
+    void StopTask();
 
   public:
     const char* GetType();
@@ -73,16 +137,14 @@ class canlog : public InternalRamAllocated
     virtual bool IsOpen() = 0;
     virtual std::string GetInfo();
     virtual void OutputMsg(CAN_log_message_t& msg);
+    virtual void OutputFlush();     // called when the ring has been drained
 
   public:
     virtual void SetFilter(canfilter* filter);
     virtual void ClearFilter();
 
-  public:
-    // Logging API:
-    virtual void LogFrame(canbus* bus, CAN_log_type_t type, const CAN_frame_t* p_frame);
-    virtual void LogStatus(canbus* bus, CAN_log_type_t type, const CAN_status_t* status);
-    virtual void LogInfo(canbus* bus, CAN_log_type_t type, const char* text);
+  protected:
+    void ProcessMsg(CAN_log_message_t& msg);
 
   public:
     const char*         m_type;
@@ -92,7 +154,11 @@ class canlog : public InternalRamAllocated
 
   public:
     TaskHandle_t        m_task;
-    QueueHandle_t       m_queue;
+    canlogring*         m_ring;         // NULL until attached by can::AddLogger()
+    uint32_t            m_cursor;       // read position in m_ring
+    volatile bool       m_waiting;      // task waiting for notification
+    volatile bool       m_stopping;     // StopTask() requested
+    SemaphoreHandle_t   m_stopped;      // given by the task on exit
     uint32_t            m_msgcount;
     uint32_t            m_dropcount;
     uint32_t            m_filtercount;
@@ -64,7 +64,7 @@ OvmsCanLogMonitorInit::OvmsCanLogMonitorInit()
         MyCanFormatFactory.RegisterCommandSet(start, "Start CAN logging to MONITOR",
           can_log_monitor_start,
           "[filter1] ... [filterN]\n"
-          "Filter: <bus> | <id>[-<id>] | <bus>:<id>[-<id>]\n"
+          "Filter: [!]<bus> | [!][<bus>:]<id>[-<id>] | [!][<bus>:]<id>/<mask>\n"
           "Example: 2:2a0-37f",
           0, 9);
         }
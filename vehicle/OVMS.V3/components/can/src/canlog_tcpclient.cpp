@@ -86,19 +86,19 @@ OvmsCanLogTcpClientInit::OvmsCanLogTcpClientInit()
         MyCanFormatFactory.RegisterCommandSet(discard, "Start CAN logging as TCP client (discard mode)",
           can_log_tcpclient_start,
           "<host:port> [filter1] ... [filterN]\n"
-          "Filter: <bus> | <id>[-<id>] | <bus>:<id>[-<id>]\n"
+          "Filter: [!]<bus> | [!][<bus>:]<id>[-<id>] | [!][<bus>:]<id>/<mask>\n"
           "Example: 2:2a0-37f",
           1, 9);
         MyCanFormatFactory.RegisterCommandSet(simulate, "Start CAN logging as TCP client (simulate mode)",
           can_log_tcpclient_start,
           "<host:port> [filter1] ... [filterN]\n"
-          "Filter: <bus> | <id>[-<id>] | <bus>:<id>[-<id>]\n"
+          "Filter: [!]<bus> | [!][<bus>:]<id>[-<id>] | [!][<bus>:]<id>/<mask>\n"
           "Example: 2:2a0-37f",
           1, 9);
         MyCanFormatFactory.RegisterCommandSet(transmit, "Start CAN logging as TCP client (transmit mode)",
           can_log_tcpclient_start,
           "<host:port> [filter1] ... [filterN]\n"
-          "Filter: <bus> | <id>[-<id>] | <bus>:<id>[-<id>]\n"
+          "Filter: [!]<bus> | [!][<bus>:]<id>[-<id>] | [!][<bus>:]<id>/<mask>\n"
           "Example: 2:2a0-37f",
           1, 9);
         }
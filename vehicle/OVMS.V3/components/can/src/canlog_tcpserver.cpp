@@ -30,6 +30,7 @@
 #include "ovms_log.h"
 static const char *TAG = "canlog-tcpserver";
 
+#include "esp_timer.h"
 #include "can.h"
 #include "canformat.h"
 #include "canlog_tcpserver.h"
@@ -42,13 +43,30 @@ void can_log_tcpserver_start(int verbosity, OvmsWriter* writer, OvmsCommand* cmd
   {
   std::string format(cmd->GetName());
   std::string mode(cmd->GetParent()->GetName());
+  bool lossless = false;
+  size_t maxqueue = CANLOG_TCPSERVER_MAXQUEUE;
+  std::vector<const char*> filters;
+  for (int i=1; i<argc; i++)
+    {
+    if (argv[i][0]=='-' && argv[i][1]=='l')
+      lossless = true;
+    else if (argv[i][0]=='-' && argv[i][1]=='q')
+      maxqueue = atoi(argv[i]+2) * 1024;
+    else
+      filters.push_back(argv[i]);
+    }
+  if (maxqueue < CANLOG_TCPSERVER_BATCHSIZE * 2)
+    maxqueue = CANLOG_TCPSERVER_BATCHSIZE * 2;
+
   canlog_tcpserver* logger = new canlog_tcpserver(argv[0],format,GetFormatModeType(mode));
+  logger->m_lossless = lossless;
+  logger->m_maxqueue = maxqueue;
   logger->Open();
 
   if (logger->IsOpen())
     {
-    if (argc>1)
-      { MyCan.AddLogger(logger, argc-1, &argv[1]); }
+    if (filters.size()>0)
+      { MyCan.AddLogger(logger, filters.size(), filters.data()); }
     else
       { MyCan.AddLogger(logger); }
     writer->printf("CAN logging as TCP server: %s\n", logger->GetInfo().c_str());
@@ -88,22 +106,28 @@ OvmsCanLogTcpServerInit::OvmsCanLogTcpServerInit()
         OvmsCommand* transmit = start->RegisterCommand("transmit","CAN logging as TCP server (transmit mode)");
         MyCanFormatFactory.RegisterCommandSet(discard, "Start CAN logging as TCP server (discard mode)",
           can_log_tcpserver_start,
-          "<port> [filter1] ... [filterN]\n"
-          "Filter: <bus> | <id>[-<id>] | <bus>:<id>[-<id>]\n"
+          "<port> [-l] [-q<size>] [filter1] ... [filterN]\n"
+          "-l: lossless, wait for slow clients instead of dropping frames\n"
+          "-q<size>: client send queue limit in kB (default 8)\n"
+          "Filter: [!]<bus> | [!][<bus>:]<id>[-<id>] | [!][<bus>:]<id>/<mask>\n"
           "Example: 2:2a0-37f",
-          1, 9);
+          1, 11);
         MyCanFormatFactory.RegisterCommandSet(simulate, "Start CAN logging as TCP server (simulate mode)",
           can_log_tcpserver_start,
-          "<port> [filter1] ... [filterN]\n"
-          "Filter: <bus> | <id>[-<id>] | <bus>:<id>[-<id>]\n"
+          "<port> [-l] [-q<size>] [filter1] ... [filterN]\n"
+          "-l: lossless, wait for slow clients instead of dropping frames\n"
+          "-q<size>: client send queue limit in kB (default 8)\n"
+          "Filter: [!]<bus> | [!][<bus>:]<id>[-<id>] | [!][<bus>:]<id>/<mask>\n"
           "Example: 2:2a0-37f",
-          1, 9);
+          1, 11);
         MyCanFormatFactory.RegisterCommandSet(transmit, "Start CAN logging as TCP server (transmit mode)",
           can_log_tcpserver_start,
-          "<port> [filter1] ... [filterN]\n"
-          "Filter: <bus> | <id>[-<id>] | <bus>:<id>[-<id>]\n"
+          "<port> [-l] [-q<size>] [filter1] ... [filterN]\n"
+          "-l: lossless, wait for slow clients instead of dropping frames\n"
+          "-q<size>: client send queue limit in kB (default 8)\n"
+          "Filter: [!]<bus> | [!][<bus>:]<id>[-<id>] | [!][<bus>:]<id>/<mask>\n"
           "Example: 2:2a0-37f",
-          1, 9);
+          1, 11);
         }
       }
     }
@@ -154,6 +178,13 @@ canlog_tcpserver::canlog_tcpserver(std::string path, std::string format, canform
     }
   m_isopen = false;
   m_mgconn = NULL;
+  m_lossless = false;
+  m_maxqueue = CANLOG_TCPSERVER_MAXQUEUE;
+  m_batch.reserve(CANLOG_TCPSERVER_BATCHSIZE + 256);
+  m_batchmsgs = 0;
+  m_batchtime = 0;
+  m_batchseq = 0;
+  m_stallcount = 0;
 
   if (m_formatter)
     {
@@ -163,8 +194,11 @@ canlog_tcpserver::canlog_tcpserver(std::string path, std::string format, canform
 
 canlog_tcpserver::~canlog_tcpserver()
   {
+  StopTask();
   Close();
   MyCanLogTcpServer = NULL;
+  // wait for a Serve() in progress:
+  OvmsMutexLock lock(&m_servemutex);
   }
 
 bool canlog_tcpserver::Open()
@@ -206,13 +240,15 @@ void canlog_tcpserver::Close()
   {
   if (m_isopen)
     {
-    if (m_smap.size() > 0)
       {
+      OvmsMutexLock lock(&m_mgmutex);
       for (ts_map_t::iterator it=m_smap.begin(); it!=m_smap.end(); ++it)
         {
         it->first->flags |= MG_F_CLOSE_IMMEDIATELY;
         }
       m_smap.clear();
+      m_batch.clear();
+      m_batchmsgs = 0;
       }
     ESP_LOGI(TAG, "Closed TCP server log: %s", GetStats().c_str());
     m_mgconn->flags |= MG_F_CLOSE_IMMEDIATELY;
@@ -231,6 +267,33 @@ std::string canlog_tcpserver::GetInfo()
   std::string result = canlog::GetInfo();
   result.append(" Path:");
   result.append(m_path);
+  char buf[48];
+  snprintf(buf, sizeof(buf), " Queue:%ukB%s", (unsigned)(m_maxqueue/1024), m_lossless ? " Lossless" : "");
+  result.append(buf);
+  return result;
+  }
+
+std::string canlog_tcpserver::GetStats()
+  {
+  std::string result = canlog::GetStats();
+  char buf[80];
+  if (m_lossless)
+    {
+    snprintf(buf, sizeof(buf), ", stalls: %u", m_stallcount);
+    result.append(buf);
+    }
+
+  // Note: the mongoose handler may need the logger map lock held by our caller
+  OvmsMutexLock lock(&m_mgmutex, pdMS_TO_TICKS(100));
+  if (!lock.IsLocked()) return result;
+  for (ts_map_t::iterator it=m_smap.begin(); it!=m_smap.end(); ++it)
+    {
+    char addr[32];
+    mg_sock_addr_to_str(&it->first->sa, addr, sizeof(addr), MG_SOCK_STRINGIFY_IP);
+    snprintf(buf, sizeof(buf), "\n  Client %s: sent %u, dropped %u, queued %u bytes",
+      addr, it->second.sentmsgs, it->second.dropmsgs, (unsigned)it->first->send_mbuf.len);
+    result.append(buf);
+    }
   return result;
   }
 
@@ -238,39 +301,98 @@ void canlog_tcpserver::OutputMsg(CAN_log_message_t& msg)
   {
   if (m_formatter == NULL) return;
 
-  std::string result = m_formatter->get(&msg);
-  if (result.length()>0)
+  bool flush;
     {
     OvmsMutexLock lock(&m_mgmutex);
-    for (ts_map_t::iterator it=m_smap.begin(); it!=m_smap.end(); ++it)
+    if (m_smap.empty()) return;
+
+    std::string result = m_formatter->get(&msg);
+    if (result.length()>0)
       {
-      if (it->first->send_mbuf.len < 4096)
-        {
-        // Limit to 4KB queue on output buffer
-        mg_send(it->first, (const char*)result.c_str(), result.length());
-        }
-      else
+      if (m_batchmsgs == 0)
+        m_batchtime = esp_timer_get_time();
+      m_batch.append(result);
+      m_batchmsgs++;
+      }
+
+    flush = (m_batch.length() >= CANLOG_TCPSERVER_BATCHSIZE ||
+      (m_batchmsgs > 0 && esp_timer_get_time() - m_batchtime >= CANLOG_TCPSERVER_BATCHTIME));
+    }
+
+  if (flush) OutputFlush();
+  }
+
+void canlog_tcpserver::OutputFlush()
+  {
+    {
+    OvmsMutexLock lock(&m_mgmutex);
+    if (m_batch.empty()) return;
+    m_batchseq++;
+    }
+
+  int64_t started = esp_timer_get_time();
+  bool stalled = false;
+  while (1)
+    {
+    // Send the batch to all clients having enough credit:
+    int pending = 0;
+      {
+      OvmsMutexLock lock(&m_mgmutex);
+      if (m_batch.empty()) break; // closed while stalled
+      bool timeout = (esp_timer_get_time() - started >= CANLOG_TCPSERVER_STALLTIME);
+      for (ts_map_t::iterator it=m_smap.begin(); it!=m_smap.end(); ++it)
         {
-        m_dropcount++;
+        tsclient_t& client = it->second;
+        if (client.batchseq == m_batchseq) continue;
+        size_t queued = it->first->send_mbuf.len;
+        if (queued == 0 || queued + m_batch.length() <= m_maxqueue)
+          {
+          mg_send(it->first, m_batch.data(), m_batch.length());
+          client.batchseq = m_batchseq;
+          client.sentmsgs += m_batchmsgs;
+          }
+        else if (!m_lossless || timeout)
+          {
+          client.batchseq = m_batchseq;
+          client.dropmsgs += m_batchmsgs;
+          m_dropcount += m_batchmsgs;
+          }
+        else
+          {
+          pending++;
+          }
         }
       }
+    if (pending == 0) break;
+
+    // Lossless mode: pause logging until the clients have caught up
+    if (!stalled)
+      {
+      stalled = true;
+      m_stallcount++;
+      }
+    vTaskDelay(pdMS_TO_TICKS(10));
     }
+
+  OvmsMutexLock lock(&m_mgmutex);
+  m_batch.clear();
+  m_batchmsgs = 0;
   }
 
 void canlog_tcpserver::MongooseHandler(struct mg_connection *nc, int ev, void *p)
   {
   char addr[32];
 
-  OvmsMutexLock lock(&m_mgmutex);
-
   switch (ev)
     {
     case MG_EV_ACCEPT:
       {
+      OvmsMutexLock lock(&m_mgmutex);
       // New network connection has arrived
       mg_sock_addr_to_str(&nc->sa, addr, sizeof(addr), MG_SOCK_STRINGIFY_IP);
       ESP_LOGI(TAG, "Log service connection from %s",addr);
-      m_smap[nc] = 1;
+      tsclient_t client = { m_batchseq, 0, 0 };
+      m_smap[nc] = client;
       if (m_formatter != NULL)
         {
         std::string result = m_formatter->getheader();
@@ -285,6 +407,7 @@ void canlog_tcpserver::MongooseHandler(struct mg_connection *nc, int ev, void *p
     case MG_EV_CLOSE:
       {
       // Network connection has gone
+      OvmsMutexLock lock(&m_mgmutex);
       auto k = m_smap.find(nc);
       if (k != m_smap.end())
         {
@@ -298,6 +421,9 @@ void canlog_tcpserver::MongooseHandler(struct mg_connection *nc, int ev, void *p
     case MG_EV_RECV:
       {
       // Receive data on the network connection
+      // Note: m_mgmutex must not be held here, serving frames in simulate &
+      //  transmit mode logs them, which needs the CAN logger map lock.
+      OvmsMutexLock lock(&m_servemutex);
       size_t used = nc->recv_mbuf.len;
       //ESP_LOGD(TAG,"Received %d bytes of data",used);
       if (m_formatter != NULL)
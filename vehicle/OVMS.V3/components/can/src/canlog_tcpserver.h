@@ -36,6 +36,22 @@
 #include "ovms_netmanager.h"
 #include "ovms_mutex.h"
 
+#define CANLOG_TCPSERVER_BATCHSIZE  1400      // flush batch at this size [bytes] (~ 1 TCP segment)
+#define CANLOG_TCPSERVER_BATCHTIME  20000     // flush batch at this age [µs]
+#define CANLOG_TCPSERVER_MAXQUEUE   8192      // default client send queue limit [bytes]
+#define CANLOG_TCPSERVER_STALLTIME  1000000   // lossless mode: max wait for a client [µs]
+
+/**
+ * canlog_tcpserver: formatted messages are collected into a batch, which is
+ *  sent to all clients at once when it reaches CANLOG_TCPSERVER_BATCHSIZE,
+ *  gets older than CANLOG_TCPSERVER_BATCHTIME or the log ring has been drained.
+ *
+ * Each client has a credit of m_maxqueue bytes in its send queue. A batch not
+ *  fitting into the remaining credit is dropped for that client, or in lossless
+ *  mode, the logger waits for the client to catch up (for up to
+ *  CANLOG_TCPSERVER_STALLTIME). While waiting, the logger stops consuming
+ *  the log ring, so frames can only get lost by a ring overrun.
+ */
 class canlog_tcpserver : public canlog
   {
   public:
@@ -47,22 +63,40 @@ class canlog_tcpserver : public canlog
     virtual void Close();
     virtual bool IsOpen();
     virtual std::string GetInfo();
+    virtual std::string GetStats();
 
   public:
     virtual void OutputMsg(CAN_log_message_t& msg);
+    virtual void OutputFlush();
 
   public:
     void MongooseHandler(struct mg_connection *nc, int ev, void *p);
 
   public:
-    typedef std::map<mg_connection*, uint8_t> ts_map_t;
-    OvmsMutex m_mgmutex;
+    typedef struct
+      {
+      uint32_t batchseq;                // last batch sent or dropped
+      uint32_t sentmsgs;
+      uint32_t dropmsgs;
+      } tsclient_t;
+    typedef std::map<mg_connection*, tsclient_t> ts_map_t;
+    OvmsMutex m_mgmutex;                // client map & batch
+    OvmsMutex m_servemutex;             // formatter Serve() (client input)
     ts_map_t m_smap;
     bool m_isopen;
     struct mg_connection *m_mgconn;
 
   public:
     std::string         m_path;
+    bool                m_lossless;     // wait for clients instead of dropping
+    size_t              m_maxqueue;     // client send queue limit [bytes]
+
+  protected:
+    std::string         m_batch;        // formatted messages to send
+    uint32_t            m_batchmsgs;    // messages in m_batch
+    int64_t             m_batchtime;    // esp_timer_get_time() of first message
+    uint32_t            m_batchseq;     // batches flushed
+    uint32_t            m_stallcount;   // lossless mode: flushes delayed by clients
   };
 
 #endif // #ifdef CONFIG_OVMS_SC_GPL_MONGOOSE
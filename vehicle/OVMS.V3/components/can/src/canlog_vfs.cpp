@@ -27,6 +27,9 @@
 #include "ovms_log.h"
 static const char *TAG = "canlog-vfs";
 
+#include <sys/stat.h>
+#include <time.h>
+#include "esp_timer.h"
 #include "can.h"
 #include "canformat.h"
 #include "canlog_vfs.h"
@@ -37,13 +40,26 @@ static const char *TAG = "canlog-vfs";
 void can_log_vfs_start(int verbosity, OvmsWriter* writer, OvmsCommand* cmd, int argc, const char* const* argv)
   {
   std::string format(cmd->GetName());
+  uint32_t maxsize = 0, maxtime = 0;
+  std::vector<const char*> filters;
+  for (int i=1; i<argc; i++)
+    {
+    if (argv[i][0]=='-' && argv[i][1]=='s')
+      maxsize = atoi(argv[i]+2) * 1024;
+    else if (argv[i][0]=='-' && argv[i][1]=='t')
+      maxtime = atoi(argv[i]+2) * 60;
+    else
+      filters.push_back(argv[i]);
+    }
+
   canlog_vfs* logger = new canlog_vfs(argv[0],format);
+  logger->SetRotation(maxsize, maxtime);
   logger->Open();
 
   if (logger->IsOpen())
     {
-    if (argc>1)
-      { MyCan.AddLogger(logger, argc-1, &argv[1]); }
+    if (filters.size()>0)
+      { MyCan.AddLogger(logger, filters.size(), filters.data()); }
     else
       { MyCan.AddLogger(logger); }
     writer->printf("CAN logging to VFS active: %s\n", logger->GetInfo().c_str());
@@ -78,10 +94,14 @@ OvmsCanLogVFSInit::OvmsCanLogVFSInit()
         OvmsCommand* start = cmd_can_log_start->RegisterCommand("vfs", "CAN logging to VFS");
         MyCanFormatFactory.RegisterCommandSet(start, "Start CAN logging to VFS",
           can_log_vfs_start,
-          "<path> [filter1] ... [filterN]\n"
-          "Filter: <bus> | <id>[-<id>] | <bus>:<id>[-<id>]\n"
+          "<path> [-s<size>] [-t<time>] [filter1] ... [filterN]\n"
+          "-s<size>: start new file when <size> kB have been written\n"
+          "-t<time>: start new file every <time> minutes\n"
+          "Path may contain strftime() patterns (i.e. /sd/can-%Y%m%d-%H%M.obl),\n"
+          "else rotated files get a date & time suffix.\n"
+          "Filter: [!]<bus> | [!][<bus>:]<id>[-<id>] | [!][<bus>:]<id>/<mask>\n"
           "Example: 2:2a0-37f",
-          1, 9);
+          1, 11);
         }
       }
     }
@@ -92,6 +112,11 @@ canlog_vfs::canlog_vfs(std::string path, std::string format)
   {
   m_file = NULL;
   m_path = path;
+  m_maxsize = 0;
+  m_maxtime = 0;
+  m_filesize = 0;
+  m_opentime = 0;
+  m_filecount = 0;
   using std::placeholders::_1;
   using std::placeholders::_2;
   MyEvents.RegisterEvent(IDTAG, "sd.mounted", std::bind(&canlog_vfs::MountListener, this, _1, _2));
@@ -108,6 +133,53 @@ canlog_vfs::~canlog_vfs()
     }
   }
 
+void canlog_vfs::SetRotation(uint32_t maxsize, uint32_t maxtime)
+  {
+  m_maxsize = maxsize;
+  m_maxtime = maxtime;
+  }
+
+std::string canlog_vfs::MakePath()
+  {
+  bool pattern = (m_path.find('%') != std::string::npos);
+  if (!pattern && m_maxsize == 0 && m_maxtime == 0)
+    return m_path;
+
+  time_t now = time(NULL);
+  struct tm* tmu = localtime(&now);
+  char buf[128];
+
+  // Split extension:
+  std::string base = m_path, ext;
+  size_t dot = m_path.find_last_of('.');
+  if (dot != std::string::npos && dot > m_path.find_last_of('/'))
+    {
+    base = m_path.substr(0, dot);
+    ext = m_path.substr(dot);
+    }
+
+  if (pattern)
+    {
+    if (strftime(buf, sizeof(buf), base.c_str(), tmu) > 0)
+      base = buf;
+    }
+  else
+    {
+    strftime(buf, sizeof(buf), "-%Y%m%d-%H%M%S", tmu);
+    base.append(buf);
+    }
+
+  // Don't overwrite a file of this session (i.e. rotating within a second):
+  std::string path = base + ext;
+  struct stat st;
+  for (int n = 1; m_filecount > 0 && stat(path.c_str(), &st) == 0; n++)
+    {
+    snprintf(buf, sizeof(buf), "-%d", n);
+    path = base + buf + ext;
+    }
+  return path;
+  }
+
 bool canlog_vfs::Open()
   {
   if (m_file)
@@ -116,32 +188,39 @@ bool canlog_vfs::Open()
     m_file = NULL;
     }
 
-  if (MyConfig.ProtectedPath(m_path))
+  m_filepath = MakePath();
+  if (MyConfig.ProtectedPath(m_filepath))
     {
-    ESP_LOGE(TAG, "Error: Path '%s' is protected and cannot be opened", m_path.c_str());
+    ESP_LOGE(TAG, "Error: Path '%s' is protected and cannot be opened", m_filepath.c_str());
     return false;
     }
 
 #ifdef CONFIG_OVMS_COMP_SDCARD
   if (startsWith(m_path, "/sd") && (!MyPeripherals || !MyPeripherals->m_sdcard || !MyPeripherals->m_sdcard->isavailable()))
     {
-    ESP_LOGE(TAG, "Error: Cannot open '%s' as SD filesystem not available", m_path.c_str());
+    ESP_LOGE(TAG, "Error: Cannot open '%s' as SD filesystem not available", m_filepath.c_str());
     return false;
     }
 #endif // #ifdef CONFIG_OVMS_COMP_SDCARD
 
-  m_file = fopen(m_path.c_str(), "w");
+  m_file = fopen(m_filepath.c_str(), "w");
   if (!m_file)
     {
-    ESP_LOGE(TAG, "Error: Can't write to '%s'", m_path.c_str());
+    ESP_LOGE(TAG, "Error: Can't write to '%s'", m_filepath.c_str());
     return false;
     }
 
-  ESP_LOGI(TAG, "Now logging CAN messages to '%s'", m_path.c_str());
+  ESP_LOGI(TAG, "Now logging CAN messages to '%s'", m_filepath.c_str());
+  m_filecount++;
+  m_opentime = esp_timer_get_time();
+  m_filesize = 0;
 
   std::string header = m_formatter->getheader();
   if (header.length()>0)
+    {
     fwrite(header.c_str(),header.length(),1,m_file);
+    m_filesize += header.length();
+    }
 
   return true;
   }
@@ -150,13 +229,22 @@ void canlog_vfs::Close()
   {
   if (m_file)
     {
+    std::string footer = m_formatter->getfooter();
+    if (footer.length()>0)
+      fwrite(footer.c_str(),footer.length(),1,m_file);
     fclose(m_file);
     m_file = NULL;
     ESP_LOGI(TAG, "Closed vfs log '%s': %s",
-      m_path.c_str(), GetStats().c_str());
+      m_filepath.c_str(), GetStats().c_str());
     }
   }
 
+bool canlog_vfs::Rotate()
+  {
+  Close();
+  return Open();
+  }
+
 bool canlog_vfs::IsOpen()
   {
   return (m_file != NULL);
@@ -167,6 +255,17 @@ std::string canlog_vfs::GetInfo()
   std::string result = canlog::GetInfo();
   result.append(" Path:");
   result.append(m_path);
+  if (m_filepath.length() > 0 && m_filepath != m_path)
+    {
+    result.append(" File:");
+    result.append(m_filepath);
+    }
+  if (m_maxsize || m_maxtime)
+    {
+    char buf[64];
+    snprintf(buf, sizeof(buf), " Rotate:%ukB/%umin", m_maxsize/1024, m_maxtime/60);
+    result.append(buf);
+    }
   return result;
   }
 
@@ -185,5 +284,38 @@ void canlog_vfs::OutputMsg(CAN_log_message_t& msg)
 
   std::string result = m_formatter->get(&msg);
   if (result.length()>0)
+    {
     fwrite(result.c_str(),result.length(),1,m_file);
+    m_filesize += result.length();
+    }
+
+  CheckRotation();
+  }
+
+void canlog_vfs::OutputFlush()
+  {
+  // Called by the logger task when the ring is drained, and at least once
+  // per second on an idle bus:
+  if (m_file == NULL) return;
+  if (m_formatter == NULL) return;
+
+  std::string result = m_formatter->getflush();
+  if (result.length()>0)
+    {
+    fwrite(result.c_str(),result.length(),1,m_file);
+    fflush(m_file);
+    m_filesize += result.length();
+    }
+
+  CheckRotation();
+  }
+
+void canlog_vfs::CheckRotation()
+  {
+  if ((m_maxsize && m_filesize >= m_maxsize) ||
+      (m_maxtime && esp_timer_get_time() - m_opentime >= (int64_t)m_maxtime * 1000000))
+    {
+    if (!Rotate())
+      ESP_LOGE(TAG, "Error: log rotation failed, logging stopped");
+    }
   }
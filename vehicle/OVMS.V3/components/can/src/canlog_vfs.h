@@ -44,13 +44,26 @@ class canlog_vfs : public canlog
 
   public:
     virtual void OutputMsg(CAN_log_message_t& msg);
+    virtual void OutputFlush();
+    void SetRotation(uint32_t maxsize, uint32_t maxtime);
+    bool Rotate();
+
+  protected:
+    std::string MakePath();
+    void CheckRotation();
 
   public:
     virtual void MountListener(std::string event, void* data);
 
   public:
-    std::string         m_path;
+    std::string         m_path;         // path or strftime() pattern
+    std::string         m_filepath;     // current file
     FILE*               m_file;
+    uint32_t            m_maxsize;      // rotate at file size [bytes], 0 = no limit
+    uint32_t            m_maxtime;      // rotate at file age [seconds], 0 = no limit
+    uint32_t            m_filesize;
+    int64_t             m_opentime;     // esp_timer_get_time() of Open()
+    int                 m_filecount;    // files opened
   };
 
 #endif // __CANLOG_VFS_H__
@@ -35,6 +35,7 @@ static const char *TAG = "canplay";
 #include <string>
 #include <sstream>
 #include <iomanip>
+#include "esp_timer.h"
 #include "ovms_config.h"
 #include "ovms_command.h"
 #include "ovms_events.h"
@@ -182,7 +183,8 @@ OvmsCanPlayInit::OvmsCanPlayInit()
 
   OvmsCommand* cmd_canplay = cmd_can->RegisterCommand("play", "CAN play framework");
   cmd_canplay->RegisterCommand("stop", "Stop playing", can_play_stop,"[<id>]",0,1);
-  cmd_canplay->RegisterCommand("speed", "Set playback speed", can_play_speed,"<speed> [<id>]",1,2);
+  cmd_canplay->RegisterCommand("speed", "Set playback speed", can_play_speed,"<speed> [<id>]\n"
+    "<speed>: time scale factor, 0 = as fast as possible",1,2);
   cmd_canplay->RegisterCommand("status", "Playing status", can_play_status,"[<id>]",0,1);
   cmd_canplay->RegisterCommand("list", "Playing list", can_play_list);
   cmd_canplay->RegisterCommand("start", "CAN play start framework");
@@ -202,16 +204,21 @@ canplay::canplay(const char* type, std::string format, canformat::canformat_serv
   m_speed = 1;
 
   m_msgcount = 0;
+  m_filtercount = 0;
+  m_dropcount = 0;
+  m_latemax = 0;
+  m_latesum = 0;
+  m_lookahead_head = 0;
+  m_lookahead_cnt = 0;
+  m_rebase = true;
+  m_base_real = 0;
+  m_base_log = 0;
   xTaskCreatePinnedToCore(PlayTask, "OVMS CanPlay", 4096, (void*)this, 10, &m_task, CORE(1));
   }
 
 canplay::~canplay()
   {
-  if (m_task)
-    {
-    vTaskDelete(m_task);
-    m_task = NULL;
-    }
+  Stop();
 
   if (m_formatter)
     {
@@ -226,21 +233,133 @@ canplay::~canplay()
     }
   }
 
+/**
+ * Start: begin playing. The task waits for this, as the sub class
+ *  is not completely constructed when the task gets created.
+ */
+void canplay::Start()
+  {
+  if (m_task)
+    xTaskNotifyGive(m_task);
+  }
+
+/**
+ * Stop: stop the play task. Sub classes need to call this in their
+ *  destructor, before their members become invalid.
+ */
+void canplay::Stop()
+  {
+  if (m_task)
+    {
+    OvmsRecMutexLock lock(&m_playmutex);
+    TaskHandle_t t = m_task;
+    m_task = NULL;
+    vTaskDelete(t);
+    }
+  }
+
 void canplay::PlayTask(void *context)
   {
-//  canplay* me = (canplay*) context;
+  canplay* me = (canplay*) context;
+  ulTaskNotifyTake(pdTRUE, portMAX_DELAY);
+  me->PlayLoop();
+  }
+
+void canplay::PlayLoop()
+  {
+  const int64_t tick_us = portTICK_PERIOD_MS * 1000;
 
-//  CAN_log_message_t msg;
-//  while (me->InputMsg(&msg))
-//    {
-//    vTaskDelay(pdMS_TO_TICKS(1000));
-//    }
+  while (1)
+    {
+    m_playmutex.Lock();
+
+    if (!IsOpen())
+      {
+      m_lookahead_cnt = 0;
+      m_rebase = true;
+      m_playmutex.Unlock();
+      vTaskDelay(pdMS_TO_TICKS(1000));
+      continue;
+      }
+
+    bool eof = false;
+    int served = 0;
+    while (1)
+      {
+      // Read ahead:
+      while (!eof && m_lookahead_cnt < CANPLAY_LOOKAHEAD)
+        {
+        CAN_log_message_t* msg = &m_lookahead[(m_lookahead_head + m_lookahead_cnt) % CANPLAY_LOOKAHEAD];
+        memset(msg, 0, sizeof(*msg));
+        if (!InputMsg(msg))
+          eof = true;
+        else if ((msg->type != CAN_LogFrame_RX && msg->type != CAN_LogFrame_TX) || msg->frame.origin == NULL)
+          continue; // only frames can be played
+        else if (m_filter && !m_filter->IsFiltered(&msg->frame))
+          m_filtercount++;
+        else
+          m_lookahead_cnt++;
+        }
+      if (m_lookahead_cnt == 0)
+        break;
+
+      // Serve next message if due within the current tick:
+      CAN_log_message_t* msg = &m_lookahead[m_lookahead_head];
+      int64_t now = esp_timer_get_time();
+      int64_t logtime = (int64_t)msg->timestamp.tv_sec * 1000000 + msg->timestamp.tv_usec;
+      uint32_t speed = m_speed;
+      if (m_rebase || logtime < m_base_log)
+        {
+        // Start, speed change or log time going backwards (i.e. concatenated logs):
+        m_base_real = now;
+        m_base_log = logtime;
+        m_rebase = false;
+        }
+      int64_t due = (speed == 0) ? now : m_base_real + (logtime - m_base_log) / speed;
+      if (due >= now + tick_us)
+        break;
+      if (speed == 0 && served >= CANPLAY_MAXBATCH)
+        break;
+
+      ServeMsg(msg, now - due);
+      served++;
+      m_lookahead_head = (m_lookahead_head + 1) % CANPLAY_LOOKAHEAD;
+      m_lookahead_cnt--;
+      }
+
+    if (eof && m_lookahead_cnt == 0)
+      {
+      ESP_LOGI(TAG, "Playback finished: %s", GetStats().c_str());
+      Close();
+      }
 
-//  me->Close();
-  while(1)
+    m_playmutex.Unlock();
+    vTaskDelay(1);
+    }
+  }
+
+void canplay::ServeMsg(CAN_log_message_t* msg, int64_t lateness)
+  {
+  if (lateness < 0) lateness = -lateness;
+  if (lateness > m_latemax) m_latemax = lateness;
+  m_latesum += lateness;
+
+  switch (m_formatter->GetServeMode())
     {
-    vTaskDelay(pdMS_TO_TICKS(1000));
+    case canformat::Simulate:
+      MyCan.IncomingFrame(&msg->frame);
+      break;
+    case canformat::Transmit:
+      if (msg->frame.origin->Write(&msg->frame) != ESP_OK)
+        {
+        m_dropcount++;
+        return;
+        }
+      break;
+    default:
+      break;
     }
+  m_msgcount++;
   }
 
 const char* canplay::GetType()
@@ -256,6 +375,7 @@ const char* canplay::GetFormat()
 void canplay::SetSpeed(uint32_t speed)
   {
   m_speed = speed;
+  m_rebase = true;
   }
 
 bool canplay::InputMsg(CAN_log_message_t* msg)
@@ -273,7 +393,10 @@ std::string canplay::GetInfo()
     buf << "(" << m_formatter->GetServeModeName() << ")";
     }
 
-  buf << " Speed:" << m_speed << "x";
+  if (m_speed)
+    buf << " Speed:" << m_speed << "x";
+  else
+    buf << " Speed:max";
 
   if (m_filter)
     {
@@ -292,6 +415,13 @@ std::string canplay::GetStats()
   std::ostringstream buf;
 
   buf << "total messages: " << m_msgcount;
+  buf << ", filtered: " << m_filtercount;
+  buf << ", dropped: " << m_dropcount;
+  if (m_msgcount)
+    {
+    buf << ", jitter avg: " << (int32_t)(m_latesum / m_msgcount) << "us";
+    buf << " max: " << (int32_t)m_latemax << "us";
+    }
 
   return buf.str();
   }
@@ -31,8 +31,20 @@
 #include "can.h"
 #include "canformat.h"
 
+#define CANPLAY_LOOKAHEAD   64          // Messages read ahead of the playback position
+#define CANPLAY_MAXBATCH    256         // Max messages served per tick in unpaced mode
+
 /**
  * canplay is the general interface and base implementation for all can players.
+ *
+ * The play task reads messages from the sub class via InputMsg() into a
+ *  lookahead ring, and injects them according to the formatter serve mode
+ *  (simulate = MyCan.IncomingFrame, transmit = canbus::Write) preserving
+ *  the original inter frame timing, scaled by the speed factor.
+ *
+ * Speed 0 means unpaced: play as fast as possible. Frames due within the
+ *  current scheduler tick are served as a batch. Lateness against the
+ *  scaled original timestamps is tracked as the playback jitter.
  */
 class canplay : public InternalRamAllocated
   {
@@ -42,6 +54,8 @@ class canplay : public InternalRamAllocated
 
   public:
     static void PlayTask(void* context);
+    void Start();
+    void Stop();
 
   public:
     const char* GetType();
@@ -61,6 +75,10 @@ class canplay : public InternalRamAllocated
     virtual void SetFilter(canfilter* filter);
     virtual void ClearFilter();
 
+  protected:
+    void PlayLoop();
+    void ServeMsg(CAN_log_message_t* msg, int64_t lateness);
+
   public:
     const char*         m_type;
     std::string         m_format;
@@ -70,7 +88,20 @@ class canplay : public InternalRamAllocated
 
   public:
     TaskHandle_t        m_task;
+    OvmsRecMutex        m_playmutex;
     uint32_t            m_msgcount;
+    uint32_t            m_filtercount;
+    uint32_t            m_dropcount;
+    int64_t             m_latemax;          // max lateness [us]
+    int64_t             m_latesum;          // lateness sum [us]
+
+  protected:
+    CAN_log_message_t   m_lookahead[CANPLAY_LOOKAHEAD];
+    int                 m_lookahead_head;
+    int                 m_lookahead_cnt;
+    volatile bool       m_rebase;           // re-anchor the time base on the next message
+    int64_t             m_base_real;        // esp_timer time of the time base [us]
+    int64_t             m_base_log;         // log time of the time base [us]
   };
 
 #endif // __CANPLAY_H__
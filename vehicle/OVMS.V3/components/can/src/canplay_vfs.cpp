@@ -27,6 +27,8 @@
 #include "ovms_log.h"
 static const char *TAG = "canplay-vfs";
 
+#include <vector>
+#include "esp_timer.h"
 #include "can.h"
 #include "canformat.h"
 #include "canplay_vfs.h"
@@ -55,6 +57,178 @@ void can_play_vfs_start(int verbosity, OvmsWriter* writer, OvmsCommand* cmd, int
     }
   }
 
+#define CANPLAY_TEST_MAXFRAMES  2000      // max frames compared by "can play test"
+#define CANPLAY_TEST_QUEUESIZE  100       // listener queue for the replayed frames
+#define CANPLAY_TEST_SEARCH     8         // expected frames searched for a received one
+#define CANPLAY_TEST_MAXJITTER  20000     // max playback lateness to pass [us]
+
+typedef struct
+  {
+  CAN_frame_t frame;
+  int64_t logtime;                        // log timestamp [us]
+  } canplay_test_frame_t;
+
+static bool can_play_test_match(const CAN_frame_t* a, const CAN_frame_t* b)
+  {
+  if (a->origin != b->origin || a->MsgID != b->MsgID ||
+      a->FIR.B.FF != b->FIR.B.FF || a->FIR.B.DLC != b->FIR.B.DLC)
+    return false;
+  return memcmp(a->data.u8, b->data.u8, MIN(a->FIR.B.DLC, 8)) == 0;
+  }
+
+/**
+ * can play test: replay a log file in simulate mode and check the frames
+ *  received by a CAN listener against the file contents (frame order) and
+ *  the log timestamps (timing). The playback lateness is measured by the
+ *  player, the receive deviation includes the latency of this task.
+ *  Other CAN traffic on the log buses is skipped as foreign frames.
+ */
+void can_play_vfs_test(int verbosity, OvmsWriter* writer, OvmsCommand* cmd, int argc, const char* const* argv)
+  {
+  const char* path = argv[0];
+  const char* format = (argc > 1) ? argv[1] : "crtd";
+  int speed = (argc > 2) ? atoi(argv[2]) : 1;
+  int maxframes = (argc > 3) ? atoi(argv[3]) : 500;
+  if (speed < 1)
+    {
+    writer->puts("Error: speed must be at least 1 for the test");
+    return;
+    }
+  if (maxframes < 1 || maxframes > CANPLAY_TEST_MAXFRAMES)
+    {
+    writer->printf("Error: frames must be 1..%d\n", CANPLAY_TEST_MAXFRAMES);
+    return;
+    }
+  if (MyCan.HasPlayer())
+    {
+    writer->puts("Error: Stop all players first");
+    return;
+    }
+  if (MyConfig.ProtectedPath(path))
+    {
+    writer->puts("Error: protected path");
+    return;
+    }
+  canformat* formatter = MyCanFormatFactory.NewFormat(format);
+  if (formatter == NULL)
+    {
+    writer->printf("Error: Unknown CAN log format: %s\n",format);
+    return;
+    }
+  FILE* fd = fopen(path, "r");
+  if (fd == NULL)
+    {
+    writer->printf("Error: Cannot open %s\n",path);
+    delete formatter;
+    return;
+    }
+
+  // Read the expected frames, as the player will serve them:
+  std::vector<canplay_test_frame_t> expected;
+  expected.reserve(maxframes);
+  uint8_t buf[512];
+  canformat_reader reader(buf, sizeof(buf),
+    [fd](uint8_t* buffer, size_t size) { return fread(buffer, 1, size, fd); });
+  formatter->DecodeStream(reader, [&expected,maxframes](CAN_log_message_t* msg)
+    {
+    if (msg->type == CAN_LogFrame_RX || msg->type == CAN_LogFrame_TX)
+      {
+      canplay_test_frame_t exp;
+      exp.frame = msg->frame;
+      exp.logtime = (int64_t)msg->timestamp.tv_sec * 1000000 + msg->timestamp.tv_usec;
+      expected.push_back(exp);
+      }
+    return (expected.size() < (size_t)maxframes);
+    });
+  fclose(fd);
+  delete formatter;
+
+  if (expected.empty())
+    {
+    writer->printf("Error: No frames read from %s (format %s)\n",path,format);
+    return;
+    }
+
+  // Start the player with a listener capturing the frames injected:
+  QueueHandle_t queue = xQueueCreate(CANPLAY_TEST_QUEUESIZE, sizeof(CAN_frame_t));
+  MyCan.RegisterListener(queue);
+  canplay_vfs* player = new canplay_vfs(path, format);
+  player->SetSpeed(speed);
+  player->Open();
+  if (!player->IsOpen())
+    {
+    writer->printf("Error: Could not start CAN playing from: %s\n", player->GetInfo().c_str());
+    delete player;
+    MyCan.DeregisterListener(queue);
+    vQueueDelete(queue);
+    return;
+    }
+  writer->printf("Replaying %d frames from %s at speed %dx...\n", (int)expected.size(), path, speed);
+  uint32_t id = MyCan.AddPlayer(player);
+
+  size_t next = 0;
+  int skipped = 0, foreign = 0;
+  int64_t t0 = 0, log0 = 0, devsum = 0, devmax = 0;
+  CAN_frame_t frame;
+  while (next < expected.size())
+    {
+    // Wait for the log gap to the next frame plus one second:
+    int64_t gap = (next > 0) ? (expected[next].logtime - expected[next-1].logtime) / speed : 0;
+    if (gap < 0) gap = 0;
+    if (xQueueReceive(queue, &frame, pdMS_TO_TICKS(1000 + gap / 1000)) != pdTRUE)
+      break;
+    int64_t now = esp_timer_get_time();
+    size_t k;
+    for (k = 0; k < CANPLAY_TEST_SEARCH && next+k < expected.size(); k++)
+      {
+      if (can_play_test_match(&frame, &expected[next+k].frame)) break;
+      }
+    if (k == CANPLAY_TEST_SEARCH || next+k == expected.size())
+      {
+      foreign++;
+      continue;
+      }
+    skipped += k;
+    next += k;
+    if (t0 == 0)
+      {
+      t0 = now;
+      log0 = expected[next].logtime;
+      }
+    int64_t dev = (now - t0) - (expected[next].logtime - log0) / speed;
+    if (dev < 0) dev = -dev;
+    if (dev > devmax) devmax = dev;
+    devsum += dev;
+    next++;
+    }
+  int received = next - skipped;
+
+  int64_t latemax = 0, latesum = 0;
+  uint32_t played = 0;
+  canplay* cp = MyCan.GetPlayer(id);
+  if (cp)
+    {
+    OvmsRecMutexLock lock(&cp->m_playmutex);
+    played = cp->m_msgcount;
+    latemax = cp->m_latemax;
+    latesum = cp->m_latesum;
+    }
+  MyCan.RemovePlayer(id);
+  MyCan.DeregisterListener(queue);
+  vQueueDelete(queue);
+
+  writer->printf("Frames: %d of %d received in order, %d missing or out of order, %d foreign\n",
+    received, (int)expected.size(), (int)(expected.size() - received), foreign);
+  if (played)
+    writer->printf("Playback lateness: avg %d us, max %d us\n",
+      (int)(latesum / played), (int)latemax);
+  if (received)
+    writer->printf("Receive deviation: avg %d us, max %d us\n",
+      (int)(devsum / received), (int)devmax);
+  bool pass = (received == (int)expected.size() && latemax <= CANPLAY_TEST_MAXJITTER);
+  writer->printf("Result: %s\n", pass ? "PASS" : "FAIL");
+  }
+
 class OvmsCanPlayVFSInit
   {
   public: OvmsCanPlayVFSInit();
@@ -70,6 +244,11 @@ OvmsCanPlayVFSInit::OvmsCanPlayVFSInit()
     OvmsCommand* cmd_can_play = cmd_can->FindCommand("play");
     if (cmd_can_play)
       {
+      cmd_can_play->RegisterCommand("test", "Test replay timing & frame order", can_play_vfs_test,
+        "<path> [<format>] [<speed>] [<frames>]\n"
+        "Replays up to <frames> (default 500) frames of the log file (default format crtd)\n"
+        "in simulate mode at <speed> (default 1) and checks order & timing",
+        1, 4);
       OvmsCommand* cmd_can_play_start = cmd_can_play->FindCommand("start");
       if (cmd_can_play_start)
         {
@@ -78,7 +257,7 @@ OvmsCanPlayVFSInit::OvmsCanPlayVFSInit()
         MyCanFormatFactory.RegisterCommandSet(start, "Start CAN playing from VFS",
           can_play_vfs_start,
           "<path> [filter1] ... [filterN]\n"
-          "Filter: <bus> | <id>[-<id>] | <bus>:<id>[-<id>]\n"
+          "Filter: [!]<bus> | [!][<bus>:]<id>[-<id>] | [!][<bus>:]<id>/<mask>\n"
           "Example: 2:2a0-37f",
           1, 9);
         }
@@ -87,7 +266,9 @@ OvmsCanPlayVFSInit::OvmsCanPlayVFSInit()
   }
 
 canplay_vfs::canplay_vfs(std::string path, std::string format)
-  : canplay("vfs", format)
+  : canplay("vfs", format),
+    m_reader(m_readbuf, sizeof(m_readbuf),
+      [this](uint8_t* buffer, size_t size) { return fread(buffer, 1, size, m_file); })
   {
   m_file = NULL;
   m_path = path;
@@ -99,6 +280,7 @@ canplay_vfs::canplay_vfs(std::string path, std::string format)
 
 canplay_vfs::~canplay_vfs()
   {
+  Stop();
   MyEvents.DeregisterEvent(IDTAG);
 
   if (m_file != NULL)
@@ -109,6 +291,7 @@ canplay_vfs::~canplay_vfs()
 
 bool canplay_vfs::Open()
   {
+  OvmsRecMutexLock lock(&m_playmutex);
   if (m_file)
     {
     fclose(m_file);
@@ -135,6 +318,7 @@ bool canplay_vfs::Open()
     ESP_LOGE(TAG, "Error: Can't read from '%s'", m_path.c_str());
     return false;
     }
+  m_reader.Reset();
 
   ESP_LOGI(TAG, "Now playing CAN messages from '%s'", m_path.c_str());
 
@@ -143,6 +327,7 @@ bool canplay_vfs::Open()
 
 void canplay_vfs::Close()
   {
+  OvmsRecMutexLock lock(&m_playmutex);
   if (m_file)
     {
     fclose(m_file);
@@ -175,8 +360,13 @@ void canplay_vfs::MountListener(std::string event, void* data)
 
 bool canplay_vfs::InputMsg(CAN_log_message_t* msg)
   {
+  OvmsRecMutexLock lock(&m_playmutex);
   if (m_file == NULL) return false;
   if (m_formatter == NULL) return false;
 
-  return false;
+  if (m_formatter->DecodeNext(msg, m_reader))
+    return true;
+  if (m_reader.m_error)
+    ESP_LOGE(TAG, "Error: format '%s' cannot parse '%s'", m_format.c_str(), m_path.c_str());
+  return false; // end of file
   }
@@ -30,6 +30,8 @@
 
 #include "canplay.h"
 
+#define CANPLAY_VFS_READSIZE  1024
+
 class canplay_vfs : public canplay
   {
   public:
@@ -51,6 +53,10 @@ class canplay_vfs : public canplay
   public:
     std::string         m_path;
     FILE*               m_file;
+
+  protected:
+    uint8_t             m_readbuf[CANPLAY_VFS_READSIZE];
+    canformat_reader    m_reader;
   };
 
 #endif // __CANPLAY_VFS_H__
@@ -142,7 +142,6 @@ CANopenWorker* CANopen::Start(canbus* bus)
     m_rxqueue = xQueueCreate(20, sizeof(CAN_frame_t));
     xTaskCreatePinnedToCore(CANopenRxTask, "OVMS COrx",
       CONFIG_OVMS_COMP_CANOPEN_RX_STACK, (void*)this, 15, &m_rxtask, CORE(0));
-    MyCan.RegisterListener(m_rxqueue);
     }
 
   // start worker:
@@ -152,6 +151,7 @@ CANopenWorker* CANopen::Start(canbus* bus)
       {
       m_worker[i] = new CANopenWorker(bus);
       m_workercnt++;
+      UpdateListener();
       ESP_LOGI(TAG, "Worker started on %s", bus->GetName());
       MyEvents.SignalEvent("canopen.worker.start", (void*) m_worker[i]);
       return m_worker[i];
@@ -162,6 +162,21 @@ CANopenWorker* CANopen::Start(canbus* bus)
   }
 
 
+/**
+ * UpdateListener: (re-)register CAN rx queue for the worker buses
+ */
+void CANopen::UpdateListener()
+  {
+  canmatch filter;
+  for (int i=0; i < CAN_INTERFACE_CNT; i++)
+    {
+    if (m_worker[i])
+      filter.AddBus(m_worker[i]->m_bus);
+    }
+  MyCan.RegisterListener(m_rxqueue, false, &filter);
+  }
+
+
 /**
  * Stop: stop CANopenWorker for a CAN bus
  *    - fails if the worker still has clients
@@ -191,6 +206,10 @@ bool CANopen::Stop(canbus* bus)
         m_rxqueue = NULL;
         m_rxtask = NULL;
         }
+      else
+        {
+        UpdateListener();
+        }
 
       return true; // stopped
       }
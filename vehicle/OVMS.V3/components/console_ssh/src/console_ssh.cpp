@@ -796,6 +796,7 @@ void ConsoleSSH::HandleDeviceEvent(void* pEvent)
                     msg.append("mkdir: ").append(strerror(errno)).append("\n");
                   else
                     {
+                    MyEvents.SignalEvent("system.vfs.file.changed", (void*)m_path.c_str(), m_path.size()+1);
                     wolfSSH_stream_send(m_ssh, (uint8_t*)"", 1);
                     break;
                     }
@@ -845,6 +846,7 @@ void ConsoleSSH::HandleDeviceEvent(void* pEvent)
           {
           fclose(m_file);
           m_file = NULL;
+          MyEvents.SignalEvent("system.vfs.file.changed", (void*)m_path.c_str(), m_path.size()+1);
           m_state = SINK_RESPONSE;
           wolfSSH_stream_send(m_ssh, (uint8_t*)"", 1);
           }
@@ -813,9 +813,79 @@ void dbcSignal::SetUnit(const char* unit)
   m_unit = std::string(unit);
   }
 
+void dbcSignal::GetLayout(bool* bigendian, uint8_t* shift, uint64_t* mask)
+  {
+  // Signal position in the 64 bit frame word. Big endian (Motorola)
+  // signals are contiguous in the byte swapped frame word.
+  int size = m_signal_size;
+  if (size < 1) size = 1;
+  if (size > 64) size = 64;
+  *mask = (size == 64) ? UINT64_MAX : ((1ULL << size) - 1);
+  if (m_byte_order == DBC_BYTEORDER_BIG_ENDIAN)
+    {
+    int msb = (7 - m_start_bit/8)*8 + (m_start_bit%8);
+    int lsb = msb - size + 1;
+    *bigendian = true;
+    *shift = (lsb < 0) ? 0 : lsb;
+    }
+  else
+    {
+    *bigendian = false;
+    *shift = (m_start_bit > 63) ? 63 : m_start_bit;
+    }
+  }
+
+uint64_t dbcSignal::EncodeRaw(double value)
+  {
+  // Clamp to the physical range (if defined, min=max=0 means unrestricted):
+  if (m_minimum.IsDefined() && m_maximum.IsDefined())
+    {
+    double min = m_minimum.GetDouble(), max = m_maximum.GetDouble();
+    if (min < max)
+      {
+      if (value < min) value = min;
+      if (value > max) value = max;
+      }
+    }
+
+  // Convert to raw:
+  double factor = m_factor.IsDefined() ? m_factor.GetDouble() : 1;
+  double offset = m_offset.IsDefined() ? m_offset.GetDouble() : 0;
+  if (factor == 0) factor = 1;
+  double raw = round((value - offset) / factor);
+
+  // Clamp to the raw range:
+  int size = m_signal_size;
+  if (size < 1) size = 1;
+  if (size > 64) size = 64;
+  uint64_t mask = (size == 64) ? UINT64_MAX : ((1ULL << size) - 1);
+  if (m_value_type == DBC_VALUETYPE_SIGNED)
+    {
+    double rmax = (double)(mask >> 1);
+    double rmin = -rmax - 1;
+    if (raw < rmin) raw = rmin;
+    if (raw > rmax) raw = rmax;
+    return ((uint64_t)(int64_t)raw) & mask;
+    }
+  else
+    {
+    if (raw < 0) raw = 0;
+    if (raw > (double)mask) return mask;
+    return ((uint64_t)raw) & mask;
+    }
+  }
+
 void dbcSignal::Encode(dbcNumber* source, CAN_frame_t* msg)
   {
-  // TODO: An efficient encoding of the signal
+  bool bigendian;
+  uint8_t shift;
+  uint64_t mask;
+  GetLayout(&bigendian, &shift, &mask);
+  uint64_t raw = EncodeRaw(source->GetDouble());
+
+  uint64_t word = bigendian ? __builtin_bswap64(msg->data.u64) : msg->data.u64;
+  word = (word & ~(mask << shift)) | (raw << shift);
+  msg->data.u64 = bigendian ? __builtin_bswap64(word) : word;
   }
 
 dbcNumber dbcSignal::Decode(CAN_frame_t* msg)
@@ -831,7 +901,12 @@ dbcNumber dbcSignal::Decode(CAN_frame_t* msg)
   if (m_value_type == DBC_VALUETYPE_UNSIGNED)
     result.Cast((uint32_t)val, DBC_NUMBER_INTEGER_UNSIGNED);
   else
+    {
+    // Sign extension:
+    if (m_signal_size > 0 && m_signal_size < 64 && (val & (1ULL << (m_signal_size-1))))
+      val |= ~((1ULL << m_signal_size) - 1);
     result.Cast((uint32_t)val, DBC_NUMBER_INTEGER_SIGNED);
+    }
 
   // Apply factor and offset
   if (!(m_factor == 1))
@@ -1263,9 +1338,12 @@ void dbcMessageTable::WriteSummary(dbcOutputCallback callback, void* param)
 ////////////////////////////////////////////////////////////////////////
 // dbcfile
 
+static uint32_t dbcfile_generation = 0;
+
 dbcfile::dbcfile()
   {
   m_locks = 0;
+  m_generation = ++dbcfile_generation;
   }
 
 dbcfile::~dbcfile()
@@ -1427,3 +1505,338 @@ bool dbcfile::IsLocked()
   {
   return (m_locks > 0);
   }
+
+void dbcfile::Changed()
+  {
+  // Invalidates compiled decoders (see dbcDecodePlan::IsCurrent)
+  m_generation = ++dbcfile_generation;
+  }
+
+////////////////////////////////////////////////////////////////////////
+// dbcDecodePlan
+
+dbcDecodePlan::dbcDecodePlan()
+  {
+  m_dbc = NULL;
+  m_generation = 0;
+  }
+
+dbcDecodePlan::~dbcDecodePlan()
+  {
+  Clear();
+  }
+
+void dbcDecodePlan::Clear()
+  {
+  m_dbc = NULL;
+  m_generation = 0;
+  m_signals.clear();
+  m_muxgroups.clear();
+  m_messages.clear();
+  m_stdindex.clear();
+  m_extindex.clear();
+  }
+
+void dbcDecodePlan::CompileSignal(dbcSignal* signal)
+  {
+  dbcDecodeSignal_t ds;
+  memset(&ds, 0, sizeof(ds));
+  ds.signal = signal;
+  ds.metric = signal->GetMetric();
+
+  signal->GetLayout(&ds.bigendian, &ds.shift, &ds.mask);
+  ds.issigned = (signal->GetValueType() == DBC_VALUETYPE_SIGNED);
+  int size = signal->GetSignalSize();
+
+  // Fuse factor & offset, use integer math if both are integral:
+  dbcNumber f = signal->GetFactor(), o = signal->GetOffset();
+  double factor = f.IsDefined() ? f.GetDouble() : 1;
+  double offset = o.IsDefined() ? o.GetDouble() : 0;
+  ds.isinteger = false;
+  if (size <= 32 && factor == (int32_t)factor && offset == (int32_t)offset)
+    {
+    // check the result range fits into 32 bits:
+    double rmin = ds.issigned ? -(double)(ds.mask >> 1) - 1 : 0;
+    double rmax = ds.issigned ? (double)(ds.mask >> 1) : (double)ds.mask;
+    double vmin = std::min(rmin*factor, rmax*factor) + offset;
+    double vmax = std::max(rmin*factor, rmax*factor) + offset;
+    if (vmin >= INT32_MIN && vmax <= (vmin < 0 ? (double)INT32_MAX : (double)UINT32_MAX))
+      ds.isinteger = true;
+    }
+  ds.ifactor = (int32_t)factor;
+  ds.ioffset = (int32_t)offset;
+  ds.factor = (float)factor;
+  ds.offset = (float)offset;
+
+  m_signals.push_back(ds);
+  }
+
+void dbcDecodePlan::Compile(dbcfile* dbc, bool assigned_only /*=true*/)
+  {
+  Clear();
+  m_dbc = dbc;
+  if (dbc == NULL) return;
+  m_generation = dbc->GetGeneration();
+
+  for (auto it = dbc->m_messages.m_entrymap.begin(); it != dbc->m_messages.m_entrymap.end(); it++)
+    {
+    dbcMessage* msg = it->second;
+    dbcDecodeMessage_t dm;
+    memset(&dm, 0, sizeof(dm));
+    dm.message = msg;
+    dm.mux = -1;
+
+    // plain signals:
+    dm.first = m_signals.size();
+    for (dbcSignal* sig : msg->m_signals)
+      {
+      if (sig->IsMultiplexSwitch()) continue;
+      if (assigned_only && sig->GetMetric() == NULL) continue;
+      CompileSignal(sig);
+      }
+    dm.count = m_signals.size() - dm.first;
+
+    // multiplexed signals, grouped by switch value:
+    dbcSignal* muxsig = msg->GetMultiplexorSignal();
+    if (muxsig)
+      {
+      std::map<uint32_t, std::vector<dbcSignal*>> groups;
+      for (dbcSignal* sig : msg->m_signals)
+        {
+        if (!sig->IsMultiplexSwitch()) continue;
+        if (assigned_only && sig->GetMetric() == NULL) continue;
+        groups[sig->GetMultiplexSwitchvalue()].push_back(sig);
+        }
+      if (!groups.empty())
+        {
+        dm.mux = m_signals.size();
+        CompileSignal(muxsig);
+        dm.muxfirst = m_muxgroups.size();
+        for (auto& group : groups)
+          {
+          dbcDecodeMuxGroup_t mg;
+          mg.switchvalue = group.first;
+          mg.first = m_signals.size();
+          for (dbcSignal* sig : group.second)
+            CompileSignal(sig);
+          mg.count = m_signals.size() - mg.first;
+          m_muxgroups.push_back(mg);
+          }
+        dm.muxcount = m_muxgroups.size() - dm.muxfirst;
+        }
+      }
+
+    if (dm.count == 0 && dm.mux < 0)
+      continue; // nothing to decode
+
+    uint16_t index = m_messages.size();
+    m_messages.push_back(dm);
+    if (msg->IsExtended())
+      {
+      m_extindex.push_back(std::make_pair(msg->GetID() & 0x7FFFFFFF, index));
+      }
+    else if (msg->GetID() <= 0x7FF)
+      {
+      if (m_stdindex.empty()) m_stdindex.resize(0x800, 0);
+      m_stdindex[msg->GetID()] = index + 1;
+      }
+    }
+
+  std::sort(m_extindex.begin(), m_extindex.end());
+  }
+
+const dbcDecodeMessage_t* dbcDecodePlan::FindMessage(CAN_frame_format_t format, uint32_t id)
+  {
+  if (format == CAN_frame_std)
+    {
+    if (id < m_stdindex.size() && m_stdindex[id])
+      return &m_messages[m_stdindex[id]-1];
+    return NULL;
+    }
+  else
+    {
+    auto it = std::lower_bound(m_extindex.begin(), m_extindex.end(), std::make_pair(id, (uint16_t)0));
+    if (it != m_extindex.end() && it->first == id)
+      return &m_messages[it->second];
+    return NULL;
+    }
+  }
+
+void dbcDecodePlan::DecodeSignal(const dbcDecodeSignal_t* ds, uint64_t le, uint64_t be, dbcNumber& result)
+  {
+  uint64_t raw = ((ds->bigendian ? be : le) >> ds->shift) & ds->mask;
+  int64_t val = raw;
+  if (ds->issigned && (raw & ~(ds->mask >> 1)))
+    val = (int64_t)(raw | ~ds->mask);  // sign extension
+
+  if (ds->isinteger)
+    {
+    int64_t ival = val * ds->ifactor + ds->ioffset;
+    if (ival < 0)
+      result = (int32_t)ival;
+    else
+      result = (uint32_t)ival;
+    }
+  else
+    {
+    result = (double)((float)val * ds->factor + ds->offset);
+    }
+  }
+
+int dbcDecodePlan::Decode(const CAN_frame_t* frame, dbcDecodeCallback_t callback /*=NULL*/, void* param /*=NULL*/)
+  {
+  const dbcDecodeMessage_t* dm = FindMessage(frame->FIR.B.FF, frame->MsgID);
+  if (dm == NULL) return 0;
+
+  uint64_t le = frame->data.u64;
+  uint64_t be = __builtin_bswap64(le);
+  dbcNumber value;
+  const dbcDecodeSignal_t *ds, *end;
+  int cnt = 0;
+
+  // plain signals:
+  for (ds = &m_signals[dm->first], end = ds + dm->count; ds < end; ds++)
+    {
+    DecodeSignal(ds, le, be, value);
+    if (callback) callback(ds->signal, value, param);
+    else if (ds->metric) ds->metric->SetValue(value);
+    cnt++;
+    }
+
+  // multiplexed signals:
+  if (dm->mux >= 0)
+    {
+    DecodeSignal(&m_signals[dm->mux], le, be, value);
+    uint32_t switchvalue = value.GetUnsignedInteger();
+    const dbcDecodeMuxGroup_t* mg = &m_muxgroups[dm->muxfirst];
+    const dbcDecodeMuxGroup_t* mgend = mg + dm->muxcount;
+    mg = std::lower_bound(mg, mgend, switchvalue,
+      [](const dbcDecodeMuxGroup_t& g, uint32_t v) { return g.switchvalue < v; });
+    if (mg < mgend && mg->switchvalue == switchvalue)
+      {
+      for (ds = &m_signals[mg->first], end = ds + mg->count; ds < end; ds++)
+        {
+        DecodeSignal(ds, le, be, value);
+        if (callback) callback(ds->signal, value, param);
+        else if (ds->metric) ds->metric->SetValue(value);
+        cnt++;
+        }
+      }
+    }
+
+  return cnt;
+  }
+
+////////////////////////////////////////////////////////////////////////
+// dbcFrameBuilder
+
+dbcFrameBuilder::dbcFrameBuilder()
+  {
+  m_message = NULL;
+  m_mux = -1;
+  }
+
+dbcFrameBuilder::~dbcFrameBuilder()
+  {
+  }
+
+void dbcFrameBuilder::Compile(dbcMessage* message)
+  {
+  m_message = message;
+  m_mux = -1;
+  m_signals.clear();
+  if (message == NULL) return;
+
+  dbcSignal* muxsig = message->GetMultiplexorSignal();
+  m_signals.reserve(message->m_signals.size());
+  for (dbcSignal* sig : message->m_signals)
+    {
+    dbcEncodeSignal_t es;
+    memset(&es, 0, sizeof(es));
+    es.signal = sig;
+    es.metric = sig->GetMetric();
+    es.value = 0;
+    sig->GetLayout(&es.bigendian, &es.shift, &es.mask);
+    es.muxed = (muxsig != NULL && sig->IsMultiplexSwitch());
+    es.switchvalue = sig->GetMultiplexSwitchvalue();
+    if (sig == muxsig) m_mux = m_signals.size();
+    m_signals.push_back(es);
+    }
+  }
+
+dbcEncodeSignal_t* dbcFrameBuilder::Find(const char* signal)
+  {
+  for (dbcEncodeSignal_t& es : m_signals)
+    {
+    if (es.signal->GetName() == signal)
+      return &es;
+    }
+  return NULL;
+  }
+
+bool dbcFrameBuilder::SetValue(const char* signal, double value)
+  {
+  dbcEncodeSignal_t* es = Find(signal);
+  if (es == NULL) return false;
+  es->metric = NULL;
+  es->value = value;
+  return true;
+  }
+
+bool dbcFrameBuilder::SetSource(const char* signal, OvmsMetric* metric)
+  {
+  dbcEncodeSignal_t* es = Find(signal);
+  if (es == NULL) return false;
+  es->metric = metric;
+  return true;
+  }
+
+bool dbcFrameBuilder::IsSource(OvmsMetric* metric)
+  {
+  for (dbcEncodeSignal_t& es : m_signals)
+    {
+    if (es.metric == metric) return true;
+    }
+  return false;
+  }
+
+void dbcFrameBuilder::GetSources(std::vector<OvmsMetric*>& metrics)
+  {
+  for (dbcEncodeSignal_t& es : m_signals)
+    {
+    if (es.metric && std::find(metrics.begin(), metrics.end(), es.metric) == metrics.end())
+      metrics.push_back(es.metric);
+    }
+  }
+
+void dbcFrameBuilder::Build(CAN_frame_t* frame)
+  {
+  memset(frame, 0, sizeof(*frame));
+  if (m_message == NULL) return;
+
+  frame->FIR.B.FF = m_message->GetFormat();
+  frame->MsgID = m_message->GetID() & 0x1FFFFFFF;
+  int size = m_message->GetSize();
+  frame->FIR.B.DLC = (size < 0) ? 0 : (size > 8) ? 8 : size;
+
+  // Current multiplexor value:
+  uint32_t muxval = 0;
+  if (m_mux >= 0)
+    {
+    dbcEncodeSignal_t& ms = m_signals[m_mux];
+    muxval = (uint32_t)ms.signal->EncodeRaw(ms.metric ? ms.metric->AsFloat() : ms.value);
+    }
+
+  // Pack all signals into the little & big endian frame words:
+  uint64_t le = 0, be = 0;
+  for (dbcEncodeSignal_t& es : m_signals)
+    {
+    if (es.muxed && es.switchvalue != muxval) continue;
+    uint64_t raw = es.signal->EncodeRaw(es.metric ? es.metric->AsFloat() : es.value);
+    if (es.bigendian)
+      be |= raw << es.shift;
+    else
+      le |= raw << es.shift;
+    }
+  frame->data.u64 = le | __builtin_bswap64(be);
+  }
@@ -34,6 +34,7 @@
 #include <string>
 #include <map>
 #include <list>
+#include <vector>
 #include <functional>
 #include <iostream>
 #include "dbc_number.h"
@@ -301,6 +302,8 @@ class dbcSignal
   public:
     void Encode(dbcNumber* source, CAN_frame_t* msg);
     dbcNumber Decode(CAN_frame_t* msg);
+    uint64_t EncodeRaw(double value);
+    void GetLayout(bool* bigendian, uint8_t* shift, uint64_t* mask);
 
   public:
     void AssignMetric(OvmsMetric* metric);
@@ -435,6 +438,8 @@ class dbcfile
     void LockFile();
     void UnlockFile();
     bool IsLocked();
+    void Changed();
+    uint32_t GetGeneration() { return m_generation; }
 
   public:
     std::string m_name;
@@ -450,6 +455,124 @@ class dbcfile
   private:
     dbcMessage* m_lastmsg;
     int m_locks;
+    volatile uint32_t m_generation;   // unique across files, renewed by Changed()
+  };
+
+////////////////////////////////////////////////////////////////////////
+// dbcDecodePlan: compiled decoder
+// A flat, allocation free representation of the messages and signals
+// of a dbcfile for bus rate decoding. Message lookup is by a direct
+// index table for standard IDs and a sorted table for extended IDs,
+// each signal has its bit position, mask and fused factor/offset
+// precomputed, multiplexed signals are grouped by switch value.
+// Signal to metric assignments are captured at Compile() time.
+
+typedef struct
+  {
+  dbcSignal* signal;
+  OvmsMetric* metric;
+  uint64_t mask;              // value mask (after shift)
+  uint8_t shift;              // bit position of LSB in frame word
+  bool bigendian;             // frame word byte order
+  bool issigned;
+  bool isinteger;             // integral factor & offset: use integer math
+  int32_t ifactor, ioffset;   // fused factor/offset (integer math)
+  float factor, offset;       // fused factor/offset (float math)
+  } dbcDecodeSignal_t;
+
+typedef struct
+  {
+  uint32_t switchvalue;
+  uint16_t first;             // index into signal table
+  uint16_t count;
+  } dbcDecodeMuxGroup_t;
+
+typedef struct
+  {
+  dbcMessage* message;
+  int16_t mux;                // index of multiplexor signal, -1 = none
+  uint16_t first;             // index into signal table (plain signals)
+  uint16_t count;
+  uint16_t muxfirst;          // index into mux group table
+  uint16_t muxcount;
+  } dbcDecodeMessage_t;
+
+typedef void (*dbcDecodeCallback_t)(dbcSignal* signal, dbcNumber& value, void* param);
+
+class dbcDecodePlan
+  {
+  public:
+    dbcDecodePlan();
+    ~dbcDecodePlan();
+
+  public:
+    void Compile(dbcfile* dbc, bool assigned_only=true);
+    void Clear();
+    dbcfile* GetDBC() { return m_dbc; }
+    bool IsCurrent(dbcfile* dbc) { return (dbc == m_dbc && dbc && dbc->GetGeneration() == m_generation); }
+    int GetMessageCount() { return m_messages.size(); }
+    int GetSignalCount() { return m_signals.size(); }
+
+  public:
+    const dbcDecodeMessage_t* FindMessage(CAN_frame_format_t format, uint32_t id);
+    static void DecodeSignal(const dbcDecodeSignal_t* ds, uint64_t le, uint64_t be, dbcNumber& result);
+    int Decode(const CAN_frame_t* frame, dbcDecodeCallback_t callback=NULL, void* param=NULL);
+
+  protected:
+    void CompileSignal(dbcSignal* signal);
+
+  protected:
+    dbcfile* m_dbc;
+    uint32_t m_generation;
+    std::vector<dbcDecodeSignal_t> m_signals;
+    std::vector<dbcDecodeMuxGroup_t> m_muxgroups;
+    std::vector<dbcDecodeMessage_t> m_messages;
+    std::vector<uint16_t> m_stdindex;                         // 11 bit ID -> message index+1, 0 = none
+    std::vector<std::pair<uint32_t,uint16_t>> m_extindex;     // sorted (ID, message index)
+  };
+
+////////////////////////////////////////////////////////////////////////
+// dbcFrameBuilder: message encoder
+// Packs the signals of a dbcMessage into a CAN frame in one pass.
+// Signal values are taken from their value source metric (by default
+// the metric assigned to the signal) or from a value set explicitly.
+// For multiplexed messages, only the switch signals matching the
+// current multiplexor value are encoded.
+
+typedef struct
+  {
+  dbcSignal* signal;
+  OvmsMetric* metric;         // value source, NULL = use value
+  double value;
+  uint64_t mask;
+  uint8_t shift;
+  bool bigendian;
+  bool muxed;
+  uint32_t switchvalue;
+  } dbcEncodeSignal_t;
+
+class dbcFrameBuilder
+  {
+  public:
+    dbcFrameBuilder();
+    ~dbcFrameBuilder();
+
+  public:
+    void Compile(dbcMessage* message);
+    dbcMessage* GetMessage() { return m_message; }
+    bool SetValue(const char* signal, double value);
+    bool SetSource(const char* signal, OvmsMetric* metric);
+    bool IsSource(OvmsMetric* metric);
+    void GetSources(std::vector<OvmsMetric*>& metrics);
+    void Build(CAN_frame_t* frame);
+
+  protected:
+    dbcEncodeSignal_t* Find(const char* signal);
+
+  protected:
+    dbcMessage* m_message;
+    int m_mux;                  // index of multiplexor signal, -1 = none
+    std::vector<dbcEncodeSignal_t> m_signals;
   };
 
 #endif //#ifndef __DBC_H__
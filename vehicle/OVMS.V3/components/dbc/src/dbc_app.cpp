@@ -39,6 +39,8 @@ static const char *TAG = "dbc-app";
 #include <dirent.h>
 #include "dbc.h"
 #include "dbc_app.h"
+#include "esp_timer.h"
+#include "canformat.h"
 #include "ovms_config.h"
 #include "ovms_events.h"
 
@@ -310,6 +312,7 @@ void dbc_message_clear(int verbosity, OvmsWriter* writer, OvmsCommand* cmd, int
     }
 
   MyDBC.m_selected->m_messages.EmptyContent();
+  MyDBC.m_selected->Changed();
   writer->puts("DBC: Message table cleared");
   }
 
@@ -333,6 +336,7 @@ void dbc_message_add(int verbosity, OvmsWriter* writer, OvmsCommand* cmd, int ar
   msg->SetSize(atoi(argv[2]));
   msg->SetTransmitterNode(argv[3]);
   MyDBC.m_selected->m_messages.AddMessage(msgid,msg);
+  MyDBC.m_selected->Changed();
   writer->printf("DBC: Added message %s\n",argv[0]);
   }
 
@@ -349,6 +353,7 @@ void dbc_message_remove(int verbosity, OvmsWriter* writer, OvmsCommand* cmd, int
   if (msg != NULL)
     {
     MyDBC.m_selected->m_messages.RemoveMessage(msg->GetID(),true);
+    MyDBC.m_selected->Changed();
     writer->printf("DBC: Message %s removed\n",argv[0]);
     }
   else
@@ -376,6 +381,7 @@ void dbc_message_set_mux(int verbosity, OvmsWriter* writer, OvmsCommand* cmd, in
   if (argc == 1)
     {
     msg->SetMultiplexorSignal(NULL);
+    MyDBC.m_selected->Changed();
     writer->printf("DBC: Cleared mux for %s\n",argv[0]);
     return;
     }
@@ -388,6 +394,7 @@ void dbc_message_set_mux(int verbosity, OvmsWriter* writer, OvmsCommand* cmd, in
     }
 
   msg->SetMultiplexorSignal(signal);
+  MyDBC.m_selected->Changed();
   writer->printf("DBC: Set mux for message %s to %s\n",argv[0],argv[1]);
   }
 
@@ -410,6 +417,7 @@ void dbc_signal_clear(int verbosity, OvmsWriter* writer, OvmsCommand* cmd, int a
     {
     msg->RemoveAllSignals(true);
     msg->SetMultiplexorSignal(NULL);
+    MyDBC.m_selected->Changed();
     writer->printf("DBC: Cleared all signals for %s\n",argv[0]);
     }
   }
@@ -449,6 +457,7 @@ void dbc_signal_add(int verbosity, OvmsWriter* writer, OvmsCommand* cmd, int arg
   signal->SetUnit(argv[10]);
   signal->AddReceiver(argv[11]);
   msg->AddSignal(signal);
+  MyDBC.m_selected->Changed();
   writer->printf("DBC: Added signal %s on message %s\n",argv[1],argv[0]);
   }
 
@@ -477,6 +486,7 @@ void dbc_signal_remove(int verbosity, OvmsWriter* writer, OvmsCommand* cmd, int
   else
     {
     msg->RemoveSignal(signal, true);
+    MyDBC.m_selected->Changed();
     writer->printf("DBC: Removed signal %s on message %s\n",argv[1],argv[0]);
     }
   }
@@ -507,15 +517,166 @@ void dbc_signal_set_mux(int verbosity, OvmsWriter* writer, OvmsCommand* cmd, int
   if (argc > 2)
     {
     signal->SetMultiplexed(atoi(argv[2]));
+    MyDBC.m_selected->Changed();
     writer->printf("DBC: Set mux %s for signal %s on message %s\n",argv[2],argv[1],argv[0]);
     }
   else
     {
     signal->ClearMultiplexed();
+    MyDBC.m_selected->Changed();
     writer->printf("DBC: Cleared mux for signal %s on message %s\n",argv[1],argv[0]);
     }
   }
 
+void dbc_encode(int verbosity, OvmsWriter* writer, OvmsCommand* cmd, int argc, const char* const* argv)
+  {
+  dbcfile* dbc = MyDBC.Find(argv[0]);
+  if (dbc == NULL)
+    {
+    writer->printf("Error: Cannot find DBC file: %s\n",argv[0]);
+    return;
+    }
+
+  OvmsMutexLock ldbc(&MyDBC.m_mutex);
+  uint32_t msgid = dbcMessageIdFromString(argv[1]);
+  dbcMessage* msg = dbc->m_messages.FindMessage(msgid);
+  if (msg == NULL)
+    {
+    writer->printf("Error: Could not find message %s\n",argv[1]);
+    return;
+    }
+
+  dbcFrameBuilder builder;
+  builder.Compile(msg);
+  for (int k=2; k<argc; k++)
+    {
+    std::string arg(argv[k]);
+    size_t eq = arg.find('=');
+    if (eq == std::string::npos ||
+        !builder.SetValue(arg.substr(0,eq).c_str(), atof(arg.substr(eq+1).c_str())))
+      {
+      writer->printf("Error: Invalid signal assignment %s\n",argv[k]);
+      return;
+      }
+    }
+
+  CAN_frame_t frame;
+  builder.Build(&frame);
+  writer->printf("%s %0*X:", (frame.FIR.B.FF == CAN_frame_std) ? "11" : "29",
+    (frame.FIR.B.FF == CAN_frame_std) ? 3 : 8, frame.MsgID);
+  for (int k=0; k<frame.FIR.B.DLC; k++)
+    writer->printf(" %02X", frame.data.u8[k]);
+  writer->puts("");
+  }
+
+#define DBC_BENCHMARK_MAXFRAMES 2000
+#define DBC_BENCHMARK_ROUNDS    10
+
+static void dbc_benchmark_callback(dbcSignal* signal, dbcNumber& value, void* param)
+  {
+  double* sum = (double*)param;
+  *sum += value.GetDouble();
+  }
+
+void dbc_benchmark(int verbosity, OvmsWriter* writer, OvmsCommand* cmd, int argc, const char* const* argv)
+  {
+  dbcfile* dbc = MyDBC.Find(argv[0]);
+  if (dbc == NULL)
+    {
+    writer->printf("Error: Cannot find DBC file: %s\n",argv[0]);
+    return;
+    }
+
+  const char* format = (argc > 2) ? argv[2] : "crtd";
+  canformat* formatter = MyCanFormatFactory.NewFormat(format);
+  if (formatter == NULL)
+    {
+    writer->printf("Error: Unknown CAN log format: %s\n",format);
+    return;
+    }
+
+  FILE* fd = fopen(argv[1], "r");
+  if (fd == NULL)
+    {
+    writer->printf("Error: Cannot open %s\n",argv[1]);
+    delete formatter;
+    return;
+    }
+
+  // Read frames from the log:
+  std::vector<CAN_frame_t> frames;
+  frames.reserve(DBC_BENCHMARK_MAXFRAMES);
+  uint8_t buf[512];
+  canformat_reader reader(buf, sizeof(buf),
+    [fd](uint8_t* buffer, size_t size) { return fread(buffer, 1, size, fd); });
+  formatter->DecodeStream(reader, [&frames](CAN_log_message_t* msg)
+    {
+    if (msg->type == CAN_LogFrame_RX || msg->type == CAN_LogFrame_TX)
+      frames.push_back(msg->frame);
+    return (frames.size() < DBC_BENCHMARK_MAXFRAMES);
+    });
+  fclose(fd);
+  delete formatter;
+
+  if (frames.empty())
+    {
+    writer->printf("Error: No frames read from %s (format %s)\n",argv[1],format);
+    return;
+    }
+
+  OvmsMutexLock ldbc(&MyDBC.m_mutex);
+  dbcDecodePlan plan;
+  int64_t started = esp_timer_get_time();
+  plan.Compile(dbc, false);
+  int64_t time_compile = esp_timer_get_time() - started;
+
+  // Legacy decoder: message lookup by map, per signal bit walk & dbcNumber math
+  double sum_legacy = 0;
+  int signals_legacy = 0;
+  started = esp_timer_get_time();
+  for (int round = 0; round < DBC_BENCHMARK_ROUNDS; round++)
+    {
+    for (CAN_frame_t& frame : frames)
+      {
+      dbcMessage* m = dbc->m_messages.FindMessage(frame.FIR.B.FF, frame.MsgID);
+      if (m == NULL) continue;
+      dbcSignal* mux = m->GetMultiplexorSignal();
+      uint32_t muxval = 0;
+      if (mux) muxval = mux->Decode(&frame).GetUnsignedInteger();
+      for (dbcSignal* sig : m->m_signals)
+        {
+        if (sig->IsMultiplexSwitch() && (mux == NULL || sig->GetMultiplexSwitchvalue() != muxval))
+          continue;
+        sum_legacy += sig->Decode(&frame).GetDouble();
+        signals_legacy++;
+        }
+      }
+    }
+  int64_t time_legacy = esp_timer_get_time() - started;
+
+  // Compiled decoder:
+  double sum_plan = 0;
+  int signals_plan = 0;
+  started = esp_timer_get_time();
+  for (int round = 0; round < DBC_BENCHMARK_ROUNDS; round++)
+    {
+    for (CAN_frame_t& frame : frames)
+      signals_plan += plan.Decode(&frame, dbc_benchmark_callback, &sum_plan);
+    }
+  int64_t time_plan = esp_timer_get_time() - started;
+
+  int total = frames.size() * DBC_BENCHMARK_ROUNDS;
+  writer->printf("Frames:   %d x %d rounds\n", frames.size(), DBC_BENCHMARK_ROUNDS);
+  writer->printf("Compile:  %lld us (%d messages, %d signals)\n",
+    time_compile, plan.GetMessageCount(), plan.GetSignalCount());
+  writer->printf("Legacy:   %lld us = %.2f us/frame, %d signals, sum %g\n",
+    time_legacy, (double)time_legacy / total, signals_legacy, sum_legacy);
+  writer->printf("Compiled: %lld us = %.2f us/frame, %d signals, sum %g\n",
+    time_plan, (double)time_plan / total, signals_plan, sum_plan);
+  if (time_plan > 0)
+    writer->printf("Speedup:  %.1fx\n", (double)time_legacy / time_plan);
+  }
+
 dbc::dbc()
   {
   ESP_LOGI(TAG, "Initialising DBC (4520)");
@@ -532,6 +693,8 @@ dbc::dbc()
   cmd_dbc->RegisterCommand("autoload", "Autoload DBC files", dbc_autoload);
   cmd_dbc->RegisterCommand("select", "Select DBC file for editing", dbc_select, "[<name>]", 0, 1);
   cmd_dbc->RegisterCommand("deselect", "Deselect DBC file for editing", dbc_deselect);
+  cmd_dbc->RegisterCommand("encode", "Encode DBC message into a CAN frame", dbc_encode, "<name> <id> [<signal>=<value> ...]", 2, 20);
+  cmd_dbc->RegisterCommand("benchmark", "Benchmark DBC decoding on a CAN log file", dbc_benchmark, "<name> <path> [<format>]", 2, 3);
 
   OvmsCommand* cmd_set = cmd_dbc->RegisterCommand("set","DBC Set framework");
   cmd_set->RegisterCommand("version", "Set version for selected DBC file", dbc_set_version, "<version>", 1, 1);
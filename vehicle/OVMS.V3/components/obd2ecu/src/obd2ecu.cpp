@@ -172,7 +172,11 @@ obd2ecu::obd2ecu(const char* name, canbus* can)
 
   xTaskCreatePinnedToCore(OBD2ECU_task, "OVMS OBDII ECU", 6144, (void*)this, 5, &m_task, CORE(1));
 
-  MyCan.RegisterListener(m_rxqueue);
+  canmatch filter;
+  filter.AddBus(m_can);
+  filter.AddStd(REQUEST_PID, REQUEST_PID);
+  filter.AddExt(REQUEST_EXT_PID, REQUEST_EXT_PID);
+  MyCan.RegisterListener(m_rxqueue, false, &filter);
   }
 
 obd2ecu::~obd2ecu()
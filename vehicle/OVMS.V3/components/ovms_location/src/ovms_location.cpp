@@ -38,10 +38,14 @@ static const char *TAG = "location";
 #include "ovms_notify.h"
 #include "ovms_command.h"
 #include "metrics_standard.h"
+#include "esp_timer.h"
 #include <math.h>
+#include <algorithm>
 
 const char *LOCATIONS_PARAM = "locations";
 #define LOCATION_DEFRADIUS 100
+#define LOCATION_DEFHYSTERESIS 10
+#define LOCATION_DEFEVALDISTANCE 5
 
 #define LOCATION_R 6371
 #define LOCATION_TO_RAD (3.1415926536 / 180)
@@ -59,6 +63,58 @@ double OvmsLocationDistance(double th1, double ph1, double th2, double ph2)
   return (asin(sqrt(dx * dx + dy * dy + dz * dz) / 2) * 2 * LOCATION_R)*1000.0;
   }
 
+// Meters per degree latitude:
+#define LOCATION_M_PER_DEG ((float)(LOCATION_TO_RAD * LOCATION_R * 1000.0))
+
+/**
+ * OvmsLocationDistanceSqrApprox: equirectangular approximation of the
+ *  squared distance [m²], for prefiltering
+ *  (coslat: cosine of the reference latitude)
+ */
+static inline float OvmsLocationDistanceSqrApprox(float lat1, float lon1, float lat2, float lon2, float coslat)
+  {
+  float dlon = lon1 - lon2;
+  if (dlon > 180) dlon -= 360;
+  else if (dlon < -180) dlon += 360;
+  float dx = dlon * coslat * LOCATION_M_PER_DEG;
+  float dy = (lat1 - lat2) * LOCATION_M_PER_DEG;
+  return dx * dx + dy * dy;
+  }
+
+/**
+ * LocationOutOfReach: prefilter, true if the position is definitely more
+ *  than reach [m] away from the location. The margin covers the approximation
+ *  error for reaches up to 10 km outside the polar regions, beyond that the
+ *  prefilter is skipped.
+ */
+static inline bool LocationOutOfReach(OvmsLocation* loc, float reach, float latitude, float longitude, float coslat)
+  {
+  if (reach > 10000 || coslat < 0.05) return false;
+  float limit = reach * 1.05f + 2;
+  return (OvmsLocationDistanceSqrApprox(latitude, longitude, loc->m_latitude, loc->m_longitude, coslat) > limit * limit);
+  }
+
+// Index grid dimensions:
+#define LOCATION_GRID_LATCELLS ((int)(180 / LOCATION_GRID + 0.5) + 1)
+#define LOCATION_GRID_LONCELLS ((int)(360 / LOCATION_GRID + 0.5))
+
+static inline int LocationGridLat(float latitude)
+  {
+  int c = (int)floorf((latitude + 90) / LOCATION_GRID);
+  return (c < 0) ? 0 : (c >= LOCATION_GRID_LATCELLS) ? LOCATION_GRID_LATCELLS-1 : c;
+  }
+
+static inline int LocationGridLon(float longitude)
+  {
+  return (int)floorf((longitude + 180) / LOCATION_GRID);
+  }
+
+static inline uint32_t LocationGridKey(int latcell, int loncell)
+  {
+  loncell = ((loncell % LOCATION_GRID_LONCELLS) + LOCATION_GRID_LONCELLS) % LOCATION_GRID_LONCELLS;
+  return ((uint32_t)latcell << 16) | (uint32_t)loncell;
+  }
+
 OvmsLocationAction::OvmsLocationAction(bool enter, enum LocationAction action, const char* params, int len)
   : m_enter(enter), m_action(action), m_params(params, len) {}
 
@@ -94,22 +150,42 @@ ActionList::iterator ActionList::erase(iterator pos)
 OvmsLocation::OvmsLocation(const std::string& name)
   {
   m_name = name;
+  m_latitude = 0;
+  m_longitude = 0;
+  m_radius = LOCATION_DEFRADIUS;
   m_inlocation = false;
+  m_evalseq = 0;
   }
 
 OvmsLocation::~OvmsLocation()
   {
   }
 
-bool OvmsLocation::IsInLocation(float latitude, float longitude)
+/**
+ * IsInLocation: check & update location status
+ *  We're entering the location when the distance gets down to the radius,
+ *  and leaving when it exceeds the radius plus the hysteresis.
+ */
+bool OvmsLocation::IsInLocation(float latitude, float longitude, int hysteresis)
   {
-  // This should check if we are in the location
   double dist = OvmsLocationDistance((double)latitude,(double)longitude,(double)m_latitude,(double)m_longitude);
-  std::string event;
 
   // ESP_LOGI(TAG, "Location %s is %0.1fm distant",m_name.c_str(),dist);
 
-  if (fabs(dist) <= m_radius)
+  if (m_inlocation)
+    SetInLocation(fabs(dist) <= m_radius + hysteresis);
+  else
+    SetInLocation(fabs(dist) <= m_radius);
+
+  // Return current status
+  return m_inlocation;
+  }
+
+void OvmsLocation::SetInLocation(bool inlocation)
+  {
+  std::string event;
+
+  if (inlocation)
     {
     // We are in the location
     if (!m_inlocation)
@@ -137,9 +213,55 @@ bool OvmsLocation::IsInLocation(float latitude, float longitude)
         }
       }
     }
+  }
 
-  // Return current status
-  return m_inlocation;
+OvmsLocationIndex::OvmsLocationIndex()
+  {
+  }
+
+OvmsLocationIndex::~OvmsLocationIndex()
+  {
+  }
+
+void OvmsLocationIndex::Clear()
+  {
+  m_cells.clear();
+  m_large.clear();
+  }
+
+void OvmsLocationIndex::Add(OvmsLocation* loc, int margin)
+  {
+  float reach = loc->m_radius + margin;
+  float coslat = cosf(loc->m_latitude * (float)LOCATION_TO_RAD);
+  if (coslat < 0.01)
+    {
+    m_large.push_back(loc);
+    return;
+    }
+  float dlat = reach / LOCATION_M_PER_DEG;
+  float dlon = reach / (LOCATION_M_PER_DEG * coslat);
+  int lat0 = LocationGridLat(loc->m_latitude - dlat);
+  int lat1 = LocationGridLat(loc->m_latitude + dlat);
+  int lon0 = LocationGridLon(loc->m_longitude - dlon);
+  int lon1 = LocationGridLon(loc->m_longitude + dlon);
+  if ((lat1-lat0+1) * (lon1-lon0+1) > LOCATION_GRID_MAXCELLS)
+    {
+    m_large.push_back(loc);
+    return;
+    }
+  for (int lat = lat0; lat <= lat1; lat++)
+    {
+    for (int lon = lon0; lon <= lon1; lon++)
+      m_cells[LocationGridKey(lat, lon)].push_back(loc);
+    }
+  }
+
+const LocationList* OvmsLocationIndex::GetCell(float latitude, float longitude)
+  {
+  auto it = m_cells.find(LocationGridKey(LocationGridLat(latitude), LocationGridLon(longitude)));
+  if (it == m_cells.end())
+    return NULL;
+  return &it->second;
   }
 
 bool OvmsLocation::Parse(const std::string& value)
@@ -279,6 +401,7 @@ void location_list(int verbosity, OvmsWriter* writer, OvmsCommand* cmd, int argc
   OvmsConfigParam* p = MyConfig.CachedParam(LOCATIONS_PARAM);
   if (p == NULL) return;
 
+  OvmsRecMutexLock lock(&MyLocations.m_mutex);
   // List all the locations that have been parsed as valid
   for (LocationMap::iterator it=MyLocations.m_locations.begin(); it!=MyLocations.m_locations.end(); ++it)
     {
@@ -331,6 +454,7 @@ void location_set(int verbosity, OvmsWriter* writer, OvmsCommand* cmd, int argc,
 void location_radius(int verbosity, OvmsWriter* writer, OvmsCommand* cmd, int argc, const char* const* argv)
   {
   const char *name = argv[0];
+  OvmsRecMutexLock lock(&MyLocations.m_mutex);
   OvmsLocation* loc = MyLocations.m_locations.FindUniquePrefix(name);
 
   if (loc == NULL)
@@ -341,6 +465,8 @@ void location_radius(int verbosity, OvmsWriter* writer, OvmsCommand* cmd, int ar
 
   std::string buf;
   loc->m_radius = atoi(argv[1]);
+  MyLocations.RebuildIndex();
+  if (MyLocations.m_gpslock) MyLocations.UpdateLocations(true);
   loc->Store(buf);
   writer->puts("Location radius set");
   }
@@ -348,6 +474,7 @@ void location_radius(int verbosity, OvmsWriter* writer, OvmsCommand* cmd, int ar
 void location_rm(int verbosity, OvmsWriter* writer, OvmsCommand* cmd, int argc, const char* const* argv)
   {
   const char *name = argv[0];
+  OvmsRecMutexLock lock(&MyLocations.m_mutex);
   OvmsLocation* loc = MyLocations.m_locations.FindUniquePrefix(name);
 
   if (loc == NULL)
@@ -374,9 +501,12 @@ void location_status(int verbosity, OvmsWriter* writer, OvmsCommand* cmd, int ar
     writer->printf("Vehicle is parked at %0.6f,%0.6f\n",
       MyLocations.m_park_latitude,
       MyLocations.m_park_longitude);
+  OvmsRecMutexLock lock(&MyLocations.m_mutex);
   n = MyLocations.m_locations.size();
   writer->printf("There %s %d location%s defined\n",
     n == 1 ? "is" : "are", n, n == 1 ? "" : "s");
+  if (verbosity >= COMMAND_RESULT_NORMAL)
+    MyLocations.IndexStatus(writer);
 
   bool found = false;
   for (LocationMap::iterator it=MyLocations.m_locations.begin(); it!=MyLocations.m_locations.end(); ++it)
@@ -397,7 +527,10 @@ void location_status(int verbosity, OvmsWriter* writer, OvmsCommand* cmd, int ar
 int location_validate(OvmsWriter* writer, OvmsCommand* cmd, int argc, const char* const* argv, bool complete)
   {
   if (argc == 1)
+    {
+    OvmsRecMutexLock lock(&MyLocations.m_mutex);
     return MyLocations.m_locations.Validate(writer, argc, argv[0], complete);
+    }
   return -1;
   }
 
@@ -407,6 +540,7 @@ void location_action(int verbosity, OvmsWriter* writer, enum LocationAction act,
   int remove = *rargv[2] == 'r' ? 1 : 0;
   bool enter = *rargv[2+remove] == 'e';
   const char* name = rargv[3+remove];
+  OvmsRecMutexLock lock(&MyLocations.m_mutex);
   OvmsLocation* loc = MyLocations.m_locations.FindUniquePrefix(name);
   if (loc == NULL)
     {
@@ -500,11 +634,121 @@ void location_all(int verbosity, OvmsWriter* writer, OvmsCommand* cmd, int argc,
   location_action(verbosity, writer, act, params);
   }
 
+void location_benchmark(int verbosity, OvmsWriter* writer, OvmsCommand* cmd, int argc, const char* const* argv)
+  {
+  int count = (argc > 0) ? atoi(argv[0]) : 1000;
+  int positions = (argc > 1) ? atoi(argv[1]) : 1000;
+  if (count < 1 || positions < 1)
+    {
+    writer->puts("Error: invalid location or position count");
+    return;
+    }
+
+  // Test locations: radius 50-500m, randomly spread over ~100 x 70 km around
+  //  the current position, test positions half random, half close to a location
+  float lat = MyLocations.m_latitude, lon = MyLocations.m_longitude;
+  if (lat == 0 && lon == 0)
+    {
+    lat = 52.52;
+    lon = 13.40;
+    }
+  uint32_t seed = 12345;
+  auto rnd = [&seed]() -> uint32_t { seed = seed * 1103515245 + 12345; return (seed >> 1); };
+  auto rndf = [&rnd](float range) -> float { return ((int)(rnd() % 20001) - 10000) * range / 10000; };
+  LocationList locs;
+  locs.reserve(count);
+  for (int i = 0; i < count; i++)
+    {
+    OvmsLocation* loc = new OvmsLocation("benchmark");
+    loc->m_latitude = lat + rndf(0.45);
+    loc->m_longitude = lon + rndf(0.5);
+    loc->m_radius = 50 + rnd() % 451;
+    locs.push_back(loc);
+    }
+  float* pos = new float[positions*2];
+  for (int i = 0; i < positions; i++)
+    {
+    if (i % 2)
+      {
+      OvmsLocation* loc = locs[rnd() % count];
+      pos[i*2] = loc->m_latitude + rndf(0.006);
+      pos[i*2+1] = loc->m_longitude + rndf(0.009);
+      }
+    else
+      {
+      pos[i*2] = lat + rndf(0.45);
+      pos[i*2+1] = lon + rndf(0.5);
+      }
+    }
+
+  // Full scan (former UpdateLocations):
+  int hits_scan = 0;
+  int64_t start = esp_timer_get_time();
+  for (int i = 0; i < positions; i++)
+    {
+    for (OvmsLocation* loc : locs)
+      {
+      double dist = OvmsLocationDistance((double)pos[i*2],(double)pos[i*2+1],(double)loc->m_latitude,(double)loc->m_longitude);
+      if (fabs(dist) <= loc->m_radius) hits_scan++;
+      }
+    }
+  int64_t scan_us = esp_timer_get_time() - start;
+
+  // Index:
+  OvmsLocationIndex index;
+  start = esp_timer_get_time();
+  for (OvmsLocation* loc : locs)
+    index.Add(loc, 0);
+  int64_t build_us = esp_timer_get_time() - start;
+  int hits_index = 0, exact = 0;
+  start = esp_timer_get_time();
+  for (int i = 0; i < positions; i++)
+    {
+    float plat = pos[i*2], plon = pos[i*2+1];
+    float coslat = cosf(plat * (float)LOCATION_TO_RAD);
+    const LocationList* cell = index.GetCell(plat, plon);
+    if (cell)
+      {
+      for (OvmsLocation* loc : *cell)
+        {
+        if (LocationOutOfReach(loc, loc->m_radius, plat, plon, coslat))
+          continue;
+        exact++;
+        double dist = OvmsLocationDistance((double)plat,(double)plon,(double)loc->m_latitude,(double)loc->m_longitude);
+        if (fabs(dist) <= loc->m_radius) hits_index++;
+        }
+      }
+    for (OvmsLocation* loc : index.m_large)
+      {
+      exact++;
+      double dist = OvmsLocationDistance((double)plat,(double)plon,(double)loc->m_latitude,(double)loc->m_longitude);
+      if (fabs(dist) <= loc->m_radius) hits_index++;
+      }
+    }
+  int64_t index_us = esp_timer_get_time() - start;
+
+  writer->printf("%d locations, %d positions:\n", count, positions);
+  writer->printf("  Full scan: %8lld us = %7.1f us/position, %d hits\n",
+    scan_us, (float)scan_us / positions, hits_scan);
+  writer->printf("  Index:     %8lld us = %7.1f us/position, %d hits, %.1f exact tests/position\n",
+    index_us, (float)index_us / positions, hits_index, (float)exact / positions);
+  writer->printf("  Index build: %lld us, %d cells, %d unindexed\n",
+    build_us, (int)index.GetCellCount(), (int)index.m_large.size());
+  if (hits_scan != hits_index)
+    writer->puts("  ERROR: results differ!");
+
+  index.Clear();
+  for (OvmsLocation* loc : locs)
+    delete loc;
+  delete [] pos;
+  }
+
 #ifdef CONFIG_OVMS_SC_JAVASCRIPT_DUKTAPE
 
 static duk_ret_t DukOvmsLocationStatus(duk_context *ctx)
   {
   const char *mn = duk_to_string(ctx,0);
+  OvmsRecMutexLock lock(&MyLocations.m_mutex);
   OvmsLocation *loc = MyLocations.m_locations.FindUniquePrefix(mn);
   if (loc)
     {
@@ -520,6 +764,8 @@ static duk_ret_t DukOvmsLocationStatus(duk_context *ctx)
 OvmsLocations MyLocations __attribute__ ((init_priority (1900)));
 
 OvmsLocations::OvmsLocations()
+  : m_cfg_hysteresis("vehicle", "location.hysteresis", LOCATION_DEFHYSTERESIS),
+    m_cfg_evaldistance("vehicle", "location.evaldistance", LOCATION_DEFEVALDISTANCE)
   {
   ESP_LOGI(TAG, "Initialising LOCATIONS (1900)");
 
@@ -529,6 +775,10 @@ OvmsLocations::OvmsLocations()
   m_park_latitude = 0;
   m_park_longitude = 0;
   m_park_distance = 0;
+  m_index_margin = 0;
+  m_evalseq = 0;
+  m_eval_latitude = 0;
+  m_eval_longitude = 0;
 
   // Register our commands
   OvmsCommand* cmd_location = MyCommandApp.RegisterCommand("location","LOCATION framework");
@@ -537,6 +787,7 @@ OvmsLocations::OvmsLocations()
   cmd_location->RegisterCommand("radius","Set the radius of a location",location_radius, "<name> <radius>", 2, 2, true, location_validate);
   cmd_location->RegisterCommand("rm","Remove a defined location",location_rm, "<name>", 1, 1, true, location_validate);
   cmd_location->RegisterCommand("status","Show location status",location_status);
+  cmd_location->RegisterCommand("benchmark","Benchmark location matching (full scan vs. index)",location_benchmark, "[<locations>] [<positions>]", 0, 2);
   OvmsCommand* cmd_action = cmd_location->RegisterCommand("action","Set an action for a location");
   OvmsCommand* cmd_enter = cmd_action->RegisterCommand("enter","Set an action upon entering a location", NULL, "<location> $L", 1, 1, true, location_validate);
   OvmsCommand* cmd_leave = cmd_action->RegisterCommand("leave","Set an action upon leaving a location", NULL, "<location> $L", 1, 1, true, location_validate);
@@ -601,7 +852,7 @@ void OvmsLocations::UpdatedGpsLock(OvmsMetric* metric)
   if (m_gpslock)
     {
     MyEvents.SignalEvent("gps.lock.acquired", NULL);
-    UpdateLocations();
+    UpdateLocations(true);
     }
   else
     {
@@ -653,6 +904,9 @@ void OvmsLocations::ReloadMap()
   OvmsConfigParam* p = MyConfig.CachedParam(LOCATIONS_PARAM);
   if (p == NULL) return;
 
+  // UpdateLocations() may run concurrently (metrics listener):
+  OvmsRecMutexLock lock(&m_mutex);
+
   // Forward search, updating existing locations
   for (ConfigParamMap::iterator it=p->m_map.begin(); it!=p->m_map.end(); ++it)
     {
@@ -698,17 +952,87 @@ void OvmsLocations::ReloadMap()
       }
     }
 
-  if (m_gpslock) UpdateLocations();
+  RebuildIndex();
+  if (m_gpslock) UpdateLocations(true);
+  }
+
+void OvmsLocations::RebuildIndex()
+  {
+  OvmsRecMutexLock lock(&m_mutex);
+  m_index_margin = std::max((int)m_cfg_hysteresis, 0);
+  m_index.Clear();
+  m_active.clear();
+  for (LocationMap::iterator it=m_locations.begin(); it!=m_locations.end(); ++it)
+    {
+    m_index.Add(it->second, m_index_margin);
+    if (it->second->m_inlocation)
+      m_active.push_back(it->second);
+    }
   }
 
-void OvmsLocations::UpdateLocations()
+void OvmsLocations::IndexStatus(OvmsWriter* writer)
+  {
+  OvmsRecMutexLock lock(&m_mutex);
+  writer->printf("Index: %d grid cells, %d unindexed location%s, hysteresis %dm, evaluation distance %dm\n",
+    (int)m_index.GetCellCount(), (int)m_index.m_large.size(), m_index.m_large.size() == 1 ? "" : "s",
+    m_index_margin, (int)m_cfg_evaldistance);
+  }
+
+/**
+ * UpdateLocations: check the current position against the locations
+ *  The position is only evaluated after moving at least the configured
+ *  evaluation distance (unless forced). Candidates are the locations we're
+ *  currently in (to detect leaving) plus those indexed for the current grid
+ *  cell, these are prefiltered by an equirectangular distance approximation
+ *  before doing the exact great circle test.
+ */
+void OvmsLocations::UpdateLocations(bool force)
   {
   if ((m_latitude == 0)||(m_longitude == 0)) return;
 
-  for (LocationMap::iterator it=m_locations.begin(); it!=m_locations.end(); ++it)
+  float coslat = cosf(m_latitude * (float)LOCATION_TO_RAD);
+  int evaldistance = m_cfg_evaldistance;
+  if (!force && evaldistance > 0 && (m_eval_latitude != 0 || m_eval_longitude != 0))
     {
-    it->second->IsInLocation(m_latitude,m_longitude);
+    if (OvmsLocationDistanceSqrApprox(m_latitude, m_longitude, m_eval_latitude, m_eval_longitude, coslat)
+        < (float)evaldistance * evaldistance)
+      return;
     }
+  m_eval_latitude = m_latitude;
+  m_eval_longitude = m_longitude;
+
+  OvmsRecMutexLock lock(&m_mutex);
+  if (std::max((int)m_cfg_hysteresis, 0) != m_index_margin)
+    RebuildIndex();
+  int hysteresis = m_index_margin;
+  uint32_t seq = ++m_evalseq;
+  LocationList active;
+
+  auto check = [&](OvmsLocation* loc, bool prefilter)
+    {
+    if (loc->m_evalseq == seq) return;
+    loc->m_evalseq = seq;
+    if (prefilter && LocationOutOfReach(loc, loc->m_radius + hysteresis, m_latitude, m_longitude, coslat))
+      {
+      loc->SetInLocation(false);
+      return;
+      }
+    if (loc->IsInLocation(m_latitude, m_longitude, hysteresis))
+      active.push_back(loc);
+    };
+
+  for (OvmsLocation* loc : m_active)
+    check(loc, true);
+  const LocationList* cell = m_index.GetCell(m_latitude, m_longitude);
+  if (cell)
+    {
+    for (OvmsLocation* loc : *cell)
+      check(loc, true);
+    }
+  for (OvmsLocation* loc : m_index.m_large)
+    check(loc, false);
+
+  m_active.swap(active);
   }
 
 void OvmsLocations::CheckTheft()
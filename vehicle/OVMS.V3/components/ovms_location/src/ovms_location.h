@@ -31,9 +31,16 @@
 #ifndef __LOCATION_H__
 #define __LOCATION_H__
 
+#include <map>
+#include <vector>
 #include "ovms_metrics.h"
 #include "ovms_utils.h"
 #include "ovms_command.h"
+#include "ovms_config.h"
+#include "ovms_mutex.h"
+
+#define LOCATION_GRID             0.02    // Index grid cell size [°] (~2.2 km latitude)
+#define LOCATION_GRID_MAXCELLS    64      // Locations covering more cells are always checked
 
 enum LocationAction {
   INVALID = 0,
@@ -69,7 +76,8 @@ class OvmsLocation
     ~OvmsLocation();
 
   public:
-    bool IsInLocation(float latitude, float longitude);
+    bool IsInLocation(float latitude, float longitude, int hysteresis=0);
+    void SetInLocation(bool inlocation);
     bool Parse(const std::string& value);
     void Store(std::string& buf);
     void Render(std::string& buf);
@@ -81,10 +89,37 @@ class OvmsLocation
     float m_longitude;
     int m_radius;
     bool m_inlocation;
+    uint32_t m_evalseq;                     // Last evaluation run (dedup of index candidates)
     ActionList m_actions;
   };
 
 typedef NameMap<OvmsLocation*> LocationMap;
+typedef std::vector<OvmsLocation*> LocationList;
+
+/**
+ * OvmsLocationIndex: grid bucket index of locations
+ *
+ * Each location is added to all grid cells covered by its radius plus
+ * the given margin, so GetCell() returns all locations the position may
+ * be in. Locations covering too many cells (large radius / near the poles)
+ * are kept in m_large and need to be checked on every position.
+ */
+class OvmsLocationIndex
+  {
+  public:
+    OvmsLocationIndex();
+    ~OvmsLocationIndex();
+
+  public:
+    void Clear();
+    void Add(OvmsLocation* loc, int margin);
+    const LocationList* GetCell(float latitude, float longitude);
+    size_t GetCellCount() { return m_cells.size(); }
+
+  public:
+    std::map<uint32_t, LocationList> m_cells;
+    LocationList m_large;
+  };
 
 class OvmsLocations
   {
@@ -100,11 +135,24 @@ class OvmsLocations
     float m_park_longitude;
     float m_park_distance;
     LocationMap m_locations;
+    OvmsRecMutex m_mutex;                   // Guards m_locations, index & active list
+
+  protected:
+    OvmsLocationIndex m_index;              // Grid index of m_locations
+    int m_index_margin;                     // Margin (hysteresis) the index was built for
+    LocationList m_active;                  // Locations we're currently in
+    uint32_t m_evalseq;                     // Evaluation run counter
+    float m_eval_latitude;                  // Position of last evaluation
+    float m_eval_longitude;
+    OvmsConfigInt m_cfg_hysteresis;         // vehicle location.hysteresis [m]
+    OvmsConfigInt m_cfg_evaldistance;       // vehicle location.evaldistance [m]
 
   public:
     void ReloadMap();
-    void UpdateLocations();
+    void RebuildIndex();
+    void UpdateLocations(bool force=false);
     void CheckTheft();
+    void IndexStatus(OvmsWriter* writer);
 
   public:
     void UpdatedGpsLock(OvmsMetric* metric);
@@ -24,6 +24,27 @@ function hasKeys(obj)
   return false;
   }
 
+/**
+ * Publish the topics having subscribers to the OVMS event dispatcher,
+ * so events without subscribers are not delivered to the script engine
+ */
+function publishSubscriptions()
+  {
+  var topics = [],
+      m;
+  for (m in messages)
+    {
+    if ( messages.hasOwnProperty(m) && hasKeys(messages[m]) )
+      {
+      topics.push(m);
+      }
+    }
+  if ( typeof OvmsEvents === 'object' && typeof OvmsEvents.Subscriptions === 'function' )
+    {
+    OvmsEvents.Subscriptions(topics);
+    }
+  }
+
 function callSubscriberWithImmediateExceptions( subscriber, message, data )
   {
   subscriber( message, data );
@@ -138,6 +159,7 @@ exports.subscribe = function( message, func )
   // and allow for easy use as key names for the 'messages' object
   var token = 'uid_' + String(++lastUid);
   messages[message][token] = func;
+  publishSubscriptions();
 
   // return token for unsubscribing
   return token;
@@ -152,6 +174,7 @@ exports.subscribe = function( message, func )
 exports.clearAllSubscriptions = function clearAllSubscriptions()
   {
   messages = {};
+  publishSubscriptions();
   };
 
 /**
@@ -170,6 +193,7 @@ exports.clearSubscriptions = function clearSubscriptions(topic)
       delete messages[m];
       }
     }
+  publishSubscriptions();
   };
 
 /**
@@ -248,5 +272,8 @@ exports.unsubscribe = function(value)
       }
     }
 
+  publishSubscriptions();
   return result;
   };
+
+publishSubscriptions();
@@ -37,7 +37,10 @@ static const char *TAG = "script";
 #include <string.h>
 #include <stdio.h>
 #include <dirent.h>
+#include <unistd.h>
+#include <sys/stat.h>
 #include <esp_task_wdt.h>
+#include "esp_timer.h"
 #include "ovms_malloc.h"
 #include "ovms_module.h"
 #include "ovms_script.h"
@@ -48,6 +51,7 @@ static const char *TAG = "script";
 #include "buffered_shell.h"
 #include "ovms_netmanager.h"
 #include "ovms_tls.h"
+#include "ovms_version.h"
 
 OvmsScripts MyScripts __attribute__ ((init_priority (1600)));
 
@@ -324,7 +328,8 @@ static duk_int_t duk__eval_module_source(duk_context *ctx, void *udata)
 	/* [ ... module source func_src ] */
 
 	(void) duk_get_prop_string(ctx, -3, "filename");
-	duk_compile(ctx, DUK_COMPILE_EVAL);
+	if (MyScripts.DuktapeCompile(ctx, duk_get_string(ctx, -1)) != DUK_EXEC_SUCCESS)
+		(void) duk_throw(ctx);
 	duk_call(ctx, 0);
 
 	/* [ ... module source func ] */
@@ -648,6 +653,25 @@ static duk_ret_t DukOvmsRaiseEvent(duk_context *ctx)
   return 0;  /* no return value */
   }
 
+static duk_ret_t DukOvmsEventSubscriptions(duk_context *ctx)
+  {
+  // Called by the PubSub module on subscription changes with the
+  // array of topics currently having subscribers:
+  std::set<std::string> topics;
+  if (duk_is_array(ctx, 0))
+    {
+    duk_size_t len = duk_get_length(ctx, 0);
+    for (duk_size_t i = 0; i < len; i++)
+      {
+      duk_get_prop_index(ctx, 0, i);
+      topics.insert(duk_to_string(ctx, -1));
+      duk_pop(ctx);
+      }
+    }
+  MyScripts.DuktapeSetSubscriptions(topics);
+  return 0;  /* no return value */
+  }
+
 static duk_ret_t DukOvmsConfigParams(duk_context *ctx)
   {
   if (!MyConfig.ismounted()) return 0;
@@ -1920,8 +1944,11 @@ void DuktapeVFSSave::Save()
     }
   else
     {
+    // copy path, the callback may free this object:
+    std::string path = m_path;
     m_error = "";
     RequestCallback("done");
+    MyEvents.SignalEvent("system.vfs.file.changed", (void*)path.c_str(), path.size()+1);
     }
   }
 
@@ -2109,12 +2136,105 @@ void OvmsScripts::DuktapeReload()
   DuktapeDispatchWait(&dmsg);
   }
 
-void OvmsScripts::DuktapeCompact()
+void OvmsScripts::DuktapeCompact(bool wait /*=true*/)
   {
   duktape_queue_t dmsg;
   memset(&dmsg, 0, sizeof(dmsg));
   dmsg.type = DUKTAPE_compact;
-  DuktapeDispatchWait(&dmsg);
+  if (wait)
+    DuktapeDispatchWait(&dmsg);
+  else
+    DuktapeDispatch(&dmsg);
+  }
+
+#define DUKTAPE_EVENT_QUEUE_MAX   (CONFIG_OVMS_SC_JAVASCRIPT_DUKTAPE_QUEUE_SIZE / 2)
+
+void OvmsScripts::DuktapeSetSubscriptions(const std::set<std::string>& topics)
+  {
+  OvmsMutexLock lock(&m_dukevents_mutex);
+  m_dukevents_topics = topics;
+  m_dukevents_known = true;
+  }
+
+bool OvmsScripts::DuktapeIsSubscribed(const std::string& event)
+  {
+  // Match the event and its parent topics, as PubSub.publish() does:
+  OvmsMutexLock lock(&m_dukevents_mutex);
+  if (!m_dukevents_known) return true;
+  if (m_dukevents_topics.empty()) return false;
+  if (m_dukevents_topics.count(event)) return true;
+  for (size_t pos = event.rfind('.'); pos != std::string::npos && pos > 0; pos = event.rfind('.', pos-1))
+    {
+    if (m_dukevents_topics.count(event.substr(0, pos)))
+      return true;
+    }
+  return false;
+  }
+
+void OvmsScripts::DuktapeQueueEvent(const std::string& event)
+  {
+  if (m_duktaskqueue == NULL) return;
+  if (!DuktapeIsSubscribed(event))
+    {
+    m_dukevents_skipped++;
+    return;
+    }
+
+  bool coalesce = startsWith(event, "ticker.");
+  {
+  OvmsMutexLock lock(&m_dukevents_mutex);
+  if (coalesce && m_dukevents_pending.count(event))
+    {
+    m_dukevents_coalesced++;
+    return;
+    }
+  if (m_dukevents_queued >= DUKTAPE_EVENT_QUEUE_MAX)
+    {
+    m_dukevents_dropped++;
+    return;
+    }
+  m_dukevents_queued++;
+  if (coalesce) m_dukevents_pending.insert(event);
+  }
+
+  duktape_queue_t dmsg;
+  memset(&dmsg, 0, sizeof(dmsg));
+  dmsg.type = DUKTAPE_event;
+  dmsg.body.dt_event.name = strdup(event.c_str());
+  if (dmsg.body.dt_event.name == NULL || xQueueSend(m_duktaskqueue, &dmsg, 0) != pdTRUE)
+    {
+    ESP_LOGW(TAG, "Duktape: event %s dropped", event.c_str());
+    DuktapeEventDone(dmsg.body.dt_event.name ? dmsg.body.dt_event.name : event.c_str());
+    free((void*)dmsg.body.dt_event.name);
+    OvmsMutexLock lock(&m_dukevents_mutex);
+    m_dukevents_dropped++;
+    return;
+    }
+  m_dukevents_dispatched++;
+  }
+
+void OvmsScripts::DuktapeEventDone(const char* event)
+  {
+  OvmsMutexLock lock(&m_dukevents_mutex);
+  if (m_dukevents_queued > 0) m_dukevents_queued--;
+  m_dukevents_pending.erase(event);
+  }
+
+void OvmsScripts::DuktapeEventStatus(OvmsWriter* writer)
+  {
+  OvmsMutexLock lock(&m_dukevents_mutex);
+  writer->printf("JS event delivery: %u dispatched, %u skipped (no subscriber), "
+    "%u coalesced, %u dropped, %d queued\n",
+    m_dukevents_dispatched, m_dukevents_skipped, m_dukevents_coalesced,
+    m_dukevents_dropped, m_dukevents_queued);
+  if (!m_dukevents_known)
+    {
+    writer->puts("JS event subscriptions: unknown (delivering all events)");
+    return;
+    }
+  writer->printf("JS event subscriptions: %d topics\n", m_dukevents_topics.size());
+  for (auto it = m_dukevents_topics.begin(); it != m_dukevents_topics.end(); it++)
+    writer->printf("  %s\n", it->c_str());
   }
 
 void OvmsScripts::DuktapeRequestCallback(DuktapeObject* instance, const char* method, void* data)
@@ -2245,6 +2365,11 @@ void OvmsScripts::DukTapeTask()
             duk_destroy_heap(m_dukctx);
             m_dukctx = NULL;
             }
+          {
+          OvmsMutexLock lock(&m_dukevents_mutex);
+          m_dukevents_topics.clear();
+          m_dukevents_known = false;
+          }
           DukTapeInit();
           }
           break;
@@ -2276,6 +2401,8 @@ void OvmsScripts::DukTapeTask()
               }
             duk_pop_2(m_dukctx);
             }
+          DuktapeEventDone(msg.body.dt_event.name);
+          free((void*)msg.body.dt_event.name);
           }
           break;
         case DUKTAPE_autoinit:
@@ -2292,7 +2419,7 @@ void OvmsScripts::DukTapeTask()
             if (!filename) filename = "eval";
             duk_push_string(m_dukctx, msg.body.dt_evalnoresult.text);
             duk_push_string(m_dukctx, filename);
-            if (duk_pcompile(m_dukctx, DUK_COMPILE_EVAL) != 0 || duk_pcall(m_dukctx, 0) != 0)
+            if (DuktapeCompile(m_dukctx, msg.body.dt_evalnoresult.filename) != 0 || duk_pcall(m_dukctx, 0) != 0)
               {
               DukOvmsErrorHandler(m_dukctx, -1, msg.writer, filename);
               }
@@ -2311,7 +2438,8 @@ void OvmsScripts::DukTapeTask()
             {
             // Execute script text (float result)
             duk_push_string(m_dukctx, msg.body.dt_evalfloatresult.text);
-            if (duk_peval(m_dukctx) != 0)
+            duk_push_string(m_dukctx, "eval");
+            if (DuktapeCompile(m_dukctx) != 0 || duk_pcall(m_dukctx, 0) != 0)
               {
               DukOvmsErrorHandler(m_dukctx, -1, msg.writer);
               *msg.body.dt_evalfloatresult.result = 0;
@@ -2336,7 +2464,8 @@ void OvmsScripts::DukTapeTask()
             {
             // Execute script text (int result)
             duk_push_string(m_dukctx, msg.body.dt_evalintresult.text);
-            if (duk_peval(m_dukctx) != 0)
+            duk_push_string(m_dukctx, "eval");
+            if (DuktapeCompile(m_dukctx) != 0 || duk_pcall(m_dukctx, 0) != 0)
               {
               DukOvmsErrorHandler(m_dukctx, -1, msg.writer);
               *msg.body.dt_evalintresult.result = 0;
@@ -2395,6 +2524,11 @@ static void script_compact(int verbosity, OvmsWriter* writer, OvmsCommand* cmd,
   MyScripts.DuktapeCompact();
   }
 
+static void script_status(int verbosity, OvmsWriter* writer, OvmsCommand* cmd, int argc, const char* const* argv)
+  {
+  MyScripts.DuktapeCacheStatus(writer);
+  }
+
 #endif // #ifdef CONFIG_OVMS_SC_JAVASCRIPT_DUKTAPE
 
 static void script_ovms(bool print, int verbosity, OvmsWriter* writer,
@@ -2485,11 +2619,18 @@ static void script_run(int verbosity, OvmsWriter* writer, OvmsCommand* cmd, int
     path.c_str(), sf, writer->IsSecure());
   }
 
+static void script_events(int verbosity, OvmsWriter* writer, OvmsCommand* cmd, int argc, const char* const* argv)
+  {
+  MyScripts.EventScriptIndexStatus(writer);
+#ifdef CONFIG_OVMS_SC_JAVASCRIPT_DUKTAPE
+  MyScripts.DuktapeEventStatus(writer);
+#endif // #ifdef CONFIG_OVMS_SC_JAVASCRIPT_DUKTAPE
+  }
+
 void OvmsScripts::AllScripts(std::string path)
   {
   DIR *dir;
   struct dirent *dp;
-  FILE *sf;
   std::set<std::string> files;
 
   // read dir, sort scripts by name:
@@ -2508,59 +2649,560 @@ void OvmsScripts::AllScripts(std::string path)
   // execute scripts:
   for (auto it = files.begin(); it != files.end(); it++)
     {
-    std::string fpath = *it;
-    sf = fopen(fpath.c_str(), "r");
-    if (sf)
+    RunScript(*it);
+    }
+  }
+
+void OvmsScripts::RunScript(const std::string& fpath)
+  {
+  FILE *sf = fopen(fpath.c_str(), "r");
+  if (sf)
+    {
+    ESP_LOGI(TAG, "Running script %s", fpath.c_str());
+    script_ovms(false, COMMAND_RESULT_MINIMAL, NULL, fpath.c_str(), sf, true);
+    // script_ovms() closes sf
+    }
+  }
+
+/**
+ * Event script index:
+ *  EventScript() is called for every event signalled, including the high
+ *  frequency tickers and vehicle events. To avoid an opendir/readdir on
+ *  the FAT filesystem per event, we keep an index of the events having
+ *  scripts. It's built on the first event, and rebuilt on the next event
+ *  after an invalidation (file changes in an events directory, SD mount
+ *  state change). As not all file writers signal changes (e.g. network
+ *  downloads, SD card edited on a PC), the index is also rebuilt once
+ *  per minute.
+ */
+
+static bool script_path_overlaps(const char* path, const char* dir)
+  {
+  // true if path is dir, inside dir, or a parent of dir:
+  size_t plen = strlen(path), dlen = strlen(dir);
+  while (plen > 1 && path[plen-1] == '/') plen--;
+  size_t n = (plen < dlen) ? plen : dlen;
+  if (strncmp(path, dir, n) != 0)
+    return false;
+  if (plen == dlen)
+    return true;
+  else if (plen > dlen)
+    return (path[dlen] == '/');
+  else
+    return (dir[plen] == '/' || plen == 1);
+  }
+
+void OvmsScripts::EventScriptIndexInvalidate(const char* path /*=NULL*/)
+  {
+  if (path
+#ifdef CONFIG_OVMS_DEV_SDCARDSCRIPTS
+    && !script_path_overlaps(path, "/sd/events")
+#endif // #ifdef CONFIG_OVMS_DEV_SDCARDSCRIPTS
+    && !script_path_overlaps(path, "/store/events"))
+    return;
+  m_evindex_generation++;
+  }
+
+void OvmsScripts::EventScriptIndexScan(const char* basepath)
+  {
+  DIR *dir, *subdir;
+  struct dirent *dp, *sdp;
+
+  if ((dir = opendir(basepath)) == NULL)
+    return;
+  while ((dp = readdir(dir)) != NULL)
+    {
+    std::string evpath = basepath;
+    evpath.append("/");
+    evpath.append(dp->d_name);
+    if ((subdir = opendir(evpath.c_str())) == NULL)
+      continue;
+    std::set<std::string> files;
+    while ((sdp = readdir(subdir)) != NULL)
+      {
+      std::string fpath = evpath;
+      fpath.append("/");
+      fpath.append(sdp->d_name);
+      files.insert(fpath);
+      }
+    closedir(subdir);
+    if (!files.empty())
       {
-      ESP_LOGI(TAG, "Running script %s", fpath.c_str());
-      script_ovms(false, COMMAND_RESULT_MINIMAL, NULL, fpath.c_str(), sf, true);
-      // script_ovms() closes sf
+      std::vector<std::string>& scripts = m_evindex[dp->d_name];
+      scripts.insert(scripts.end(), files.begin(), files.end());
       }
     }
+  closedir(dir);
   }
 
-void OvmsScripts::EventScript(std::string event, void* data)
+bool OvmsScripts::EventScriptIndexLookup(const std::string& event, std::vector<std::string>& scripts)
   {
-  std::string path;
+  OvmsMutexLock lock(&m_evindex_mutex);
+
+  unsigned int generation = m_evindex_generation;
+  if (m_evindex_built != generation)
+    {
+    m_evindex_misses++;
+    m_evindex.clear();
+#ifdef CONFIG_OVMS_DEV_SDCARDSCRIPTS
+    EventScriptIndexScan("/sd/events");
+#endif // #ifdef CONFIG_OVMS_DEV_SDCARDSCRIPTS
+    EventScriptIndexScan("/store/events");
+    m_evindex_built = generation;
+    ESP_LOGD(TAG, "Event script index rebuilt: %d events with scripts", m_evindex.size());
+    }
+  else
+    {
+    m_evindex_hits++;
+    }
+
+  auto it = m_evindex.find(event);
+  if (it == m_evindex.end())
+    {
+    m_evindex_skipped++;
+    return false;
+    }
+  scripts = it->second;
+  return true;
+  }
+
+void OvmsScripts::EventScriptIndexStatus(OvmsWriter* writer)
+  {
+  OvmsMutexLock lock(&m_evindex_mutex);
+
+  writer->printf("Event script index: %s\n",
+    (m_evindex_built == m_evindex_generation) ? "valid" : "invalid (rebuild on next event)");
+  writer->printf("  Lookups: %u hits, %u misses (rebuilds), %u without scripts\n",
+    m_evindex_hits, m_evindex_misses, m_evindex_skipped);
+  for (auto it = m_evindex.begin(); it != m_evindex.end(); it++)
+    {
+    writer->printf("  %s:\n", it->first.c_str());
+    for (auto sit = it->second.begin(); sit != it->second.end(); sit++)
+      writer->printf("    %s\n", sit->c_str());
+    }
+  }
 
 #ifdef CONFIG_OVMS_SC_JAVASCRIPT_DUKTAPE
-  // dispatch event to PubSub component:
-  duktape_queue_t dmsg;
-  memset(&dmsg, 0, sizeof(dmsg));
-  dmsg.type = DUKTAPE_event;
-  dmsg.body.dt_event.name = event.c_str();
-  dmsg.body.dt_event.data = data;
-  DuktapeDispatchWait(&dmsg);
+
+/**
+ * Bytecode cache:
+ *  Duktape needs about 10-20 times longer to compile a function from source
+ *  than to load the bytecode dump of the compiled function. Script files,
+ *  event scripts, modules and evals (e.g. the obd2ecu metric scripts) are
+ *  compiled from source on every execution, so DuktapeCompile() keeps the
+ *  dumps of all functions compiled.
+ *  Entries are keyed by the script path and validated by the source size and
+ *  hash. The hash replaces the file mtime, as FAT mtimes only have a two
+ *  second resolution and evals have no file. Hashing the source costs ~1%
+ *  of the compilation. Evals are keyed by the hash, so their entries keep
+ *  the source to exclude collisions (evals are short).
+ *  Note: the disk store is trusted like the scripts themselves, Duktape
+ *  does not validate the bytecode loaded.
+ */
+
+#define DUKTAPE_BCCACHE_DIR     "/store/.jscache"
+#define DUKTAPE_BCCACHE_MAGIC   0x43424a4f  // "OJBC"
+
+typedef struct
+  {
+  uint32_t magic;
+  uint32_t srcsize;
+  uint32_t srchash;
+  uint32_t compile_us;
+  uint32_t bcsize;
+  uint16_t keylen;
+  uint16_t buildlen;
+  // followed by key, build & bytecode
+  } duktape_bccache_header_t;
+
+static uint32_t script_hash(const char* data, size_t len)
+  {
+  // FNV-1a
+  uint32_t hash = 2166136261u;
+  for (size_t i = 0; i < len; i++)
+    {
+    hash ^= (uint8_t)data[i];
+    hash *= 16777619u;
+    }
+  return hash;
+  }
+
+static bool script_cache_anonymous(const std::string& key)
+  {
+  return (key.compare(0, 5, "eval:") == 0);
+  }
+
+static std::string script_cache_file(const std::string& key)
+  {
+  char name[20];
+  snprintf(name, sizeof(name), "/%08x.bc", script_hash(key.data(), key.size()));
+  return std::string(DUKTAPE_BCCACHE_DIR) + name;
+  }
+
+static bool script_cache_affected(const std::string& key, const char* path)
+  {
+  // module keys are filenames relative to the scripts directories:
+  if (key[0] == '/')
+    return script_path_overlaps(key.c_str(), path);
+  else if (script_cache_anonymous(key))
+    return false;
+  else
+    return script_path_overlaps((std::string("/store/scripts/") + key).c_str(), path)
+      || script_path_overlaps((std::string("/sd/scripts/") + key).c_str(), path);
+  }
+
+static duk_ret_t script_bytecode_dump(duk_context *ctx, void *udata)
+  {
+  duk_dump_function(ctx);
+  return 1;
+  }
+
+static duk_ret_t script_bytecode_load(duk_context *ctx, void *udata)
+  {
+  duk_load_function(ctx);
+  return 1;
+  }
+
+duk_int_t OvmsScripts::DuktapeCompile(duk_context *ctx, const char* key /*=NULL*/)
+  {
+  // Stack: [ ... source filename ] => [ ... function ] or [ ... error ]
+  duk_size_t srclen;
+  const char* src = duk_get_lstring(ctx, -2, &srclen);
+  if (m_cfg_bccache_size <= 0 || src == NULL)
+    return duk_pcompile(ctx, DUK_COMPILE_EVAL);
+
+  uint32_t srchash = script_hash(src, srclen);
+  std::string ckey;
+  if (key)
+    {
+    ckey = key;
+    }
+  else
+    {
+    char buf[20];
+    snprintf(buf, sizeof(buf), "eval:%08x", srchash);
+    ckey = buf;
+    }
+
+  // Try to load from cache:
+  uint32_t compile_us = 0;
+  int64_t start = esp_timer_get_time();
+  DuktapeBytecode bytecode = DuktapeCacheLookup(ckey, src, srclen, srchash, &compile_us);
+  if (bytecode)
+    {
+    // the loader copies the bytecode, so we can refer to the cache buffer:
+    duk_push_external_buffer(ctx);
+    duk_config_buffer(ctx, -1, (void*)bytecode->data(), bytecode->size());
+    if (duk_safe_call(ctx, script_bytecode_load, NULL, 1, 1) == DUK_EXEC_SUCCESS)
+      {
+      duk_remove(ctx, -2);  // filename
+      duk_remove(ctx, -2);  // source
+      uint32_t load_us = esp_timer_get_time() - start;
+      OvmsMutexLock lock(&m_bccache_mutex);
+      m_bccache_load_us += load_us;
+      if (compile_us > load_us)
+        m_bccache_saved_us += compile_us - load_us;
+      return DUK_EXEC_SUCCESS;
+      }
+    ESP_LOGW(TAG, "DuktapeCompile: invalid bytecode for '%s': %s",
+      ckey.c_str(), duk_safe_to_string(ctx, -1));
+    duk_pop(ctx);
+    DuktapeCacheInvalidate(ckey.c_str());
+    }
+
+  // Compile from source:
+  start = esp_timer_get_time();
+  duk_int_t res = duk_pcompile(ctx, DUK_COMPILE_EVAL);
+  compile_us = esp_timer_get_time() - start;
+  {
+  OvmsMutexLock lock(&m_bccache_mutex);
+  m_bccache_misses++;
+  m_bccache_compile_us += compile_us;
+  }
+  if (res != DUK_EXEC_SUCCESS)
+    return res;
+
+  // Add to cache:
+  duk_dup(ctx, -1);
+  if (duk_safe_call(ctx, script_bytecode_dump, NULL, 1, 1) == DUK_EXEC_SUCCESS)
+    {
+    duk_size_t size;
+    const char* data = (const char*) duk_get_buffer_data(ctx, -1, &size);
+    bytecode = std::make_shared<const extram::string>(data, size);
+    DuktapeCacheStore(ckey, src, srclen, srchash, compile_us, bytecode, true);
+    }
+  duk_pop(ctx);
+  return DUK_EXEC_SUCCESS;
+  }
+
+DuktapeBytecode OvmsScripts::DuktapeCacheLookup(const std::string& key, const char* src, uint32_t srcsize,
+  uint32_t srchash, uint32_t* compile_us)
+  {
+  bool anonymous = script_cache_anonymous(key);
+  {
+  OvmsMutexLock lock(&m_bccache_mutex);
+  auto it = m_bccache_index.find(key);
+  if (it != m_bccache_index.end())
+    {
+    DuktapeBytecodeList::iterator entry = it->second;
+    // anonymous code is keyed by the source hash only, so verify the source:
+    if (entry->srcsize == srcsize && entry->srchash == srchash &&
+        (!anonymous || entry->source.compare(0, entry->source.size(), src, srcsize) == 0))
+      {
+      // move to front (most recently used):
+      m_bccache.splice(m_bccache.begin(), m_bccache, entry);
+      m_bccache_hits++;
+      *compile_us = entry->compile_us;
+      return entry->bytecode;
+      }
+    // source changed without a file change event:
+    DuktapeCacheDrop(entry, false);
+    m_bccache_invalidations++;
+    }
+  }
+
+  if (m_cfg_bccache_disk && !anonymous)
+    {
+    DuktapeBytecode bytecode = DuktapeCacheDiskLoad(key, srcsize, srchash, compile_us);
+    if (bytecode)
+      {
+      DuktapeCacheStore(key, src, srcsize, srchash, *compile_us, bytecode, false);
+      OvmsMutexLock lock(&m_bccache_mutex);
+      m_bccache_diskhits++;
+      return bytecode;
+      }
+    }
+
+  return DuktapeBytecode();
+  }
+
+void OvmsScripts::DuktapeCacheStore(const std::string& key, const char* src, uint32_t srcsize,
+  uint32_t srchash, uint32_t compile_us, DuktapeBytecode bytecode, bool disk)
+  {
+  duktape_bytecode_entry_t entry = { key, srcsize, srchash, compile_us, bytecode };
+  if (script_cache_anonymous(key))
+    entry.source.assign(src, srcsize);
+  else if (disk && m_cfg_bccache_disk)
+    DuktapeCacheDiskSave(entry);
+
+  size_t limit = (size_t) m_cfg_bccache_size * 1024;
+  size_t size = bytecode->size() + entry.source.size();
+  if (size > limit)
+    return;
+
+  OvmsMutexLock lock(&m_bccache_mutex);
+  auto it = m_bccache_index.find(key);
+  if (it != m_bccache_index.end())
+    DuktapeCacheDrop(it->second, false);
+  m_bccache.push_front(std::move(entry));
+  m_bccache_index[key] = m_bccache.begin();
+  m_bccache_bytes += size;
+
+  // evict least recently used entries:
+  while (m_bccache_bytes > limit)
+    {
+    DuktapeCacheDrop(std::prev(m_bccache.end()), false);
+    m_bccache_evictions++;
+    }
+  }
+
+void OvmsScripts::DuktapeCacheDrop(DuktapeBytecodeList::iterator it, bool disk)
+  {
+  // Note: caller needs to hold m_bccache_mutex
+  if (disk && m_cfg_bccache_disk && !script_cache_anonymous(it->key))
+    unlink(script_cache_file(it->key).c_str());
+  m_bccache_bytes -= it->bytecode->size() + it->source.size();
+  m_bccache_index.erase(it->key);
+  m_bccache.erase(it);
+  }
+
+void OvmsScripts::DuktapeCacheInvalidate(const char* path)
+  {
+  OvmsMutexLock lock(&m_bccache_mutex);
+  for (auto it = m_bccache.begin(); it != m_bccache.end(); )
+    {
+    auto entry = it++;
+    if (entry->key == path || script_cache_affected(entry->key, path))
+      {
+      DuktapeCacheDrop(entry, true);
+      m_bccache_invalidations++;
+      }
+    }
+  }
+
+DuktapeBytecode OvmsScripts::DuktapeCacheDiskLoad(const std::string& key, uint32_t srcsize, uint32_t srchash,
+  uint32_t* compile_us)
+  {
+  if (m_bccache_build.empty())
+    m_bccache_build = GetOVMSVersion() + " " + GetOVMSBuild() + " duktape " + STR(DUK_VERSION);
+
+  FILE* f = fopen(script_cache_file(key).c_str(), "r");
+  if (f == NULL)
+    return DuktapeBytecode();
+
+  duktape_bccache_header_t hdr;
+  std::string id;
+  extram::string* bytecode = NULL;
+  if (fread(&hdr, sizeof(hdr), 1, f) == 1
+    && hdr.magic == DUKTAPE_BCCACHE_MAGIC
+    && hdr.srcsize == srcsize && hdr.srchash == srchash
+    && hdr.keylen == key.size() && hdr.buildlen == m_bccache_build.size())
+    {
+    id.resize(hdr.keylen + hdr.buildlen);
+    if (fread(&id[0], id.size(), 1, f) == 1
+      && id.compare(0, hdr.keylen, key) == 0
+      && id.compare(hdr.keylen, hdr.buildlen, m_bccache_build) == 0)
+      {
+      bytecode = new extram::string(hdr.bcsize, '\0');
+      if (fread(&(*bytecode)[0], hdr.bcsize, 1, f) == 1)
+        {
+        *compile_us = hdr.compile_us;
+        }
+      else
+        {
+        delete bytecode;
+        bytecode = NULL;
+        }
+      }
+    }
+  fclose(f);
+
+  return DuktapeBytecode(bytecode);
+  }
+
+void OvmsScripts::DuktapeCacheDiskSave(const duktape_bytecode_entry_t& entry)
+  {
+  if (m_bccache_build.empty())
+    m_bccache_build = GetOVMSVersion() + " " + GetOVMSBuild() + " duktape " + STR(DUK_VERSION);
+
+  std::string path = script_cache_file(entry.key);
+  mkdir(DUKTAPE_BCCACHE_DIR, 0);
+  FILE* f = fopen(path.c_str(), "w");
+  if (f == NULL)
+    {
+    ESP_LOGW(TAG, "DuktapeCacheDiskSave: cannot write %s", path.c_str());
+    return;
+    }
+
+  duktape_bccache_header_t hdr;
+  hdr.magic = DUKTAPE_BCCACHE_MAGIC;
+  hdr.srcsize = entry.srcsize;
+  hdr.srchash = entry.srchash;
+  hdr.compile_us = entry.compile_us;
+  hdr.bcsize = entry.bytecode->size();
+  hdr.keylen = entry.key.size();
+  hdr.buildlen = m_bccache_build.size();
+  bool ok = fwrite(&hdr, sizeof(hdr), 1, f) == 1
+    && fwrite(entry.key.data(), entry.key.size(), 1, f) == 1
+    && fwrite(m_bccache_build.data(), m_bccache_build.size(), 1, f) == 1
+    && fwrite(entry.bytecode->data(), entry.bytecode->size(), 1, f) == 1;
+  if (fclose(f) != 0 || !ok)
+    {
+    ESP_LOGW(TAG, "DuktapeCacheDiskSave: write error on %s", path.c_str());
+    unlink(path.c_str());
+    }
+  }
+
+void OvmsScripts::DuktapeCacheStatus(OvmsWriter* writer)
+  {
+  OvmsMutexLock lock(&m_bccache_mutex);
+
+  int limit = m_cfg_bccache_size;
+  if (limit <= 0)
+    {
+    writer->puts("Bytecode cache: disabled");
+    return;
+    }
+  writer->printf("Bytecode cache: %u entries, %.1f of %d kB, disk store %s\n",
+    m_bccache.size(), (float)m_bccache_bytes / 1024, limit,
+    m_cfg_bccache_disk ? "enabled (" DUKTAPE_BCCACHE_DIR ")" : "disabled");
+  writer->printf("  Compilations: %u from memory, %u from disk, %u from source\n",
+    m_bccache_hits, m_bccache_diskhits, m_bccache_misses);
+  writer->printf("  Entries dropped: %u evicted, %u invalidated\n",
+    m_bccache_evictions, m_bccache_invalidations);
+  writer->printf("  Compile time: %.1f ms spent, %.1f ms saved (bytecode loading: %.1f ms)\n",
+    (float)m_bccache_compile_us / 1000, (float)m_bccache_saved_us / 1000,
+    (float)m_bccache_load_us / 1000);
+  for (auto it = m_bccache.begin(); it != m_bccache.end(); it++)
+    {
+    writer->printf("  %s: %u bytes, compiles in %.1f ms\n",
+      it->key.c_str(), it->bytecode->size() + it->source.size(), (float)it->compile_us / 1000);
+    }
+  }
+
+#endif // #ifdef CONFIG_OVMS_SC_JAVASCRIPT_DUKTAPE
+
+void OvmsScripts::EventScript(event_id_t id, const std::string& event, void* data)
+  {
+  std::vector<std::string> scripts;
+
+#ifdef CONFIG_OVMS_SC_JAVASCRIPT_DUKTAPE
+  // dispatch event to PubSub component (if subscribed):
+  DuktapeQueueEvent(event);
 #endif // #ifdef CONFIG_OVMS_SC_JAVASCRIPT_DUKTAPE
 
+  // maintain event script index:
+  if (event == "system.vfs.file.changed")
+    {
+    EventScriptIndexInvalidate((const char*)data);
+#ifdef CONFIG_OVMS_SC_JAVASCRIPT_DUKTAPE
+    DuktapeCacheInvalidate((const char*)data);
+#endif // #ifdef CONFIG_OVMS_SC_JAVASCRIPT_DUKTAPE
+    }
+  else if (id == EVENT_ID_TICKER_60)
+    EventScriptIndexInvalidate();
 #ifdef CONFIG_OVMS_DEV_SDCARDSCRIPTS
-  // run event scripts on external storage:
-  path=std::string("/sd/events/");
-  path.append(event);
-  AllScripts(path);
+  else if (event == "sd.mounted" || event == "sd.unmounted")
+    EventScriptIndexInvalidate();
 #endif // #ifdef CONFIG_OVMS_DEV_SDCARDSCRIPTS
 
-  // run event scripts on internal storage:
-  path=std::string("/store/events/");
-  path.append(event);
-  AllScripts(path);
+  // run event scripts (external storage first, then internal):
+  if (EventScriptIndexLookup(event, scripts))
+    {
+    for (auto it = scripts.begin(); it != scripts.end(); it++)
+      RunScript(*it);
+    }
 
 #ifdef CONFIG_OVMS_SC_JAVASCRIPT_DUKTAPE
-  if (event == "ticker.60")
+  if (id == EVENT_ID_TICKER_60)
     {
     // do garbage collection once per minute:
-    DuktapeCompact();
+    DuktapeCompact(false);
     }
 #endif // CONFIG_OVMS_SC_JAVASCRIPT_DUKTAPE
   }
 
 OvmsScripts::OvmsScripts()
+#ifdef CONFIG_OVMS_SC_JAVASCRIPT_DUKTAPE
+  : m_cfg_bccache_size("module", "script.cache.size", 256),
+    m_cfg_bccache_disk("module", "script.cache.disk", false)
+#endif // CONFIG_OVMS_SC_JAVASCRIPT_DUKTAPE
   {
   ESP_LOGI(TAG, "Initialising SCRIPTS (1600)");
+  m_evindex_generation = 1;
+  m_evindex_built = 0;
+  m_evindex_hits = 0;
+  m_evindex_misses = 0;
+  m_evindex_skipped = 0;
 #ifdef CONFIG_OVMS_SC_JAVASCRIPT_DUKTAPE
   m_dukctx = NULL;
   m_duktaskid = NULL;
   m_duktaskqueue = NULL;
+  m_dukevents_known = false;
+  m_dukevents_queued = 0;
+  m_dukevents_dispatched = 0;
+  m_dukevents_skipped = 0;
+  m_dukevents_coalesced = 0;
+  m_dukevents_dropped = 0;
+  m_bccache_bytes = 0;
+  m_bccache_hits = 0;
+  m_bccache_diskhits = 0;
+  m_bccache_misses = 0;
+  m_bccache_evictions = 0;
+  m_bccache_invalidations = 0;
+  m_bccache_compile_us = 0;
+  m_bccache_load_us = 0;
+  m_bccache_saved_us = 0;
 #endif // CONFIG_OVMS_SC_JAVASCRIPT_DUKTAPE
 
 #ifdef CONFIG_OVMS_SC_JAVASCRIPT_NONE
@@ -2587,6 +3229,7 @@ OvmsScripts::OvmsScripts()
   RegisterDuktapeObject(dto);
   dto = new DuktapeObjectRegistration("OvmsEvents");
   dto->RegisterDuktapeFunction(DukOvmsRaiseEvent, 2, "Raise");
+  dto->RegisterDuktapeFunction(DukOvmsEventSubscriptions, 1, "Subscriptions");
   RegisterDuktapeObject(dto);
   dto = new DuktapeObjectRegistration("OvmsConfig");
   dto->RegisterDuktapeFunction(DukOvmsConfigParams, 0, "Params");
@@ -2616,10 +3259,12 @@ OvmsScripts::OvmsScripts()
 
   OvmsCommand* cmd_script = MyCommandApp.RegisterCommand("script","SCRIPT framework");
   cmd_script->RegisterCommand("run","Run a script",script_run,"<path>",1,1);
+  cmd_script->RegisterCommand("events","Show event script index & JS event delivery status",script_events);
 #ifdef CONFIG_OVMS_SC_JAVASCRIPT_DUKTAPE
   cmd_script->RegisterCommand("reload","Reload javascript framework",script_reload);
   cmd_script->RegisterCommand("eval","Eval some javascript code",script_eval,"<code>",1,1);
   cmd_script->RegisterCommand("compact","Compact javascript heap",script_compact);
+  cmd_script->RegisterCommand("status","Show javascript bytecode cache status",script_status);
 #endif // #ifdef CONFIG_OVMS_SC_JAVASCRIPT_DUKTAPE
   MyCommandApp.RegisterCommand(".","Run a script",script_run,"<path>",1,1);
   }
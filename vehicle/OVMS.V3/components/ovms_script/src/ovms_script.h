@@ -31,8 +31,14 @@
 #ifndef __SCRIPT_H__
 #define __SCRIPT_H__
 
+#include <map>
+#include <vector>
+#include <set>
+#include <atomic>
 #include "ovms_command.h"
 #include "ovms_utils.h"
+#include "ovms_mutex.h"
+#include "ovms_events.h"
 #include "freertos/FreeRTOS.h"
 #include "freertos/task.h"
 #include "freertos/queue.h"
@@ -41,7 +47,9 @@
 #ifdef CONFIG_OVMS_SC_JAVASCRIPT_DUKTAPE
 #include "duktape.h"
 #include <list>
+#include <memory>
 #include <utility>
+#include "ovms_config.h"
 
 /**
  * DukContext: C++ wrapper for duk_context
@@ -105,6 +113,28 @@ typedef struct
 
 typedef std::map<const char*, duktape_registermodule_t*, CmpStrOp> DuktapeModuleMap;
 
+/**
+ * Bytecode cache entry: compiled function dump of a script source, keyed by
+ * the script path (module filename, or "eval:<hash>" for anonymous code),
+ * validated by source size & hash. Anonymous entries also keep the source,
+ * as the key hash may collide. The bytecode is shared, so a lookup can
+ * release the cache lock before loading it into the heap.
+ */
+typedef std::shared_ptr<const extram::string> DuktapeBytecode;
+
+typedef struct
+  {
+  std::string key;
+  uint32_t srcsize;
+  uint32_t srchash;
+  uint32_t compile_us;                  // time needed to compile the source
+  DuktapeBytecode bytecode;
+  extram::string source;                // anonymous code: source (empty for files)
+  } duktape_bytecode_entry_t;
+
+typedef std::list<duktape_bytecode_entry_t> DuktapeBytecodeList;    // LRU order, front = newest
+typedef std::map<std::string, DuktapeBytecodeList::iterator> DuktapeBytecodeMap;
+
 class DuktapeObjectRegistration
   {
   public:
@@ -320,8 +350,28 @@ class OvmsScripts
     ~OvmsScripts();
 
   public:
-    void EventScript(std::string event, void* data);
+    void EventScript(event_id_t id, const std::string& event, void* data);
     void AllScripts(std::string path);
+    void RunScript(const std::string& fpath);
+
+  public:
+    // Event script index: event name => script paths (ordered as executed)
+    typedef std::map<std::string, std::vector<std::string>> EventScriptIndex;
+    void EventScriptIndexInvalidate(const char* path=NULL);
+    void EventScriptIndexStatus(OvmsWriter* writer);
+
+  protected:
+    bool EventScriptIndexLookup(const std::string& event, std::vector<std::string>& scripts);
+    void EventScriptIndexScan(const char* basepath);
+
+  protected:
+    OvmsMutex m_evindex_mutex;
+    EventScriptIndex m_evindex;
+    std::atomic_uint m_evindex_generation;          // incremented on invalidation
+    unsigned int m_evindex_built;                   // generation of current index
+    uint32_t m_evindex_hits;                        // lookups served from index
+    uint32_t m_evindex_misses;                      // lookups needing a rebuild
+    uint32_t m_evindex_skipped;                     // events without scripts
 
 #ifdef CONFIG_OVMS_SC_JAVASCRIPT_DUKTAPE
   public:
@@ -340,9 +390,41 @@ class OvmsScripts
     float DuktapeEvalFloatResult(const char* text, OvmsWriter* writer=NULL);
     int   DuktapeEvalIntResult(const char* text, OvmsWriter* writer=NULL);
     void  DuktapeReload();
-    void  DuktapeCompact();
+    void  DuktapeCompact(bool wait=true);
     void  DuktapeRequestCallback(DuktapeObject* instance, const char* method, void* data);
 
+  public:
+    // Event delivery to the PubSub module: the module publishes its topic
+    // subscriptions, events without subscribers are not dispatched, others
+    // are queued without waiting for completion.
+    void DuktapeSetSubscriptions(const std::set<std::string>& topics);
+    bool DuktapeIsSubscribed(const std::string& event);
+    void DuktapeEventStatus(OvmsWriter* writer);
+
+  protected:
+    void DuktapeQueueEvent(const std::string& event);
+    void DuktapeEventDone(const char* event);
+
+  public:
+    // Bytecode cache: DuktapeCompile() replaces duk_pcompile(ctx, DUK_COMPILE_EVAL)
+    // for script files, modules & evals, loading the function from the cache
+    // if the source is unchanged. Entries live in SPIRAM (LRU, limited by
+    // config module script.cache.size [KB]) and optionally in /store/.jscache
+    // (module script.cache.disk). VFS file changes drop the entries affected.
+    duk_int_t DuktapeCompile(duk_context *ctx, const char* key=NULL);
+    void DuktapeCacheInvalidate(const char* path=NULL);
+    void DuktapeCacheStatus(OvmsWriter* writer);
+
+  protected:
+    DuktapeBytecode DuktapeCacheLookup(const std::string& key, const char* src, uint32_t srcsize,
+      uint32_t srchash, uint32_t* compile_us);
+    void DuktapeCacheStore(const std::string& key, const char* src, uint32_t srcsize,
+      uint32_t srchash, uint32_t compile_us, DuktapeBytecode bytecode, bool disk);
+    void DuktapeCacheDrop(DuktapeBytecodeList::iterator it, bool disk);
+    DuktapeBytecode DuktapeCacheDiskLoad(const std::string& key, uint32_t srcsize, uint32_t srchash,
+      uint32_t* compile_us);
+    void DuktapeCacheDiskSave(const duktape_bytecode_entry_t& entry);
+
   public:
     void DukTapeInit();
     void DukTapeTask();
@@ -355,6 +437,34 @@ class OvmsScripts
     DuktapeFunctionMap m_fnmap;
     DuktapeModuleMap m_modmap;
     DuktapeObjectMap m_obmap;
+
+  protected:
+    OvmsMutex m_dukevents_mutex;
+    std::set<std::string> m_dukevents_topics;       // subscribed PubSub topics
+    bool m_dukevents_known;                         // false = topics unknown, dispatch all
+    std::set<std::string> m_dukevents_pending;      // coalescing events in queue
+    int m_dukevents_queued;                         // events in queue
+    uint32_t m_dukevents_dispatched;                // events queued for delivery
+    uint32_t m_dukevents_skipped;                   // events without subscribers
+    uint32_t m_dukevents_coalesced;                 // ticker events already pending
+    uint32_t m_dukevents_dropped;                   // events dropped (queue full)
+
+  protected:
+    OvmsMutex m_bccache_mutex;
+    DuktapeBytecodeList m_bccache;
+    DuktapeBytecodeMap m_bccache_index;
+    size_t m_bccache_bytes;                         // bytecode size of all entries
+    uint32_t m_bccache_hits;                        // compilations served from memory
+    uint32_t m_bccache_diskhits;                    // compilations served from disk
+    uint32_t m_bccache_misses;                      // compilations from source
+    uint32_t m_bccache_evictions;                   // entries dropped for size limit
+    uint32_t m_bccache_invalidations;               // entries dropped for file changes
+    uint64_t m_bccache_compile_us;                  // time spent compiling (misses)
+    uint64_t m_bccache_load_us;                     // time spent loading bytecode (hits)
+    uint64_t m_bccache_saved_us;                    // compile time saved by hits
+    std::string m_bccache_build;                    // firmware build (disk cache validity)
+    OvmsConfigInt m_cfg_bccache_size;
+    OvmsConfigBool m_cfg_bccache_disk;
 #endif // #ifdef CONFIG_OVMS_SC_JAVASCRIPT_DUKTAPE
   };
 
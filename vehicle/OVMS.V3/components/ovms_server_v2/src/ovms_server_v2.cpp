@@ -47,6 +47,7 @@ static const char *TAG = "ovms-server-v2";
 #include "ovms_utils.h"
 #include "ovms_boot.h"
 #include "ovms_tls.h"
+#include "esp_timer.h"
 
 // should this go in the .h or in the .cpp?
 typedef union {
@@ -153,6 +154,65 @@ static struct
   { "vehicle",   "timezone" }              // 23 PARAM_TIMEZONE
   };
 
+/**
+ * OvmsServerV2Discard: discard cipher stream bytes (RC4-drop)
+ */
+static void OvmsServerV2Discard(RC4_CTX1* ctx1, RC4_CTX2* ctx2, int count)
+  {
+  uint8_t zero[64];
+  while (count > 0)
+    {
+    int n = (count < (int)sizeof(zero)) ? count : sizeof(zero);
+    memset(zero, 0, n);
+    RC4_crypt(ctx1, ctx2, zero, n);
+    count -= n;
+    }
+  }
+
+/**
+ * OvmsServerV2Encode: encrypt & encode a protocol message, append line to out
+ *  - paranoid: encrypt message part using a copy of the paranoid cipher state
+ *    prepared on login (the paranoid key & discard are the same for every message)
+ *  - work: reusable buffer (paranoid data & message)
+ */
+static void OvmsServerV2Encode(const std::string& message, bool paranoid,
+  RC4_CTX1* tx1, RC4_CTX2* tx2, const RC4_CTX1* pcrypto1, const RC4_CTX2* pcrypto2,
+  std::string& work, std::string& out)
+  {
+  char* s;
+  int len = message.length();
+
+  if (paranoid)
+    {
+    // Convert MP-0 X... into MP-0 EMX<base64 paranoid encrypted ...>
+    int dlen = len - 6;
+    len = 8 + 4*((dlen+2)/3);
+    work.resize(dlen + len + 1);
+    uint8_t* d = (uint8_t*) &work[0];
+    s = &work[dlen];
+    memcpy(d, message.data()+6, dlen);
+    RC4_CTX1 pm_crypto1 = *pcrypto1;
+    RC4_CTX2 pm_crypto2 = *pcrypto2;
+    RC4_crypt(&pm_crypto1, &pm_crypto2, d, dlen);
+    memcpy(s, "MP-0 EM", 7);
+    s[7] = message[5];
+    base64encode(d, dlen, (uint8_t*)s+8);
+    }
+  else
+    {
+    work.assign(message);
+    s = &work[0];
+    }
+
+  RC4_crypt(tx1, tx2, (uint8_t*)s, len);
+
+  size_t pos = out.size();
+  out.resize(pos + 4*((len+2)/3) + 1);
+  char* end = base64encode((uint8_t*)s, len, (uint8_t*)&out[pos]);
+  out.resize(end - out.data());
+  out.append("\r\n");
+  }
+
 OvmsServerV2 *MyOvmsServerV2 = NULL;
 size_t MyOvmsServerV2Modifier = 0;
 size_t MyOvmsServerV2Reader = 0;
@@ -266,17 +326,9 @@ void OvmsServerV2::ProcessServerMsg()
     ESP_LOGI(TAG, "Shared secret key is %s (%d bytes)",key.c_str(),key.length());
     hmac_md5((uint8_t*)key.c_str(), key.length(), (uint8_t*)m_password.c_str(), m_password.length(), sdigest);
     RC4_setup(&m_crypto_rx1, &m_crypto_rx2, sdigest, OVMS_MD5_SIZE);
-    for (int k=0;k<1024;k++)
-      {
-      uint8_t v = 0;
-      RC4_crypt(&m_crypto_rx1, &m_crypto_rx2, &v, 1);
-      }
+    OvmsServerV2Discard(&m_crypto_rx1, &m_crypto_rx2, 1024);
     RC4_setup(&m_crypto_tx1, &m_crypto_tx2, sdigest, OVMS_MD5_SIZE);
-    for (int k=0;k<1024;k++)
-      {
-      uint8_t v = 0;
-      RC4_crypt(&m_crypto_tx1, &m_crypto_tx2, &v, 1);
-      }
+    OvmsServerV2Discard(&m_crypto_tx1, &m_crypto_tx2, 1024);
 
     if (m_paranoid)
       {
@@ -296,11 +348,13 @@ void OvmsServerV2::ProcessServerMsg()
       std::string msg("MP-0 ET");
       msg.append(m_ptoken);
       Transmit(msg);
-      m_ptoken_ready = true;
 
-      // Generate, and store, the digest for future use
+      // Generate, and store, the digest and the prepared cipher state for future use
       std::string modpass = MyConfig.GetParamValue("password","module");
       hmac_md5((uint8_t*) token, OVMS_PROTOCOL_V2_TOKENSIZE, (uint8_t*)modpass.c_str(), modpass.length(), m_pdigest);
+      RC4_setup(&m_pcrypto1, &m_pcrypto2, m_pdigest, OVMS_MD5_SIZE);
+      OvmsServerV2Discard(&m_pcrypto1, &m_pcrypto2, 1024);
+      m_ptoken_ready = true;
       }
 
     m_pending_notify_info = true;
@@ -345,15 +399,9 @@ void OvmsServerV2::ProcessServerMsg()
     uint8_t *d = new uint8_t[line.length()-6];
     len = base64decode(line.c_str()+7,d+1);
 
-    RC4_CTX1* pm_crypto1 = new RC4_CTX1;
-    RC4_CTX2* pm_crypto2 = new RC4_CTX2;
-    RC4_setup(pm_crypto1, pm_crypto2, m_pdigest, OVMS_MD5_SIZE);
-    for (int k=0;k<1024;k++)
-      {
-      uint8_t zero = 0;
-      RC4_crypt(pm_crypto1, pm_crypto2, &zero, 1);
-      }
-    RC4_crypt(pm_crypto1, pm_crypto2, d, len);
+    RC4_CTX1 pm_crypto1 = m_pcrypto1;
+    RC4_CTX2 pm_crypto2 = m_pcrypto2;
+    RC4_crypt(&pm_crypto1, &pm_crypto2, d, len);
 
     line.erase(5);
     line = std::string("MP-0 ");
@@ -361,9 +409,7 @@ void OvmsServerV2::ProcessServerMsg()
     line.append((char*)d);
     len = line.length();
 
-    delete pm_crypto1;
-    delete pm_crypto2;
-    delete d;
+    delete [] d;
     ESP_LOGI(TAG, "Decoded Paranoid Msg: %s",line.c_str());
     }
 
@@ -727,54 +773,57 @@ void OvmsServerV2::Transmit(const std::string& message)
   if (!m_mgconn)
     return;
 
-  int len = message.length();
-  char* s = new char[(len*2)+4];
-  memcpy(s,message.c_str(),len);
   ESP_LOGI(TAG, "Send %s",message.c_str());
 
-  if ((m_ptoken_ready)&&
-      (s[5] != 'E')&&
-      (s[5] != 'A')&&
-      (s[5] != 'a')&&
-      (s[5] != 'g')&&
-      (s[5] != 'P'))
-    {
-    // We must convert the message to a paranoid one...
-    // The message is of the form MP-0 X...
-    // Where X is the code and ... is the (optional) data
-    char code[2]; code[0] = s[5]; code[1] = 0;
-    uint8_t* d = new uint8_t[len-6];
-    memcpy(d,s+6,len-6);
-
-    // Paranoid encrypt the message part of the transaction
-    RC4_CTX1* pm_crypto1 = new RC4_CTX1;
-    RC4_CTX2* pm_crypto2 = new RC4_CTX2;
-    RC4_setup(pm_crypto1, pm_crypto2, m_pdigest, OVMS_MD5_SIZE);
-    for (int k=0;k<1024;k++)
-      {
-      uint8_t zero = 0;
-      RC4_crypt(pm_crypto1, pm_crypto2, &zero, 1);
-      }
-    RC4_crypt(pm_crypto1, pm_crypto2, d, len-6);
-
-    strcpy(s,"MP-0 EM");
-    strcat(s,code);
-    base64encode(d, len-6, (uint8_t*)s+8);
-    // The messdage is now in paranoid mode...
-    delete d;
-    delete pm_crypto1;
-    delete pm_crypto2;
-    }
+  // The message is of the form MP-0 X...
+  // Where X is the code and ... is the (optional) data
+  char code = (message.length() > 5) ? message[5] : 0;
+  bool paranoid = ((m_ptoken_ready)&&
+                   (code != 0)&&
+                   (code != 'E')&&
+                   (code != 'A')&&
+                   (code != 'a')&&
+                   (code != 'g')&&
+                   (code != 'P'));
+
+  OvmsServerV2Encode(message, paranoid, &m_crypto_tx1, &m_crypto_tx2,
+    &m_pcrypto1, &m_pcrypto2, m_txwork, m_txbuf);
+
+  if (!m_txbatch || m_txbuf.size() >= OVMS_PROTOCOL_V2_TXBATCH_SIZE)
+    TransmitFlush();
+  }
 
-  RC4_crypt(&m_crypto_tx1, &m_crypto_tx2, (uint8_t*)s, len);
+/**
+ * TransmitFlush: send collected lines
+ *  - Note: caller needs to hold m_mgconn_mutex
+ */
+void OvmsServerV2::TransmitFlush()
+  {
+  if (m_mgconn && !m_txbuf.empty())
+    mg_send(m_mgconn, m_txbuf.data(), m_txbuf.size());
+  m_txbuf.clear();
+
+  // Release buffers grown by large messages (e.g. notifications):
+  if (m_txbuf.capacity() > OVMS_PROTOCOL_V2_TXBATCH_SIZE*2)
+    std::string().swap(m_txbuf);
+  if (m_txwork.capacity() > OVMS_PROTOCOL_V2_TXBATCH_SIZE*2)
+    std::string().swap(m_txwork);
+  }
 
-  char* buf = new char[(len*2)+4];
-  base64encode((uint8_t*)s, len, (uint8_t*)buf);
-  strcat(buf,"\r\n");
-  mg_send(m_mgconn, buf, strlen(buf));
+/**
+ * TransmitBatchStart/End: collect messages sent in between for a single mg_send()
+ */
+void OvmsServerV2::TransmitBatchStart()
+  {
+  OvmsMutexLock mg(&m_mgconn_mutex);
+  m_txbatch = true;
+  }
 
-  delete [] buf;
-  delete [] s;
+void OvmsServerV2::TransmitBatchEnd()
+  {
+  OvmsMutexLock mg(&m_mgconn_mutex);
+  m_txbatch = false;
+  TransmitFlush();
   }
 
 void OvmsServerV2::SetStatus(const char* status, bool fault, State newstate)
@@ -884,6 +933,7 @@ void OvmsServerV2::Disconnect()
     m_mgconn = NULL;
     }
   m_buffer->EmptyAll();
+  m_txbuf.clear();
   m_connretry = 0;
   StandardMetrics.ms_s_v2_connected->SetValue(false);
   StandardMetrics.ms_s_v2_peers->SetValue(0);
@@ -898,6 +948,7 @@ void OvmsServerV2::Reconnect(int connretry)
     m_mgconn = NULL;
     }
   m_buffer->EmptyAll();
+  m_txbuf.clear();
   m_connretry = connretry;
   StandardMetrics.ms_s_v2_connected->SetValue(false);
   StandardMetrics.ms_s_v2_peers->SetValue(0);
@@ -1720,7 +1771,7 @@ void OvmsServerV2::NetmanStop(std::string event, void* data)
     }
   }
 
-void OvmsServerV2::Ticker1(std::string event, void* data)
+void OvmsServerV2::Ticker1(event_id_t id, const char* event, void* data)
   {
   if (m_connretry > 0)
     {
@@ -1744,13 +1795,16 @@ void OvmsServerV2::Ticker1(std::string event, void* data)
   if (StandardMetrics.ms_s_v2_connected->AsBool())
     {
     // check for issue #241 condition:
-    if (esp_log_timestamp() - m_lastrx_time > MyConfig.GetParamValueInt("server.v2", "timeout.rx", 960) * 1000)
+    if (esp_log_timestamp() - m_lastrx_time > m_cfg_timeout_rx * 1000)
       {
       ESP_LOGW(TAG, "Detected stale connection (issue #241), restarting network");
       MyNetManager.RestartNetwork();
       return;
       }
 
+    // Collect all messages of this tick for a single mg_send():
+    TransmitBatchStart();
+
     // Periodic transmission of metrics
     bool caron = StandardMetrics.ms_v_env_on->AsBool();
     int now = StandardMetrics.ms_m_monotonic->AsInt();
@@ -1795,11 +1849,13 @@ void OvmsServerV2::Ticker1(std::string event, void* data)
       m_pending_notify_data_last = 0;
       TransmitNotifyData();
       }
+
+    TransmitBatchEnd();
     }
   }
 
 OvmsServerV2::OvmsServerV2(const char* name)
-  : OvmsServer(name)
+  : OvmsServer(name), m_cfg_timeout_rx("server.v2", "timeout.rx", 960)
   {
   if (MyOvmsServerV2Modifier == 0)
     {
@@ -1824,6 +1880,8 @@ OvmsServerV2::OvmsServerV2(const char* name)
   m_peers = 0;
   m_connretry = 0;
   m_mgconn = NULL;
+  m_ptoken_ready = false;
+  m_txbatch = false;
 
   m_pending_notify_info = false;
   m_pending_notify_error = false;
@@ -1842,6 +1900,7 @@ OvmsServerV2::OvmsServerV2(const char* name)
   #undef bind  // Kludgy, but works
   using std::placeholders::_1;
   using std::placeholders::_2;
+  using std::placeholders::_3;
   MyMetrics.RegisterListener(TAG, "*", std::bind(&OvmsServerV2::MetricModified, this, _1));
 
   if (MyOvmsServerV2Reader == 0)
@@ -1861,7 +1920,7 @@ OvmsServerV2::OvmsServerV2(const char* name)
   MyEvents.RegisterEvent(TAG,"network.reconfigured", std::bind(&OvmsServerV2::NetReconfigured, this, _1, _2));
   MyEvents.RegisterEvent(TAG,"network.mgr.init", std::bind(&OvmsServerV2::NetmanInit, this, _1, _2));
   MyEvents.RegisterEvent(TAG,"network.mgr.stop", std::bind(&OvmsServerV2::NetmanStop, this, _1, _2));
-  MyEvents.RegisterEvent(TAG,"ticker.1", std::bind(&OvmsServerV2::Ticker1, this, _1, _2));
+  MyEvents.RegisterEvent(TAG, EVENT_ID_TICKER_1, std::bind(&OvmsServerV2::Ticker1, this, _1, _2, _3));
   MyEvents.RegisterEvent(TAG,"system.modem.received.ussd", std::bind(&OvmsServerV2::EventListener, this, _1, _2));
   MyEvents.RegisterEvent(TAG,"config.changed", std::bind(&OvmsServerV2::EventListener, this, _1, _2));
   MyEvents.RegisterEvent(TAG,"config.mounted", std::bind(&OvmsServerV2::EventListener, this, _1, _2));
@@ -1965,6 +2024,64 @@ void ovmsv2_status(int verbosity, OvmsWriter* writer, OvmsCommand* cmd, int argc
     }
   }
 
+void ovmsv2_benchmark(int verbosity, OvmsWriter* writer, OvmsCommand* cmd, int argc, const char* const* argv)
+  {
+  int count = (argc > 0) ? atoi(argv[0]) : 1000;
+  if (count < 1)
+    {
+    writer->puts("Error: invalid message count");
+    return;
+    }
+
+  // Session & paranoid ciphers with random keys, independent of a running connection:
+  uint8_t key[OVMS_MD5_SIZE], pkey[OVMS_MD5_SIZE];
+  for (int k=0;k<OVMS_MD5_SIZE;k++)
+    {
+    key[k] = esp_random();
+    pkey[k] = esp_random();
+    }
+  RC4_CTX1 tx1, pm1;
+  RC4_CTX2 tx2, pm2;
+  RC4_setup(&tx1, &tx2, key, OVMS_MD5_SIZE);
+  OvmsServerV2Discard(&tx1, &tx2, 1024);
+  RC4_setup(&pm1, &pm2, pkey, OVMS_MD5_SIZE);
+  OvmsServerV2Discard(&pm1, &pm2, 1024);
+
+  // Typical status message:
+  std::string msg("MP-0 S82,K,230,16,charging,standard,312,287,32,3547,4,35,4,2,0,0,"
+    "0,0,0,14.2,1,0,0,0,42,0,0,0,0,95.3,12.8,22,0,0,0,-1,-1,-1,0,0.0,0.0");
+  std::string work, out;
+  int64_t time_us[3];
+  size_t bytes[3] = { 0, 0, 0 };
+
+  for (int mode = 0; mode < 3; mode++)
+    {
+    int64_t start = esp_timer_get_time();
+    for (int i = 0; i < count; i++)
+      {
+      if (mode == 2)
+        {
+        // former per message paranoid key setup:
+        RC4_setup(&pm1, &pm2, pkey, OVMS_MD5_SIZE);
+        OvmsServerV2Discard(&pm1, &pm2, 1024);
+        }
+      OvmsServerV2Encode(msg, (mode > 0), &tx1, &tx2, &pm1, &pm2, work, out);
+      bytes[mode] += out.size();
+      out.clear();
+      }
+    time_us[mode] = esp_timer_get_time() - start;
+    }
+
+  static const char* modes[3] = { "plain", "paranoid", "paranoid, key setup per message" };
+  writer->printf("%d messages of %u bytes:\n", count, (unsigned) msg.length());
+  for (int mode = 0; mode < 3; mode++)
+    {
+    writer->printf("  %-32s %8.0f msg/s, %6.1f us/msg, %u bytes/msg\n", modes[mode],
+      (time_us[mode] > 0) ? (double)count * 1000000 / time_us[mode] : 0.0,
+      (double)time_us[mode] / count, (unsigned) (bytes[mode] / count));
+    }
+  }
+
 OvmsServerV2Init MyOvmsServerV2Init  __attribute__ ((init_priority (6100)));
 
 OvmsServerV2Init::OvmsServerV2Init()
@@ -1976,6 +2093,7 @@ OvmsServerV2Init::OvmsServerV2Init()
   cmd_v2->RegisterCommand("start","Start an OVMS V2 Server Connection",ovmsv2_start);
   cmd_v2->RegisterCommand("stop","Stop an OVMS V2 Server Connection",ovmsv2_stop);
   cmd_v2->RegisterCommand("status","Show OVMS V2 Server connection status",ovmsv2_status);
+  cmd_v2->RegisterCommand("benchmark","Benchmark message encoding (plain & paranoid mode)",ovmsv2_benchmark,"[<messages>]", 0, 1);
 
   MyConfig.RegisterParam("server.v2", "V2 Server Configuration", true, true);
   // Our instances:
@@ -37,6 +37,8 @@
 #include <iomanip>
 #include <sys/time.h>
 #include "ovms_server.h"
+#include "ovms_config.h"
+#include "ovms_events.h"
 #include "ovms_netmanager.h"
 #include "ovms_buffer.h"
 #include "crypt_rc4.h"
@@ -46,6 +48,7 @@
 #include "ovms_mutex.h"
 
 #define OVMS_PROTOCOL_V2_TOKENSIZE 22
+#define OVMS_PROTOCOL_V2_TXBATCH_SIZE 2048   // max bytes collected for one mg_send()
 
 class OvmsServerV2 : public OvmsServer
   {
@@ -65,6 +68,9 @@ class OvmsServerV2 : public OvmsServer
     void ProcessServerMsg();
     void ProcessCommand(const char* payload);
     void Transmit(const std::string& message);
+    void TransmitFlush();
+    void TransmitBatchStart();
+    void TransmitBatchEnd();
 
   protected:
     void TransmitMsgStat(bool always = false);
@@ -93,7 +99,7 @@ class OvmsServerV2 : public OvmsServer
     void NetReconfigured(std::string event, void* data);
     void NetmanInit(std::string event, void* data);
     void NetmanStop(std::string event, void* data);
-    void Ticker1(std::string event, void* data);
+    void Ticker1(event_id_t id, const char* event, void* data);
 
   public:
     enum State
@@ -134,9 +140,15 @@ class OvmsServerV2 : public OvmsServer
 
     bool m_paranoid;
     uint8_t m_pdigest[OVMS_MD5_SIZE];
+    RC4_CTX1 m_pcrypto1;              // paranoid mode cipher state after key setup & discard
+    RC4_CTX2 m_pcrypto2;
     std::string m_ptoken;
     bool m_ptoken_ready;
 
+    std::string m_txwork;             // reusable transmit encoding buffers
+    std::string m_txbuf;
+    bool m_txbatch;
+
     bool m_now_stat;
     bool m_now_gps;
     bool m_now_tpms;
@@ -148,6 +160,7 @@ class OvmsServerV2 : public OvmsServer
     int m_streaming;
     int m_updatetime_idle;
     int m_updatetime_connected;
+    OvmsConfigInt m_cfg_timeout_rx;
 
     uint32_t m_lastrx_time = 0;
     int m_lasttx = 0;
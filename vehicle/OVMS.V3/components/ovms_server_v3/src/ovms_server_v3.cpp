@@ -33,12 +33,14 @@ static const char *TAG = "ovms-server-v3";
 
 #include <string.h>
 #include <stdint.h>
+#include <math.h>
 #include "ovms_server_v3.h"
 #include "buffered_shell.h"
 #include "ovms_command.h"
 #include "ovms_metrics.h"
 #include "metrics_standard.h"
 #include "ovms_tls.h"
+#include "ovms_utils.h"
 
 OvmsServerV3 *MyOvmsServerV3 = NULL;
 size_t MyOvmsServerV3Modifier = 0;
@@ -60,6 +62,56 @@ bool OvmsServerV3ReaderFilterCallback(OvmsNotifyType* type, const char* subtype)
     return false;
   }
 
+/**
+ * OvmsServerV3MatchPattern: match metric name against pattern with
+ *  '*' (any sequence) and '?' (any single character) wildcards
+ */
+static bool OvmsServerV3MatchPattern(const char* pattern, const char* name)
+  {
+  const char* star = NULL;
+  const char* resume = NULL;
+  while (*name)
+    {
+    if (*pattern == '*')
+      {
+      star = pattern++;
+      resume = name;
+      }
+    else if (*pattern == '?' || *pattern == *name)
+      {
+      pattern++;
+      name++;
+      }
+    else if (star)
+      {
+      pattern = star + 1;
+      name = ++resume;
+      }
+    else
+      return false;
+    }
+  while (*pattern == '*') pattern++;
+  return (*pattern == 0);
+  }
+
+/**
+ * OvmsServerV3FindRule: find best matching rule for a metric
+ *  - an exact name match wins, else the longest matching pattern
+ */
+static const OvmsServerV3MetricRule* OvmsServerV3FindRule(const OvmsServerV3MetricRules& rules, const char* name)
+  {
+  const OvmsServerV3MetricRule* best = NULL;
+  for (const OvmsServerV3MetricRule& rule : rules)
+    {
+    if (rule.pattern == name)
+      return &rule;
+    if ((!best || rule.pattern.length() > best->pattern.length()) &&
+        OvmsServerV3MatchPattern(rule.pattern.c_str(), name))
+      best = &rule;
+    }
+  return best;
+  }
+
 static void OvmsServerV3MongooseCallback(struct mg_connection *nc, int ev, void *p)
   {
   struct mg_mqtt_message *msg = (struct mg_mqtt_message *) p;
@@ -184,6 +236,7 @@ OvmsServerV3::OvmsServerV3(const char* name)
   if (MyOvmsServerV3Modifier == 0)
     {
     MyOvmsServerV3Modifier = MyMetrics.RegisterModifier();
+    MyMetrics.RegisterJournal(MyOvmsServerV3Modifier);
     ESP_LOGI(TAG, "OVMS Server V3 registered metric modifier is #%d",MyOvmsServerV3Modifier);
     }
 
@@ -204,12 +257,21 @@ OvmsServerV3::OvmsServerV3(const char* name)
   m_notify_data_waitcomp = 0;
   m_notify_data_waittype = NULL;
   m_notify_data_waitentry = NULL;
+  m_metrics_held = false;
+  m_bulk = false;
+  m_bulk_count = 0;
+  m_stat_metrics = 0;
+  m_stat_messages = 0;
+  m_stat_bytes = 0;
+  m_stat_held = 0;
+  m_stat_suppressed = 0;
 
   ESP_LOGI(TAG, "OVMS Server v3 running");
 
   #undef bind  // Kludgy, but works
   using std::placeholders::_1;
   using std::placeholders::_2;
+  using std::placeholders::_3;
   MyMetrics.RegisterListener(TAG, "*", std::bind(&OvmsServerV3::MetricModified, this, _1));
 
   if (MyOvmsServerV3Reader == 0)
@@ -229,8 +291,8 @@ OvmsServerV3::OvmsServerV3(const char* name)
   MyEvents.RegisterEvent(TAG,"network.reconfigured", std::bind(&OvmsServerV3::NetReconfigured, this, _1, _2));
   MyEvents.RegisterEvent(TAG,"network.mgr.init", std::bind(&OvmsServerV3::NetmanInit, this, _1, _2));
   MyEvents.RegisterEvent(TAG,"network.mgr.stop", std::bind(&OvmsServerV3::NetmanStop, this, _1, _2));
-  MyEvents.RegisterEvent(TAG,"ticker.1", std::bind(&OvmsServerV3::Ticker1, this, _1, _2));
-  MyEvents.RegisterEvent(TAG,"ticker.60", std::bind(&OvmsServerV3::Ticker60, this, _1, _2));
+  MyEvents.RegisterEvent(TAG, EVENT_ID_TICKER_1, std::bind(&OvmsServerV3::Ticker1, this, _1, _2, _3));
+  MyEvents.RegisterEvent(TAG, EVENT_ID_TICKER_60, std::bind(&OvmsServerV3::Ticker60, this, _1, _2, _3));
   MyEvents.RegisterEvent(TAG,"system.modem.received.ussd", std::bind(&OvmsServerV3::EventListener, this, _1, _2));
   MyEvents.RegisterEvent(TAG,"config.changed", std::bind(&OvmsServerV3::EventListener, this, _1, _2));
   MyEvents.RegisterEvent(TAG,"config.mounted", std::bind(&OvmsServerV3::EventListener, this, _1, _2));
@@ -259,13 +321,15 @@ void OvmsServerV3::TransmitAllMetrics()
   if (!m_mgconn)
     return;
 
+  // Full transmission: send per metric retained topics, ignoring rules
   OvmsMetric* metric = MyMetrics.m_first;
   while (metric != NULL)
     {
     metric->ClearModified(MyOvmsServerV3Modifier);
-    TransmitMetric(metric);
+    TransmitMetric(metric, true);
     metric = metric->m_next;
     }
+  m_metrics_held = false;
   }
 
 void OvmsServerV3::TransmitModifiedMetrics()
@@ -274,35 +338,182 @@ void OvmsServerV3::TransmitModifiedMetrics()
   if (!m_mgconn)
     return;
 
-  OvmsMetric* metric = MyMetrics.m_first;
-  while (metric != NULL)
+  OvmsMetric* metric;
+  while ((metric = MyMetrics.NextModified(MyOvmsServerV3Modifier)) != NULL)
     {
-    if (metric->IsModifiedAndClear(MyOvmsServerV3Modifier))
-      {
+    TransmitMetric(metric);
+    }
+  TransmitBulk();
+  }
+
+/**
+ * TransmitHeldMetrics: retry transmission of changes held back by an
+ *  interval or deadband rule (iterating the metrics list, as metrics
+ *  may have been deleted since they were held)
+ */
+void OvmsServerV3::TransmitHeldMetrics()
+  {
+  OvmsMutexLock mg(&m_mgconn_mutex);
+  if (!m_mgconn)
+    return;
+
+  m_metrics_held = false;
+  for (OvmsMetric* metric = MyMetrics.m_first; metric != NULL; metric = metric->m_next)
+    {
+    auto it = m_metrics.find(metric);
+    if (it != m_metrics.end() && it->second.pending && it->second.name == metric->m_name)
       TransmitMetric(metric);
+    }
+  TransmitBulk();
+  }
+
+/**
+ * ReadMetricRules: read deadband & interval rules from config
+ *  - deadband: "metric.deadband.<pattern>" = <value> or <percent>%
+ *  - interval: "metric.interval.<pattern>" = <seconds>
+ */
+void OvmsServerV3::ReadMetricRules()
+  {
+  m_deadband_rules.clear();
+  m_interval_rules.clear();
+  const ConfigParamMap* map = MyConfig.GetParamMap("server.v3");
+  if (!map)
+    return;
+  for (auto& kv : *map)
+    {
+    OvmsServerV3MetricRule rule;
+    char* end;
+    rule.value = strtof(kv.second.c_str(), &end);
+    rule.relative = (*end == '%');
+    if (rule.relative)
+      rule.value /= 100;
+    if (rule.value <= 0)
+      continue;
+    if (startsWith(kv.first, "metric.deadband."))
+      {
+      rule.pattern = kv.first.substr(16);
+      m_deadband_rules.push_back(rule);
+      }
+    else if (startsWith(kv.first, "metric.interval."))
+      {
+      rule.pattern = kv.first.substr(16);
+      rule.relative = false;
+      m_interval_rules.push_back(rule);
       }
-    metric = metric->m_next;
     }
   }
 
-void OvmsServerV3::TransmitMetric(OvmsMetric* metric)
+/**
+ * GetMetricState: get/create transmission state for a metric
+ *  - Note: caller needs to hold m_mgconn_mutex
+ */
+OvmsServerV3MetricState* OvmsServerV3::GetMetricState(OvmsMetric* metric)
   {
-  std::string topic(m_topic_prefix);
-  topic.append("metric/");
-  topic.append(metric->m_name);
+  auto it = m_metrics.find(metric);
+  if (it != m_metrics.end() && it->second.name == metric->m_name)
+    return &it->second;
 
+  OvmsServerV3MetricState& state = m_metrics[metric];
+  state.name = metric->m_name;
   // Replace '.' inside the metric name by '/' for MQTT like namespacing.
-  for(size_t i = m_topic_prefix.length(); i < topic.length(); i++)
+  state.topic = m_topic_prefix + "metric/" + mqtt_topic(state.name);
+  const OvmsServerV3MetricRule* rule = OvmsServerV3FindRule(m_deadband_rules, metric->m_name);
+  state.deadband = rule ? rule->value : 0;
+  state.relative = rule ? rule->relative : false;
+  rule = OvmsServerV3FindRule(m_interval_rules, metric->m_name);
+  state.interval = rule ? rule->value : 0;
+  state.value = 0;
+  state.lasttx = 0;
+  state.sent = false;
+  state.pending = false;
+  return &state;
+  }
+
+/**
+ * TransmitMetric: publish metric, or hold it back if within its interval or deadband
+ *  - force: ignore rules (full transmission)
+ *  - in bulk mode, the change is added to the bulk payload, see TransmitBulk()
+ *  - Note: caller needs to hold m_mgconn_mutex
+ */
+void OvmsServerV3::TransmitMetric(OvmsMetric* metric, bool force /*=false*/)
+  {
+  OvmsServerV3MetricState* state = GetMetricState(metric);
+
+  // Only numeric metrics return their value independent of the default:
+  float value = metric->AsFloat(0);
+  bool numeric = metric->IsDefined() && value == metric->AsFloat(1);
+
+  if (!force && state->sent)
+    {
+    uint32_t age = monotonictime - state->lasttx;
+    bool hold = false;
+    if (state->interval && age < state->interval)
+      {
+      hold = true;
+      if (!state->pending) m_stat_held++;
+      }
+    else if (state->deadband > 0 && numeric && age < (uint32_t)m_updatetime_idle)
+      {
+      // Changes within the deadband are held back for up to updatetime.idle seconds:
+      float limit = state->relative ? fabsf(state->value) * state->deadband : state->deadband;
+      if (fabsf(value - state->value) < limit)
+        {
+        hold = true;
+        if (!state->pending) m_stat_suppressed++;
+        }
+      }
+    if (hold)
+      {
+      state->pending = true;
+      m_metrics_held = true;
+      return;
+      }
+    }
+
+  state->value = value;
+  state->lasttx = monotonictime;
+  state->sent = true;
+  state->pending = false;
+  m_stat_metrics++;
+
+  if (m_bulk && !force)
     {
-      if(topic[i] == '.')
-        topic[i] = '/';
+    m_bulk_payload.append(m_bulk_payload.empty() ? "{\"" : ",\"");
+    m_bulk_payload.append(metric->m_name);
+    m_bulk_payload.append("\":");
+    m_bulk_payload.append(metric->AsJSON("null"));
+    m_bulk_count++;
+    if (m_bulk_payload.size() >= MQTT_BULK_MAXSIZE)
+      TransmitBulk();
+    return;
     }
 
   std::string val = metric->AsString();
 
-  mg_mqtt_publish(m_mgconn, topic.c_str(), m_msgid++,
+  mg_mqtt_publish(m_mgconn, state->topic.c_str(), m_msgid++,
     MG_MQTT_QOS(0) | MG_MQTT_RETAIN, val.c_str(), val.length());
-  ESP_LOGI(TAG,"Tx metric %s=%s",topic.c_str(),val.c_str());
+  m_stat_messages++;
+  m_stat_bytes += state->topic.length() + val.length();
+  ESP_LOGD(TAG,"Tx metric %s=%s",state->topic.c_str(),val.c_str());
+  }
+
+/**
+ * TransmitBulk: publish collected metric changes as one JSON object
+ *  - Note: caller needs to hold m_mgconn_mutex
+ */
+void OvmsServerV3::TransmitBulk()
+  {
+  if (m_bulk_payload.empty())
+    return;
+  m_bulk_payload.append("}");
+  mg_mqtt_publish(m_mgconn, m_bulk_topic.c_str(), m_msgid++,
+    MG_MQTT_QOS(0), m_bulk_payload.c_str(), m_bulk_payload.length());
+  m_stat_messages++;
+  m_stat_bytes += m_bulk_topic.length() + m_bulk_payload.length();
+  ESP_LOGD(TAG,"Tx bulk %s: %d metrics, %u bytes",
+    m_bulk_topic.c_str(), m_bulk_count, (unsigned) m_bulk_payload.length());
+  m_bulk_payload.clear();
+  m_bulk_count = 0;
   }
 
 int OvmsServerV3::TransmitNotificationInfo(OvmsNotifyEntry* entry)
@@ -635,6 +846,18 @@ void OvmsServerV3::Connect()
   m_will_topic = std::string(m_topic_prefix);
   m_will_topic.append("metric/s/v3/connected");
 
+  m_bulk_topic = std::string(m_topic_prefix);
+  m_bulk_topic.append("bulk/metric");
+
+  {
+  // metric topics depend on the prefix:
+  OvmsMutexLock mg(&m_mgconn_mutex);
+  m_metrics.clear();
+  m_bulk_payload.clear();
+  m_bulk_count = 0;
+  m_metrics_held = false;
+  }
+
   m_conn_topic[0] = std::string(m_topic_prefix);
   m_conn_topic[0].append("client/+/active");
 
@@ -740,7 +963,7 @@ void OvmsServerV3::MetricModified(OvmsMetric* metric)
   {
   if (!StandardMetrics.ms_s_v3_connected->AsBool()) return;
 
-  if (m_streaming)
+  if (m_streaming && !m_bulk)
     {
     OvmsMutexLock mg(&m_mgconn_mutex);
     if (!m_mgconn)
@@ -812,6 +1035,20 @@ void OvmsServerV3::ConfigChanged(OvmsConfigParam* param)
   m_streaming = MyConfig.GetParamValueInt("vehicle", "stream", 0);
   m_updatetime_connected = MyConfig.GetParamValueInt("server.v3", "updatetime.connected", 60);
   m_updatetime_idle = MyConfig.GetParamValueInt("server.v3", "updatetime.idle", 600);
+
+  if (param == NULL || param->GetName() == "server.v3")
+    {
+    OvmsMutexLock mg(&m_mgconn_mutex);
+    m_bulk = MyConfig.GetParamValueBool("server.v3", "metric.bulk", false);
+    ReadMetricRules();
+    m_metrics.clear();
+    m_metrics_held = false;
+    if (!m_bulk)
+      {
+      m_bulk_payload.clear();
+      m_bulk_count = 0;
+      }
+    }
   }
 
 void OvmsServerV3::NetUp(std::string event, void* data)
@@ -858,7 +1095,7 @@ void OvmsServerV3::NetmanStop(std::string event, void* data)
     }
   }
 
-void OvmsServerV3::Ticker1(std::string event, void* data)
+void OvmsServerV3::Ticker1(event_id_t id, const char* event, void* data)
   {
   if (m_connretry > 0)
     {
@@ -908,13 +1145,16 @@ void OvmsServerV3::Ticker1(std::string event, void* data)
       }
     else if (m_streaming && caron && m_peers && now > m_lasttx_stream+m_streaming)
       {
-      // TODO: transmit streaming metrics
+      // In bulk mode, streaming sends all changes since the last tick in one message:
+      if (m_bulk) TransmitModifiedMetrics();
       m_lasttx_stream = now;
       }
+
+    if (m_metrics_held) TransmitHeldMetrics();
     }
   }
 
-void OvmsServerV3::Ticker60(std::string event, void* data)
+void OvmsServerV3::Ticker60(event_id_t id, const char* event, void* data)
   {
   CountClients();
   }
@@ -990,6 +1230,12 @@ void ovmsv3_status(int verbosity, OvmsWriter* writer, OvmsCommand* cmd, int argc
         break;
       }
     writer->printf("       %s\n",MyOvmsServerV3->m_status.c_str());
+    writer->printf("Metrics: %u transmitted in %u messages, %u bytes%s\n",
+      MyOvmsServerV3->m_stat_metrics, MyOvmsServerV3->m_stat_messages,
+      MyOvmsServerV3->m_stat_bytes, MyOvmsServerV3->m_bulk ? " (bulk mode)" : "");
+    writer->printf("         %u held by interval, %u held by deadband, %u rule(s)\n",
+      MyOvmsServerV3->m_stat_held, MyOvmsServerV3->m_stat_suppressed,
+      (unsigned) (MyOvmsServerV3->m_deadband_rules.size() + MyOvmsServerV3->m_interval_rules.size()));
     }
   }
 
@@ -1007,13 +1253,17 @@ OvmsServerV3Init::OvmsServerV3Init()
 
   using std::placeholders::_1;
   using std::placeholders::_2;
-  MyEvents.RegisterEvent(TAG, "*", std::bind(&OvmsServerV3Init::EventListener, this, _1, _2));
+  using std::placeholders::_3;
+  MyEvents.RegisterEvent(TAG, EVENT_ID_ANY, std::bind(&OvmsServerV3Init::EventListener, this, _1, _2, _3));
 
   MyConfig.RegisterParam("server.v3", "V3 Server Configuration", true, true);
   // Our instances:
   //   'server': The server name/ip
   //   'user': The server username
   //   'port': The port to connect to (default: 1883)
+  //   'metric.deadband.<pattern>': minimum change to transmit, absolute or <n>%
+  //   'metric.interval.<pattern>': minimum seconds between transmissions
+  //   'metric.bulk': yes = send changes as one JSON object on <prefix>/bulk/metric
   // Also note:
   //  Parameter "vehicle", instance "id", is the vehicle ID
   //  Parameter "password", instance "server.v3", is the server password
@@ -1025,11 +1275,12 @@ void OvmsServerV3Init::AutoInit()
     MyOvmsServerV3 = new OvmsServerV3("oscv3");
   }
 
-void OvmsServerV3Init::EventListener(std::string event, void* data)
+void OvmsServerV3Init::EventListener(event_id_t id, const char* event, void* data)
   {
-  if (event.compare(0,7,"ticker.") == 0) return; // Skip ticker.* events
-  if (event.compare("system.event") == 0) return; // Skip event
-  if (event.compare("system.wifi.scan.done") == 0) return; // Skip event
+  // Note: called for every event, so filter without std::string copies
+  if (strncmp(event,"ticker.",7) == 0) return; // Skip ticker.* events
+  if (strcmp(event,"system.event") == 0) return; // Skip event
+  if (strcmp(event,"system.wifi.scan.done") == 0) return; // Skip event
 
   if (MyOvmsServerV3)
     {
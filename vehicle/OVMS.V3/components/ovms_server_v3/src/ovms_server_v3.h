@@ -33,16 +33,45 @@
 
 #include <string>
 #include <map>
+#include <vector>
+#include <unordered_map>
 #include "ovms_server.h"
 #include "ovms_netmanager.h"
 #include "ovms_metrics.h"
 #include "ovms_notify.h"
 #include "ovms_config.h"
+#include "ovms_events.h"
 #include "ovms_mutex.h"
 
 typedef std::map<std::string, uint32_t> OvmsServerV3ClientMap;
 
 #define MQTT_CONN_NTOPICS 2
+#define MQTT_BULK_MAXSIZE 2048
+
+// Metric transmission rule from config instance "metric.deadband.<pattern>" or
+// "metric.interval.<pattern>" (pattern may contain '*' and '?' wildcards):
+struct OvmsServerV3MetricRule
+  {
+  std::string pattern;
+  float value;                        // deadband / interval [s]
+  bool relative;                      // deadband given in percent of last value
+  };
+typedef std::vector<OvmsServerV3MetricRule> OvmsServerV3MetricRules;
+
+// Per metric transmission state:
+struct OvmsServerV3MetricState
+  {
+  std::string name;                   // guard against metric address reuse
+  std::string topic;                  // precomputed publish topic
+  float deadband;                     // 0 = transmit every change
+  bool relative;
+  uint32_t interval;                  // minimum seconds between transmissions
+  float value;                        // last transmitted value (numeric metrics)
+  uint32_t lasttx;                    // monotonictime of last transmission
+  bool sent;
+  bool pending;                       // change held back by interval / deadband
+  };
+typedef std::unordered_map<OvmsMetric*, OvmsServerV3MetricState> OvmsServerV3MetricStateMap;
 
 class OvmsServerV3 : public OvmsServer
   {
@@ -61,8 +90,8 @@ class OvmsServerV3 : public OvmsServer
     void NetReconfigured(std::string event, void* data);
     void NetmanInit(std::string event, void* data);
     void NetmanStop(std::string event, void* data);
-    void Ticker1(std::string event, void* data);
-    void Ticker60(std::string event, void* data);
+    void Ticker1(event_id_t id, const char* event, void* data);
+    void Ticker60(event_id_t id, const char* event, void* data);
 
   public:
     enum State
@@ -89,6 +118,7 @@ class OvmsServerV3 : public OvmsServer
     bool m_tls;
     std::string m_topic_prefix;
     std::string m_will_topic;
+    std::string m_bulk_topic;
     std::string m_conn_topic[MQTT_CONN_NTOPICS];
     struct mg_connection *m_mgconn;
     OvmsMutex m_mgconn_mutex;
@@ -109,6 +139,18 @@ class OvmsServerV3 : public OvmsServer
     OvmsNotifyType* m_notify_data_waittype;
     OvmsNotifyEntry* m_notify_data_waitentry;
     OvmsServerV3ClientMap m_clients;
+    OvmsServerV3MetricRules m_deadband_rules;
+    OvmsServerV3MetricRules m_interval_rules;
+    OvmsServerV3MetricStateMap m_metrics;
+    bool m_metrics_held;
+    bool m_bulk;
+    std::string m_bulk_payload;
+    int m_bulk_count;
+    uint32_t m_stat_metrics;
+    uint32_t m_stat_messages;
+    uint32_t m_stat_bytes;
+    uint32_t m_stat_held;
+    uint32_t m_stat_suppressed;
 
   public:
     virtual void SetPowerMode(PowerMode powermode);
@@ -116,6 +158,7 @@ class OvmsServerV3 : public OvmsServer
     void Disconnect();
     void TransmitAllMetrics();
     void TransmitModifiedMetrics();
+    void TransmitHeldMetrics();
     int TransmitNotificationInfo(OvmsNotifyEntry* entry);
     int TransmitNotificationError(OvmsNotifyEntry* entry);
     int TransmitNotificationAlert(OvmsNotifyEntry* entry);
@@ -133,7 +176,10 @@ class OvmsServerV3 : public OvmsServer
     void CountClients();
 
   private:
-    void TransmitMetric(OvmsMetric* metric);
+    void ReadMetricRules();
+    OvmsServerV3MetricState* GetMetricState(OvmsMetric* metric);
+    void TransmitMetric(OvmsMetric* metric, bool force=false);
+    void TransmitBulk();
   };
 
 class OvmsServerV3Init
@@ -143,7 +189,7 @@ class OvmsServerV3Init
     void AutoInit();
 
   public:
-    void EventListener(std::string event, void* data);
+    void EventListener(event_id_t id, const char* event, void* data);
   };
 
 extern OvmsServerV3Init MyOvmsServerV3Init;
@@ -38,7 +38,8 @@ static const char *TAG = "webserver";
 
 #include <string.h>
 #include <stdio.h>
-#include <fstream>
+#include <sys/stat.h>
+#include "esp_timer.h"
 #include "ovms_webserver.h"
 #include "ovms_config.h"
 #include "ovms_metrics.h"
@@ -49,6 +50,11 @@ static const char *TAG = "webserver";
 
 OvmsWebServer MyWebServer __attribute__ ((init_priority (8200)));
 
+static void webserver_status(int verbosity, OvmsWriter* writer, OvmsCommand* cmd, int argc, const char* const* argv)
+{
+  MyWebServer.Status(writer);
+}
+
 OvmsWebServer::OvmsWebServer()
 {
   ESP_LOGI(TAG, "Initialising WEBSERVER (8200)");
@@ -80,6 +86,9 @@ OvmsWebServer::OvmsWebServer()
   MyEvents.RegisterEvent(TAG, "config.mounted", std::bind(&OvmsWebServer::ConfigChanged, this, _1, _2));
   MyEvents.RegisterEvent(TAG, "*", std::bind(&OvmsWebServer::EventListener, this, _1, _2));
 
+  OvmsCommand* cmd_webserver = MyCommandApp.RegisterCommand("webserver", "Web server framework");
+  cmd_webserver->RegisterCommand("status", "Show request statistics per route & content cache status", webserver_status);
+
   // register standard framework URIs:
   RegisterPage("/", "OVMS", HandleRoot);
   RegisterPage("/assets/style.css", "style.css", HandleAsset);
@@ -312,6 +321,7 @@ const std::string OvmsWebServer::ExecuteCommand(const std::string command, int v
 void OvmsWebServer::RegisterPage(std::string uri, std::string label, PageHandler_t handler,
   PageMenu_t menu /*=PageMenu_None*/, PageAuth_t auth /*=PageAuth_None*/, int priority /*=0*/)
 {
+  OvmsRecMutexLock lock(&m_page_mutex);
   auto prev = m_pagemap.before_begin();
   for (auto it = m_pagemap.begin(); it != m_pagemap.end(); prev = it++) {
     if ((*it).uri == uri) {
@@ -325,21 +335,224 @@ void OvmsWebServer::RegisterPage(std::string uri, std::string label, PageHandler
       }
     }
   }
-  m_pagemap.insert_after(prev, PageEntry(uri, label, handler, menu, auth));
+  auto it = m_pagemap.insert_after(prev, PageEntry(uri, label, handler, menu, auth));
+  m_pageindex[uri] = &(*it);
 }
 
 void OvmsWebServer::DeregisterPage(std::string uri)
 {
+  OvmsRecMutexLock lock(&m_page_mutex);
   m_pagemap.remove_if([uri](PageEntry &e){ return (e.uri == uri); });
+  m_pageindex.erase(uri);
+}
+
+/**
+ * FindPage: URI lookup via hash index
+ *  (m_pagemap is kept in registration order for the menus)
+ * Note: pages may be (de)registered by other tasks, callers using the
+ *  PageEntry need to hold m_page_mutex (recursive, so handlers may
+ *  register pages).
+ */
+PageEntry* OvmsWebServer::FindPage(const std::string& uri)
+{
+  OvmsRecMutexLock lock(&m_page_mutex);
+  auto it = m_pageindex.find(uri);
+  if (it == m_pageindex.end())
+    return NULL;
+  return it->second;
+}
+
+void OvmsWebServer::IndexPages()
+{
+  OvmsRecMutexLock lock(&m_page_mutex);
+  m_pageindex.clear();
+  for (PageEntry& e : m_pagemap)
+    m_pageindex[e.uri] = &e;
+}
+
+
+/**
+ * Route statistics
+ */
+
+PageStats* OvmsWebServer::GetRouteStats(const std::string& route)
+{
+  OvmsMutexLock lock(&m_stats_mutex);
+  PageStats* stats = &m_stats[route];
+  if (!stats->m_time) {
+    // create metrics on first request, named by the route in dot notation:
+    std::string name;
+    for (char ch : route) {
+      if (isalnum(ch) || ch == '-' || ch == '_')
+        name += tolower(ch);
+      else if (ch == '/' && !name.empty() && name.back() != '.')
+        name += '.';
+      else if (ch == '.' && !name.empty() && name.back() != '.')
+        name += '_';
+    }
+    while (!name.empty() && name.back() == '.')
+      name.pop_back();
+    if (name.empty())
+      name = "root";
+    stats->m_time = MyMetrics.InitFloat(strdup(("m.http." + name + ".time").c_str()), SM_STALE_NONE, 0, Seconds);
+    stats->m_sent = MyMetrics.InitInt(strdup(("m.http." + name + ".sent").c_str()), SM_STALE_NONE, 0);
+  }
+  return stats;
+}
+
+void PageStats::Publish()
+{
+  if (m_time && requests)
+    m_time->SetValue((float)time_us / requests / 1000000);
+  if (m_sent)
+    m_sent->SetValue((int)bytes);
+}
+
+void OvmsWebServer::PublishConnStats(mg_connection* nc)
+{
+  auto it = m_connstats.find(nc);
+  if (it != m_connstats.end()) {
+    it->second->Publish();
+    m_connstats.erase(it);
+  }
+}
+
+void OvmsWebServer::Status(OvmsWriter* writer)
+{
+  {
+    OvmsRecMutexLock pagelock(&m_page_mutex);
+    OvmsMutexLock lock(&m_stats_mutex);
+    writer->printf("Routes: %u pages registered, %u routes requested\n",
+      m_pageindex.size(), m_stats.size());
+    if (!m_stats.empty()) {
+      writer->printf("  %-30s %8s %6s %8s %8s %9s\n",
+        "Route", "Requests", "304", "Avg[ms]", "Max[ms]", "Sent[kB]");
+      for (auto& kv : m_stats) {
+        PageStats& st = kv.second;
+        writer->printf("  %-30s %8u %6u %8.1f %8.1f %9.1f\n",
+          kv.first.c_str(), st.requests, st.notmodified,
+          st.requests ? (float)st.time_us / st.requests / 1000 : 0.0f,
+          (float)st.time_max_us / 1000, (float)st.bytes / 1024);
+      }
+    }
+  }
+  m_content_cache.Status(writer);
+}
+
+
+/**
+ * PageContentCache
+ */
+
+PageContentCache::PageContentCache()
+  : m_cfg_size("http.server", "cache.size", 128)
+{
+  m_bytes = 0;
+  m_hits = 0;
+  m_misses = 0;
+  m_reloads = 0;
+  m_evictions = 0;
 }
 
-PageEntry* OvmsWebServer::FindPage(std::string uri)
+PageContent_t PageContentCache::Get(const std::string& path, std::string* etag /*=NULL*/, time_t* mtime /*=NULL*/)
 {
-  for (PageEntry& e : m_pagemap) {
-    if (e.uri == uri)
-      return &e;
+  OvmsMutexLock lock(&m_mutex);
+  PageContent_t content;
+  time_t content_mtime = 0;
+  struct stat st;
+
+  auto it = m_index.find(path);
+  if (it != m_index.end()) {
+    PageContentList_t::iterator entry = it->second;
+    if (monotonictime - entry->checked < CONTENT_CACHE_CHECK_TIME) {
+      content = entry->content;
+    }
+    else if (stat(path.c_str(), &st) == 0 && st.st_mtime == entry->mtime && (size_t)st.st_size == entry->size) {
+      entry->checked = monotonictime;
+      content = entry->content;
+    }
+    else {
+      Drop(entry);
+      m_reloads++;
+    }
+    if (content) {
+      content_mtime = entry->mtime;
+      m_lru.splice(m_lru.begin(), m_lru, entry);
+      m_hits++;
+    }
+  }
+
+  if (!content) {
+    // load file:
+    m_misses++;
+    FILE* f = fopen(path.c_str(), "r");
+    if (!f)
+      return content;
+    if (fstat(fileno(f), &st) != 0) {
+      fclose(f);
+      return content;
+    }
+    extram::string* data = new extram::string(st.st_size, '\0');
+    if (st.st_size > 0 && fread(&(*data)[0], st.st_size, 1, f) != 1) {
+      ESP_LOGE(TAG, "PageContentCache: read error on '%s'", path.c_str());
+      delete data;
+      fclose(f);
+      return content;
+    }
+    fclose(f);
+    content.reset(data);
+    content_mtime = st.st_mtime;
+    ESP_LOGD(TAG, "PageContentCache: loaded '%s', %u bytes", path.c_str(), data->size());
+
+    m_lru.push_front({ path, st.st_mtime, (size_t)st.st_size, monotonictime, content });
+    m_index[path] = m_lru.begin();
+    m_bytes += content->size();
+
+    // evict least recently used entries, but keep the current one:
+    size_t limit = (size_t) MAX(0, (int)m_cfg_size) * 1024;
+    while (m_bytes > limit && m_lru.size() > 1) {
+      Drop(std::prev(m_lru.end()));
+      m_evictions++;
+    }
+    if (m_bytes > limit)
+      Drop(m_lru.begin());
+  }
+
+  if (etag) {
+    char buf[40];
+    snprintf(buf, sizeof(buf), "\"%lx.%x\"", (unsigned long) content_mtime, (unsigned int) content->size());
+    *etag = buf;
   }
-  return NULL;
+  if (mtime)
+    *mtime = content_mtime;
+  return content;
+}
+
+void PageContentCache::Drop(PageContentList_t::iterator it)
+{
+  // Note: caller needs to hold m_mutex
+  m_bytes -= it->content->size();
+  m_index.erase(it->path);
+  m_lru.erase(it);
+}
+
+void PageContentCache::Invalidate(const std::string& path)
+{
+  OvmsMutexLock lock(&m_mutex);
+  auto it = m_index.find(path);
+  if (it != m_index.end())
+    Drop(it->second);
+}
+
+void PageContentCache::Status(OvmsWriter* writer)
+{
+  OvmsMutexLock lock(&m_mutex);
+  writer->printf("Content cache: %u entries, %.1f of %d kB\n",
+    m_lru.size(), (float)m_bytes / 1024, (int)m_cfg_size);
+  writer->printf("  Requests: %u hits, %u misses, %u reloads (file changed), %u evictions\n",
+    m_hits, m_misses, m_reloads, m_evictions);
+  for (auto& e : m_lru)
+    writer->printf("  %s: %u bytes\n", e.path.c_str(), e.content->size());
 }
 
 
@@ -347,29 +560,18 @@ PageEntry* OvmsWebServer::FindPage(std::string uri)
  * Plugin Registry
  */
 
-void PagePluginContent::LoadContent()
+PageContent_t PagePluginContent::GetContent(std::string* etag /*=NULL*/, time_t* mtime /*=NULL*/)
 {
   std::string path = "/store/plugin/" + m_path;
-  std::ifstream file(path, std::ios::in | std::ios::binary | std::ios::ate);
-  if (!file.is_open()) {
+  PageContent_t content = MyWebServer.m_content_cache.Get(path, etag, mtime);
+  if (!content) {
     ESP_LOGE(TAG, "Plugin file missing: '%s'", path.c_str());
-    m_content = "<!-- ERROR: Plugin file missing: '";
-    m_content += PageContext::encode_html(path).c_str();
-    m_content += "' -->";
-  } else {
-    auto size = file.tellg();
-    if (size < 0) {
-      ESP_LOGE(TAG, "Plugin file '%s': seek failed", path.c_str());
-      m_content = "<!-- ERROR: Plugin file missing: '";
-      m_content += PageContext::encode_html(path).c_str();
-      m_content += "' -->";
-    } else {
-      m_content.resize(size, '\0');
-      file.seekg(0);
-      file.read(&m_content[0], size);
-      ESP_LOGD(TAG, "Plugin file loaded: '%s', %u bytes", path.c_str(), (size_t)size);
-    }
+    extram::string* error = new extram::string("<!-- ERROR: Plugin file missing: '");
+    *error += PageContext::encode_html(path).c_str();
+    *error += "' -->";
+    content.reset(error);
   }
+  return content;
 }
 
 void OvmsWebServer::RegisterPlugins()
@@ -421,7 +623,9 @@ void OvmsWebServer::RegisterPlugins()
 
 void OvmsWebServer::DeregisterPlugins()
 {
+  OvmsRecMutexLock lock(&m_page_mutex);
   m_pagemap.remove_if([](PageEntry& e){ return e.handler == PluginHandler; });
+  IndexPages();
   m_plugin_pages.clear();
   DeregisterCallbacks("http.plugin");
   m_plugin_parts.clear();
@@ -429,16 +633,10 @@ void OvmsWebServer::DeregisterPlugins()
 
 void OvmsWebServer::ReloadPlugin(std::string path)
 {
-  if (startsWith(path, "/store/plugin/"))
-    path = path.substr(14);
-  for (auto i = m_plugin_pages.begin(); i != m_plugin_pages.end(); i++) {
-    if (i->second.m_path == path)
-      i->second.LoadContent();
-  }
-  for (auto i = m_plugin_parts.begin(); i != m_plugin_parts.end(); i++) {
-    if (i->second.m_path == path)
-      i->second.LoadContent();
-  }
+  // drop cached content, will be reloaded on the next request:
+  if (!startsWith(path, "/store/plugin/"))
+    path = "/store/plugin/" + path;
+  m_content_cache.Invalidate(path);
 }
 
 void OvmsWebServer::PluginHandler(PageEntry_t& p, PageContext_t& c)
@@ -447,9 +645,22 @@ void OvmsWebServer::PluginHandler(PageEntry_t& p, PageContext_t& c)
   if (i == MyWebServer.m_plugin_pages.end())
     return;
 
-  extram::string& content = i->second.GetContent();
-  c.head(200);
-  c.print(content);
+  std::string etag;
+  time_t mtime = 0;
+  PageContent_t content = i->second.GetContent(&etag, &mtime);
+  if (etag.empty()) {
+    c.head(200);
+  }
+  else {
+    if (c.not_modified(etag.c_str(), mtime))
+      return;
+    std::string headers =
+      "Content-Type: text/html; charset=utf-8\r\n"
+      "Cache-Control: no-cache\r\n"
+      "Etag: " + etag;
+    c.head(200, headers.c_str());
+  }
+  c.print(*content);
   c.done();
 }
 
@@ -461,8 +672,8 @@ PageResult_t OvmsWebServer::PluginCallback(PageEntry_t& p, PageContext_t& c, con
     return PageResult_OK;
 
   for (auto i = range.first; i != range.second; i++) {
-    extram::string& content = i->second.GetContent();
-    c.print(content);
+    PageContent_t content = i->second.GetContent();
+    c.print(*content);
   }
 
   return PageResult_OK;
@@ -490,6 +701,7 @@ void OvmsWebServer::EventHandler(mg_connection *nc, int ev, void *p)
   {
     case MG_EV_WEBSOCKET_HANDSHAKE_DONE:    // new websocket connection
       {
+        MyWebServer.PublishConnStats(nc);
         MyWebServer.CreateWebSocketHandler(nc);
       }
       break;
@@ -503,14 +715,22 @@ void OvmsWebServer::EventHandler(mg_connection *nc, int ev, void *p)
         c.uri.assign(c.hm->uri.p, c.hm->uri.len);
         ESP_LOGI(TAG, "HTTP %s %s", c.method.c_str(), c.uri.c_str());
 
-        PageEntry* page = MyWebServer.FindPage(c.uri.c_str());
+        // publish stats of the previous request on a keep-alive connection:
+        MyWebServer.PublishConnStats(nc);
+
+        int64_t start = esp_timer_get_time();
+        PageStats* stats;
+        OvmsRecMutexLock pagelock(&MyWebServer.m_page_mutex);
+        PageEntry* page = MyWebServer.FindPage(c.uri);
         if (page) {
           // serve by page handler:
+          stats = MyWebServer.GetRouteStats(page->uri);
           page->Serve(c);
         }
 #if MG_ENABLE_FILESYSTEM
         else if (MyWebServer.m_file_enable) {
           // serve from file space:
+          stats = MyWebServer.GetRouteStats("(files)");
           if (MyConfig.ProtectedPath(c.uri)) {
             mg_http_send_error(c.nc, 401, "Unauthorized");
             nc->flags |= MG_F_SEND_AND_CLOSE;
@@ -521,14 +741,34 @@ void OvmsWebServer::EventHandler(mg_connection *nc, int ev, void *p)
         }
 #endif //MG_ENABLE_FILESYSTEM
         else {
+          stats = MyWebServer.GetRouteStats("(not found)");
           mg_http_send_error(c.nc, 404, "Not found");
           nc->flags |= MG_F_SEND_AND_CLOSE;
         }
+
+        uint32_t time_us = esp_timer_get_time() - start;
+        stats->requests++;
+        if (c.notmodified)
+          stats->notmodified++;
+        stats->time_us += time_us;
+        if (time_us > stats->time_max_us)
+          stats->time_max_us = time_us;
+        stats->Publish();
+        MyWebServer.m_connstats[nc] = stats;
+      }
+      break;
+
+    case MG_EV_SEND:                        // data has been sent
+      {
+        auto it = MyWebServer.m_connstats.find(nc);
+        if (it != MyWebServer.m_connstats.end() && *((int*)p) > 0)
+          it->second->bytes += *((int*)p);
       }
       break;
 
     case MG_EV_CLOSE:                       // connection has been closed
       {
+        MyWebServer.PublishConnStats(nc);
         if (handler) {
           if (nc->flags & MG_F_IS_WEBSOCKET)
             MyWebServer.DestroyWebSocketHandler((WebSocketHandler*)handler);
@@ -600,7 +840,8 @@ void PageEntry::Serve(PageContext_t& c)
   }
 #endif //MG_ENABLE_FILESYSTEM
 
-  // call page handler:
+  // call page handler, batching config changes of form submits:
+  OvmsConfigTransaction txn;
   handler(*this, c);
 }
 
@@ -611,6 +852,7 @@ void PageEntry::Serve(PageContext_t& c)
 
 bool OvmsWebServer::RegisterCallback(std::string caller, std::string uri, PageCallback_t handler, int priority /*=0*/)
 {
+  OvmsRecMutexLock lock(&m_page_mutex);
   PageEntry* e = FindPage(uri);
   if (!e)
     return false;
@@ -620,6 +862,7 @@ bool OvmsWebServer::RegisterCallback(std::string caller, std::string uri, PageCa
 
 void OvmsWebServer::DeregisterCallbacks(std::string caller)
 {
+  OvmsRecMutexLock lock(&m_page_mutex);
   for (PageEntry& e : m_pagemap)
     e.DeregisterCallback(caller);
 }
@@ -35,9 +35,11 @@
 #include <forward_list>
 #include <iterator>
 #include <vector>
+#include <list>
 #include <memory>
 #include <utility>
 #include <map>
+#include <unordered_map>
 
 #include "freertos/FreeRTOS.h"
 #include "freertos/timers.h"
@@ -50,6 +52,7 @@
 #include "ovms_shell.h"
 #include "ovms_netmanager.h"
 #include "ovms_utils.h"
+#include "ovms_mutex.h"
 #include "log_buffers.h"
 
 #define OVMS_GLOBAL_AUTH_FILE     "/store/.htpasswd"
@@ -61,6 +64,8 @@
 
 #define XFER_CHUNK_SIZE           1024
 
+#define CONTENT_CACHE_CHECK_TIME  2         // seconds between file validations of cached content
+
 #define WEBSRV_USE_MG_BROADCAST   0  // Note: mg_broadcast() not working reliably yet, do not enable for production!
 
 // Asset URLs with versioning:
@@ -134,6 +139,7 @@ struct PageContext : public ExternalRamAllocated
   user_session *session;
   std::string method;
   std::string uri;
+  bool notmodified = false;   // set by not_modified() when sending a 304 response
 
   // utils:
   std::string getvar(const std::string& name, size_t maxlen=200);
@@ -147,8 +153,9 @@ struct PageContext : public ExternalRamAllocated
   // output:
   void error(int code, const char* text);
   void head(int code, const char* headers=NULL);
-  void print(const std::string text);
-  void print(const extram::string text);
+  bool not_modified(const char* etag, time_t mtime=0);
+  void print(const std::string& text);
+  void print(const extram::string& text);
   void print(const char* text);
   void printf(const char *fmt, ...);
   void done();
@@ -235,28 +242,98 @@ struct PageEntry
 };
 
 typedef std::forward_list<PageEntry> PageMap_t;
+typedef std::unordered_map<std::string, PageEntry*> PageIndex_t;
+
+
+/**
+ * PageStats: request statistics per route (URI, files, not found)
+ *
+ * Handler time is the synchronous page handler execution, bytes are counted
+ *  on transmission, so include asynchronous transfers (assets, commands).
+ *
+ * Average handler time and bytes sent are published as metrics
+ *  m.http.<route>.time [s] and m.http.<route>.sent [bytes], with <route>
+ *  being the URI path in dot notation ("root" for "/").
+ */
+
+struct PageStats
+{
+  uint32_t requests = 0;        // requests served
+  uint32_t notmodified = 0;     // thereof answered by 304 Not Modified
+  uint64_t time_us = 0;         // handler time sum
+  uint32_t time_max_us = 0;     // handler time maximum
+  uint64_t bytes = 0;           // response bytes sent
+  OvmsMetricFloat* m_time = NULL;
+  OvmsMetricInt* m_sent = NULL;
+
+  void Publish();
+};
+
+typedef std::map<std::string, PageStats> PageStatsMap_t;
+
+
+/**
+ * PageContentCache: LRU cache for VFS file content (plugins)
+ *
+ * Entries are validated by file mtime & size (checked at most every
+ *  CONTENT_CACHE_CHECK_TIME seconds) and dropped on VFS change events.
+ *  The cache size is limited by config http.server cache.size [kB].
+ *  Content is shared, so it stays valid for the requests using it when
+ *  an entry gets dropped.
+ */
+
+typedef std::shared_ptr<const extram::string> PageContent_t;
+
+struct PageContentEntry
+{
+  std::string       path;
+  time_t            mtime;
+  size_t            size;
+  uint32_t          checked;      // monotonictime of last validation
+  PageContent_t     content;
+};
+
+typedef std::list<PageContentEntry> PageContentList_t;
+
+class PageContentCache
+{
+  public:
+    PageContentCache();
+
+  public:
+    PageContent_t Get(const std::string& path, std::string* etag=NULL, time_t* mtime=NULL);
+    void Invalidate(const std::string& path);
+    void Status(OvmsWriter* writer);
+
+  protected:
+    void Drop(PageContentList_t::iterator it);
+
+  protected:
+    OvmsMutex         m_mutex;
+    PageContentList_t m_lru;          // front = most recently used
+    std::unordered_map<std::string, PageContentList_t::iterator> m_index;
+    size_t            m_bytes;
+    uint32_t          m_hits;
+    uint32_t          m_misses;
+    uint32_t          m_reloads;      // content changed on validation
+    uint32_t          m_evictions;
+    OvmsConfigInt     m_cfg_size;
+};
 
 
 /**
- * Plugin Cache
+ * Plugin Registry
  */
 
 struct PagePluginContent
 {
   std::string       m_path;
-  extram::string    m_content;
 
   PagePluginContent(std::string path) {
     m_path = path;
   }
 
-  extram::string& GetContent() {
-    if (m_content.empty())
-      LoadContent();
-    return m_content;
-  }
-  
-  void LoadContent();
+  PageContent_t GetContent(std::string* etag=NULL, time_t* mtime=NULL);
 };
 
 typedef std::map<std::string, PagePluginContent> PagePluginMap;
@@ -498,7 +575,11 @@ class OvmsWebServer : public ExternalRamAllocated
     void RegisterPage(std::string uri, std::string label, PageHandler_t handler,
       PageMenu_t menu=PageMenu_None, PageAuth_t auth=PageAuth_None, int priority=0);
     void DeregisterPage(std::string uri);
-    PageEntry* FindPage(std::string uri);
+    PageEntry* FindPage(const std::string& uri);
+    void IndexPages();
+    PageStats* GetRouteStats(const std::string& route);
+    void PublishConnStats(mg_connection* nc);
+    void Status(OvmsWriter* writer);
     bool RegisterCallback(std::string caller, std::string uri, PageCallback_t handler, int priority=0);
     void DeregisterCallbacks(std::string caller);
     void RegisterPlugins();
@@ -581,9 +662,16 @@ class OvmsWebServer : public ExternalRamAllocated
     mg_serve_http_opts        m_file_opts;
 #endif //MG_ENABLE_FILESYSTEM
 
+    OvmsRecMutex              m_page_mutex;                 // m_pagemap & m_pageindex
     PageMap_t                 m_pagemap;
+    PageIndex_t               m_pageindex;                  // uri → m_pagemap entry
     PagePluginMap             m_plugin_pages;
     PagePluginMultiMap        m_plugin_parts;
+    PageContentCache          m_content_cache;
+
+    OvmsMutex                 m_stats_mutex;
+    PageStatsMap_t            m_stats;                      // route → stats (never erased)
+    std::map<mg_connection*, PageStats*> m_connstats;       // connection → route stats
 
     user_session              m_sessions[NUM_SESSIONS];
 
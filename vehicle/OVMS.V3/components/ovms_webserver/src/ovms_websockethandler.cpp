@@ -114,29 +114,36 @@ void WebSocketHandler::ProcessTxJob()
     case WSTX_MetricsAll:
     case WSTX_MetricsUpdate:
     {
-      // Note: this loops over the metrics by index, keeping the checked count
+      // Note: MetricsAll loops over the metrics by index, keeping the checked count
       //  in m_sent. It will not detect new metrics added between polls if they are
       //  inserted before m_sent, so new metrics may not be sent until first changed.
       //  The Metrics set normally is static, so this should be no problem.
+      // MetricsUpdate fetches the changed metrics from our modifier's journal.
       
       // find start:
       int i;
       OvmsMetric* m;
-      for (i=0, m=MyMetrics.m_first; i < m_sent && m != NULL; m=m->m_next, i++);
+      bool all = (m_job.type == WSTX_MetricsAll);
+      if (all)
+        for (i=0, m=MyMetrics.m_first; i < m_sent && m != NULL; m=m->m_next, i++);
+      else
+        m = MyMetrics.NextModified(m_modifier);
       
       // build msg:
       extram::string msg;
       msg.reserve(2*XFER_CHUNK_SIZE+128);
       msg = "{\"metrics\":{";
-      for (i=0; m && msg.size() < XFER_CHUNK_SIZE; m=m->m_next) {
-        if (m->IsModifiedAndClear(m_modifier) || m_job.type == WSTX_MetricsAll) {
-          if (i) msg += ',';
-          msg += '\"';
-          msg += m->m_name;
-          msg += "\":";
-          msg += m->AsJSON().c_str();
-          i++;
-        }
+      for (i=0; m; ) {
+        if (all) m->ClearModified(m_modifier);
+        if (i) msg += ',';
+        msg += '\"';
+        msg += m->m_name;
+        msg += "\":";
+        msg += m->AsJSON().c_str();
+        i++;
+        if (msg.size() >= XFER_CHUNK_SIZE)
+          break;
+        m = all ? m->m_next : MyMetrics.NextModified(m_modifier);
       }
       
       // send msg:
@@ -438,6 +445,7 @@ WebSocketHandler* OvmsWebServer::CreateWebSocketHandler(mg_connection* nc)
     WebSocketSlot slot;
     slot.handler = NULL;
     slot.modifier = MyMetrics.RegisterModifier();
+    MyMetrics.RegisterJournal(slot.modifier);
     slot.reader = MyNotify.RegisterReader("ovmsweb", COMMAND_RESULT_VERBOSE,
                                           std::bind(&OvmsWebServer::IncomingNotification, i, _1, _2), true,
                                           std::bind(&OvmsWebServer::NotificationFilter, i, _1, _2));
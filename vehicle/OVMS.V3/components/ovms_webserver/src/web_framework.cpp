@@ -165,11 +165,73 @@ void PageContext::head(int code, const char* headers /*=NULL*/) {
   mg_send_head(nc, code, -1, headers);
 }
 
-void PageContext::print(const std::string text) {
+/**
+ * not_modified: check the conditional GET headers against the current Etag
+ *  and modification time of the resource. If the client copy is still valid,
+ *  send a 304 response (headers only) and return true.
+ */
+
+static time_t parse_http_date(const struct mg_str* str) {
+  // IMF-fixdate: "Sun, 06 Nov 1994 08:49:37 GMT"
+  static const char months[] = "JanFebMarAprMayJunJulAugSepOctNovDec";
+  char buf[40], mon[4];
+  int d, m, y, hh, mm, ss;
+  if (str->len >= sizeof(buf))
+    return 0;
+  memcpy(buf, str->p, str->len);
+  buf[str->len] = 0;
+  if (sscanf(buf, "%*3s, %d %3s %d %d:%d:%d", &d, mon, &y, &hh, &mm, &ss) != 6)
+    return 0;
+  const char* mp = strstr(months, mon);
+  if (!mp || strlen(mon) != 3 || (mp - months) % 3 != 0)
+    return 0;
+  m = (mp - months) / 3 + 1;
+  // days since epoch from civil date:
+  y -= (m <= 2);
+  int era = (y >= 0 ? y : y-399) / 400;
+  int yoe = y - era * 400;
+  int doy = (153 * (m + (m > 2 ? -3 : 9)) + 2) / 5 + d - 1;
+  int doe = yoe * 365 + yoe/4 - yoe/100 + doy;
+  long days = (long)era * 146097 + doe - 719468;
+  return (time_t)days * 86400 + hh * 3600 + mm * 60 + ss;
+}
+
+bool PageContext::not_modified(const char* etag, time_t mtime /*=0*/) {
+  struct mg_str* hdr;
+  bool valid = false;
+  if (method != "GET" && method != "HEAD")
+    return false;
+  if ((hdr = mg_get_http_header(hm, "If-None-Match")) != NULL) {
+    // If-None-Match has precedence over If-Modified-Since:
+    std::string tags(hdr->p, hdr->len);
+    valid = (tags == "*" || tags.find(etag) != std::string::npos);
+  }
+  else if (mtime && (hdr = mg_get_http_header(hm, "If-Modified-Since")) != NULL) {
+    time_t since = parse_http_date(hdr);
+    valid = (since != 0 && mtime <= since);
+  }
+  if (!valid)
+    return false;
+
+  char current_time[50];
+  time_t t = (time_t) mg_time();
+  strftime(current_time, sizeof(current_time), "%a, %d %b %Y %H:%M:%S GMT", gmtime(&t));
+  mg_send_response_line(nc, 304, NULL);
+  mg_printf(nc,
+    "Date: %s\r\n"
+    "Etag: %s\r\n"
+    "\r\n"
+    , current_time
+    , etag);
+  notmodified = true;
+  return true;
+}
+
+void PageContext::print(const std::string& text) {
   mg_send_http_chunk(nc, text.data(), text.size());
 }
 
-void PageContext::print(const extram::string text) {
+void PageContext::print(const extram::string& text) {
   mg_send_http_chunk(nc, text.data(), text.size());
 }
 
@@ -455,6 +517,7 @@ std::string OvmsWebServer::CreateMenu(PageContext_t& c)
   std::string main, tools, config, vehicle;
 
   // collect menu items:
+  OvmsRecMutexLock lock(&MyWebServer.m_page_mutex);
   for (PageEntry& e : MyWebServer.m_pagemap) {
     if (e.menu == PageMenu_Main)
       main += "<li><a href=\"" + std::string(e.uri) + "\" target=\"#main\">" + std::string(e.label) + "</a></li>";
@@ -520,6 +583,7 @@ void OvmsWebServer::OutputHome(PageEntry_t& p, PageContext_t& c)
 {
   // collect menu items:
   std::string main, config, tools, vehicle;
+  OvmsRecMutexLock lock(&MyWebServer.m_page_mutex);
   for (PageEntry& e : MyWebServer.m_pagemap) {
     if (e.menu == PageMenu_Main)
       main += "<li><a class=\"btn btn-default\" href=\"" + std::string(e.uri) + "\" target=\"#main\">" + std::string(e.label) + "</a></li>";
@@ -731,6 +795,8 @@ void OvmsWebServer::OutputReconnect(PageEntry_t& p, PageContext_t& c, const char
 /**
  * HandleAsset: output gzip assets
  * Note: no check for Accept-Encoding, we can't unzip & a modern browser is required anyway
+ * Conditional GETs are answered by 304 Not Modified. Versioned URLs (?v=<mtime>)
+ *  can be cached by the browser without revalidation, as a new version changes the URL.
  */
 
 extern const uint8_t script_js_gz_start[]     asm("_binary_script_js_gz_start");
@@ -796,9 +862,13 @@ void OvmsWebServer::HandleAsset(PageEntry_t& p, PageContext_t& c)
     return;
   }
 
-  char etag[50], current_time[50], last_modified[50];
+  char etag[50], version[20], current_time[50], last_modified[50];
   time_t t = (time_t) mg_time();
   snprintf(etag, sizeof(etag), "\"%lx.%" INT64_FMT "\"", (unsigned long) mtime, (int64_t) size);
+  if (c.not_modified(etag, mtime))
+    return;
+  snprintf(version, sizeof(version), "%ld", (long) mtime);
+  bool versioned = (c.getvar("v", sizeof(version)) == version);
   strftime(current_time, sizeof(current_time), "%a, %d %b %Y %H:%M:%S GMT", gmtime(&t));
   strftime(last_modified, sizeof(last_modified), "%a, %d %b %Y %H:%M:%S GMT", gmtime(&mtime));
 
@@ -808,6 +878,7 @@ void OvmsWebServer::HandleAsset(PageEntry_t& p, PageContext_t& c)
     "Last-Modified: %s\r\n"
     "Content-Type: %s\r\n"
     "%s"
+    "%s"
     "Transfer-Encoding: chunked\r\n"
     "Etag: %s\r\n"
     "\r\n"
@@ -815,6 +886,7 @@ void OvmsWebServer::HandleAsset(PageEntry_t& p, PageContext_t& c)
     , last_modified
     , type
     , gzip_encoded ? "Content-Encoding: gzip\r\n" : ""
+    , versioned ? "Cache-Control: max-age=31536000, immutable\r\n" : ""
     , etag);
 
   // start chunked transfer:
@@ -94,6 +94,7 @@ bool PushoverReaderFilterCallback(OvmsNotifyType* type, const char* subtype)
 
 
 Pushover::Pushover()
+  : m_cfg_enable("pushover", "enable", false)
   {
   ESP_LOGI(TAG, "Initialising Pushover client (8800)");
 
@@ -143,7 +144,7 @@ bool Pushover::IncomingNotification(OvmsNotifyType* type, OvmsNotifyEntry* entry
   std::string sound;
   std::string msg;
 
-  if (MyConfig.GetParamValueBool("pushover","enable", false) == false)
+  if (!m_cfg_enable)
     {
     //ESP_LOGD(TAG,"IncomingNotification: Ignore notification (%s:%s:%s) (pushover not enabled)",type->m_name,entry->GetSubType(),entry->GetValue().c_str());
     return true;
@@ -197,7 +198,7 @@ void Pushover::EventListener(std::string event, void* data)
   if ( (event == "ticker.1") || (event == "ticker.10") )
     return;
 
-  if (MyConfig.GetParamValueBool("pushover","enable", false) == false)
+  if (!m_cfg_enable)
     {
     //ESP_LOGD(TAG,"EventListener: Ignore event (%s) (pushover not enabled)",event.c_str());
     return;
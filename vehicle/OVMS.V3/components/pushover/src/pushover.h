@@ -60,6 +60,7 @@ class Pushover : public InternalRamAllocated
 
   private:
     size_t reader;
+    OvmsConfigBool m_cfg_enable;
 
   };
 
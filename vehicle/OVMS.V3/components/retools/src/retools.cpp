@@ -32,6 +32,8 @@
 static const char *TAG = "re";
 
 #include <string.h>
+#include <algorithm>
+#include "esp_timer.h"
 #include "retools.h"
 #include "dbc_app.h"
 #include "ovms.h"
@@ -131,19 +133,23 @@ void re::Task()
 void re::DoAnalyse(CAN_frame_t* frame)
   {
   char vbuf[256];
+  int64_t now = esp_timer_get_time();
 
   OvmsMutexLock lock(&m_mutex);
-  std::string key = GetKey(frame);
-  auto k = m_rmap.find(key);
-  re_record_t* r;
-  if (m_rmap.size() == 0) m_started = monotonictime;
-  if (k == m_rmap.end())
-    {
-    r = k->second;
-    r = new re_record_t;
-    memset(r,0,sizeof(re_record_t));
+  re_key_t key = GetKey(frame);
+  if (m_count == 0) m_started = monotonictime;
+  bool created;
+  re_record_t* r = Lookup(key, &created);
+  if (r == NULL)
+    {
+    m_dropped++;
+    return;
+    }
+  if (created)
+    {
     r->attr.b.Changed = 1; // Mark the whole ID as changed
     r->attr.dc = 0xff;
+    r->firstrx = now;
     switch (MyRE->m_mode)
       {
       case Analyse:
@@ -153,14 +159,15 @@ void re::DoAnalyse(CAN_frame_t* frame)
         r->attr.dd = 0xff;
         HighlightDump(vbuf, (const char*)frame->data.u8, frame->FIR.B.DLC, r->attr.dc, r->attr.dd);
         ESP_LOGV(TAG, "Discovered new %s%s%s %s",
-          re_green[0][0], key.c_str(), re_green[0][1], vbuf);
+          re_green[0][0], GetKeyName(key).c_str(), re_green[0][1], vbuf);
         break;
       }
-    m_rmap[key] = r;
     }
   else
     {
-    r = k->second;
+    uint32_t interval = now - r->lastrx;
+    if ((r->rxcount == 1)||(interval < r->intmin)) r->intmin = interval;
+    if (interval > r->intmax) r->intmax = interval;
     switch (MyRE->m_mode)
       {
       case Analyse:
@@ -187,31 +194,23 @@ void re::DoAnalyse(CAN_frame_t* frame)
         if (found)
           {
           HighlightDump(vbuf, (const char*)frame->data.u8, frame->FIR.B.DLC, r->attr.dc, r->attr.dd);
-          ESP_LOGV(TAG, "Discovered change %s %s", k->first.c_str(), vbuf);
+          ESP_LOGV(TAG, "Discovered change %s %s", GetKeyName(key).c_str(), vbuf);
           }
         break;
         }
       }
     }
   memcpy(&r->last,frame,sizeof(CAN_frame_t));
+  r->lastrx = now;
   r->rxcount++;
   }
 
-std::string re::GetKey(CAN_frame_t* frame)
+re_key_t re::GetKey(CAN_frame_t* frame)
   {
-  std::string key;
-  if (frame->origin != NULL)
-    key = std::string(frame->origin->GetName());
-  else
-    key = std::string("can?");
-  key.append("/");
-
-  char id[9];
-  if (frame->FIR.B.FF == CAN_frame_std)
-    sprintf(id,"%03x",frame->MsgID);
-  else
-    sprintf(id,"%08x",frame->MsgID);
-  key.append(id);
+  re_key_t bus = (frame->origin != NULL) ? ((frame->origin->m_busnumber + 1) & 7) : 7;
+  re_key_t key = (bus << 61)
+    | ((re_key_t)((frame->FIR.B.FF == CAN_frame_ext) ? 1 : 0) << 60)
+    | ((re_key_t)(frame->MsgID & 0x1FFFFFFF) << 31);
 
   if (((m_obdii_std_min>0) &&
        (frame->FIR.B.FF == CAN_frame_std) &&
@@ -230,25 +229,12 @@ std::string re::GetKey(CAN_frame_t* frame)
       return key;
       }
     uint8_t mode = frame->data.u8[1];
-    char req[16];
-    if (mode > 0x4a)
-      {
-      sprintf(req,":O2Pm%d:%d",mode-0x40,((int)frame->data.u8[2]<<8)+frame->data.u8[3]);
-      }
-    else if (mode > 0x40)
-      {
-      sprintf(req,":O2Pm%d:%d",mode-0x40,(int)frame->data.u8[2]);
-      }
-    else if (mode > 0x0a)
-      {
-      sprintf(req,":O2Qm%d:%d",mode,((int)frame->data.u8[2]<<8)+frame->data.u8[3]);
-      }
+    uint32_t pid;
+    if ((mode > 0x4a) || ((mode <= 0x40) && (mode > 0x0a)))
+      pid = ((uint32_t)frame->data.u8[2]<<8) + frame->data.u8[3];
     else
-      {
-      sprintf(req,":O2Qm%d:%d",mode,(int)frame->data.u8[2]);
-      }
-    key.append(req);
-    return key;
+      pid = frame->data.u8[2];
+    return key | ((re_key_t)RE_KEY_OBDII << 29) | ((re_key_t)mode << 16) | pid;
     }
 
   // Check for, and process, multiplexed signal
@@ -264,9 +250,7 @@ std::string re::GetKey(CAN_frame_t* frame)
         dbcSignal* s = m->GetMultiplexorSignal();
         dbcNumber muxn = s->Decode(frame);
         uint32_t mux = muxn.GetUnsignedInteger();
-        char b[8];
-        sprintf(b,":%04x",mux);
-        key.append(b);
+        key |= ((re_key_t)RE_KEY_MUX << 29) | (mux & 0x1FFFFFFF);
         }
       }
     }
@@ -274,6 +258,114 @@ std::string re::GetKey(CAN_frame_t* frame)
   return key;
   }
 
+std::string re::GetKeyName(re_key_t key)
+  {
+  char buf[48];
+  char* p = buf;
+  int bus = key >> 61;
+  bool ext = (key >> 60) & 1;
+  uint32_t id = (key >> 31) & 0x1FFFFFFF;
+  int kind = (key >> 29) & 3;
+  uint32_t sub = key & 0x1FFFFFFF;
+
+  if (bus == 7)
+    p += sprintf(p, "can?/");
+  else
+    p += sprintf(p, "can%d/", bus);
+  p += sprintf(p, ext ? "%08x" : "%03x", id);
+
+  if (kind == RE_KEY_MUX)
+    {
+    sprintf(p, ":%04x", sub);
+    }
+  else if (kind == RE_KEY_OBDII)
+    {
+    int mode = sub >> 16;
+    int pid = sub & 0xffff;
+    if (mode > 0x40)
+      sprintf(p, ":O2Pm%d:%d", mode-0x40, pid);
+    else
+      sprintf(p, ":O2Qm%d:%d", mode, pid);
+    }
+
+  return std::string(buf);
+  }
+
+static inline uint32_t re_hash(re_key_t key, uint32_t size)
+  {
+  // Fibonacci hashing, size is a power of 2:
+  return (uint32_t)((key * 0x9E3779B97F4A7C15ULL) >> 32) & (size - 1);
+  }
+
+re_record_t* re::Lookup(re_key_t key, bool* created)
+  {
+  *created = false;
+  if (m_table == NULL) return NULL;
+
+  uint32_t i = re_hash(key, m_size);
+  while (m_table[i].key != 0)
+    {
+    if (m_table[i].key == key) return &m_table[i];
+    i = (i + 1) & (m_size - 1);
+    }
+
+  // Not found, insert (keeping the load factor below 75%):
+  if ((m_count+1) * 4 > m_size * 3)
+    {
+    if (Resize(m_size * 2))
+      return Lookup(key, created);
+    else if (m_count+1 >= m_size)
+      return NULL; // table full
+    }
+  re_record_t* r = &m_table[i];
+  memset(r, 0, sizeof(re_record_t));
+  r->key = key;
+  m_count++;
+  *created = true;
+  return r;
+  }
+
+bool re::Resize(uint32_t size)
+  {
+  re_record_t* table = (re_record_t*)ExternalRamCalloc(size, sizeof(re_record_t));
+  if (table == NULL)
+    {
+    ESP_LOGW(TAG, "Cannot resize record table to %u entries", size);
+    return false;
+    }
+  if (m_table)
+    {
+    for (uint32_t k=0; k<m_size; k++)
+      {
+      if (m_table[k].key == 0) continue;
+      uint32_t i = re_hash(m_table[k].key, size);
+      while (table[i].key != 0)
+        i = (i + 1) & (size - 1);
+      table[i] = m_table[k];
+      }
+    free(m_table);
+    }
+  m_table = table;
+  m_size = size;
+  return true;
+  }
+
+void re::GetRecords(re_record_list_t& list, const char* filter /*=NULL*/)
+  {
+  // Note: caller needs to hold m_mutex
+  list.clear();
+  list.reserve(m_count);
+  for (uint32_t k=0; k<m_size; k++)
+    {
+    re_record_t* r = &m_table[k];
+    if (r->key == 0) continue;
+    if (filter && !strstr(GetKeyName(r->key).c_str(), filter)) continue;
+    list.push_back(r);
+    }
+  std::sort(list.begin(), list.end(),
+    [](const re_record_t* a, const re_record_t* b) { return a->key < b->key; });
+  }
+
 re::re(const char* name, canfilter* filter)
   : pcp(name)
   {
@@ -285,6 +377,11 @@ re::re(const char* name, canfilter* filter)
   m_started = monotonictime;
   m_finished = monotonictime;
   m_mode = Analyse;
+  m_dropped = 0;
+  m_table = NULL;
+  m_size = 0;
+  m_count = 0;
+  Resize(RE_TABLE_INITIAL);
   m_rxqueue = xQueueCreate(20,sizeof(CAN_frame_t));
   xTaskCreatePinnedToCore(RE_task, "OVMS RE", 4096, (void*)this, 5, &m_task, CORE(1));
   MyCan.RegisterListener(m_rxqueue, true);
@@ -294,9 +391,13 @@ re::~re()
   {
   MyCan.DeregisterListener(m_rxqueue);
 
-  Clear();
-  vQueueDelete(m_rxqueue);
   vTaskDelete(m_task);
+  vQueueDelete(m_rxqueue);
+  if (m_table)
+    {
+    free(m_table);
+    m_table = NULL;
+    }
   if (m_filter)
     {
     delete m_filter;
@@ -325,11 +426,9 @@ void re::SetPowerMode(PowerMode powermode)
 void re::Clear()
   {
   OvmsMutexLock lock(&m_mutex);
-  for (re_record_map_t::iterator it=m_rmap.begin(); it!=m_rmap.end(); ++it)
-    {
-    delete it->second;
-    }
-  m_rmap.clear();
+  if (m_table) memset(m_table, 0, m_size * sizeof(re_record_t));
+  m_count = 0;
+  m_dropped = 0;
   m_started = monotonictime;
   m_finished = monotonictime;
   }
@@ -377,6 +476,28 @@ void re_clear(int verbosity, OvmsWriter* writer, OvmsCommand* cmd, int argc, con
     }
   }
 
+static uint32_t re_interval_avg(re_record_t* r, uint32_t tdiff)
+  {
+  // Average inter-arrival time in ms:
+  if (r->rxcount > 1)
+    return (uint32_t)((r->lastrx - r->firstrx) / (r->rxcount - 1) / 1000);
+  else
+    return tdiff / r->rxcount;
+  }
+
+static void re_list_header(OvmsWriter* writer)
+  {
+  writer->printf("%-20.20s %10s %6s %6s %6s %s\n","key","records","ms","min","max","last");
+  }
+
+static void re_list_record(OvmsWriter* writer, re_record_t* r, uint32_t tdiff, const char* vbuf)
+  {
+  writer->printf("%-20s %10d %6d %6d %6d %s\n",
+    MyRE->GetKeyName(r->key).c_str(), r->rxcount, re_interval_avg(r, tdiff),
+    (r->rxcount > 1) ? r->intmin/1000 : 0, (r->rxcount > 1) ? r->intmax/1000 : 0,
+    vbuf);
+  }
+
 void re_list(int verbosity, OvmsWriter* writer, OvmsCommand* cmd, int argc, const char* const* argv)
   {
   if (!MyRE)
@@ -389,17 +510,15 @@ void re_list(int verbosity, OvmsWriter* writer, OvmsCommand* cmd, int argc, cons
   if (tdiff == 0) tdiff = 1000;
 
   OvmsMutexLock lock(&MyRE->m_mutex);
-  writer->printf("%-20.20s %10s %6s %s\n","key","records","ms","last");
-  for (re_record_map_t::iterator it=MyRE->m_rmap.begin(); it!=MyRE->m_rmap.end(); ++it)
+  re_record_list_t list;
+  MyRE->GetRecords(list, (argc>0) ? argv[0] : NULL);
+  re_list_header(writer);
+  for (re_record_t* r : list)
     {
-    if ((argc==0)||(strstr(it->first.c_str(),argv[0])))
-      {
-      char vbuf[48];
-      char *s = vbuf;
-      FormatHexDump(&s, (const char*)it->second->last.data.u8, it->second->last.FIR.B.DLC, 8);
-      writer->printf("%-20s %10d %6d %s\n",
-        it->first.c_str(),it->second->rxcount,(tdiff/it->second->rxcount),vbuf);
-      }
+    char vbuf[48];
+    char *s = vbuf;
+    FormatHexDump(&s, (const char*)r->last.data.u8, r->last.FIR.B.DLC, 8);
+    re_list_record(writer, r, tdiff, vbuf);
     }
   }
 
@@ -415,23 +534,22 @@ void re_stream_list(int verbosity, OvmsWriter* writer, OvmsCommand* cmd, int arg
   if (tdiff == 0) tdiff = 1000;
 
   OvmsMutexLock lock(&MyRE->m_mutex);
+  re_record_list_t list;
+  MyRE->GetRecords(list, (argc>0) ? argv[0] : NULL);
   writer->printf("[");
   int cnt = 0;
-  for (re_record_map_t::iterator it=MyRE->m_rmap.begin(); it!=MyRE->m_rmap.end(); ++it)
-    {
-    if ((argc==0)||(strstr(it->first.c_str(),argv[0])))
-      {
-      char vbuf[48];
-      char *s = vbuf;
-      FormatHexDump(&s, (const char*)it->second->last.data.u8, it->second->last.FIR.B.DLC, 8);
-      vbuf[24] = 0;
-      writer->printf("%s[\"%s\",%d,%d,\"%s\",\"%s\"]\n",
-        cnt ? "," : "",
-        json_encode(it->first).c_str(), it->second->rxcount, (tdiff/it->second->rxcount),
-        json_encode(std::string(vbuf)).c_str(),
-        json_encode(std::string(vbuf+25)).c_str());
-      cnt++;
-      }
+  for (re_record_t* r : list)
+    {
+    char vbuf[48];
+    char *s = vbuf;
+    FormatHexDump(&s, (const char*)r->last.data.u8, r->last.FIR.B.DLC, 8);
+    vbuf[24] = 0;
+    writer->printf("%s[\"%s\",%d,%d,\"%s\",\"%s\"]\n",
+      cnt ? "," : "",
+      json_encode(MyRE->GetKeyName(r->key)).c_str(), r->rxcount, re_interval_avg(r, tdiff),
+      json_encode(std::string(vbuf)).c_str(),
+      json_encode(std::string(vbuf+25)).c_str());
+    cnt++;
     }
   writer->puts("]");
   }
@@ -448,56 +566,54 @@ void re_dbc_list(int verbosity, OvmsWriter* writer, OvmsCommand* cmd, int argc,
   if (tdiff == 0) tdiff = 1000;
 
   OvmsMutexLock lock(&MyRE->m_mutex);
-  writer->printf("%-20.20s %10s %6s %s\n","key","records","ms","last");
-  for (re_record_map_t::iterator it=MyRE->m_rmap.begin(); it!=MyRE->m_rmap.end(); ++it)
-    {
-    if ((argc==0)||(strstr(it->first.c_str(),argv[0])))
+  re_record_list_t list;
+  MyRE->GetRecords(list, (argc>0) ? argv[0] : NULL);
+  re_list_header(writer);
+  for (re_record_t* r : list)
+    {
+    char vbuf[48];
+    char *s = vbuf;
+    FormatHexDump(&s, (const char*)r->last.data.u8, r->last.FIR.B.DLC, 8);
+    re_list_record(writer, r, tdiff, vbuf);
+    if (r->last.origin)
       {
-      char vbuf[48];
-      char *s = vbuf;
-      FormatHexDump(&s, (const char*)it->second->last.data.u8, it->second->last.FIR.B.DLC, 8);
-      writer->printf("%-20s %10d %6d %s\n",
-        it->first.c_str(),it->second->rxcount,(tdiff/it->second->rxcount),vbuf);
-      if (it->second->last.origin)
+      dbcfile* dbc = r->last.origin->GetDBC();
+      if (dbc)
         {
-        dbcfile* dbc = it->second->last.origin->GetDBC();
-        if (dbc)
+        // We have a DBC attached.
+        dbcMessage* msg = dbc->m_messages.FindMessage(r->last.FIR.B.FF, r->last.MsgID);
+        if (msg)
           {
-          // We have a DBC attached.
-          dbcMessage* msg = dbc->m_messages.FindMessage(it->second->last.FIR.B.FF, it->second->last.MsgID);
-          if (msg)
+          // Let's look for signals...
+          dbcSignal* mux = msg->GetMultiplexorSignal();
+          uint32_t muxval;
+          if (mux)
             {
-            // Let's look for signals...
-            dbcSignal* mux = msg->GetMultiplexorSignal();
-            uint32_t muxval;
-            if (mux)
+            dbcNumber v = mux->Decode(&r->last);
+            muxval = v.GetSignedInteger();
+            std::ostringstream ss;
+            ss << "  dbc/mux/";
+            ss << mux->GetName();
+            ss << ": ";
+            ss << v;
+            ss << " ";
+            ss << mux->GetUnit();
+            writer->puts(ss.str().c_str());
+            }
+          for (dbcSignal* sig : msg->m_signals)
+            {
+            if ((mux==NULL)||(sig->GetMultiplexSwitchvalue() == muxval))
               {
-              dbcNumber r = mux->Decode(&it->second->last);
-              muxval = r.GetSignedInteger();
+              dbcNumber v = sig->Decode(&r->last);
               std::ostringstream ss;
-              ss << "  dbc/mux/";
-              ss << mux->GetName();
+              ss << "  dbc/";
+              ss << sig->GetName();
               ss << ": ";
-              ss << r;
+              ss << v;
               ss << " ";
-              ss << mux->GetUnit();
+              ss << sig->GetUnit();
               writer->puts(ss.str().c_str());
               }
-            for (dbcSignal* sig : msg->m_signals)
-              {
-              if ((mux==NULL)||(sig->GetMultiplexSwitchvalue() == muxval))
-                {
-                dbcNumber r = sig->Decode(&it->second->last);
-                std::ostringstream ss;
-                ss << "  dbc/";
-                ss << sig->GetName();
-                ss << ": ";
-                ss << r;
-                ss << " ";
-                ss << sig->GetUnit();
-                writer->puts(ss.str().c_str());
-                }
-              }
             }
           }
         }
@@ -529,17 +645,20 @@ void re_status(int verbosity, OvmsWriter* writer, OvmsCommand* cmd, int argc, co
     }
 
   OvmsMutexLock lock(&MyRE->m_mutex);
-  writer->printf("Key Map: %d entries\n",MyRE->m_rmap.size());
-  if (MyRE->m_rmap.size() > 0)
+  writer->printf("Key Map: %d entries (table size %d)\n",MyRE->GetRecordCount(),MyRE->GetTableSize());
+  if (MyRE->m_dropped > 0)
+    writer->printf("         %d frames dropped (table full)\n",MyRE->m_dropped);
+  if (MyRE->GetRecordCount() > 0)
     {
+    re_record_list_t list;
+    MyRE->GetRecords(list);
     int nignored = 0;
     int nchanged = 0;
     int bchanged = 0;
     int ndiscovered = 0;
     int bdiscovered = 0;
-    for (re_record_map_t::iterator it=MyRE->m_rmap.begin(); it!=MyRE->m_rmap.end(); ++it)
+    for (re_record_t* r : list)
       {
-      re_record_t *r = it->second;
       if (r->attr.b.Ignore) nignored++;
       if (r->attr.b.Changed) nchanged++;
       if (r->attr.b.Discovered) ndiscovered++;
@@ -608,10 +727,12 @@ void re_mode_discover(int verbosity, OvmsWriter* writer, OvmsCommand* cmd, int a
     }
 
   OvmsMutexLock lock(&MyRE->m_mutex);
-  for (re_record_map_t::iterator it=MyRE->m_rmap.begin(); it!=MyRE->m_rmap.end(); ++it)
+  re_record_list_t list;
+  MyRE->GetRecords(list);
+  for (re_record_t* r : list)
     {
-    it->second->attr.b.Discovered = 0;
-    it->second->attr.dd = 0;
+    r->attr.b.Discovered = 0;
+    r->attr.dd = 0;
     }
 
   MyRE->m_mode = Discover;
@@ -628,10 +749,12 @@ void re_clear_changed(int verbosity, OvmsWriter* writer, OvmsCommand* cmd, int a
     }
 
   OvmsMutexLock lock(&MyRE->m_mutex);
-  for (re_record_map_t::iterator it=MyRE->m_rmap.begin(); it!=MyRE->m_rmap.end(); ++it)
+  re_record_list_t list;
+  MyRE->GetRecords(list);
+  for (re_record_t* r : list)
     {
-    it->second->attr.b.Changed = 0;
-    it->second->attr.dc = 0;
+    r->attr.b.Changed = 0;
+    r->attr.dc = 0;
     }
 
   writer->puts("Cleared all change flags");
@@ -647,10 +770,12 @@ void re_clear_discovered(int verbosity, OvmsWriter* writer, OvmsCommand* cmd, in
     }
 
   OvmsMutexLock lock(&MyRE->m_mutex);
-  for (re_record_map_t::iterator it=MyRE->m_rmap.begin(); it!=MyRE->m_rmap.end(); ++it)
+  re_record_list_t list;
+  MyRE->GetRecords(list);
+  for (re_record_t* r : list)
     {
-    it->second->attr.b.Discovered = 0;
-    it->second->attr.dd = 0;
+    r->attr.b.Discovered = 0;
+    r->attr.dd = 0;
     }
 
   writer->puts("Cleared all discover flags");
@@ -670,18 +795,16 @@ void re_list_changed(int verbosity, OvmsWriter* writer, OvmsCommand* cmd, int ar
   if (tdiff == 0) tdiff = 1000;
 
   OvmsMutexLock lock(&MyRE->m_mutex);
-  writer->printf("%-20.20s %10s %6s %s\n","key","records","ms","last");
-  for (re_record_map_t::iterator it=MyRE->m_rmap.begin(); it!=MyRE->m_rmap.end(); ++it)
+  re_list_header(writer);
+  re_record_list_t list;
+  MyRE->GetRecords(list, (argc>0) ? argv[0] : NULL);
+  for (re_record_t* r : list)
     {
-    if ((it->second->attr.b.Changed)||(it->second->attr.dc))
+    if ((r->attr.b.Changed)||(r->attr.dc))
       {
-      HighlightDump(vbuf, (const char*)it->second->last.data.u8,
-        it->second->last.FIR.B.DLC, it->second->attr.dc, it->second->attr.dd);
-      if ((argc==0)||(strstr(it->first.c_str(),argv[0])))
-        {
-        writer->printf("%-20s %10d %6d %s\n",
-          it->first.c_str(),it->second->rxcount,(tdiff/it->second->rxcount),vbuf);
-        }
+      HighlightDump(vbuf, (const char*)r->last.data.u8,
+        r->last.FIR.B.DLC, r->attr.dc, r->attr.dd);
+      re_list_record(writer, r, tdiff, vbuf);
       }
     }
   }
@@ -701,23 +824,22 @@ void re_stream_changed(int verbosity, OvmsWriter* writer, OvmsCommand* cmd, int
   OvmsMutexLock lock(&MyRE->m_mutex);
   writer->printf("[");
   int cnt = 0;
-  for (re_record_map_t::iterator it=MyRE->m_rmap.begin(); it!=MyRE->m_rmap.end(); ++it)
+  re_record_list_t list;
+  MyRE->GetRecords(list, (argc>0) ? argv[0] : NULL);
+  for (re_record_t* r : list)
     {
-    if ((it->second->attr.b.Changed)||(it->second->attr.dc))
+    if ((r->attr.b.Changed)||(r->attr.dc))
       {
-      HighlightDump(vbuf, (const char*)it->second->last.data.u8,
-        it->second->last.FIR.B.DLC, it->second->attr.dc, it->second->attr.dd, 1);
-      if ((argc==0)||(strstr(it->first.c_str(),argv[0])))
-        {
-        char *asc = strchr(vbuf, '|');
-        *asc = 0;
-        writer->printf("%s[\"%s\",%d,%d,\"%s\",\"%s\"]\n",
-          cnt ? "," : "",
-          json_encode(it->first).c_str(), it->second->rxcount, (tdiff/it->second->rxcount),
-          json_encode(std::string(vbuf)).c_str(),
-          json_encode(std::string(asc+2)).c_str());
-        cnt++;
-        }
+      HighlightDump(vbuf, (const char*)r->last.data.u8,
+        r->last.FIR.B.DLC, r->attr.dc, r->attr.dd, 1);
+      char *asc = strchr(vbuf, '|');
+      *asc = 0;
+      writer->printf("%s[\"%s\",%d,%d,\"%s\",\"%s\"]\n",
+        cnt ? "," : "",
+        json_encode(MyRE->GetKeyName(r->key)).c_str(), r->rxcount, re_interval_avg(r, tdiff),
+        json_encode(std::string(vbuf)).c_str(),
+        json_encode(std::string(asc+2)).c_str());
+      cnt++;
       }
     }
   writer->puts("]");
@@ -736,18 +858,16 @@ void re_list_discovered(int verbosity, OvmsWriter* writer, OvmsCommand* cmd, int
   if (tdiff == 0) tdiff = 1000;
 
   OvmsMutexLock lock(&MyRE->m_mutex);
-  writer->printf("%-20.20s %10s %6s %s\n","key","records","ms","last");
-  for (re_record_map_t::iterator it=MyRE->m_rmap.begin(); it!=MyRE->m_rmap.end(); ++it)
+  re_list_header(writer);
+  re_record_list_t list;
+  MyRE->GetRecords(list, (argc>0) ? argv[0] : NULL);
+  for (re_record_t* r : list)
     {
-    if ((it->second->attr.b.Discovered)||(it->second->attr.dd))
+    if ((r->attr.b.Discovered)||(r->attr.dd))
       {
-      HighlightDump(vbuf, (const char*)it->second->last.data.u8,
-        it->second->last.FIR.B.DLC, it->second->attr.dc, it->second->attr.dd);
-      if ((argc==0)||(strstr(it->first.c_str(),argv[0])))
-        {
-        writer->printf("%-20s %10d %6d %s\n",
-          it->first.c_str(),it->second->rxcount,(tdiff/it->second->rxcount),vbuf);
-        }
+      HighlightDump(vbuf, (const char*)r->last.data.u8,
+        r->last.FIR.B.DLC, r->attr.dc, r->attr.dd);
+      re_list_record(writer, r, tdiff, vbuf);
       }
     }
   }
@@ -783,7 +903,7 @@ REInit::REInit()
   cmd_re->RegisterCommand("start","Start RE tools",
     re_start,
     "[filter1] ... [filterN]\n"
-    "Filter: <bus> | <id>[-<id>] | <bus>:<id>[-<id>]\n"
+    "Filter: [!]<bus> | [!][<bus>:]<id>[-<id>] | [!][<bus>:]<id>/<mask>\n"
     "Example: 2:2a0-37f",
     0, 9);
   cmd_re->RegisterCommand("stop","Stop RE tools",re_stop);
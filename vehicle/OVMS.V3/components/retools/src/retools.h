@@ -35,7 +35,7 @@
 #include "freertos/task.h"
 #include "freertos/queue.h"
 #include <string>
-#include <map>
+#include <vector>
 #include "can.h"
 #include "canformat.h"
 #include "dbc.h"
@@ -44,10 +44,30 @@
 #include "ovms_mutex.h"
 #include "ovms_netmanager.h"
 
+// Record key: packed (bus, format, id, kind, sub) integer, sorting
+// by key yields bus / format / id / kind / sub order.
+//   bits 61-63: bus number + 1 (7 = unknown origin)
+//   bit  60:    extended frame format
+//   bits 31-59: CAN ID
+//   bits 29-30: kind (plain, multiplexed, OBDII request/response)
+//   bits 0-28:  sub key (mux value, OBDII mode & PID)
+typedef uint64_t re_key_t;
+
+#define RE_KEY_PLAIN          0
+#define RE_KEY_MUX            1
+#define RE_KEY_OBDII          2
+
+#define RE_TABLE_INITIAL      1024    // initial table size (power of 2)
+
 typedef struct
   {
+  re_key_t key;             // 0 = unused slot
   CAN_frame_t last;
   uint32_t rxcount;
+  int64_t firstrx;          // esp_timer_get_time() of first frame
+  int64_t lastrx;           // esp_timer_get_time() of last frame
+  uint32_t intmin;          // inter-arrival time minimum [us]
+  uint32_t intmax;          // inter-arrival time maximum [us]
   struct __attribute__((__packed__))
     {
     struct {
@@ -66,7 +86,7 @@ typedef struct
     } attr;
   } re_record_t;
 
-typedef std::map<std::string, re_record_t*> re_record_map_t;
+typedef std::vector<re_record_t*> re_record_list_t;
 
 enum REMode { Analyse, Discover };
 
@@ -82,26 +102,35 @@ class re : public pcp, public ExternalRamAllocated
   public:
     void Task();
     void Clear();
-    std::string GetKey(CAN_frame_t* frame);
+    re_key_t GetKey(CAN_frame_t* frame);
+    static std::string GetKeyName(re_key_t key);
+    void GetRecords(re_record_list_t& list, const char* filter=NULL);
+    uint32_t GetRecordCount() { return m_count; }
+    uint32_t GetTableSize() { return m_size; }
 
   protected:
     void DoAnalyse(CAN_frame_t* frame);
+    re_record_t* Lookup(re_key_t key, bool* created);
+    bool Resize(uint32_t size);
 
   protected:
     TaskHandle_t m_task;
     QueueHandle_t m_rxqueue;
+    re_record_t* m_table;           // open addressing hash table (external RAM)
+    uint32_t m_size;                // table size (power of 2)
+    uint32_t m_count;               // used slots
 
   public:
     OvmsMutex m_mutex;
     canfilter* m_filter;
     REMode m_mode;
-    re_record_map_t m_rmap;
     uint32_t m_obdii_std_min;
     uint32_t m_obdii_std_max;
     uint32_t m_obdii_ext_min;
     uint32_t m_obdii_ext_max;
     uint32_t m_started;
     uint32_t m_finished;
+    uint32_t m_dropped;             // frames dropped due to table full
   };
 
 #endif //#ifndef __RETOOLS_H__
@@ -154,8 +154,9 @@ void GsmMuxChannel::ProcessFrame(uint8_t* frame, size_t length, size_t iframepos
     case ChanOpen:
       if (frame[1] == (GSM_UIH + GSM_PF))
         {
-        for (size_t k=iframepos;k<length;k++)
-          m_buffer.Push(frame[k]);
+        size_t n = (length > iframepos) ? length-iframepos : 0;
+        if (n > m_buffer.FreeSpace()) n = m_buffer.FreeSpace();
+        m_buffer.Push(frame+iframepos, n);
         m_mux->m_modem->IncomingMuxData(this);
         }
       break;
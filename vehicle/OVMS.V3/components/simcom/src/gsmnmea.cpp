@@ -34,6 +34,7 @@ static const char *TAG = "gsm-nmea";
 
 #include <string>
 #include <sstream>
+#include <string.h>
 
 #include "gsmnmea.h"
 #include "ovms_command.h"
@@ -42,6 +43,7 @@ static const char *TAG = "gsm-nmea";
 #include "ovms_metrics.h"
 #include "metrics_standard.h"
 #include "ovms_time.h"
+#include "esp_timer.h"
 
 #define JDEpoch 2440588 // Julian date of the Unix epoch
 #define DIM(a) (sizeof(a)/sizeof(*(a)))
@@ -49,6 +51,7 @@ static const char *TAG = "gsm-nmea";
 
 /**
  * gps2latlon: convert NMEA degree/minute form to degrees
+ *  (former float parser, used for the parser test)
  */
 static float gps2latlon(const char *gpscoord)
 {
@@ -99,151 +102,420 @@ static unsigned long utc_to_timestamp(const char* date, const char* time)
   }
 
 
-void GsmNMEA::IncomingLine(const std::string line)
+static inline int hexval(char c)
   {
-  ESP_LOGV(TAG, "IncomingLine: %s", line.c_str());
+  if (c >= '0' && c <= '9') return c - '0';
+  if (c >= 'A' && c <= 'F') return c - 'A' + 10;
+  if (c >= 'a' && c <= 'f') return c - 'a' + 10;
+  return -1;
+  }
 
-  std::istringstream sentence(line);
-  std::string token;
+static inline bool isdigitc(char c)
+  {
+  return (c >= '0' && c <= '9');
+  }
 
-  if (!std::getline(sentence, token, ','))
-    return;
-  if (token[0] != '$')
-    return;
 
-  if (token.substr(3) == "GNS")
+/**
+ * NmeaSentence::Parse: validate checksum & split fields
+ *  Expects a single line "$<address>,<field>,…*<hh>" (trailing CR/LF allowed).
+ */
+nmea_result_t NmeaSentence::Parse(const char* line, size_t len)
+  {
+  m_count = 0;
+  m_key = 0;
+
+  while (len > 0 && (line[len-1] == '\r' || line[len-1] == '\n' || line[len-1] == ' '))
+    len--;
+  if (len < 1 || line[0] != '$')
+    return NMEA_NOSENTENCE;
+  if (len > NMEA_MAXLEN || len < 4 || line[len-3] != '*')
+    return NMEA_MALFORMED;
+  int hi = hexval(line[len-2]), lo = hexval(line[len-1]);
+  if (hi < 0 || lo < 0)
+    return NMEA_MALFORMED;
+
+  // Tokenize & compute checksum in one pass:
+  const char* end = line + len - 3;
+  const char* start = line + 1;
+  uint8_t checksum = 0;
+  for (const char* p = start; p < end; p++)
     {
-    // NMEA sentence type "GNS": GNSS Position Fix Data (GPS/GLONASS/… combined position data)
-    //  $..GNS,<Time>,<Latitude>,<NS>,<Longitude>,<EW>,<Mode>,<SatCnt>,<HDOP>,<Altitude>,<GeoidalSep>,<DiffAge>,<Chksum>
-    // Example:
-    //  $GNGNS,085320.0,5118.138139,N,00723.398844,E,AA,12,0.9,321.3,47.0,,*6E
-    // Notes:
-    //  <Mode>: first char = GPS, second = GLONASS;
-    //    N = No fix
-    //    A = Autonomous mode (non differential)
-    //    D = Differential mode
-    //    E = Estimation mode
-
-    float lat=0, lon=0, alt=0, hdop=0;
-    char ns=0, ew=0;
-    char mode[3] = {0,0,0};
-    int satcnt=0;
-
-    // Parse sentence:
-
-    if (std::getline(sentence, token, ','))
-      {;} // Time ignored here, see RMC handler
-    if (std::getline(sentence, token, ','))
-      lat = gps2latlon(token.c_str());
-    if (std::getline(sentence, token, ','))
-      ns = token[0];
-    if (std::getline(sentence, token, ','))
-      lon = gps2latlon(token.c_str());
-    if (std::getline(sentence, token, ','))
-      ew = token[0];
-    if (std::getline(sentence, token, ','))
+    char c = *p;
+    checksum ^= c;
+    if (c == ',')
       {
-      mode[0] = token[0];
-      mode[1] = token[1];
+      if (m_count >= NMEA_MAXFIELDS-1)
+        return NMEA_MALFORMED;
+      m_field[m_count] = start;
+      m_len[m_count] = p - start;
+      m_count++;
+      start = p + 1;
       }
-    if (std::getline(sentence, token, ','))
-      satcnt = atoi(token.c_str());
-    if (std::getline(sentence, token, ','))
-      hdop = atof(token.c_str());
-    if (std::getline(sentence, token, ','))
-      alt = atof(token.c_str());
-
-    // Check:
-
-    if (!ns || !ew || !mode[0])
-      return; // malformed/empty sentence
-
-    // Data set complete, store:
+    else if (c == '*' || c == '$')
+      return NMEA_MALFORMED;
+    }
+  if (checksum != ((hi << 4) | lo))
+    {
+    m_count = 0;
+    return NMEA_BADCHECKSUM;
+    }
+  m_field[m_count] = start;
+  m_len[m_count] = end - start;
+  m_count++;
 
-    if (ns == 'S')
-      lat = -lat;
-    if (ew == 'W')
-      lon = -lon;
+  // Address field: 2 char talker ID + 3 char sentence formatter
+  if (m_len[0] == 5)
+    m_key = NMEA_KEY(m_field[0][2], m_field[0][3], m_field[0][4]);
 
-    bool gpslock = (mode[0] != 'N' || mode[1] != 'N');
+  return NMEA_OK;
+  }
 
-    *StdMetrics.ms_v_pos_gpsmode = (std::string) mode;
-    *StdMetrics.ms_v_pos_satcount = (int) satcnt;
-    *StdMetrics.ms_v_pos_gpshdop = (float) hdop;
+/**
+ * NmeaSentence::UInt: decode unsigned integer field (max 9 digits)
+ */
+bool NmeaSentence::UInt(int i, uint32_t* val)
+  {
+  if (IsEmpty(i) || m_len[i] > 9) return false;
+  const char *p = m_field[i], *e = p + m_len[i];
+  uint32_t v = 0;
+  for (; p < e; p++)
+    {
+    if (!isdigitc(*p)) return false;
+    v = v * 10 + (*p - '0');
+    }
+  *val = v;
+  return true;
+  }
 
-    if (gpslock)
+/**
+ * NmeaSentence::Fixed: decode decimal field into a fixed point integer
+ *  with the given number of decimals, e.g. "12.345" → 1234 for decimals=2
+ *  (excess decimals are truncated, max 9 significant digits)
+ */
+bool NmeaSentence::Fixed(int i, int decimals, int32_t* val)
+  {
+  if (IsEmpty(i)) return false;
+  const char *p = m_field[i], *e = p + m_len[i];
+  bool neg = false;
+  if (*p == '-' || *p == '+')
+    {
+    neg = (*p == '-');
+    p++;
+    }
+  int32_t v = 0;
+  int digits = 0;
+  for (; p < e && isdigitc(*p); p++)
+    {
+    if (++digits + decimals > 9) return false;
+    v = v * 10 + (*p - '0');
+    }
+  int frac = 0;
+  if (p < e && *p == '.')
+    {
+    for (p++; p < e && isdigitc(*p); p++)
       {
-      *StdMetrics.ms_v_pos_latitude = (float) lat;
-      *StdMetrics.ms_v_pos_longitude = (float) lon;
-      *StdMetrics.ms_v_pos_altitude = (float) alt;
+      if (frac < decimals)
+        {
+        v = v * 10 + (*p - '0');
+        frac++;
+        }
       }
+    }
+  if (p != e || (digits == 0 && frac == 0)) return false;
+  for (; frac < decimals; frac++)
+    v *= 10;
+  *val = neg ? -v : v;
+  return true;
+  }
 
-    // upodate gpslock last, so listeners will see updated lat/lon values:
-    if (gpslock != StdMetrics.ms_v_pos_gpslock->AsBool())
+/**
+ * NmeaSentence::Coord: decode coordinate field "[d]ddmm.mmmmmm" into
+ *  1/10^7 degrees (signed by the hemisphere: 'S' & 'W' = negative)
+ */
+bool NmeaSentence::Coord(int i, char hemisphere, int32_t* val)
+  {
+  if (IsEmpty(i)) return false;
+  const char *p = m_field[i], *e = p + m_len[i];
+  int32_t ip = 0;
+  int digits = 0;
+  for (; p < e && isdigitc(*p); p++)
+    {
+    if (++digits > 5) return false;
+    ip = ip * 10 + (*p - '0');
+    }
+  if (digits < 3) return false;
+  int32_t deg = ip / 100, min = ip % 100;
+  if (deg > 180 || min >= 60) return false;
+  // minutes in 1/10^6:
+  int32_t umin = min * 1000000;
+  if (p < e && *p == '.')
+    {
+    int32_t scale = 100000;
+    for (p++; p < e && isdigitc(*p); p++)
       {
-      *StdMetrics.ms_v_pos_gpslock = (bool) gpslock;
-      if (gpslock)
-        MyEvents.SignalEvent("system.modem.gotgps", NULL);
-      else
-        MyEvents.SignalEvent("system.modem.lostgps", NULL);
+      umin += (*p - '0') * scale;
+      scale /= 10;
       }
+    }
+  if (p != e) return false;
+  // 1/10^7 degrees = 1/10^6 minutes * 10 / 60:
+  int32_t v = deg * 10000000 + (umin + 3) / 6;
+  *val = (hemisphere == 'S' || hemisphere == 'W') ? -v : v;
+  return true;
+  }
+
+/**
+ * NmeaSentence::Copy: copy field as a zero terminated string
+ *  (truncated to size-1 chars)
+ */
+bool NmeaSentence::Copy(int i, char* dest, size_t size)
+  {
+  if (size == 0) return false;
+  size_t n = (i < m_count) ? m_len[i] : 0;
+  if (n > size-1) n = size-1;
+  if (n) memcpy(dest, m_field[i], n);
+  dest[n] = 0;
+  return (n > 0);
+  }
+
 
-    // END "GNS" handler
+void GsmNMEA::IncomingLine(const char* line, size_t len)
+  {
+  ESP_LOGV(TAG, "IncomingLine: %.*s", (int)len, line);
+
+  NmeaSentence s;
+  switch (s.Parse(line, len))
+    {
+    case NMEA_OK:
+      m_sentences++;
+      break;
+    case NMEA_BADCHECKSUM:
+      m_badchecksums++;
+      ESP_LOGD(TAG, "IncomingLine: checksum mismatch: %.*s", (int)len, line);
+      return;
+    case NMEA_MALFORMED:
+      m_malformed++;
+      return;
+    default:
+      return;
     }
 
-  else if (token.substr(3) == "RMC")
+  switch (s.Key())
+    {
+    case NMEA_KEY('G','N','S'): HandleGNS(s); break;
+    case NMEA_KEY('R','M','C'): HandleRMC(s); break;
+    case NMEA_KEY('G','S','A'): HandleGSA(s); break;
+    case NMEA_KEY('V','T','G'): HandleVTG(s); break;
+    case NMEA_KEY('G','S','V'): HandleGSV(s); break;
+    default: break;
+    }
+  }
+
+
+void GsmNMEA::HandleGNS(NmeaSentence& s)
+  {
+  // NMEA sentence type "GNS": GNSS Position Fix Data (GPS/GLONASS/… combined position data)
+  //  $..GNS,<Time>,<Latitude>,<NS>,<Longitude>,<EW>,<Mode>,<SatCnt>,<HDOP>,<Altitude>,<GeoidalSep>,<DiffAge>,<Chksum>
+  // Example:
+  //  $GNGNS,085320.0,5118.138139,N,00723.398844,E,AA,12,0.9,321.3,47.0,,*6E
+  // Notes:
+  //  <Mode>: first char = GPS, second = GLONASS;
+  //    N = No fix
+  //    A = Autonomous mode (non differential)
+  //    D = Differential mode
+  //    E = Estimation mode
+
+  int32_t lat=0, lon=0, alt=0, hdop=0;
+  uint32_t satcnt=0;
+  char ns, ew;
+  char mode[3];
+
+  // Parse sentence:
+
+  ns = s.Char(3);
+  ew = s.Char(5);
+  s.Copy(6, mode, sizeof(mode));
+  s.Coord(2, ns, &lat);
+  s.Coord(4, ew, &lon);
+  s.UInt(7, &satcnt);
+  s.Fixed(8, 2, &hdop);
+  s.Fixed(9, 2, &alt);
+
+  // Check:
+
+  if (!ns || !ew || !mode[0])
+    return; // malformed/empty sentence
+
+  // Data set complete, store:
+
+  bool gpslock = (mode[0] != 'N' || (mode[1] != 'N' && mode[1] != 0));
+
+  *StdMetrics.ms_v_pos_gpsmode = (std::string) mode;
+  *StdMetrics.ms_v_pos_satcount = (int) satcnt;
+  *StdMetrics.ms_v_pos_gpshdop = (float) hdop / 100;
+
+  if (gpslock)
+    {
+    *StdMetrics.ms_v_pos_latitude = (float) lat / 10000000;
+    *StdMetrics.ms_v_pos_longitude = (float) lon / 10000000;
+    *StdMetrics.ms_v_pos_altitude = (float) alt / 100;
+    }
+
+  // upodate gpslock last, so listeners will see updated lat/lon values:
+  if (gpslock != StdMetrics.ms_v_pos_gpslock->AsBool())
+    {
+    *StdMetrics.ms_v_pos_gpslock = (bool) gpslock;
+    if (gpslock)
+      MyEvents.SignalEvent("system.modem.gotgps", NULL);
+    else
+      MyEvents.SignalEvent("system.modem.lostgps", NULL);
+    }
+  }
+
+
+void GsmNMEA::HandleRMC(NmeaSentence& s)
+  {
+  // NMEA sentence type "RMC": Recommended Minimum Specific GNSS Data
+  //  $..RMC,<Time>,<Status>,<Latitude>,<NS>,<Longitude>,<EW>,<SpeedKnots>,<Direction>,<Date>,<MagVar>,<MagVarEW>,<Mode>,<Chksum>
+  // Example:
+  //  $GPRMC,085320.0,A,5118.138139,N,00723.398844,E,0.0,265.5,101217,,,A*62
+
+  char date[7], time[7];
+  int32_t direction=0, speed=0;
+
+  // Parse sentence:
+
+  s.Copy(1, time, sizeof(time));
+  s.Fixed(7, 3, &speed);        // knots
+  s.Fixed(8, 2, &direction);
+  s.Copy(9, date, sizeof(date));
+
+  // Check:
+
+  if (strlen(date) != 6 || strlen(time) != 6 || strspn(date, "0123456789") != 6 || strspn(time, "0123456789") != 6)
+    return; // malformed/empty sentence
+
+  // Data complete, store:
+
+  if (m_gpstime_enabled)
+    {
+    int tm = utc_to_timestamp(date, time);
+    if (tm < 1572735600) // 2019-11-03 00:00:00
+      tm += (1024*7*86400); // Nasty kludge to workaround SIM5360 week rollover
+    *StdMetrics.ms_m_timeutc = (int) tm;
+    MyTime.Set(TAG, 2, true, tm);
+    }
+
+  *StdMetrics.ms_v_pos_direction = (float) direction / 100;
+  *StdMetrics.ms_v_pos_gpsspeed = (float) speed * 0.001852f;
+  }
+
+
+void GsmNMEA::HandleGSA(NmeaSentence& s)
+  {
+  // NMEA sentence type "GSA": GNSS DOP and Active Satellites
+  //  $..GSA,<Mode>,<FixType>,<SV>,<SV>,…(12),<PDOP>,<HDOP>,<VDOP>[,<SystemID>],<Chksum>
+  // Example:
+  //  $GNGSA,A,3,05,13,15,18,20,24,29,,,,,,1.6,0.9,1.3*25
+  // Notes:
+  //  <FixType>: 1 = no fix, 2 = 2D fix, 3 = 3D fix
+  //  Combined GNSS receivers send one GSA per system, DOP values are common
+
+  uint32_t fixtype;
+  if (!s.UInt(2, &fixtype) || fixtype < 1 || fixtype > 3)
+    return;
+  m_fixtype = fixtype;
+  if (!s.Fixed(15, 2, &m_pdop)) m_pdop = 0;
+  if (!s.Fixed(17, 2, &m_vdop)) m_vdop = 0;
+  }
+
+
+void GsmNMEA::HandleVTG(NmeaSentence& s)
+  {
+  // NMEA sentence type "VTG": Course Over Ground and Ground Speed
+  //  $..VTG,<CourseTrue>,T,<CourseMagnetic>,M,<SpeedKnots>,N,<SpeedKph>,K,<Mode>,<Chksum>
+  // Example:
+  //  $GPVTG,182.4,T,,M,27.5,N,50.9,K,D*0B
+
+  if (s.Char(9) == 'N')
+    return; // no fix
+  int32_t direction, speed;
+  if (s.Fixed(1, 2, &direction))
+    *StdMetrics.ms_v_pos_direction = (float) direction / 100;
+  if (s.Fixed(7, 2, &speed))
+    *StdMetrics.ms_v_pos_gpsspeed = (float) speed / 100;
+  }
+
+
+void GsmNMEA::HandleGSV(NmeaSentence& s)
+  {
+  // NMEA sentence type "GSV": GNSS Satellites in View
+  //  $..GSV,<NumMsgs>,<MsgNum>,<SatsInView>,{<PRN>,<Elevation>,<Azimuth>,<SNR>}(1-4)[,<SignalID>],<Chksum>
+  // Example:
+  //  $GPGSV,3,1,11,05,41,269,38,13,48,166,41,15,59,068,42,18,23,061,33*78
+  // Notes:
+  //  One message group per system (talker), <SNR> empty = not tracked
+
+  uint32_t nummsgs, msgnum, inview;
+  if (!s.UInt(1, &nummsgs) || !s.UInt(2, &msgnum) || !s.UInt(3, &inview))
+    return;
+  if (msgnum < 1 || msgnum > nummsgs)
+    return;
+
+  int sys;
+  char t0 = s.Talker(0), t1 = s.Talker(1);
+  if (t0 == 'G' && t1 == 'P') sys = 0;
+  else if (t0 == 'G' && t1 == 'L') sys = 1;
+  else if (t0 == 'G' && t1 == 'A') sys = 2;
+  else if ((t0 == 'G' && t1 == 'B') || (t0 == 'B' && t1 == 'D')) sys = 3;
+  else sys = 4;
+  auto& gsv = m_gsv[sys];
+
+  if (msgnum == 1)
+    {
+    gsv.cur_tracked = 0;
+    gsv.cur_snrmax = 0;
+    gsv.cur_snrsum = 0;
+    }
+  for (int i = 4; i+3 < s.Count(); i += 4)
     {
-    // NMEA sentence type "RMC": Recommended Minimum Specific GNSS Data
-    //  $..RMC,<Time>,<Status>,<Latitude>,<NS>,<Longitude>,<EW>,<SpeedKnots>,<Direction>,<Date>,<MagVar>,<MagVarEW>,<Mode>,<Chksum>
-    // Example:
-    //  $GPRMC,085320.0,A,5118.138139,N,00723.398844,E,0.0,265.5,101217,,,A*62
-
-    char date[6] = {0}, time[6] = {0};
-    float direction=0, speed=0;
-
-    // Parse sentence:
-
-    if (std::getline(sentence, token, ','))
-      strncpy(time, token.c_str(), 6);
-    if (std::getline(sentence, token, ','))
-      {;} // Status
-    if (std::getline(sentence, token, ','))
-      {;} // Latitude
-    if (std::getline(sentence, token, ','))
-      {;} // NS
-    if (std::getline(sentence, token, ','))
-      {;} // Longitude
-    if (std::getline(sentence, token, ','))
-      {;} // EW
-    if (std::getline(sentence, token, ','))
-      speed = atof(token.c_str()) * 1.852;
-    if (std::getline(sentence, token, ','))
-      direction = atof(token.c_str());
-    if (std::getline(sentence, token, ','))
-      strncpy(date, token.c_str(), 6);
-
-    // Check:
-
-    if (!date[0] || !time[0])
-      return; // malformed/empty sentence
-
-    // Data complete, store:
-
-    if (m_gpstime_enabled)
+    uint32_t snr;
+    if (s.UInt(i+3, &snr) && snr > 0 && snr < 100)
       {
-      int tm = utc_to_timestamp(date, time);
-      if (tm < 1572735600) // 2019-11-03 00:00:00
-        tm += (1024*7*86400); // Nasty kludge to workaround SIM5360 week rollover
-      *StdMetrics.ms_m_timeutc = (int) tm;
-      MyTime.Set(TAG, 2, true, tm);
+      gsv.cur_tracked++;
+      gsv.cur_snrsum += snr;
+      if (snr > gsv.cur_snrmax) gsv.cur_snrmax = snr;
       }
+    }
+  if (msgnum == nummsgs)
+    {
+    gsv.inview = (inview < 256) ? inview : 255;
+    gsv.tracked = gsv.cur_tracked;
+    gsv.snrmax = gsv.cur_snrmax;
+    gsv.snrsum = gsv.cur_snrsum;
+    }
+  }
 
-    *StdMetrics.ms_v_pos_direction = (float) direction;
-    *StdMetrics.ms_v_pos_gpsspeed = (float) speed;
 
-    // END "RMC" handler
+void GsmNMEA::Status(OvmsWriter* writer)
+  {
+  writer->printf("     Sentences: %u valid, %u checksum errors, %u malformed\n",
+    m_sentences, m_badchecksums, m_malformed);
+  if (m_fixtype)
+    {
+    writer->printf("     Fix: %s, PDOP %.1f, VDOP %.1f\n",
+      (m_fixtype == 3) ? "3D" : (m_fixtype == 2) ? "2D" : "none",
+      (float) m_pdop / 100, (float) m_vdop / 100);
+    }
+  static const char* sysname[5] = { "GPS", "GLONASS", "Galileo", "BeiDou", "Other" };
+  for (int i = 0; i < 5; i++)
+    {
+    if (m_gsv[i].inview == 0) continue;
+    writer->printf("     %s: %d satellites in view, %d tracked, SNR avg %d max %d dB\n",
+      sysname[i], m_gsv[i].inview, m_gsv[i].tracked,
+      m_gsv[i].tracked ? m_gsv[i].snrsum / m_gsv[i].tracked : 0, m_gsv[i].snrmax);
     }
-
   }
 
 
@@ -259,10 +531,18 @@ void GsmNMEA::Startup()
 
   m_gpstime_enabled = MyConfig.GetParamValueBool("modem", "enable.gpstime", false);
 
+  m_fixtype = 0;
+  m_pdop = m_vdop = 0;
+  memset(m_gsv, 0, sizeof(m_gsv));
+
   // Switch on GPS, subscribe to NMEA sentences…
   //   2 = $..RMC -- UTC time & date
   //  64 = $..GNS -- Position & fix data
-  m_mux->tx(GSM_MUX_CHAN_CMD, "AT+CGPSNMEA=66;+CGPS=1,1\r\n");
+  // GSA/GSV/VTG may be added by config (see modem AT command manual for the bits)
+  int sentences = MyConfig.GetParamValueInt("modem", "gps.nmea", 66);
+  char cmd[48];
+  snprintf(cmd, sizeof(cmd), "AT+CGPSNMEA=%d;+CGPS=1,1\r\n", sentences);
+  m_mux->tx(GSM_MUX_CHAN_CMD, cmd);
 
   m_connected = true;
   }
@@ -291,8 +571,223 @@ GsmNMEA::GsmNMEA(GsmMux* mux, int channel)
   m_channel = channel;
   m_connected = false;
   m_gpstime_enabled = false;
+  m_sentences = 0;
+  m_badchecksums = 0;
+  m_malformed = 0;
+  m_fixtype = 0;
+  m_pdop = 0;
+  m_vdop = 0;
+  memset(m_gsv, 0, sizeof(m_gsv));
   }
 
 GsmNMEA::~GsmNMEA()
   {
   }
+
+
+// Recorded sentences (SIM5360 / SIM7600) for the parser test:
+static const char* const nmea_test_sentences[] =
+  {
+  "$GNGNS,085320.0,5118.138139,N,00723.398844,E,AA,12,0.9,321.3,47.0,,*6E",
+  "$GPRMC,085320.0,A,5118.138139,N,00723.398844,E,0.0,265.5,101217,,,A*62",
+  "$GNGSA,A,3,05,13,15,18,20,24,29,,,,,,1.6,0.9,1.3*25",
+  "$GNGSA,A,3,66,67,76,77,,,,,,,,,1.6,0.9,1.3*20",
+  "$GPGSV,3,1,11,05,41,269,38,13,48,166,41,15,59,068,42,18,23,061,33*78",
+  "$GPGSV,3,2,11,20,37,120,40,24,16,037,29,29,27,298,36,02,04,329,*71",
+  "$GPGSV,3,3,11,25,03,261,,26,01,358,,31,01,115,*45",
+  "$GLGSV,2,1,06,66,48,053,31,67,62,306,35,76,27,225,33,77,65,311,37*6B",
+  "$GLGSV,2,2,06,68,10,281,,87,02,017,*6C",
+  "$GPVTG,265.5,T,,M,0.0,N,0.0,K,A*09",
+  "$GNGNS,085321.0,5118.138201,N,00723.398712,E,AA,12,0.9,321.4,47.0,,*6C",
+  "$GPRMC,085321.0,A,5118.138201,N,00723.398712,E,12.3,91.2,101217,,,A*69",
+  "$GNGNS,193502.0,3352.096530,S,15112.462380,E,AN,07,1.4,38.2,22.5,,*4B",
+  "$GPRMC,193502.0,A,3352.096530,S,15112.462380,E,31.8,4.7,150320,,,A*40",
+  "$GNGNS,120000.0,4043.574512,N,07400.147883,W,DA,09,1.1,12.7,-34.2,,*68",
+  "$GPVTG,182.4,T,,M,27.5,N,50.9,K,D*0B",
+  "$GNGNS,000000.0,,,,,NN,00,,,,,*4D",
+  "$GPRMC,000000.0,V,,,,,,,060180,,,N*42",
+  };
+
+// Former tokenizer (istringstream), for benchmark comparison:
+static int nmea_test_legacy(const std::string& line)
+  {
+  std::istringstream sentence(line);
+  std::string token;
+  int fields = 0;
+  float val = 0;
+
+  if (!std::getline(sentence, token, ','))
+    return 0;
+  if (token[0] != '$')
+    return 0;
+  if (token.substr(3) == "GNS")
+    {
+    for (int i = 1; std::getline(sentence, token, ','); i++, fields++)
+      {
+      if (i == 2 || i == 4) val += gps2latlon(token.c_str());
+      else if (i >= 7 && i <= 9) val += atof(token.c_str());
+      }
+    }
+  else if (token.substr(3) == "RMC")
+    {
+    for (int i = 1; std::getline(sentence, token, ','); i++, fields++)
+      {
+      if (i == 7 || i == 8) val += atof(token.c_str());
+      }
+    }
+  return fields + (val != 0);
+  }
+
+// Decode all fields with all decoders:
+static int nmea_test_decode(NmeaSentence& s)
+  {
+  int decoded = 0;
+  char buf[16];
+  for (int i = 0; i < s.Count(); i++)
+    {
+    uint32_t u;
+    int32_t v;
+    decoded += s.UInt(i, &u);
+    decoded += s.Fixed(i, 2, &v);
+    decoded += s.Coord(i, s.Char(i+1), &v);
+    decoded += s.Copy(i, buf, sizeof(buf));
+    }
+  return decoded;
+  }
+
+/**
+ * simcom_nmea_test: NMEA parser test
+ *  - checks the recorded sentences & compares coordinates to the former float parser
+ *  - fuzzes the parser with mutated sentences (raw & with recomputed checksums)
+ *  - benchmarks former tokenizer vs. NmeaSentence on the recorded sentences
+ */
+void simcom_nmea_test(int verbosity, OvmsWriter* writer, OvmsCommand* cmd, int argc, const char* const* argv)
+  {
+  int rounds = (argc > 0) ? atoi(argv[0]) : 1000;
+  if (rounds < 1)
+    {
+    writer->puts("Error: invalid round count");
+    return;
+    }
+  const int count = DIM(nmea_test_sentences);
+  NmeaSentence s;
+
+  // Recorded sentences:
+  int failed = 0;
+  float maxerr = 0;
+  for (int k = 0; k < count; k++)
+    {
+    const char* line = nmea_test_sentences[k];
+    if (s.Parse(line, strlen(line)) != NMEA_OK)
+      {
+      writer->printf("  FAIL: %s\n", line);
+      failed++;
+      continue;
+      }
+    if (s.Key() == NMEA_KEY('G','N','S') && !s.IsEmpty(2))
+      {
+      int32_t lat, lon;
+      std::string fld2(s.m_field[2], s.m_len[2]), fld4(s.m_field[4], s.m_len[4]);
+      if (!s.Coord(2, 'N', &lat) || !s.Coord(4, 'E', &lon))
+        {
+        writer->printf("  FAIL: coordinates %s\n", line);
+        failed++;
+        continue;
+        }
+      float err = fabsf((float) lat / 10000000 - gps2latlon(fld2.c_str()));
+      if (err > maxerr) maxerr = err;
+      err = fabsf((float) lon / 10000000 - gps2latlon(fld4.c_str()));
+      if (err > maxerr) maxerr = err;
+      }
+    }
+  writer->printf("Recorded: %d sentences, %d failed, max coordinate deviation to float parser: %.7f°\n",
+    count, failed, maxerr);
+
+  // Fuzzing:
+  uint32_t seed = 12345;
+  auto rnd = [&seed]() -> uint32_t { seed = seed * 1103515245 + 12345; return (seed >> 1); };
+  static const char charset[] = "0123456789.,-*$NSEWA \r";
+  char buf[NMEA_MAXLEN+32];
+  int results[4] = { 0, 0, 0, 0 };
+  int decoded = 0;
+  for (int r = 0; r < rounds; r++)
+    {
+    const char* line = nmea_test_sentences[rnd() % count];
+    size_t len = strlen(line);
+    memcpy(buf, line, len);
+    int mutations = 1 + rnd() % 4;
+    for (int m = 0; m < mutations; m++)
+      {
+      size_t pos = rnd() % len;
+      switch (rnd() % 4)
+        {
+        case 0: // replace char
+          buf[pos] = charset[rnd() % (sizeof(charset)-1)];
+          break;
+        case 1: // truncate
+          len = pos + 1;
+          break;
+        case 2: // insert digits
+          {
+          size_t n = 1 + rnd() % 12;
+          if (len + n > sizeof(buf)) break;
+          memmove(buf+pos+n, buf+pos, len-pos);
+          for (size_t i = 0; i < n; i++) buf[pos+i] = '0' + rnd() % 10;
+          len += n;
+          }
+          break;
+        case 3: // random byte
+          buf[pos] = rnd() & 0xff;
+          break;
+        }
+      }
+    if (r & 1)
+      {
+      // recompute checksum, so the field decoders see the mutations:
+      char* star = (char*) memchr(buf+1, '*', len-1);
+      size_t end = star ? star - buf : len;
+      if (end + 4 <= sizeof(buf))
+        {
+        uint8_t checksum = 0;
+        for (size_t i = 1; i < end; i++) checksum ^= buf[i];
+        snprintf(buf+end, 4, "*%02X", checksum);
+        len = end + 3;
+        }
+      }
+    nmea_result_t res = s.Parse(buf, len);
+    results[res]++;
+    if (res == NMEA_OK)
+      decoded += nmea_test_decode(s);
+    }
+  writer->printf("Fuzzing: %d sentences: %d valid, %d no sentence, %d malformed, %d bad checksum, %d fields decoded\n",
+    rounds, results[NMEA_OK], results[NMEA_NOSENTENCE], results[NMEA_MALFORMED], results[NMEA_BADCHECKSUM], decoded);
+
+  // Benchmark:
+  std::string lines[count];
+  for (int k = 0; k < count; k++)
+    lines[k] = nmea_test_sentences[k];
+  int check = 0;
+  int64_t start = esp_timer_get_time();
+  for (int r = 0; r < rounds; r++)
+    {
+    for (int k = 0; k < count; k++)
+      check += nmea_test_legacy(lines[k]);
+    }
+  int64_t legacy_us = esp_timer_get_time() - start;
+  start = esp_timer_get_time();
+  for (int r = 0; r < rounds; r++)
+    {
+    for (int k = 0; k < count; k++)
+      {
+      if (s.Parse(nmea_test_sentences[k], lines[k].size()) == NMEA_OK)
+        check += nmea_test_decode(s);
+      }
+    }
+  int64_t parser_us = esp_timer_get_time() - start;
+  writer->printf("Benchmark: %d sentences\n", rounds * count);
+  writer->printf("  Former (istringstream, GNS/RMC only): %8lld us = %6.2f us/sentence\n",
+    legacy_us, (float) legacy_us / (rounds * count));
+  writer->printf("  NmeaSentence (all fields decoded):    %8lld us = %6.2f us/sentence\n",
+    parser_us, (float) parser_us / (rounds * count));
+  ESP_LOGD(TAG, "simcom_nmea_test: check %d", check);
+  }
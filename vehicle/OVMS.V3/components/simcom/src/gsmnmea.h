@@ -37,6 +37,52 @@
 #include "freertos/queue.h"
 #include "driver/uart.h"
 #include "gsmmux.h"
+#include "ovms_command.h"
+
+#define NMEA_MAXLEN         100     // Max sentence length accepted (NMEA 0183: 82)
+#define NMEA_MAXFIELDS      24      // Max number of fields (incl. address field)
+
+// Sentence formatter key: 3 char sentence type as an integer
+#define NMEA_KEY(a,b,c)     (((uint32_t)(a) << 16) | ((uint32_t)(b) << 8) | (uint32_t)(c))
+
+typedef enum
+  {
+  NMEA_OK = 0,
+  NMEA_NOSENTENCE,                  // Line is not an NMEA sentence
+  NMEA_MALFORMED,                   // Too long, too many fields, no checksum
+  NMEA_BADCHECKSUM,
+  } nmea_result_t;
+
+/**
+ * NmeaSentence: in place NMEA sentence tokenizer & field decoder
+ *
+ * Parse() validates the checksum and splits the sentence into fields
+ *  (pointers into the line, not zero terminated), the line must stay
+ *  valid while the fields are accessed. Decoders return false on empty
+ *  or invalid fields.
+ */
+class NmeaSentence
+  {
+  public:
+    nmea_result_t Parse(const char* line, size_t len);
+
+  public:
+    uint32_t Key() { return m_key; }
+    char Talker(int i) { return (m_len[0] >= 2) ? m_field[0][i] : 0; }
+    int Count() { return m_count; }
+    bool IsEmpty(int i) { return (i >= m_count || m_len[i] == 0); }
+    char Char(int i) { return IsEmpty(i) ? 0 : m_field[i][0]; }
+    bool UInt(int i, uint32_t* val);
+    bool Fixed(int i, int decimals, int32_t* val);
+    bool Coord(int i, char hemisphere, int32_t* val);
+    bool Copy(int i, char* dest, size_t size);
+
+  public:
+    const char*   m_field[NMEA_MAXFIELDS];
+    uint8_t       m_len[NMEA_MAXFIELDS];
+    int           m_count;
+    uint32_t      m_key;
+  };
 
 class GsmNMEA : public InternalRamAllocated
   {
@@ -45,15 +91,48 @@ class GsmNMEA : public InternalRamAllocated
     ~GsmNMEA();
 
   public:
-    void IncomingLine(const std::string line);
+    void IncomingLine(const char* line, size_t len);
+    void IncomingLine(const std::string& line) { IncomingLine(line.data(), line.size()); }
     void Startup();
     void Shutdown(bool hard=false);
+    void Status(OvmsWriter* writer);
+
+  protected:
+    void HandleGNS(NmeaSentence& s);
+    void HandleRMC(NmeaSentence& s);
+    void HandleGSA(NmeaSentence& s);
+    void HandleVTG(NmeaSentence& s);
+    void HandleGSV(NmeaSentence& s);
 
   public:
     GsmMux*       m_mux;
     int           m_channel;
     bool          m_connected;
     bool          m_gpstime_enabled;
+
+    // Statistics:
+    uint32_t      m_sentences;          // Valid sentences received
+    uint32_t      m_badchecksums;       // Sentences dropped due to checksum mismatch
+    uint32_t      m_malformed;          // Lines dropped as malformed
+
+    // GSA: DOP & fix status
+    int           m_fixtype;            // 1 = no fix, 2 = 2D, 3 = 3D, 0 = unknown
+    int32_t       m_pdop;               // Dilution of precision [1/100]
+    int32_t       m_vdop;
+
+    // GSV: satellites in view per system (GP, GL, GA, GB/BD, other)
+    struct
+      {
+      uint8_t     inview;               // Satellites in view
+      uint8_t     tracked;              // … with signal
+      uint8_t     snrmax;               // Max SNR [dB]
+      uint16_t    snrsum;               // SNR sum of tracked satellites
+      uint8_t     cur_tracked;          // Accumulators for current GSV message group
+      uint8_t     cur_snrmax;
+      uint16_t    cur_snrsum;
+      } m_gsv[5];
   };
 
+extern void simcom_nmea_test(int verbosity, OvmsWriter* writer, OvmsCommand* cmd, int argc, const char* const* argv);
+
 #endif //#ifndef __GSM_NMEA__
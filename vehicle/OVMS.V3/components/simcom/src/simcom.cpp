@@ -117,11 +117,19 @@ void simcom::Task()
             size_t buffered_size = event.uart.size;
             while (buffered_size > 0)
               {
-              if (buffered_size>sizeof(data)) buffered_size = sizeof(data);
-              int len = uart_read_bytes(m_uartnum, (uint8_t*)data, buffered_size, 100 / portTICK_RATE_MS);
-              m_buffer.Push(data,len);
+              // read directly into the buffer if possible:
+              uint8_t *dest;
+              size_t avail = m_buffer.WritableSpan(&dest);
+              if (avail == 0)
+                {
+                dest = data; // buffer full, read and discard
+                avail = sizeof(data);
+                }
+              if (buffered_size>avail) buffered_size = avail;
+              int len = uart_read_bytes(m_uartnum, dest, buffered_size, 100 / portTICK_RATE_MS);
+              if (len > 0 && dest != data) m_buffer.Produce(len);
               if (m_state1 == NetDeepSleep)
-                { MyCommandApp.HexDump(TAG, "rx", (const char*)data, len); }
+                { MyCommandApp.HexDump(TAG, "rx", (const char*)dest, len); }
               uart_get_buffered_data_len(m_uartnum, &buffered_size);
               SimcomState1 newstate = State1Activity();
               if ((newstate != m_state1)&&(newstate != None)) SetState1(newstate);
@@ -303,6 +311,8 @@ void simcom::SupportSummary(OvmsWriter* writer)
     MyConfig.GetParamValueBool("modem", "enable.gps", false) ? "enabled" : "disabled");
   writer->printf("     Time: %s\n",
     MyConfig.GetParamValueBool("modem", "enable.gpstime", false) ? "enabled" : "disabled");
+  if (m_nmea.m_connected)
+    m_nmea.Status(writer);
   }
 
 void simcom::StartTask()
@@ -410,8 +420,17 @@ void simcom::IncomingMuxData(GsmMuxChannel* channel)
       channel->m_buffer.EmptyAll();
       break;
     case GSM_MUX_CHAN_NMEA:
-      while (channel->m_buffer.HasLine() >= 0)
-        m_nmea.IncomingLine(channel->m_buffer.ReadLine());
+      {
+      char line[NMEA_MAXLEN+1];
+      int len;
+      while ((len = channel->m_buffer.ReadLine(line, sizeof(line))) >= 0)
+        {
+        if (len < (int)sizeof(line))
+          m_nmea.IncomingLine(line, len);
+        else
+          m_nmea.m_malformed++;
+        }
+      }
       break;
     case GSM_MUX_CHAN_DATA:
       if (m_state1 == NetMode)
@@ -1288,6 +1307,8 @@ SimcomInit::SimcomInit()
   OvmsCommand* cmd_status = cmd_simcom->RegisterCommand("status","Show SIMCOM status",simcom_status, "[debug]", 0, 0, false);
   cmd_status->RegisterCommand("debug","Show extended SIMCOM status",simcom_status, "", 0, 0, false);
   cmd_simcom->RegisterCommand("cmd","Send SIMCOM AT command",simcom_cmd, "<command>", 1, INT_MAX);
+  OvmsCommand* cmd_nmea = cmd_simcom->RegisterCommand("nmea","SIMCOM NMEA framework");
+  cmd_nmea->RegisterCommand("test","Test & benchmark NMEA parser on recorded sentences",simcom_nmea_test, "[<rounds>]", 0, 1);
 
   OvmsCommand* cmd_setstate = cmd_simcom->RegisterCommand("setstate","SIMCOM state change framework");
   for (int x = simcom::CheckPowerOff; x<=simcom::PowerOffOn; x++)
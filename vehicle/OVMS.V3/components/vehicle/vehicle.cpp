@@ -43,6 +43,7 @@ static const char *TAG = "vehicle";
 #endif // #ifdef CONFIG_OVMS_COMP_WEBSERVER
 #include <ovms_peripherals.h>
 #include <string_writer.h>
+#include "esp_timer.h"
 #include "vehicle.h"
 
 #undef SQR
@@ -97,6 +98,40 @@ void vehicle_status(int verbosity, OvmsWriter* writer, OvmsCommand* cmd, int arg
     }
   }
 
+void vehicle_poller_status(int verbosity, OvmsWriter* writer, OvmsCommand* cmd, int argc, const char* const* argv)
+  {
+  if (MyVehicleFactory.m_currentvehicle != NULL)
+    {
+    MyVehicleFactory.m_currentvehicle->PollerStatus(verbosity, writer);
+    }
+  else
+    {
+    writer->puts("No vehicle module selected");
+    }
+  }
+
+void vehicle_poller_simulate(int verbosity, OvmsWriter* writer, OvmsCommand* cmd, int argc, const char* const* argv)
+  {
+  if (MyVehicleFactory.m_currentvehicle == NULL)
+    {
+    writer->puts("No vehicle module selected");
+    return;
+    }
+  int length = 64;
+  if (argc > 0)
+    length = (strcmp(argv[0], "off") == 0) ? 0 : atoi(argv[0]);
+  if ((length < 0)||(length > 4092))
+    {
+    writer->puts("Error: length must be 1-4092 bytes");
+    return;
+    }
+  MyVehicleFactory.m_currentvehicle->PollerSimulate(length);
+  if (length)
+    writer->printf("ECU simulator started with %d byte responses, see 'vehicle poller status'\n", length);
+  else
+    writer->puts("ECU simulator stopped");
+  }
+
 void vehicle_wakeup(int verbosity, OvmsWriter* writer, OvmsCommand* cmd, int argc, const char* const* argv)
   {
   if (MyVehicleFactory.m_currentvehicle==NULL)
@@ -461,6 +496,119 @@ void bms_alerts(int verbosity, OvmsWriter* writer, OvmsCommand* cmd, int argc, c
     }
   }
 
+void bms_spread(int verbosity, OvmsWriter* writer, OvmsCommand* cmd, int argc, const char* const* argv)
+  {
+  if (MyVehicleFactory.m_currentvehicle != NULL)
+    {
+    MyVehicleFactory.m_currentvehicle->BmsSpreadStatus(verbosity, writer);
+    }
+  else
+    {
+    writer->puts("No vehicle module selected");
+    }
+  }
+
+// Former BMS cell statistics implementation (double precision, branching),
+//  for benchmark comparison:
+static void bms_stats_legacy(int n, const float* values, float* devmaxs, short* alerts,
+  float thr_warn, float thr_alert, float* avgout, float* stddevout)
+  {
+  double sum=0, sqrsum=0, avg, stddev=0;
+  float min=0, max=0;
+  for (int i=0; i<n; i++)
+    {
+    sum += values[i];
+    sqrsum += SQR(values[i]);
+    if (min==0 || values[i]<min)
+      min = values[i];
+    if (max==0 || values[i]>max)
+      max = values[i];
+    }
+  avg = sum / n;
+  stddev = sqrt(LIMIT_MIN((sqrsum / n) - SQR(avg), 0));
+  float dev;
+  for (int i=0; i<n; i++)
+    {
+    dev = ROUNDPREC(values[i] - avg, 5);
+    if (ABS(dev) > ABS(devmaxs[i]))
+      devmaxs[i] = dev;
+    if (ABS(dev) >= thr_alert && alerts[i] < 2)
+      alerts[i] = 2;
+    else if (ABS(dev) >= thr_warn && alerts[i] < 1)
+      alerts[i] = 1;
+    }
+  *avgout = ROUNDPREC(avg, 5);
+  *stddevout = ROUNDPREC(stddev, 5);
+  }
+
+void bms_benchmark(int verbosity, OvmsWriter* writer, OvmsCommand* cmd, int argc, const char* const* argv)
+  {
+  int cells = (argc > 0) ? atoi(argv[0]) : 96;
+  int rounds = (argc > 1) ? atoi(argv[1]) : 1000;
+  if (cells < 1 || cells > 1000 || rounds < 1)
+    {
+    writer->puts("Error: invalid cell or round count");
+    return;
+    }
+
+  // Test sets: cell voltages around 3.9V with some noise & drifting cells
+  const int nsets = 16;
+  float* sets = new float[nsets*cells];
+  uint32_t seed = 12345;
+  auto rnd = [&seed]() -> uint32_t { seed = seed * 1103515245 + 12345; return (seed >> 1); };
+  for (int k=0; k<nsets; k++)
+    {
+    for (int i=0; i<cells; i++)
+      sets[k*cells+i] = 3.9f + (int)(rnd() % 41 - 20) * 0.001f + ((i % 17 == 0) ? k * 0.004f : 0);
+    }
+
+  float* devmaxs = new float[cells]();
+  short* alerts = new short[cells]();
+  float avg = 0, stddev = 0;
+  int64_t start = esp_timer_get_time();
+  for (int r=0; r<rounds; r++)
+    bms_stats_legacy(cells, &sets[(r % nsets)*cells], devmaxs, alerts, BMS_DEFTHR_VWARN, BMS_DEFTHR_VALERT, &avg, &stddev);
+  int64_t legacy_us = esp_timer_get_time() - start;
+
+  OvmsBmsCellStats bms;
+  bms.SetArrangement(cells, cells);
+  bms.SetPrecision(5);
+  bms.SetSpreadBinWidth(0.005);
+  start = esp_timer_get_time();
+  for (int r=0; r<rounds; r++)
+    {
+    const float* set = &sets[(r % nsets)*cells];
+    for (int i=0; i<cells; i++)
+      bms.Set(i, set[i]);
+    bms.Update(BMS_DEFTHR_VWARN, BMS_DEFTHR_VALERT);
+    }
+  int64_t engine_us = esp_timer_get_time() - start;
+
+  // Verify results of the last set:
+  int mismatches = 0;
+  for (int i=0; i<cells; i++)
+    {
+    if (ABS(devmaxs[i] - bms.GetDevMaxs()[i]) > 0.00002f) mismatches++;
+    if (alerts[i] != bms.GetAlerts()[i]) mismatches++;
+    }
+  if (ABS(avg - bms.GetAvg()) > 0.00002f) mismatches++;
+  if (ABS(stddev - bms.GetStddev()) > 0.00002f) mismatches++;
+
+  writer->printf("%d cells, %d rounds:\n", cells, rounds);
+  writer->printf("  Legacy:  %8lld us = %6.1f us/set\n", legacy_us, (float)legacy_us / rounds);
+  writer->printf("  Engine:  %8lld us = %6.1f us/set (incl. Set() calls)\n", engine_us, (float)engine_us / rounds);
+  writer->printf("  Mismatches: %d\n", mismatches);
+  if (verbosity >= COMMAND_RESULT_NORMAL)
+    {
+    writer->puts("Cell spread histogram:");
+    bms.SpreadHistogram(writer, 1000, "mV");
+    }
+
+  delete [] alerts;
+  delete [] devmaxs;
+  delete [] sets;
+  }
+
 #ifdef CONFIG_OVMS_SC_JAVASCRIPT_DUKTAPE
 
 static duk_ret_t DukOvmsVehicleType(duk_context *ctx)
@@ -806,6 +954,9 @@ OvmsVehicleFactory::OvmsVehicleFactory()
   cmd_vehicle->RegisterCommand("module","Set (or clear) vehicle module",vehicle_module,"<type>",0,1);
   cmd_vehicle->RegisterCommand("list","Show list of available vehicle modules",vehicle_list);
   cmd_vehicle->RegisterCommand("status","Show vehicle module status",vehicle_status);
+  OvmsCommand* cmd_poller = cmd_vehicle->RegisterCommand("poller","OBD/UDS poller framework");
+  cmd_poller->RegisterCommand("status","Show poller status and statistics",vehicle_poller_status);
+  cmd_poller->RegisterCommand("simulate","Answer poll requests by simulated ECUs",vehicle_poller_simulate,"[<length>|off]",0,1);
 
   MyCommandApp.RegisterCommand("wakeup","Wake up vehicle",vehicle_wakeup);
   MyCommandApp.RegisterCommand("homelink","Activate specified homelink button",vehicle_homelink,"<homelink><durationms>",1,2);
@@ -832,6 +983,8 @@ OvmsVehicleFactory::OvmsVehicleFactory()
   cmd_bms->RegisterCommand("status","Show BMS status",bms_status);
   cmd_bms->RegisterCommand("reset","Reset BMS statistics",bms_reset);
   cmd_bms->RegisterCommand("alerts","Show BMS alerts",bms_alerts);
+  cmd_bms->RegisterCommand("spread","Show BMS cell spread histograms",bms_spread);
+  cmd_bms->RegisterCommand("benchmark","Benchmark BMS cell statistics",bms_benchmark,"[<cells>] [<rounds>]", 0, 2);
 
 #ifdef CONFIG_OVMS_SC_JAVASCRIPT_DUKTAPE
   DuktapeObjectRegistration* dto = new DuktapeObjectRegistration("OvmsVehicle");
@@ -941,6 +1094,14 @@ static void OvmsVehicleRxTask(void *pvParameters)
   }
 
 OvmsVehicle::OvmsVehicle()
+  : m_cfg_12v_ref("vehicle", "12v.ref", 12.6),
+    m_cfg_12v_alert("vehicle", "12v.alert", 1.6),
+    m_cfg_minsoc("vehicle", "minsoc", 0),
+    m_cfg_bms_alerts("vehicle", "bms.alerts.enabled", true),
+    m_cfg_bms_vwarn("vehicle", "bms.dev.voltage.warn", BMS_DEFTHR_VWARN),
+    m_cfg_bms_valert("vehicle", "bms.dev.voltage.alert", BMS_DEFTHR_VALERT),
+    m_cfg_bms_twarn("vehicle", "bms.dev.temp.warn", BMS_DEFTHR_TWARN),
+    m_cfg_bms_talert("vehicle", "bms.dev.temp.alert", BMS_DEFTHR_TALERT)
   {
   m_can1 = NULL;
   m_can2 = NULL;
@@ -959,7 +1120,6 @@ OvmsVehicle::OvmsVehicle()
   m_poll_bus = NULL;
   m_poll_plist = NULL;
   m_poll_plcur = NULL;
-  m_poll_ticker = 0;
   m_poll_moduleid_sent = 0;
   m_poll_moduleid_low = 0;
   m_poll_moduleid_high = 0;
@@ -968,37 +1128,18 @@ OvmsVehicle::OvmsVehicle()
   m_poll_ml_remain = 0;
   m_poll_ml_offset = 0;
   m_poll_ml_frame = 0;
-  m_poll_wait = 0;
-
-  m_bms_voltages = NULL;
-  m_bms_vmins = NULL;
-  m_bms_vmaxs = NULL;
-  m_bms_vdevmaxs = NULL;
-  m_bms_valerts = NULL;
-  m_bms_valerts_new = 0;
-  m_bms_has_voltages = false;
-
-  m_bms_temperatures = NULL;
-  m_bms_tmins = NULL;
-  m_bms_tmaxs = NULL;
-  m_bms_tdevmaxs = NULL;
-  m_bms_talerts = NULL;
-  m_bms_talerts_new = 0;
-  m_bms_has_temperatures = false;
-
-  m_bms_bitset_v.clear();
-  m_bms_bitset_t.clear();
-  m_bms_bitset_cv = 0;
-  m_bms_bitset_ct = 0;
-  m_bms_readings_v = 0;
-  m_bms_readingspermodule_v = 0;
-  m_bms_readings_t = 0;
-  m_bms_readingspermodule_t = 0;
-
-  m_bms_limit_tmin = -1000;
-  m_bms_limit_tmax = 1000;
-  m_bms_limit_vmin = -1000;
-  m_bms_limit_vmax = 1000;
+  m_poll_sessions_max = 1;
+  m_poll_timeout = VEHICLE_POLL_TIMEOUT;
+  m_poll_fc_blocksize = VEHICLE_POLL_FC_BLOCKSIZE;
+  m_poll_fc_stmin = VEHICLE_POLL_FC_STMIN;
+  m_poll_simulate = 0;
+  memset(&m_poll_stats, 0, sizeof(m_poll_stats));
+  PollResetSessions();
+
+  m_bms_v.SetPrecision(5);
+  m_bms_v.SetSpreadBinWidth(0.005);
+  m_bms_t.SetPrecision(2);
+  m_bms_t.SetSpreadBinWidth(0.5);
 
   m_bms_defthr_vwarn  = BMS_DEFTHR_VWARN;
   m_bms_defthr_valert = BMS_DEFTHR_VALERT;
@@ -1029,7 +1170,8 @@ OvmsVehicle::OvmsVehicle()
 
   using std::placeholders::_1;
   using std::placeholders::_2;
-  MyEvents.RegisterEvent(TAG, "ticker.1", std::bind(&OvmsVehicle::VehicleTicker1, this, _1, _2));
+  using std::placeholders::_3;
+  MyEvents.RegisterEvent(TAG, EVENT_ID_TICKER_1, std::bind(&OvmsVehicle::VehicleTicker1, this, _1, _2, _3));
   MyEvents.RegisterEvent(TAG, "config.changed", std::bind(&OvmsVehicle::VehicleConfigChanged, this, _1, _2));
   MyEvents.RegisterEvent(TAG, "config.mounted", std::bind(&OvmsVehicle::VehicleConfigChanged, this, _1, _2));
   VehicleConfigChanged("config.mounted", NULL);
@@ -1044,58 +1186,6 @@ OvmsVehicle::~OvmsVehicle()
   if (m_can3) m_can3->SetPowerMode(Off);
   if (m_can4) m_can4->SetPowerMode(Off);
 
-  if (m_bms_voltages != NULL)
-    {
-    delete [] m_bms_voltages;
-    m_bms_voltages = NULL;
-    }
-  if (m_bms_vmins != NULL)
-    {
-    delete [] m_bms_vmins;
-    m_bms_vmins = NULL;
-    }
-  if (m_bms_vmaxs != NULL)
-    {
-    delete [] m_bms_vmaxs;
-    m_bms_vmaxs = NULL;
-    }
-  if (m_bms_vdevmaxs != NULL)
-    {
-    delete [] m_bms_vdevmaxs;
-    m_bms_vdevmaxs = NULL;
-    }
-  if (m_bms_valerts != NULL)
-    {
-    delete [] m_bms_valerts;
-    m_bms_valerts = NULL;
-    }
-
-  if (m_bms_temperatures != NULL)
-    {
-    delete [] m_bms_temperatures;
-    m_bms_temperatures = NULL;
-    }
-  if (m_bms_tmins != NULL)
-    {
-    delete [] m_bms_tmins;
-    m_bms_tmins = NULL;
-    }
-  if (m_bms_tmaxs != NULL)
-    {
-    delete [] m_bms_tmaxs;
-    m_bms_tmaxs = NULL;
-    }
-  if (m_bms_tdevmaxs != NULL)
-    {
-    delete [] m_bms_tdevmaxs;
-    m_bms_tdevmaxs = NULL;
-    }
-  if (m_bms_talerts != NULL)
-    {
-    delete [] m_bms_talerts;
-    m_bms_talerts = NULL;
-    }
-
   if (m_registeredlistener)
     {
     MyCan.DeregisterListener(m_rxqueue);
@@ -1117,27 +1207,40 @@ const char* OvmsVehicle::VehicleShortName()
 void OvmsVehicle::RxTask()
   {
   CAN_frame_t frame;
+  int64_t pollnext = 0;
 
   while(1)
     {
-    if (xQueueReceive(m_rxqueue, &frame, (portTickType)portMAX_DELAY)==pdTRUE)
+    // The poller is run from here with tick resolution while a poll list is set:
+    TickType_t wait = (m_poll_plist) ? 1 : pdMS_TO_TICKS(1000);
+    if (xQueueReceive(m_rxqueue, &frame, wait)==pdTRUE)
       {
       if (!m_ready)
         continue;
       if ((frame.origin == m_poll_bus)&&(m_poll_plist))
         {
-        // This is intended for our poller
-        // ESP_LOGI(TAG, "Poller Rx candidate ID=%03x (expecting %03x-%03x)",frame.MsgID,m_poll_moduleid_low,m_poll_moduleid_high);
-        if ((frame.MsgID >= m_poll_moduleid_low)&&(frame.MsgID <= m_poll_moduleid_high))
-          {
-          PollerReceive(&frame);
-          }
+        // This may be intended for our poller; if it finished a
+        // transaction, the session can be reused immediately:
+        if (PollerReceive(&frame))
+          pollnext = 0;
+        // the simulator owns the poll bus:
+        if (m_poll_simulate)
+          continue;
         }
       if (m_can1 == frame.origin) IncomingFrameCan1(&frame);
       else if (m_can2 == frame.origin) IncomingFrameCan2(&frame);
       else if (m_can3 == frame.origin) IncomingFrameCan3(&frame);
       else if (m_can4 == frame.origin) IncomingFrameCan4(&frame);
       }
+    if (m_ready && m_poll_plist)
+      {
+      int64_t now = esp_timer_get_time();
+      if (now >= pollnext)
+        {
+        PollerSend();
+        pollnext = now + portTICK_PERIOD_MS * 1000;
+        }
+      }
     }
   }
 
@@ -1161,6 +1264,10 @@ void OvmsVehicle::IncomingPollReply(canbus* bus, uint16_t type, uint16_t pid, ui
   {
   }
 
+void OvmsVehicle::IncomingPollResponse(canbus* bus, uint16_t type, uint16_t pid, const uint8_t* data, uint16_t length)
+  {
+  }
+
 void OvmsVehicle::Status(int verbosity, OvmsWriter* writer)
   {
   writer->puts("Vehicle module loaded and running");
@@ -1194,11 +1301,14 @@ void OvmsVehicle::RegisterCanBus(int bus, CAN_mode_t mode, CAN_speed_t speed, db
       break;
     }
 
-  if (!m_registeredlistener)
-    {
-    m_registeredlistener = true;
-    MyCan.RegisterListener(m_rxqueue);
-    }
+  // (re-)register listener for the buses in use:
+  canmatch filter;
+  filter.AddBus(m_can1);
+  filter.AddBus(m_can2);
+  filter.AddBus(m_can3);
+  filter.AddBus(m_can4);
+  m_registeredlistener = true;
+  MyCan.RegisterListener(m_rxqueue, false, &filter);
   }
 
 bool OvmsVehicle::PinCheck(char* pin)
@@ -1209,15 +1319,13 @@ bool OvmsVehicle::PinCheck(char* pin)
   return (strcmp(vpin.c_str(),pin)==0);
   }
 
-void OvmsVehicle::VehicleTicker1(std::string event, void* data)
+void OvmsVehicle::VehicleTicker1(event_id_t id, const char* event, void* data)
   {
   if (!m_ready)
     return;
 
   m_ticker++;
 
-  PollerSend();
-
   Ticker1(m_ticker);
   if ((m_ticker % 10) == 0) Ticker10(m_ticker);
   if ((m_ticker % 60) == 0) Ticker60(m_ticker);
@@ -1269,10 +1377,10 @@ void OvmsVehicle::VehicleTicker1(std::string event, void* data)
     float volt = StandardMetrics.ms_v_bat_12v_voltage->AsFloat();
     // …against the maximum of default and measured reference voltage, so alerts will also
     //  be triggered if the measured ref follows a degrading battery:
-    float dref = MyConfig.GetParamValueFloat("vehicle", "12v.ref", 12.6);
+    float dref = m_cfg_12v_ref;
     float vref = MAX(StandardMetrics.ms_v_bat_12v_voltage_ref->AsFloat(), dref);
     bool alert_on = StandardMetrics.ms_v_bat_12v_voltage_alert->AsBool();
-    float alert_threshold = MyConfig.GetParamValueFloat("vehicle", "12v.alert", 1.6);
+    float alert_threshold = m_cfg_12v_alert;
     if (!alert_on && volt > 0 && vref > 0 && vref-volt > alert_threshold)
       {
       StandardMetrics.ms_v_bat_12v_voltage_alert->SetValue(true);
@@ -1291,7 +1399,7 @@ void OvmsVehicle::VehicleTicker1(std::string event, void* data)
     {
     // Check MINSOC
     int soc = (int)StandardMetrics.ms_v_bat_soc->AsFloat();
-    m_minsoc = MyConfig.GetParamValueInt("vehicle", "minsoc", 0);
+    m_minsoc = m_cfg_minsoc;
     if (m_minsoc <= 0)
       {
       m_minsoc_triggered = 0;
@@ -1312,14 +1420,14 @@ void OvmsVehicle::VehicleTicker1(std::string event, void* data)
     }
 
   // BMS alerts:
-  if (m_bms_valerts_new || m_bms_talerts_new)
+  if (m_bms_v.GetNewAlerts() || m_bms_t.GetNewAlerts())
     {
-    ESP_LOGW(TAG, "BMS new alerts: %d voltages, %d temperatures", m_bms_valerts_new, m_bms_talerts_new);
+    ESP_LOGW(TAG, "BMS new alerts: %d voltages, %d temperatures", m_bms_v.GetNewAlerts(), m_bms_t.GetNewAlerts());
     MyEvents.SignalEvent("vehicle.alert.bms", NULL);
-    if (m_autonotifications && MyConfig.GetParamValueBool("vehicle", "bms.alerts.enabled", true))
+    if (m_autonotifications && m_cfg_bms_alerts)
       NotifyBmsAlerts();
-    m_bms_valerts_new = 0;
-    m_bms_talerts_new = 0;
+    m_bms_v.ClearNewAlerts();
+    m_bms_t.ClearNewAlerts();
     }
 
   // Idle alert:
@@ -1422,7 +1530,7 @@ void OvmsVehicle::NotifyAlarmStopped()
 void OvmsVehicle::Notify12vCritical()
   {
   float volt = StandardMetrics.ms_v_bat_12v_voltage->AsFloat();
-  float dref = MyConfig.GetParamValueFloat("vehicle", "12v.ref", 12.6);
+  float dref = m_cfg_12v_ref;
   float vref = MAX(StandardMetrics.ms_v_bat_12v_voltage_ref->AsFloat(), dref);
 
   MyNotify.NotifyStringf("alert", "batt.12v.alert", "12V Battery critical: %.1fV (ref=%.1fV)", volt, vref);
@@ -1431,7 +1539,7 @@ void OvmsVehicle::Notify12vCritical()
 void OvmsVehicle::Notify12vRecovered()
   {
   float volt = StandardMetrics.ms_v_bat_12v_voltage->AsFloat();
-  float dref = MyConfig.GetParamValueFloat("vehicle", "12v.ref", 12.6);
+  float dref = m_cfg_12v_ref;
   float vref = MAX(StandardMetrics.ms_v_bat_12v_voltage_ref->AsFloat(), dref);
 
   MyNotify.NotifyStringf("alert", "batt.12v.recovered", "12V Battery restored: %.1fV (ref=%.1fV)", volt, vref);
@@ -2013,8 +2121,8 @@ void OvmsVehicle::PollSetPidList(canbus* bus, const poll_pid_t* plist)
   OvmsMutexLock lock(&m_poll_mutex);
   m_poll_bus = bus;
   m_poll_plist = plist;
-  m_poll_ticker = 0;
-  m_poll_plcur = NULL;
+  m_poll_due.clear();
+  PollResetSessions();
   }
 
 void OvmsVehicle::PollSetState(uint8_t state)
@@ -2023,262 +2131,586 @@ void OvmsVehicle::PollSetState(uint8_t state)
     {
     OvmsMutexLock lock(&m_poll_mutex);
     m_poll_state = state;
-    m_poll_ticker = 0;
-    m_poll_plcur = NULL;
+    m_poll_due.clear();
     }
   }
 
+/**
+ * PollSetSessions: set number of concurrent ECU transactions
+ *  Default is 1 (strictly sequential). Vehicles whose IncomingPollReply() handlers
+ *  keep their state per module (see m_poll_moduleid_low) can raise this to poll
+ *  ECUs in parallel. Broadcast (0x7df) requests are always exclusive.
+ */
+void OvmsVehicle::PollSetSessions(uint8_t sessions)
+  {
+  OvmsMutexLock lock(&m_poll_mutex);
+  if (sessions < 1) sessions = 1;
+  if (sessions > VEHICLE_POLL_MAXSESSIONS) sessions = VEHICLE_POLL_MAXSESSIONS;
+  m_poll_sessions_max = sessions;
+  }
+
+void OvmsVehicle::PollSetTimeout(uint16_t timeout_ms)
+  {
+  OvmsMutexLock lock(&m_poll_mutex);
+  m_poll_timeout = (timeout_ms) ? timeout_ms : VEHICLE_POLL_TIMEOUT;
+  }
+
+/**
+ * PollSetFlowControl: set the ISO-TP flow control parameters sent to ECUs
+ *  blocksize: consecutive frames per flow control (0 = all)
+ *  stmin: separation time (0x00-0x7f = ms, 0xf1-0xf9 = 100-900 us)
+ */
+void OvmsVehicle::PollSetFlowControl(uint8_t blocksize, uint8_t stmin)
+  {
+  OvmsMutexLock lock(&m_poll_mutex);
+  m_poll_fc_blocksize = blocksize;
+  m_poll_fc_stmin = stmin;
+  }
+
+void OvmsVehicle::PollResetSessions()
+  {
+  for (int i=0; i<VEHICLE_POLL_MAXSESSIONS; i++)
+    {
+    poll_session_t* s = &m_poll_sessions[i];
+    s->state = PollIdle;
+    s->entry = NULL;
+    s->ml_buffer.clear();
+    }
+  }
+
+OvmsVehicle::poll_session_t* OvmsVehicle::PollFindSession(uint32_t rxid)
+  {
+  for (int i=0; i<VEHICLE_POLL_MAXSESSIONS; i++)
+    {
+    poll_session_t* s = &m_poll_sessions[i];
+    if ((s->state != PollIdle)&&(rxid >= s->moduleid_low)&&(rxid <= s->moduleid_high))
+      return s;
+    }
+  return NULL;
+  }
+
+void OvmsVehicle::PollTransmit(CAN_frame_t* frame)
+  {
+  if (m_poll_simulate)
+    PollSimulatorReceive(frame);
+  else
+    frame->Write();
+  }
+
+void OvmsVehicle::PollSendFlowControl(poll_session_t* session, canbus* bus)
+  {
+  CAN_frame_t txframe;
+  memset(&txframe,0,sizeof(txframe));
+  txframe.origin = bus;
+  txframe.FIR.B.FF = CAN_frame_std;
+  txframe.FIR.B.DLC = 8;
+
+  if (session->moduleid_sent == 0x7df)
+    {
+    // broadcast request: derive module ID from response ID:
+    // (Note: this only works for the SAE standard ID scheme)
+    txframe.MsgID = session->moduleid_rec - 8;
+    }
+  else
+    {
+    // use known module ID:
+    txframe.MsgID = session->moduleid_sent;
+    }
+
+  txframe.data.u8[0] = 0x30; // flow control frame type: continue to send
+  txframe.data.u8[1] = m_poll_fc_blocksize;
+  txframe.data.u8[2] = m_poll_fc_stmin;
+  session->ml_block = m_poll_fc_blocksize;
+  PollTransmit(&txframe);
+  }
+
+/**
+ * PollerSend: poll scheduler
+ *  Called by the vehicle RX task once per tick and after each finished transaction.
+ *  Every poll list entry is due each polltime[state] seconds; due entries are sent
+ *  as soon as their ECU has no outstanding transaction and a session is free.
+ */
 void OvmsVehicle::PollerSend()
   {
   OvmsMutexLock lock(&m_poll_mutex);
   if (!m_poll_bus || !m_poll_plist) return;
-  if (m_poll_plcur == NULL) m_poll_plcur = m_poll_plist;
+  int64_t now = esp_timer_get_time();
+  if (m_poll_simulate) PollSimulatorRun();
 
-  while (m_poll_plcur->txmoduleid != 0)
+  // Expire sessions, count active:
+  int active = 0;
+  for (int i=0; i<VEHICLE_POLL_MAXSESSIONS; i++)
     {
-    // there are remaining poll replays from last poll. we wait for it.
-    if (m_poll_ml_remain > 7)
+    poll_session_t* s = &m_poll_sessions[i];
+    if (s->state == PollIdle)
+      continue;
+    if (now < s->deadline)
       {
-      if (m_poll_wait)
-        {
-        // ESP_LOGD(TAG,"wait last Polling for %02x: there are remaining poll replays", m_poll_plcur->pid);
-        m_poll_wait = 0;
-        m_poll_ml_remain = 0;
-        return;
-        }
-      else
-        {
-        // ESP_LOGD(TAG,"wait Polling for %02x: there are remaining poll replays", m_poll_plcur->pid);
-        m_poll_wait = 1;
-        return;
-        }
+      if (s->moduleid_sent == 0x7df) return; // broadcast requests are exclusive
+      active++;
+      continue;
       }
-    m_poll_wait = 0;
-    if ((m_poll_plcur->polltime[m_poll_state] > 0)&&
-        ((m_poll_ticker % m_poll_plcur->polltime[m_poll_state] ) == 0))
+    if (s->replies == 0)
       {
-      // We need to poll this one...
-      m_poll_type = m_poll_plcur->type;
-      m_poll_pid = m_poll_plcur->pid;
-      if (m_poll_plcur->rxmoduleid != 0)
-        {
-        // send to <moduleid>, listen to response from <rmoduleid>:
-        m_poll_moduleid_sent = m_poll_plcur->txmoduleid;
-        m_poll_moduleid_low = m_poll_plcur->rxmoduleid;
-        m_poll_moduleid_high = m_poll_plcur->rxmoduleid;
-        }
-      else
-        {
-        // broadcast: send to 0x7df, listen to all responses:
-        m_poll_moduleid_sent = 0x7df;
-        m_poll_moduleid_low = 0x7e8;
-        m_poll_moduleid_high = 0x7ef;
-        }
+      m_poll_stats.timeouts++;
+      ESP_LOGD(TAG, "Poll timeout for %03x type %02x pid %x",
+        s->moduleid_sent, s->entry->type, s->entry->pid);
+      }
+    s->state = PollIdle;
+    s->entry = NULL;
+    }
+
+  if (m_poll_due.empty())
+    {
+    // New list or state: everything is due now
+    int count = 0;
+    for (const poll_pid_t* p = m_poll_plist; p->txmoduleid != 0; p++) count++;
+    m_poll_due.assign(count, now);
+    }
+
+  int index = 0;
+  for (const poll_pid_t* p = m_poll_plist; (p->txmoduleid != 0)&&(active < m_poll_sessions_max); p++, index++)
+    {
+    uint16_t polltime = p->polltime[m_poll_state];
+    if ((polltime == 0)||(now < m_poll_due[index]))
+      continue;
+
+    uint32_t txid, rxlow, rxhigh;
+    if (p->rxmoduleid != 0)
+      {
+      // send to <moduleid>, listen to response from <rmoduleid>:
+      txid = p->txmoduleid;
+      rxlow = rxhigh = p->rxmoduleid;
+      }
+    else
+      {
+      // broadcast: send to 0x7df, listen to all responses:
+      if (active > 0) continue;
+      txid = 0x7df;
+      rxlow = 0x7e8;
+      rxhigh = 0x7ef;
+      }
 
-      // ESP_LOGD(TAG, "Polling for %d/%02x (expecting %03x/%03x-%03x)",
-      //   m_poll_type,m_poll_pid,m_poll_moduleid_sent,m_poll_moduleid_low,m_poll_moduleid_high);
-      CAN_frame_t txframe;
-      memset(&txframe,0,sizeof(txframe));
-      txframe.origin = m_poll_bus;
-      txframe.MsgID = m_poll_moduleid_sent;
-      txframe.FIR.B.FF = CAN_frame_std;
-      txframe.FIR.B.DLC = 8;
-      switch (m_poll_plcur->type)
+    // One transaction per ECU, responses must be distinguishable:
+    poll_session_t* session = NULL;
+    bool busy = false;
+    for (int i=0; i<VEHICLE_POLL_MAXSESSIONS && !busy; i++)
+      {
+      poll_session_t* s = &m_poll_sessions[i];
+      if (s->state == PollIdle)
         {
-        case VEHICLE_POLL_TYPE_OBDIICURRENT:
-        case VEHICLE_POLL_TYPE_OBDIIFREEZE:
-        case VEHICLE_POLL_TYPE_OBDIISESSION:
-          // 8 bit PID request for single frame response:
-          txframe.data.u8[0] = 0x02;
-          txframe.data.u8[1] = m_poll_type;
-          txframe.data.u8[2] = m_poll_pid;
-          break;
-        case VEHICLE_POLL_TYPE_OBDIIVEHICLE:
-        case VEHICLE_POLL_TYPE_OBDIIGROUP:
-        case VEHICLE_POLL_TYPE_OBDII_1A:
-          // 8 bit PID request for multi frame response:
-          m_poll_ml_remain = 0;
-          txframe.data.u8[0] = 0x02;
-          txframe.data.u8[1] = m_poll_type;
-          txframe.data.u8[2] = m_poll_pid;
-          break;
-        case VEHICLE_POLL_TYPE_OBDIIEXTENDED:
-          // 16 bit PID request:
-          m_poll_ml_remain = 0;
-          txframe.data.u8[0] = 0x03;
-          txframe.data.u8[1] = m_poll_type; //VEHICLE_POLL_TYPE_OBDIIEXTENDED;    // Get extended PID
-          txframe.data.u8[2] = m_poll_pid >> 8;
-          txframe.data.u8[3] = m_poll_pid & 0xff;
-          break;
+        if (!session) session = s;
         }
-      m_poll_bus->Write(&txframe);
-      m_poll_plcur++;
-      return;
+      else if ((s->moduleid_sent == txid)||((rxlow <= s->moduleid_high)&&(rxhigh >= s->moduleid_low)))
+        busy = true;
       }
-    m_poll_plcur++;
-    }
+    if (busy || !session)
+      continue;
+
+    // ESP_LOGD(TAG, "Polling for %d/%02x (expecting %03x/%03x-%03x)",
+    //   p->type,p->pid,txid,rxlow,rxhigh);
+    CAN_frame_t txframe;
+    memset(&txframe,0,sizeof(txframe));
+    txframe.origin = m_poll_bus;
+    txframe.MsgID = txid;
+    txframe.FIR.B.FF = CAN_frame_std;
+    txframe.FIR.B.DLC = 8;
+    if (p->type == VEHICLE_POLL_TYPE_OBDIIEXTENDED)
+      {
+      // 16 bit PID request:
+      txframe.data.u8[0] = 0x03;
+      txframe.data.u8[1] = p->type;
+      txframe.data.u8[2] = p->pid >> 8;
+      txframe.data.u8[3] = p->pid & 0xff;
+      }
+    else
+      {
+      // 8 bit PID request:
+      txframe.data.u8[0] = 0x02;
+      txframe.data.u8[1] = p->type;
+      txframe.data.u8[2] = p->pid;
+      }
+
+    session->state = PollWaitResponse;
+    session->entry = p;
+    session->moduleid_sent = txid;
+    session->moduleid_low = rxlow;
+    session->moduleid_high = rxhigh;
+    session->moduleid_rec = 0;
+    session->sent = now;
+    session->deadline = now + (int64_t)m_poll_timeout * 1000;
+    session->replies = 0;
+    session->ml_remain = 0;
+    session->ml_offset = 0;
+    session->ml_frame = 0;
+    session->ml_todo = 0;
+    session->ml_buffer.clear();
 
-  m_poll_plcur = m_poll_plist;
-  m_poll_ticker++;
-  if (m_poll_ticker > 3600) m_poll_ticker -= 3600;
+    m_poll_due[index] = now + (int64_t)polltime * 1000000;
+    m_poll_stats.requests++;
+    active = (txid == 0x7df) ? m_poll_sessions_max : active+1;
+    PollTransmit(&txframe);
+    }
   }
 
-void OvmsVehicle::PollerReceive(CAN_frame_t* frame)
+/**
+ * PollerReceive: ISO-TP response processing
+ *  Returns true if the frame finished a transaction (session is free again).
+ *  Multi frame responses are passed to IncomingPollReply() frame by frame as before,
+ *  and additionally reassembled for IncomingPollResponse() (payload without the
+ *  response type & PID bytes).
+ */
+bool OvmsVehicle::PollerReceive(CAN_frame_t* frame)
   {
-  // ESP_LOGI(TAG, "Receive Poll Response for %d/%02x",m_poll_type,m_poll_pid);
-  switch (m_poll_type)
+  uint8_t* d = frame->data.u8;
+  uint8_t* chunk = NULL;
+  uint8_t chunklen = 0;
+  uint16_t type, pid, mlremain;
+  bool complete = false, done = false;
+  std::string response;
+
     {
-    case VEHICLE_POLL_TYPE_OBDIICURRENT:
-    case VEHICLE_POLL_TYPE_OBDIIFREEZE:
-    case VEHICLE_POLL_TYPE_OBDIISESSION:
-      // 8 bit PID single frame response:
-      if ((frame->data.u8[1] == 0x40+m_poll_type)&&
-          (frame->data.u8[2] == m_poll_pid))
-        {
-        m_poll_ml_frame = 0;
-        IncomingPollReply(frame->origin, m_poll_type, m_poll_pid, &frame->data.u8[3], 5, 0);
-        return;
-        }
-      break;
-    case VEHICLE_POLL_TYPE_OBDIIVEHICLE:
-    case VEHICLE_POLL_TYPE_OBDIIGROUP:
-    case VEHICLE_POLL_TYPE_OBDII_1A:
-      // 8 bit PID multiple frame response:
-      if (((frame->data.u8[0]>>4) == 0x1)&&
-          (frame->data.u8[2] == 0x40+m_poll_type)&&
-          (frame->data.u8[3] == m_poll_pid))
+    OvmsMutexLock lock(&m_poll_mutex);
+    poll_session_t* s = PollFindSession(frame->MsgID);
+    if (!s)
+      return false;
+
+    int64_t now = esp_timer_get_time();
+    const poll_pid_t* p = s->entry;
+    type = p->type;
+    pid = p->pid;
+    int pidlen = (type == VEHICLE_POLL_TYPE_OBDIIEXTENDED) ? 2 : 1;
+
+    switch (d[0] >> 4)
+      {
+      case 0x0:
         {
-        // First frame is 4 bytes header (2 ISO-TP, 2 OBDII), 4 bytes data:
-        // [first=1,lenH] [lenL] [type+40] [pid] [data0] [data1] [data2] [data3]
-        // Note that the value of 'len' includes the OBDII type and pid bytes,
-        // but we don't count these in the data we pass to IncomingPollReply.
-        //
-        // First frame; send flow control frame:
-        CAN_frame_t txframe;
-        memset(&txframe,0,sizeof(txframe));
-        txframe.origin = frame->origin;
-        txframe.FIR.B.FF = CAN_frame_std;
-        txframe.FIR.B.DLC = 8;
-
-        if (m_poll_moduleid_sent == 0x7df)
+        // Single frame: [len] [type+40] [pid] [data...]
+        if (s->state != PollWaitResponse)
+          return false;
+        uint8_t len = d[0] & 0x0f;
+        if ((len >= 3)&&(d[1] == 0x7f)&&(d[2] == type))
           {
-          // broadcast request: derive module ID from response ID:
-          // (Note: this only works for the SAE standard ID scheme)
-          txframe.MsgID = frame->MsgID - 8;
-          }
-        else
-          {
-          // use known module ID:
-          txframe.MsgID = m_poll_moduleid_sent;
+          if (d[3] == 0x78)
+            {
+            // response pending, ECU asks us to wait:
+            s->deadline = now + (int64_t)m_poll_timeout * 1000;
+            return false;
+            }
+          ESP_LOGD(TAG, "Poll %03x type %02x pid %x: negative response code %02x",
+            frame->MsgID, type, pid, d[3]);
+          m_poll_stats.errors++;
+          done = true;
+          break;
           }
-
-        txframe.data.u8[0] = 0x30; // flow control frame type
-        txframe.data.u8[1] = 0x00; // request all frames available
-        txframe.data.u8[2] = 0x19; // with 25ms send interval
-        txframe.Write();
-
-        // prepare frame processing, first frame contains first 4 bytes:
-        m_poll_ml_remain = (((uint16_t)(frame->data.u8[0]&0x0f))<<8) + frame->data.u8[1] - 2 - 4;
-        m_poll_ml_offset = 4;
-        m_poll_ml_frame = 0;
-
-        // ESP_LOGI(TAG, "Poll ML first frame (frame=%d, remain=%d)",m_poll_ml_frame,m_poll_ml_remain);
-        IncomingPollReply(frame->origin, m_poll_type, m_poll_pid, &frame->data.u8[4], 4, m_poll_ml_remain);
-        return;
+        if ((len < 1+pidlen)||(len > 7)||(d[1] != 0x40+type))
+          return false;
+        if ((pidlen == 1) ? (d[2] != pid) : (((uint16_t)d[2] << 8) + d[3] != pid))
+          return false;
+        m_poll_stats.frames++;
+        s->ml_buffer.assign((char*)&d[1], len);
+        s->ml_remain = 0;
+        s->ml_offset = 0;
+        s->ml_frame = 0;
+        chunk = &d[2+pidlen];
+        chunklen = 6-pidlen;
+        complete = true;
+        break;
         }
-      else if (((frame->data.u8[0]>>4)==0x2)&&(m_poll_ml_remain>0))
+      case 0x1:
         {
-        // Consecutive frame (1 control + 7 data bytes)
-        uint16_t len;
-        if (m_poll_ml_remain>7)
+        // First frame: [first=1,lenH] [lenL] [type+40] [pid] [data...]
+        if (s->state != PollWaitResponse)
+          return false;
+        uint16_t len = (((uint16_t)(d[0]&0x0f))<<8) + d[1];
+        if ((len < 8)||(d[2] != 0x40+type))
+          return false;
+        if ((pidlen == 1) ? (d[3] != pid) : (((uint16_t)d[3] << 8) + d[4] != pid))
+          return false;
+        m_poll_stats.frames++;
+        s->state = PollWaitConsecutive;
+        s->moduleid_rec = frame->MsgID;
+        s->deadline = now + (int64_t)m_poll_timeout * 1000;
+        s->ml_buffer.reserve(len);
+        s->ml_buffer.assign((char*)&d[2], 6);
+        s->ml_todo = len - 6;
+        s->ml_seq = 1;
+        s->ml_frame = 0;
+        // The first 4 bytes after the type & 8 bit PID are passed to IncomingPollReply;
+        // for 16 bit PIDs, that includes the PID low byte. 'mlremain' for 16 bit PIDs
+        // is kept compatible with existing vehicle modules.
+        if (pidlen == 1)
           {
-          m_poll_ml_remain -= 7;
-          m_poll_ml_offset += 7;
-          len = 7;
+          s->ml_remain = len - 2 - 4;
+          s->ml_offset = 4;
           }
         else
           {
-          len = m_poll_ml_remain;
-          m_poll_ml_offset += m_poll_ml_remain;
-          m_poll_ml_remain = 0;
+          s->ml_remain = len - 3;
+          s->ml_offset = 3;
           }
-        m_poll_ml_frame++;
-        // ESP_LOGI(TAG, "Poll ML subsequent frame (frame=%d, remain=%d)",m_poll_ml_frame,m_poll_ml_remain);
-        IncomingPollReply(frame->origin, m_poll_type, m_poll_pid, &frame->data.u8[1], len, m_poll_ml_remain);
-        return;
+        chunk = &d[4];
+        chunklen = 4;
+        PollSendFlowControl(s, frame->origin);
+        break;
         }
-      break;
-    case VEHICLE_POLL_TYPE_OBDIIEXTENDED:
-      // 16 bit PID response:
-      if (((frame->data.u8[0]>>4) == 0x1)&&
-          (frame->data.u8[2] == 0x40+m_poll_type)&&
-          ((frame->data.u8[4]+(((uint16_t) frame->data.u8[3]) << 8))  == m_poll_pid))
+      case 0x2:
         {
-        // First frame is 4 bytes header (2 ISO-TP, 2 OBDII), 4 bytes data:
-        // [first=1,lenH] [lenL] [type+40] [pid] [data0] [data1] [data2] [data3]
-        // Note that the value of 'len' includes the OBDII type and pid bytes,
-        // but we don't count these in the data we pass to IncomingPollReply.
-        //
-        // First frame; send flow control frame:
-        CAN_frame_t txframe;
-        memset(&txframe,0,sizeof(txframe));
-        txframe.origin = frame->origin;
-        txframe.FIR.B.FF = CAN_frame_std; //CAN_frame_ext?
-        txframe.FIR.B.DLC = 8;
-
-        if (m_poll_moduleid_sent == 0x7df)
+        // Consecutive frame: [consecutive=2,seq] [data...]
+        if ((s->state != PollWaitConsecutive)||(frame->MsgID != s->moduleid_rec))
+          return false;
+        m_poll_stats.frames++;
+        if ((d[0] & 0x0f) != s->ml_seq)
           {
-          // broadcast request: derive module ID from response ID:
-          // (Note: this only works for the SAE standard ID scheme)
-          txframe.MsgID = frame->MsgID - 8;
+          ESP_LOGD(TAG, "Poll %03x type %02x pid %x: sequence error (got %d, expected %d)",
+            frame->MsgID, type, pid, d[0] & 0x0f, s->ml_seq);
+          m_poll_stats.sequence_errors++;
+          done = true;
+          break;
+          }
+        s->ml_seq = (s->ml_seq + 1) & 0x0f;
+        s->deadline = now + (int64_t)m_poll_timeout * 1000;
+        uint16_t len = (s->ml_todo > 7) ? 7 : s->ml_todo;
+        s->ml_buffer.append((char*)&d[1], len);
+        s->ml_todo -= len;
+        if (s->ml_remain > 7)
+          {
+          s->ml_remain -= 7;
+          s->ml_offset += 7;
+          chunklen = 7;
           }
         else
           {
-          // use known module ID:
-          txframe.MsgID = m_poll_moduleid_sent;
+          chunklen = s->ml_remain;
+          s->ml_offset += s->ml_remain;
+          s->ml_remain = 0;
           }
+        s->ml_frame++;
+        chunk = &d[1];
+        if (s->ml_todo == 0)
+          complete = true;
+        else if ((s->ml_block > 0)&&(--s->ml_block == 0))
+          PollSendFlowControl(s, frame->origin);
+        break;
+        }
+      default:
+        return false;
+      }
 
-        txframe.data.u8[0] = 0x30; // flow control frame type
-        txframe.data.u8[1] = 0x00; // request all frames available
-        txframe.data.u8[2] = 0x19; // with 25ms send interval
-        txframe.Write();
+    if (complete)
+      {
+      s->replies++;
+      m_poll_stats.responses++;
+      m_poll_stats.response_time += now - s->sent;
+      response.assign(s->ml_buffer, 1+pidlen, std::string::npos);
+      if (s->moduleid_sent == 0x7df)
+        {
+        // broadcast: collect further replies for a short while
+        s->state = PollWaitResponse;
+        int64_t deadline = now + VEHICLE_POLL_BROADCAST_WINDOW * 1000;
+        if (deadline < s->deadline) s->deadline = deadline;
+        }
+      else
+        {
+        done = true;
+        }
+      }
 
-        // prepare frame processing, first frame contains first 4 bytes:
-        m_poll_ml_remain = (((uint16_t)(frame->data.u8[0]&0x0f))<<8) + frame->data.u8[1] - 3;
-        m_poll_ml_offset = 3;
-        m_poll_ml_frame = 0;
+    // Set up the current reply context for the vehicle:
+    m_poll_plcur = p;
+    m_poll_moduleid_sent = s->moduleid_sent;
+    m_poll_moduleid_low = s->moduleid_low;
+    m_poll_moduleid_high = s->moduleid_high;
+    m_poll_type = type;
+    m_poll_pid = pid;
+    m_poll_ml_remain = mlremain = s->ml_remain;
+    m_poll_ml_offset = s->ml_offset;
+    m_poll_ml_frame = s->ml_frame;
+
+    if (done)
+      {
+      s->state = PollIdle;
+      s->entry = NULL;
+      }
 
-        //ESP_LOGD(TAG, "Poll ML first frame (frame=%d, remain=%d)",m_poll_ml_frame,m_poll_ml_remain);
-        IncomingPollReply(frame->origin, m_poll_type, m_poll_pid, &frame->data.u8[4], 4, m_poll_ml_remain);
-        return;
-        }
-      else if (((frame->data.u8[0]>>4)==0x2)&&(m_poll_ml_remain>0))
+    if (m_poll_simulate)
+      {
+      // Verify simulated response, don't pass to vehicle:
+      if (complete)
         {
-        // Consecutive frame (1 control + 7 data bytes)
-        uint16_t len;
-        if (m_poll_ml_remain>7)
+        bool ok = (response.size() == m_poll_simulate);
+        for (size_t k=0; ok && k<response.size(); k++)
+          ok = ((uint8_t)response[k] == (uint8_t)(pid + k));
+        if (!ok)
           {
-          m_poll_ml_remain -= 7;
-          m_poll_ml_offset += 7;
-          len = 7;
+          ESP_LOGW(TAG, "Poll simulator: invalid response for %03x type %02x pid %x (%d bytes)",
+            frame->MsgID, type, pid, (int)response.size());
+          m_poll_stats.errors++;
           }
-        else
-          {
-          len = m_poll_ml_remain;
-          m_poll_ml_offset += m_poll_ml_remain;
-          m_poll_ml_remain = 0;
-          }
-        m_poll_ml_frame++;
-        //ESP_LOGD(TAG, "Poll ML subsequent frame (frame=%d, remain=%d)",m_poll_ml_frame,m_poll_ml_remain);
-        IncomingPollReply(frame->origin, m_poll_type, m_poll_pid, &frame->data.u8[1], len, m_poll_ml_remain);
-        return;
-        }
-      else if ((frame->data.u8[1] == 0x62)&&
-               ((frame->data.u8[3]+(((uint16_t) frame->data.u8[2]) << 8)) == m_poll_pid))
-        {
-        IncomingPollReply(frame->origin, m_poll_type, m_poll_pid, &frame->data.u8[4], 4, 0);
         }
-      break;
+      return done;
+      }
+    }
+
+  // Deliver to vehicle, outside of the poller lock:
+  if (chunk)
+    IncomingPollReply(frame->origin, type, pid, chunk, chunklen, mlremain);
+  if (complete)
+    IncomingPollResponse(frame->origin, type, pid, (const uint8_t*)response.data(), response.size());
+  return done;
+  }
+
+/**
+ * PollerSimulate: ISO-TP ECU simulator
+ *  While active, poll requests are answered by simulated ECUs instead of being
+ *  sent to the bus. Each response carries <length> payload bytes (pid + n),
+ *  multi frame responses follow our flow control block size. Responses are
+ *  verified by PollerReceive() and not passed on to the vehicle module.
+ */
+void OvmsVehicle::PollerSimulate(uint16_t length)
+  {
+  OvmsMutexLock lock(&m_poll_mutex);
+  m_poll_simulate = length;
+  m_poll_simecus.clear();
+  memset(&m_poll_stats, 0, sizeof(m_poll_stats));
+  m_poll_due.clear();
+  PollResetSessions();
+  }
+
+void OvmsVehicle::PollSimulatorSend(uint32_t rxid, const uint8_t* data)
+  {
+  CAN_frame_t frame;
+  memset(&frame,0,sizeof(frame));
+  frame.origin = m_poll_bus;
+  frame.MsgID = rxid;
+  frame.FIR.B.FF = CAN_frame_std;
+  frame.FIR.B.DLC = 8;
+  memcpy(frame.data.u8, data, 8);
+  xQueueSend(m_rxqueue, &frame, 0);
+  }
+
+void OvmsVehicle::PollSimulatorReceive(const CAN_frame_t* frame)
+  {
+  const uint8_t* d = frame->data.u8;
+  uint8_t tx[8];
+
+  if ((d[0] >> 4) == 0x0)
+    {
+    // Request: respond from the first module in the expected range
+    uint8_t type = d[1];
+    int pidlen = (type == VEHICLE_POLL_TYPE_OBDIIEXTENDED) ? 2 : 1;
+    uint16_t pid = (pidlen == 1) ? d[2] : ((uint16_t)d[2] << 8) + d[3];
+    poll_simecu_t ecu;
+    ecu.rxid = 0;
+    for (int i=0; i<VEHICLE_POLL_MAXSESSIONS; i++)
+      {
+      if ((m_poll_sessions[i].state != PollIdle)&&(m_poll_sessions[i].moduleid_sent == frame->MsgID))
+        ecu.rxid = m_poll_sessions[i].moduleid_low;
+      }
+    if (ecu.rxid == 0)
+      return;
+    ecu.data.append(1, (char)(0x40 + type));
+    ecu.data.append((const char*)&d[2], pidlen);
+    for (int k=0; k<m_poll_simulate; k++)
+      ecu.data.append(1, (char)(pid + k));
+
+    memset(tx, 0xaa, sizeof(tx));
+    if (ecu.data.size() <= 7)
+      {
+      tx[0] = ecu.data.size();
+      memcpy(&tx[1], ecu.data.data(), ecu.data.size());
+      PollSimulatorSend(ecu.rxid, tx);
+      }
+    else
+      {
+      tx[0] = 0x10 | ((ecu.data.size() >> 8) & 0x0f);
+      tx[1] = ecu.data.size() & 0xff;
+      memcpy(&tx[2], ecu.data.data(), 6);
+      ecu.pos = 6;
+      ecu.seq = 1;
+      ecu.cts = false;
+      ecu.block = 0;
+      PollSimulatorSend(ecu.rxid, tx);
+      // flow control will be addressed to the request ID or derived from the response ID:
+      m_poll_simecus[(frame->MsgID == 0x7df) ? ecu.rxid - 8 : frame->MsgID] = ecu;
+      }
+    }
+  else if (d[0] == 0x30)
+    {
+    // Flow control: clear to send next block
+    auto it = m_poll_simecus.find(frame->MsgID);
+    if (it == m_poll_simecus.end())
+      return;
+    it->second.cts = true;
+    it->second.block = d[1];
+    PollSimulatorRun();
+    }
+  }
+
+void OvmsVehicle::PollSimulatorRun()
+  {
+  // Send consecutive frames as far as the RX queue has room,
+  // remaining frames will be sent on the next poller run:
+  uint8_t tx[8];
+  for (auto it = m_poll_simecus.begin(); it != m_poll_simecus.end(); )
+    {
+    poll_simecu_t& ecu = it->second;
+    while (ecu.cts && (ecu.pos < ecu.data.size())&&(uxQueueSpacesAvailable(m_rxqueue) > 1))
+      {
+      int len = ecu.data.size() - ecu.pos;
+      if (len > 7) len = 7;
+      memset(tx, 0xaa, sizeof(tx));
+      tx[0] = 0x20 | ecu.seq;
+      memcpy(&tx[1], ecu.data.data() + ecu.pos, len);
+      ecu.pos += len;
+      ecu.seq = (ecu.seq + 1) & 0x0f;
+      PollSimulatorSend(ecu.rxid, tx);
+      if ((ecu.block > 0)&&(--ecu.block == 0))
+        ecu.cts = false; // wait for next flow control
+      }
+    if (ecu.pos >= ecu.data.size())
+      it = m_poll_simecus.erase(it);
+    else
+      ++it;
+    }
+  }
+
+void OvmsVehicle::PollerStatus(int verbosity, OvmsWriter* writer)
+  {
+  OvmsMutexLock lock(&m_poll_mutex);
+  int64_t now = esp_timer_get_time();
+
+  if (!m_poll_bus || !m_poll_plist)
+    {
+    writer->puts("Poller: not active");
+    }
+  else
+    {
+    int count = 0;
+    for (const poll_pid_t* p = m_poll_plist; p->txmoduleid != 0; p++) count++;
+    writer->printf("Poller: %s, state %d, %d entries\n",
+      m_poll_bus->GetName(), m_poll_state, count);
+    }
+  writer->printf("Sessions: %d, timeout: %d ms, flow control: BS=%d STmin=0x%02x\n",
+    m_poll_sessions_max, m_poll_timeout, m_poll_fc_blocksize, m_poll_fc_stmin);
+  if (m_poll_simulate)
+    writer->printf("ECU simulator: active, %d byte responses\n", m_poll_simulate);
+  writer->printf("Requests: %u, responses: %u, timeouts: %u, errors: %u, sequence errors: %u, frames: %u\n",
+    m_poll_stats.requests, m_poll_stats.responses, m_poll_stats.timeouts,
+    m_poll_stats.errors, m_poll_stats.sequence_errors, m_poll_stats.frames);
+  if (m_poll_stats.responses)
+    writer->printf("Average response time: %.1f ms\n",
+      (float)m_poll_stats.response_time / m_poll_stats.responses / 1000);
+
+  for (int i=0; i<VEHICLE_POLL_MAXSESSIONS; i++)
+    {
+    poll_session_t* s = &m_poll_sessions[i];
+    if (s->state == PollIdle)
+      continue;
+    writer->printf("  %03x -> %03x-%03x: type %02x pid %x, %s, %d ms\n",
+      s->moduleid_sent, s->moduleid_low, s->moduleid_high, s->entry->type, s->entry->pid,
+      (s->state == PollWaitResponse) ? "waiting" : "receiving",
+      (int)((now - s->sent) / 1000));
     }
   }
 
@@ -2341,67 +2773,35 @@ OvmsVehicle::vehicle_command_t OvmsVehicle::ProcessMsgCommand(std::string &resul
 
 void OvmsVehicle::BmsSetCellArrangementVoltage(int readings, int readingspermodule)
   {
-  if (m_bms_voltages != NULL) delete m_bms_voltages;
-  m_bms_voltages = new float[readings];
-  if (m_bms_vmins != NULL) delete m_bms_vmins;
-  m_bms_vmins = new float[readings];
-  if (m_bms_vmaxs != NULL) delete m_bms_vmaxs;
-  m_bms_vmaxs = new float[readings];
-  if (m_bms_vdevmaxs != NULL) delete m_bms_vdevmaxs;
-  m_bms_vdevmaxs = new float[readings];
-  if (m_bms_valerts != NULL) delete m_bms_valerts;
-  m_bms_valerts = new short[readings];
-  m_bms_valerts_new = 0;
-
-  m_bms_bitset_v.clear();
-  m_bms_bitset_v.reserve(readings);
-
-  m_bms_readings_v = readings;
-  m_bms_readingspermodule_v = readingspermodule;
-
+  m_bms_v.SetArrangement(readings, readingspermodule);
   BmsResetCellVoltages();
   }
 
 void OvmsVehicle::BmsSetCellArrangementTemperature(int readings, int readingspermodule)
   {
-  if (m_bms_temperatures != NULL) delete m_bms_temperatures;
-  m_bms_temperatures = new float[readings];
-  if (m_bms_tmins != NULL) delete m_bms_tmins;
-  m_bms_tmins = new float[readings];
-  if (m_bms_tmaxs != NULL) delete m_bms_tmaxs;
-  m_bms_tmaxs = new float[readings];
-  if (m_bms_tdevmaxs != NULL) delete m_bms_tdevmaxs;
-  m_bms_tdevmaxs = new float[readings];
-  if (m_bms_talerts != NULL) delete m_bms_talerts;
-  m_bms_talerts = new short[readings];
-  m_bms_talerts_new = 0;
-
-  m_bms_bitset_t.clear();
-  m_bms_bitset_t.reserve(readings);
-
-  m_bms_readings_t = readings;
-  m_bms_readingspermodule_t = readingspermodule;
-
+  m_bms_t.SetArrangement(readings, readingspermodule);
   BmsResetCellTemperatures();
   }
 
 int OvmsVehicle::BmsGetCellArangementVoltage(int* readings, int* readingspermodule)
   {
-  if (readings) *readings = m_bms_readings_v;
-  if (readingspermodule) *readingspermodule = m_bms_readingspermodule_v;
-  return m_bms_readings_v;
+  if (readings) *readings = m_bms_v.GetReadings();
+  if (readingspermodule) *readingspermodule = m_bms_v.GetReadingsPerModule();
+  return m_bms_v.GetReadings();
   }
 int OvmsVehicle::BmsGetCellArangementTemperature(int* readings, int* readingspermodule)
   {
-  if (readings) *readings = m_bms_readings_t;
-  if (readingspermodule) *readingspermodule = m_bms_readingspermodule_t;
-  return m_bms_readings_t;
+  if (readings) *readings = m_bms_t.GetReadings();
+  if (readingspermodule) *readingspermodule = m_bms_t.GetReadingsPerModule();
+  return m_bms_t.GetReadings();
   }
 
 void OvmsVehicle::BmsSetCellDefaultThresholdsVoltage(float warn, float alert)
   {
   m_bms_defthr_vwarn = warn;
   m_bms_defthr_valert = alert;
+  m_cfg_bms_vwarn.SetDefault(warn);
+  m_cfg_bms_valert.SetDefault(alert);
   }
 void OvmsVehicle::BmsGetCellDefaultThresholdsVoltage(float* warn, float* alert)
   {
@@ -2413,6 +2813,8 @@ void OvmsVehicle::BmsSetCellDefaultThresholdsTemperature(float warn, float alert
   {
   m_bms_defthr_twarn = warn;
   m_bms_defthr_talert = alert;
+  m_cfg_bms_twarn.SetDefault(warn);
+  m_cfg_bms_talert.SetDefault(alert);
   }
 void OvmsVehicle::BmsGetCellDefaultThresholdsTemperature(float* warn, float* alert)
   {
@@ -2422,224 +2824,101 @@ void OvmsVehicle::BmsGetCellDefaultThresholdsTemperature(float* warn, float* ale
 
 void OvmsVehicle::BmsSetCellLimitsVoltage(float min, float max)
   {
-  m_bms_limit_vmin = min;
-  m_bms_limit_vmax = max;
+  m_bms_v.SetLimits(min, max);
   }
 
 void OvmsVehicle::BmsSetCellLimitsTemperature(float min, float max)
   {
-  m_bms_limit_tmin = min;
-  m_bms_limit_tmax = max;
+  m_bms_t.SetLimits(min, max);
+  }
+
+/**
+ * BmsPublishCellStats: publish statistics of a completed cell set to the
+ *  metrics; per cell vectors are only published if changed
+ */
+static void BmsPublishCellStats(OvmsBmsCellStats& bms,
+  OvmsMetricFloat* pack_min, OvmsMetricFloat* pack_max, OvmsMetricFloat* pack_avg,
+  OvmsMetricFloat* pack_stddev, OvmsMetricFloat* pack_stddev_max,
+  OvmsMetricVector<float>* cell_values, OvmsMetricVector<float>* cell_mins,
+  OvmsMetricVector<float>* cell_maxs, OvmsMetricVector<float>* cell_devmaxs,
+  OvmsMetricVector<short>* cell_alerts)
+  {
+  int n = bms.GetReadings();
+  int dirty = bms.GetDirty();
+  pack_min->SetValue(bms.GetMin());
+  pack_max->SetValue(bms.GetMax());
+  pack_avg->SetValue(bms.GetAvg());
+  pack_stddev->SetValue(bms.GetStddev());
+  if (bms.GetStddev() > pack_stddev_max->AsFloat())
+    pack_stddev_max->SetValue(bms.GetStddev());
+  cell_values->SetElemValues(0, n, bms.GetValues());
+  if (dirty & BMS_DIRTY_MINS)
+    cell_mins->SetElemValues(0, n, bms.GetMins());
+  if (dirty & BMS_DIRTY_MAXS)
+    cell_maxs->SetElemValues(0, n, bms.GetMaxs());
+  if (dirty & BMS_DIRTY_DEVMAXS)
+    cell_devmaxs->SetElemValues(0, n, bms.GetDevMaxs());
+  if (dirty & BMS_DIRTY_ALERTS)
+    cell_alerts->SetElemValues(0, n, bms.GetAlerts());
+  bms.ClearDirty();
   }
 
 void OvmsVehicle::BmsSetCellVoltage(int index, float value)
   {
-  // ESP_LOGI(TAG,"BmsSetCellVoltage(%d,%f) c=%d", index, value, m_bms_bitset_cv);
-  if ((index<0)||(index>=m_bms_readings_v)) return;
-  if ((value<m_bms_limit_vmin)||(value>m_bms_limit_vmax)) return;
-  m_bms_voltages[index] = value;
-
-  if (! m_bms_has_voltages)
-    {
-    m_bms_vmins[index] = value;
-    m_bms_vmaxs[index] = value;
-    }
-  else if (m_bms_vmins[index] > value)
-    m_bms_vmins[index] = value;
-  else if (m_bms_vmaxs[index] < value)
-    m_bms_vmaxs[index] = value;
-
-  if (m_bms_bitset_v[index] == false) m_bms_bitset_cv++;
-  if (m_bms_bitset_cv == m_bms_readings_v)
-    {
-    // get min, max, avg & standard deviation:
-    double sum=0, sqrsum=0, avg, stddev=0;
-    float min=0, max=0;
-    for (int i=0; i<m_bms_readings_v; i++)
-      {
-      sum += m_bms_voltages[i];
-      sqrsum += SQR(m_bms_voltages[i]);
-      if (min==0 || m_bms_voltages[i]<min)
-        min = m_bms_voltages[i];
-      if (max==0 || m_bms_voltages[i]>max)
-        max = m_bms_voltages[i];
-      }
-    avg = sum / m_bms_readings_v;
-    stddev = sqrt(LIMIT_MIN((sqrsum / m_bms_readings_v) - SQR(avg), 0));
-    // check cell deviations:
-    float dev;
-    float thr_warn  = MyConfig.GetParamValueFloat("vehicle", "bms.dev.voltage.warn", m_bms_defthr_vwarn);
-    float thr_alert = MyConfig.GetParamValueFloat("vehicle", "bms.dev.voltage.alert", m_bms_defthr_valert);
-    for (int i=0; i<m_bms_readings_v; i++)
-      {
-      dev = ROUNDPREC(m_bms_voltages[i] - avg, 5);
-      if (ABS(dev) > ABS(m_bms_vdevmaxs[i]))
-        m_bms_vdevmaxs[i] = dev;
-      if (ABS(dev) >= thr_alert && m_bms_valerts[i] < 2)
-        {
-        m_bms_valerts[i] = 2;
-        m_bms_valerts_new++; // trigger notification
-        }
-      else if (ABS(dev) >= thr_warn && m_bms_valerts[i] < 1)
-        m_bms_valerts[i] = 1;
-      }
-    // publish to metrics:
-    avg = ROUNDPREC(avg, 5);
-    stddev = ROUNDPREC(stddev, 5);
-    StandardMetrics.ms_v_bat_pack_vmin->SetValue(min);
-    StandardMetrics.ms_v_bat_pack_vmax->SetValue(max);
-    StandardMetrics.ms_v_bat_pack_vavg->SetValue(avg);
-    StandardMetrics.ms_v_bat_pack_vstddev->SetValue(stddev);
-    if (stddev > StandardMetrics.ms_v_bat_pack_vstddev_max->AsFloat())
-      StandardMetrics.ms_v_bat_pack_vstddev_max->SetValue(stddev);
-    StandardMetrics.ms_v_bat_cell_voltage->SetElemValues(0, m_bms_readings_v, m_bms_voltages);
-    StandardMetrics.ms_v_bat_cell_vmin->SetElemValues(0, m_bms_readings_v, m_bms_vmins);
-    StandardMetrics.ms_v_bat_cell_vmax->SetElemValues(0, m_bms_readings_v, m_bms_vmaxs);
-    StandardMetrics.ms_v_bat_cell_vdevmax->SetElemValues(0, m_bms_readings_v, m_bms_vdevmaxs);
-    StandardMetrics.ms_v_bat_cell_valert->SetElemValues(0, m_bms_readings_v, m_bms_valerts);
-    // complete:
-    m_bms_has_voltages = true;
-    m_bms_bitset_v.clear();
-    m_bms_bitset_v.resize(m_bms_readings_v);
-    m_bms_bitset_cv = 0;
-    }
-  else
-    {
-    m_bms_bitset_v[index] = true;
-    }
+  if (!m_bms_v.Set(index, value))
+    return;
+  m_bms_v.Update(m_cfg_bms_vwarn, m_cfg_bms_valert);
+  BmsPublishCellStats(m_bms_v,
+    StandardMetrics.ms_v_bat_pack_vmin, StandardMetrics.ms_v_bat_pack_vmax,
+    StandardMetrics.ms_v_bat_pack_vavg, StandardMetrics.ms_v_bat_pack_vstddev,
+    StandardMetrics.ms_v_bat_pack_vstddev_max,
+    StandardMetrics.ms_v_bat_cell_voltage, StandardMetrics.ms_v_bat_cell_vmin,
+    StandardMetrics.ms_v_bat_cell_vmax, StandardMetrics.ms_v_bat_cell_vdevmax,
+    StandardMetrics.ms_v_bat_cell_valert);
   }
 
 void OvmsVehicle::BmsSetCellTemperature(int index, float value)
   {
-  // ESP_LOGI(TAG,"BmsSetCellTemperature(%d,%f) c=%d", index, value, m_bms_bitset_ct);
-  if ((index<0)||(index>=m_bms_readings_t)) return;
-  if ((value<m_bms_limit_tmin)||(value>m_bms_limit_tmax)) return;
-  m_bms_temperatures[index] = value;
-
-  if (! m_bms_has_temperatures)
-    {
-    m_bms_tmins[index] = value;
-    m_bms_tmaxs[index] = value;
-    }
-  else if (m_bms_tmins[index] > value)
-    m_bms_tmins[index] = value;
-  else if (m_bms_tmaxs[index] < value)
-    m_bms_tmaxs[index] = value;
-
-  if (m_bms_bitset_t[index] == false) m_bms_bitset_ct++;
-  if (m_bms_bitset_ct == m_bms_readings_t)
-    {
-    // get min, max, avg & standard deviation:
-    double sum=0, sqrsum=0, avg, stddev=0;
-    float min=0, max=0;
-    for (int i=0; i<m_bms_readings_t; i++)
-      {
-      sum += m_bms_temperatures[i];
-      sqrsum += SQR(m_bms_temperatures[i]);
-      if (min==0 || m_bms_temperatures[i]<min)
-        min = m_bms_temperatures[i];
-      if (max==0 || m_bms_temperatures[i]>max)
-        max = m_bms_temperatures[i];
-      }
-    avg = sum / m_bms_readings_t;
-    stddev = sqrt(LIMIT_MIN((sqrsum / m_bms_readings_t) - SQR(avg), 0));
-    // check cell deviations:
-    float dev;
-    float thr_warn  = MyConfig.GetParamValueFloat("vehicle", "bms.dev.temp.warn", m_bms_defthr_twarn);
-    float thr_alert = MyConfig.GetParamValueFloat("vehicle", "bms.dev.temp.alert", m_bms_defthr_talert);
-    for (int i=0; i<m_bms_readings_t; i++)
-      {
-      dev = ROUNDPREC(m_bms_temperatures[i] - avg, 2);
-      if (ABS(dev) > ABS(m_bms_tdevmaxs[i]))
-        m_bms_tdevmaxs[i] = dev;
-      if (ABS(dev) >= thr_alert && m_bms_talerts[i] < 2)
-        {
-        m_bms_talerts[i] = 2;
-        m_bms_talerts_new++; // trigger notification
-        }
-      else if (ABS(dev) >= thr_warn && m_bms_valerts[i] < 1)
-        m_bms_talerts[i] = 1;
-      }
-    // publish to metrics:
-    avg = ROUNDPREC(avg, 2);
-    stddev = ROUNDPREC(stddev, 2);
-    StandardMetrics.ms_v_bat_pack_tmin->SetValue(min);
-    StandardMetrics.ms_v_bat_pack_tmax->SetValue(max);
-    StandardMetrics.ms_v_bat_pack_tavg->SetValue(avg);
-    StandardMetrics.ms_v_bat_pack_tstddev->SetValue(stddev);
-    if (stddev > StandardMetrics.ms_v_bat_pack_tstddev_max->AsFloat())
-      StandardMetrics.ms_v_bat_pack_tstddev_max->SetValue(stddev);
-    StandardMetrics.ms_v_bat_cell_temp->SetElemValues(0, m_bms_readings_t, m_bms_temperatures);
-    StandardMetrics.ms_v_bat_cell_tmin->SetElemValues(0, m_bms_readings_t, m_bms_tmins);
-    StandardMetrics.ms_v_bat_cell_tmax->SetElemValues(0, m_bms_readings_t, m_bms_tmaxs);
-    StandardMetrics.ms_v_bat_cell_tdevmax->SetElemValues(0, m_bms_readings_t, m_bms_tdevmaxs);
-    StandardMetrics.ms_v_bat_cell_talert->SetElemValues(0, m_bms_readings_t, m_bms_talerts);
-    // complete:
-    m_bms_has_temperatures = true;
-    m_bms_bitset_t.clear();
-    m_bms_bitset_t.resize(m_bms_readings_t);
-    m_bms_bitset_ct = 0;
-    }
-  else
-    {
-    m_bms_bitset_t[index] = true;
-    }
+  if (!m_bms_t.Set(index, value))
+    return;
+  m_bms_t.Update(m_cfg_bms_twarn, m_cfg_bms_talert);
+  BmsPublishCellStats(m_bms_t,
+    StandardMetrics.ms_v_bat_pack_tmin, StandardMetrics.ms_v_bat_pack_tmax,
+    StandardMetrics.ms_v_bat_pack_tavg, StandardMetrics.ms_v_bat_pack_tstddev,
+    StandardMetrics.ms_v_bat_pack_tstddev_max,
+    StandardMetrics.ms_v_bat_cell_temp, StandardMetrics.ms_v_bat_cell_tmin,
+    StandardMetrics.ms_v_bat_cell_tmax, StandardMetrics.ms_v_bat_cell_tdevmax,
+    StandardMetrics.ms_v_bat_cell_talert);
   }
 
 void OvmsVehicle::BmsRestartCellVoltages()
   {
-  m_bms_bitset_v.clear();
-  m_bms_bitset_v.resize(m_bms_readings_v);
-  m_bms_bitset_cv = 0;
+  m_bms_v.Restart();
   }
 
 void OvmsVehicle::BmsRestartCellTemperatures()
   {
-  m_bms_bitset_t.clear();
-  m_bms_bitset_v.resize(m_bms_readings_t);
-  m_bms_bitset_ct = 0;
+  m_bms_t.Restart();
   }
 
 void OvmsVehicle::BmsResetCellVoltages()
   {
-  if (m_bms_readings_v > 0)
+  if (m_bms_v.GetReadings() > 0)
     {
-    m_bms_bitset_v.clear();
-    m_bms_bitset_v.resize(m_bms_readings_v);
-    m_bms_bitset_cv = 0;
-    m_bms_has_voltages = false;
-    for (int k=0; k<m_bms_readings_v; k++)
-      {
-      m_bms_vmins[k] = 0;
-      m_bms_vmaxs[k] = 0;
-      m_bms_vdevmaxs[k] = 0;
-      m_bms_valerts[k] = 0;
-      }
-    m_bms_valerts_new = 0;
+    m_bms_v.Reset();
     StandardMetrics.ms_v_bat_cell_vmin->ClearValue();
     StandardMetrics.ms_v_bat_cell_vmax->ClearValue();
     StandardMetrics.ms_v_bat_cell_vdevmax->ClearValue();
     StandardMetrics.ms_v_bat_cell_valert->ClearValue();
-    StandardMetrics.ms_v_bat_pack_tstddev_max->SetValue(StandardMetrics.ms_v_bat_pack_tstddev->AsFloat());
+    StandardMetrics.ms_v_bat_pack_vstddev_max->SetValue(StandardMetrics.ms_v_bat_pack_vstddev->AsFloat());
     }
   }
 
 void OvmsVehicle::BmsResetCellTemperatures()
   {
-  if (m_bms_readings_t > 0)
+  if (m_bms_t.GetReadings() > 0)
     {
-    m_bms_bitset_t.clear();
-    m_bms_bitset_t.resize(m_bms_readings_t);
-    m_bms_bitset_ct = 0;
-    m_bms_has_temperatures = false;
-    for (int k=0; k<m_bms_readings_t; k++)
-      {
-      m_bms_tmins[k] = 0;
-      m_bms_tmaxs[k] = 0;
-      m_bms_tdevmaxs[k] = 0;
-      m_bms_talerts[k] = 0;
-      }
-    m_bms_talerts_new = 0;
+    m_bms_t.Reset();
     StandardMetrics.ms_v_bat_cell_tmin->ClearValue();
     StandardMetrics.ms_v_bat_cell_tmax->ClearValue();
     StandardMetrics.ms_v_bat_cell_tdevmax->ClearValue();
@@ -2654,11 +2933,19 @@ void OvmsVehicle::BmsResetCellStats()
   BmsResetCellTemperatures();
   }
 
+void OvmsVehicle::BmsSpreadStatus(int verbosity, OvmsWriter* writer)
+  {
+  writer->puts("Voltage spread (max-min) since reset:");
+  m_bms_v.SpreadHistogram(writer, 1000, "mV");
+  writer->puts("Temperature spread (max-min) since reset:");
+  m_bms_t.SpreadHistogram(writer, 1, "C");
+  }
+
 void OvmsVehicle::BmsStatus(int verbosity, OvmsWriter* writer)
   {
   int c;
 
-  if ((! m_bms_has_voltages)||(! m_bms_has_temperatures))
+  if ((! m_bms_v.HasSet())||(! m_bms_t.HasSet()))
     {
     writer->puts("No BMS status data available");
     return;
@@ -2666,14 +2953,20 @@ void OvmsVehicle::BmsStatus(int verbosity, OvmsWriter* writer)
 
   int vwarn=0, valert=0;
   int twarn=0, talert=0;
-  for (c=0; c<m_bms_readings_v; c++) {
-    if (m_bms_valerts[c]==1) vwarn++;
-    if (m_bms_valerts[c]==2) valert++;
+  short* valerts = m_bms_v.GetAlerts();
+  short* talerts = m_bms_t.GetAlerts();
+  for (c=0; c<m_bms_v.GetReadings(); c++) {
+    if (valerts[c]==1) vwarn++;
+    if (valerts[c]==2) valert++;
   }
-  for (c=0; c<m_bms_readings_t; c++) {
-    if (m_bms_talerts[c]==1) twarn++;
-    if (m_bms_talerts[c]==2) talert++;
+  for (c=0; c<m_bms_t.GetReadings(); c++) {
+    if (talerts[c]==1) twarn++;
+    if (talerts[c]==2) talert++;
   }
+  int vpermodule = m_bms_v.GetReadingsPerModule();
+  int tpermodule = m_bms_t.GetReadingsPerModule();
+  float* voltages = m_bms_v.GetValues();
+  float* temperatures = m_bms_t.GetValues();
 
   writer->puts("Voltage:");
   writer->printf("    Average: %5.3fV [%5.3fV - %5.3fV]\n",
@@ -2698,30 +2991,30 @@ void OvmsVehicle::BmsStatus(int verbosity, OvmsWriter* writer)
   writer->puts("Cells:");
   int kv = 0;
   int kt = 0;
-  for (int module = 0; module < (m_bms_readings_v/m_bms_readingspermodule_v); module++)
+  for (int module = 0; module < (m_bms_v.GetReadings()/vpermodule); module++)
     {
     writer->printf("    +");
-    for (c=0;c<m_bms_readingspermodule_v;c++) { writer->printf("-------"); }
+    for (c=0;c<vpermodule;c++) { writer->printf("-------"); }
     writer->printf("-+");
-    for (c=0;c<m_bms_readingspermodule_t;c++) { writer->printf("-------"); }
+    for (c=0;c<tpermodule;c++) { writer->printf("-------"); }
     writer->puts("-+");
     writer->printf("%3d |",module+1);
-    for (c=0; c<m_bms_readingspermodule_v; c++)
+    for (c=0; c<vpermodule; c++)
       {
-      writer->printf(" %5.3fV",m_bms_voltages[kv++]);
+      writer->printf(" %5.3fV",voltages[kv++]);
       }
     writer->printf(" |");
-    for (c=0; c<m_bms_readingspermodule_t; c++)
+    for (c=0; c<tpermodule; c++)
       {
-      writer->printf(" %5.1fC",m_bms_temperatures[kt++]);
+      writer->printf(" %5.1fC",temperatures[kt++]);
       }
     writer->puts(" |");
     }
 
   writer->printf("    +");
-  for (c=0;c<m_bms_readingspermodule_v;c++) { writer->printf("-------"); }
+  for (c=0;c<vpermodule;c++) { writer->printf("-------"); }
   writer->printf("-+");
-  for (c=0;c<m_bms_readingspermodule_t;c++) { writer->printf("-------"); }
+  for (c=0;c<tpermodule;c++) { writer->printf("-------"); }
   writer->puts("-+");
   }
 
@@ -2730,7 +3023,7 @@ bool OvmsVehicle::FormatBmsAlerts(int verbosity, OvmsWriter* writer, bool show_w
   // Voltages:
   writer->printf("Voltage: SD=%dmV", (int)(StdMetrics.ms_v_bat_pack_vstddev_max->AsFloat() * 1000));
   bool has_valerts = false;
-  for (int i=0; i<m_bms_readings_v; i++)
+  for (int i=0; i<m_bms_v.GetReadings(); i++)
     {
     int sts = StdMetrics.ms_v_bat_cell_valert->GetElemValue(i);
     if (sts == 0) continue;
@@ -2745,7 +3038,7 @@ bool OvmsVehicle::FormatBmsAlerts(int verbosity, OvmsWriter* writer, bool show_w
   // (Note: '°' is not SMS safe, so we only output 'C')
   writer->printf("Temperature: SD=%.1fC", StdMetrics.ms_v_bat_pack_tstddev_max->AsFloat());
   bool has_talerts = false;
-  for (int i=0; i<m_bms_readings_v; i++)
+  for (int i=0; i<m_bms_t.GetReadings(); i++)
     {
     int sts = StdMetrics.ms_v_bat_cell_talert->GetElemValue(i);
     if (sts == 0) continue;
@@ -41,6 +41,7 @@
 #include "ovms_command.h"
 #include "metrics_standard.h"
 #include "ovms_mutex.h"
+#include "vehicle_bmsstats.h"
 
 using namespace std;
 struct DashboardConfig;
@@ -60,6 +61,16 @@ struct DashboardConfig;
 
 #define VEHICLE_POLL_NSTATES            4
 
+// Poll scheduler:
+//  The poller runs in the vehicle RX task with tick resolution and keeps up to
+//  m_poll_sessions_max ISO-TP transactions outstanding (one per ECU address).
+
+#define VEHICLE_POLL_MAXSESSIONS        8     // Max concurrent ECU transactions
+#define VEHICLE_POLL_TIMEOUT            1000  // Default response timeout [ms]
+#define VEHICLE_POLL_BROADCAST_WINDOW   100   // Collect further broadcast replies [ms]
+#define VEHICLE_POLL_FC_BLOCKSIZE       0     // Default flow control block size (0=all)
+#define VEHICLE_POLL_FC_STMIN           0x19  // Default flow control separation time (25 ms)
+
 
 // Standard MSG protocol commands:
 
@@ -122,10 +133,10 @@ class OvmsVehicle : public InternalRamAllocated
     canbus* m_can4;
 
   private:
-    void VehicleTicker1(std::string event, void* data);
+    void VehicleTicker1(event_id_t id, const char* event, void* data);
     void VehicleConfigChanged(std::string event, void* data);
     void PollerSend();
-    void PollerReceive(CAN_frame_t* frame);
+    bool PollerReceive(CAN_frame_t* frame);
 
   protected:
     virtual void IncomingFrameCan1(CAN_frame_t* p_frame);
@@ -133,11 +144,22 @@ class OvmsVehicle : public InternalRamAllocated
     virtual void IncomingFrameCan3(CAN_frame_t* p_frame);
     virtual void IncomingFrameCan4(CAN_frame_t* p_frame);
     virtual void IncomingPollReply(canbus* bus, uint16_t type, uint16_t pid, uint8_t* data, uint8_t length, uint16_t mlremain);
+    virtual void IncomingPollResponse(canbus* bus, uint16_t type, uint16_t pid, const uint8_t* data, uint16_t length);
 
   protected:
     int m_minsoc;            // The minimum SOC level before alert
     int m_minsoc_triggered;  // The triggered minimum SOC level to alert at
 
+  protected:
+    OvmsConfigFloat m_cfg_12v_ref;            // vehicle 12v.ref
+    OvmsConfigFloat m_cfg_12v_alert;          // vehicle 12v.alert
+    OvmsConfigInt m_cfg_minsoc;               // vehicle minsoc
+    OvmsConfigBool m_cfg_bms_alerts;          // vehicle bms.alerts.enabled
+    OvmsConfigFloat m_cfg_bms_vwarn;          // vehicle bms.dev.voltage.warn
+    OvmsConfigFloat m_cfg_bms_valert;         // vehicle bms.dev.voltage.alert
+    OvmsConfigFloat m_cfg_bms_twarn;          // vehicle bms.dev.temp.warn
+    OvmsConfigFloat m_cfg_bms_talert;         // vehicle bms.dev.temp.alert
+
   protected:
     float m_accel_refspeed;                 // Acceleration calculation: last speed measured (m/s)
     uint32_t m_accel_reftime;               // … timestamp for refspeed (ms)
@@ -288,55 +310,103 @@ class OvmsVehicle : public InternalRamAllocated
       uint16_t polltime[VEHICLE_POLL_NSTATES];
       } poll_pid_t;
 
+    typedef enum
+      {
+      PollIdle = 0,                           // Session free
+      PollWaitResponse,                       // Request sent, waiting for single/first frame
+      PollWaitConsecutive,                    // Receiving consecutive frames
+      } poll_session_state_t;
+
+    typedef struct
+      {
+      poll_session_state_t state;
+      const poll_pid_t* entry;                // Poll list entry being served
+      uint32_t moduleid_sent;                 // ModuleID request was sent to
+      uint32_t moduleid_low;                  // Expected response moduleid low mark
+      uint32_t moduleid_high;                 // Expected response moduleid high mark
+      uint32_t moduleid_rec;                  // ModuleID of multi frame responder
+      int64_t sent;                           // Request time [us]
+      int64_t deadline;                       // Timeout [us]
+      uint16_t replies;                       // Complete responses received
+      uint16_t ml_remain;                     // Bytes remaining for ML poll (legacy count)
+      uint16_t ml_offset;                     // Offset of ML poll
+      uint16_t ml_frame;                      // Frame number for ML poll
+      uint16_t ml_todo;                       // ISO-TP payload bytes outstanding
+      uint8_t ml_seq;                         // Next expected sequence number
+      uint8_t ml_block;                       // Frames left in current flow control block
+      std::string ml_buffer;                  // Reassembled ISO-TP payload
+      } poll_session_t;
+
+    typedef struct
+      {
+      uint32_t requests;
+      uint32_t responses;
+      uint32_t timeouts;
+      uint32_t errors;
+      uint32_t sequence_errors;
+      uint32_t frames;
+      uint64_t response_time;                 // Sum of transaction times [us]
+      } poll_stats_t;
+
+    typedef struct
+      {
+      uint32_t rxid;                          // Response ID
+      std::string data;                       // Response payload
+      uint16_t pos;                           // Bytes sent
+      uint8_t seq;                            // Next sequence number
+      uint8_t block;                          // Frames left in block (0=all)
+      bool cts;                               // Clear to send (flow control received)
+      } poll_simecu_t;
+
   protected:
     OvmsMutex         m_poll_mutex;           // Concurrency protection
     uint8_t           m_poll_state;           // Current poll state
     canbus*           m_poll_bus;             // Bus to poll on
     const poll_pid_t* m_poll_plist;           // Head of poll list
-    const poll_pid_t* m_poll_plcur;           // Current position in poll list
-    uint32_t          m_poll_ticker;          // Polling ticker
-    uint32_t          m_poll_moduleid_sent;   // ModuleID last sent
-    uint32_t          m_poll_moduleid_low;    // Expected response moduleid low mark
-    uint32_t          m_poll_moduleid_high;   // Expected response moduleid high mark
-    uint16_t          m_poll_type;            // Expected type
-    uint16_t          m_poll_pid;             // Expected PID
+    const poll_pid_t* m_poll_plcur;           // Poll list entry of current reply
+    uint32_t          m_poll_moduleid_sent;   // ModuleID of current reply request
+    uint32_t          m_poll_moduleid_low;    // Current reply moduleid low mark
+    uint32_t          m_poll_moduleid_high;   // Current reply moduleid high mark
+    uint16_t          m_poll_type;            // Current reply type
+    uint16_t          m_poll_pid;             // Current reply PID
     uint16_t          m_poll_ml_remain;       // Bytes remainign for ML poll
     uint16_t          m_poll_ml_offset;       // Offset of ML poll
     uint16_t          m_poll_ml_frame;        // Frame number for ML poll
-    uint16_t          m_poll_wait;            // Wait for remaining poll replays
+
+  private:
+    std::vector<int64_t> m_poll_due;          // Next due time per poll list entry [us]
+    poll_session_t    m_poll_sessions[VEHICLE_POLL_MAXSESSIONS];
+    uint8_t           m_poll_sessions_max;    // Concurrent ECU transactions allowed
+    uint16_t          m_poll_timeout;         // Response timeout [ms]
+    uint8_t           m_poll_fc_blocksize;    // Flow control block size
+    uint8_t           m_poll_fc_stmin;        // Flow control separation time
+    poll_stats_t      m_poll_stats;           // Poller statistics
+    uint16_t          m_poll_simulate;        // ECU simulator response size (0=off)
+    std::map<uint32_t, poll_simecu_t> m_poll_simecus; // ECU simulator pending responses
+
+    poll_session_t* PollFindSession(uint32_t rxid);
+    void PollResetSessions();
+    void PollTransmit(CAN_frame_t* frame);
+    void PollSendFlowControl(poll_session_t* session, canbus* bus);
+    void PollSimulatorReceive(const CAN_frame_t* frame);
+    void PollSimulatorSend(uint32_t rxid, const uint8_t* data);
+    void PollSimulatorRun();
 
   protected:
     void PollSetPidList(canbus* bus, const poll_pid_t* plist);
     void PollSetState(uint8_t state);
+    void PollSetSessions(uint8_t sessions);
+    void PollSetTimeout(uint16_t timeout_ms);
+    void PollSetFlowControl(uint8_t blocksize, uint8_t stmin);
+
+  public:
+    void PollerStatus(int verbosity, OvmsWriter* writer);
+    void PollerSimulate(uint16_t length);
 
   // BMS helpers
   protected:
-    float* m_bms_voltages;                    // BMS voltages (current value)
-    float* m_bms_vmins;                       // BMS minimum voltages seen (since reset)
-    float* m_bms_vmaxs;                       // BMS maximum voltages seen (since reset)
-    float* m_bms_vdevmaxs;                    // BMS maximum voltage deviations seen (since reset)
-    short* m_bms_valerts;                     // BMS voltage deviation alerts (since reset)
-    int m_bms_valerts_new;                    // BMS new voltage alerts since last notification
-    bool m_bms_has_voltages;                  // True if BMS has a complete set of voltage values
-    float* m_bms_temperatures;                // BMS temperatures (celcius current value)
-    float* m_bms_tmins;                       // BMS minimum temperatures seen (since reset)
-    float* m_bms_tmaxs;                       // BMS maximum temperatures seen (since reset)
-    float* m_bms_tdevmaxs;                    // BMS maximum temperature deviations seen (since reset)
-    short* m_bms_talerts;                     // BMS temperature deviation alerts (since reset)
-    int m_bms_talerts_new;                    // BMS new temperature alerts since last notification
-    bool m_bms_has_temperatures;              // True if BMS has a complete set of temperature values
-    std::vector<bool> m_bms_bitset_v;         // BMS tracking: true if corresponding voltage set
-    std::vector<bool> m_bms_bitset_t;         // BMS tracking: true if corresponding temperature set
-    int m_bms_bitset_cv;                      // BMS tracking: count of unique voltage values set
-    int m_bms_bitset_ct;                      // BMS tracking: count of unique temperature values set
-    int m_bms_readings_v;                     // Number of BMS voltage readings expected
-    int m_bms_readingspermodule_v;            // Number of BMS voltage readings per module
-    int m_bms_readings_t;                     // Number of BMS temperature readings expected
-    int m_bms_readingspermodule_t;            // Number of BMS temperature readings per module
-    float m_bms_limit_tmin;                   // Minimum temperature limit (for sanity checking)
-    float m_bms_limit_tmax;                   // Maximum temperature limit (for sanity checking)
-    float m_bms_limit_vmin;                   // Minimum voltage limit (for sanity checking)
-    float m_bms_limit_vmax;                   // Maximum voltage limit (for sanity checking)
+    OvmsBmsCellStats m_bms_v;                 // BMS cell voltage statistics [V]
+    OvmsBmsCellStats m_bms_t;                 // BMS cell temperature statistics [°C]
     float m_bms_defthr_vwarn;                 // Default voltage deviation warn threshold [V]
     float m_bms_defthr_valert;                // Default voltage deviation alert threshold [V]
     float m_bms_defthr_twarn;                 // Default temperature deviation warn threshold [°C]
@@ -363,6 +433,7 @@ class OvmsVehicle : public InternalRamAllocated
     void BmsGetCellDefaultThresholdsVoltage(float* warn, float* alert);
     void BmsGetCellDefaultThresholdsTemperature(float* warn, float* alert);
     void BmsResetCellStats();
+    void BmsSpreadStatus(int verbosity, OvmsWriter* writer);
     virtual void BmsStatus(int verbosity, OvmsWriter* writer);
     virtual bool FormatBmsAlerts(int verbosity, OvmsWriter* writer, bool show_warnings);
   };
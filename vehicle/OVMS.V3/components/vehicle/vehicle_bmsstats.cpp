@@ -0,0 +1,256 @@
+/*
+;    Project:       Open Vehicle Monitor System
+;    Date:          16th October 2026
+;
+;    (C) 2026       Mark Webb-Johnson
+;
+; Permission is hereby granted, free of charge, to any person obtaining a copy
+; of this software and associated documentation files (the "Software"), to deal
+; in the Software without restriction, including without limitation the rights
+; to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+; copies of the Software, and to permit persons to whom the Software is
+; furnished to do so, subject to the following conditions:
+;
+; The above copyright notice and this permission notice shall be included in
+; all copies or substantial portions of the Software.
+;
+; THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+; IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+; FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+; AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+; LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+; OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+; THE SOFTWARE.
+*/
+
+#include <string.h>
+#include <math.h>
+#include "ovms_command.h"
+#include "vehicle_bmsstats.h"
+
+OvmsBmsCellStats::OvmsBmsCellStats()
+  {
+  m_readings = 0;
+  m_readingspermodule = 0;
+  m_limitmin = -1000;
+  m_limitmax = 1000;
+  m_values = NULL;
+  m_mins = NULL;
+  m_maxs = NULL;
+  m_devmaxs = NULL;
+  m_alerts = NULL;
+  m_setbits = NULL;
+  m_spreadbinwidth = 1;
+  SetPrecision(2);
+  Reset();
+  }
+
+OvmsBmsCellStats::~OvmsBmsCellStats()
+  {
+  Free();
+  }
+
+void OvmsBmsCellStats::Free()
+  {
+  if (m_values) { delete [] m_values; m_values = NULL; }
+  if (m_mins) { delete [] m_mins; m_mins = NULL; }
+  if (m_maxs) { delete [] m_maxs; m_maxs = NULL; }
+  if (m_devmaxs) { delete [] m_devmaxs; m_devmaxs = NULL; }
+  if (m_alerts) { delete [] m_alerts; m_alerts = NULL; }
+  if (m_setbits) { delete [] m_setbits; m_setbits = NULL; }
+  m_readings = 0;
+  }
+
+void OvmsBmsCellStats::SetArrangement(int readings, int readingspermodule)
+  {
+  Free();
+  if (readings > 0)
+    {
+    m_values = new float[readings]();
+    m_mins = new float[readings];
+    m_maxs = new float[readings];
+    m_devmaxs = new float[readings];
+    m_alerts = new short[readings];
+    m_setbits = new uint32_t[(readings+31)/32];
+    m_readings = readings;
+    }
+  m_readingspermodule = readingspermodule;
+  Reset();
+  }
+
+void OvmsBmsCellStats::SetLimits(float min, float max)
+  {
+  m_limitmin = min;
+  m_limitmax = max;
+  }
+
+void OvmsBmsCellStats::SetPrecision(int digits)
+  {
+  m_prec = powf(10, digits);
+  m_invprec = 1 / m_prec;
+  }
+
+void OvmsBmsCellStats::SetSpreadBinWidth(float width)
+  {
+  if (width > 0) m_spreadbinwidth = width;
+  }
+
+bool OvmsBmsCellStats::Set(int index, float value)
+  {
+  if ((index<0)||(index>=m_readings)) return false;
+  if ((value<m_limitmin)||(value>m_limitmax)) return false;
+  m_values[index] = value;
+
+  if (!m_hasset)
+    {
+    m_mins[index] = value;
+    m_maxs[index] = value;
+    }
+  else if (m_mins[index] > value)
+    {
+    m_mins[index] = value;
+    m_dirty |= BMS_DIRTY_MINS;
+    }
+  else if (m_maxs[index] < value)
+    {
+    m_maxs[index] = value;
+    m_dirty |= BMS_DIRTY_MAXS;
+    }
+
+  uint32_t bit = 1u << (index & 31);
+  uint32_t& word = m_setbits[index >> 5];
+  if ((word & bit) == 0)
+    {
+    word |= bit;
+    m_setcount++;
+    }
+  return (m_setcount == m_readings);
+  }
+
+void OvmsBmsCellStats::Update(float thr_warn, float thr_alert)
+  {
+  const int n = m_readings;
+  if (n == 0) return;
+  const float* __restrict__ values = m_values;
+  float* __restrict__ devmaxs = m_devmaxs;
+  short* __restrict__ alerts = m_alerts;
+
+  // Pass 1: sum & sum of squares (shifted by the first value to avoid
+  //  cancellation in single precision), min & max:
+  float shift = values[0];
+  float sum = 0, sqrsum = 0;
+  float min = shift, max = shift;
+  int mincell = 0, maxcell = 0;
+  for (int i=0; i<n; i++)
+    {
+    float x = values[i];
+    float d = x - shift;
+    sum += d;
+    sqrsum += d * d;
+    mincell = (x < min) ? i : mincell;
+    min = (x < min) ? x : min;
+    maxcell = (x > max) ? i : maxcell;
+    max = (x > max) ? x : max;
+    }
+  float mean = sum / n;
+  float avg = shift + mean;
+  float var = sqrsum / n - mean * mean;
+  float stddev = sqrtf((var > 0) ? var : 0);
+
+  // Pass 2: deviations, maximum deviations & alert levels (alerts only rise
+  //  until reset):
+  const float prec = m_prec, invprec = m_invprec;
+  int newalerts = 0, devchanged = 0, alertchanged = 0;
+  for (int i=0; i<n; i++)
+    {
+    float d = (values[i] - avg) * prec;
+    float dev = (float)(int)(d + copysignf(0.5f, d)) * invprec;    // round half away from zero
+    float adev = fabsf(dev);
+    int grow = (adev > fabsf(devmaxs[i]));
+    devmaxs[i] = grow ? dev : devmaxs[i];
+    devchanged |= grow;
+    short level = (adev >= thr_warn) + (adev >= thr_alert);
+    short old = alerts[i];
+    short cur = (level > old) ? level : old;
+    newalerts += (cur == 2) & (old < 2);
+    alertchanged |= (cur != old);
+    alerts[i] = cur;
+    }
+
+  m_min = min;
+  m_max = max;
+  m_mincell = mincell + 1;
+  m_maxcell = maxcell + 1;
+  m_avg = roundf(avg * prec) * invprec;
+  m_stddev = roundf(stddev * prec) * invprec;
+  m_newalerts += newalerts;
+  // First complete set after Reset(): publish all vectors, as the metrics
+  //  have been cleared (a healthy pack has no alert or deviation change):
+  if (!m_hasset)
+    m_dirty |= BMS_DIRTY_ALL;
+  if (devchanged)
+    m_dirty |= BMS_DIRTY_DEVMAXS;
+  if (alertchanged)
+    m_dirty |= BMS_DIRTY_ALERTS;
+
+  // Cell spread histogram:
+  float spread = max - min;
+  int bin = (int)(spread / m_spreadbinwidth);
+  if (bin >= BMS_SPREAD_BINS) bin = BMS_SPREAD_BINS-1;
+  m_spreadhist[bin]++;
+  m_spreadcount++;
+  if (spread > m_spreadmax) m_spreadmax = spread;
+
+  m_hasset = true;
+  Restart();
+  }
+
+void OvmsBmsCellStats::Restart()
+  {
+  if (m_setbits)
+    memset(m_setbits, 0, sizeof(uint32_t) * ((m_readings+31)/32));
+  m_setcount = 0;
+  }
+
+void OvmsBmsCellStats::Reset()
+  {
+  for (int i=0; i<m_readings; i++)
+    {
+    m_mins[i] = 0;
+    m_maxs[i] = 0;
+    m_devmaxs[i] = 0;
+    m_alerts[i] = 0;
+    }
+  m_hasset = false;
+  m_min = m_max = m_avg = m_stddev = 0;
+  m_mincell = m_maxcell = 0;
+  m_dirty = 0;
+  m_newalerts = 0;
+  memset(m_spreadhist, 0, sizeof(m_spreadhist));
+  m_spreadcount = 0;
+  m_spreadmax = 0;
+  Restart();
+  }
+
+void OvmsBmsCellStats::SpreadHistogram(OvmsWriter* writer, float scale, const char* unit)
+  {
+  if (m_spreadcount == 0)
+    {
+    writer->puts("    (no data)");
+    return;
+    }
+  for (int i=0; i<BMS_SPREAD_BINS; i++)
+    {
+    if (m_spreadhist[i] == 0) continue;
+    float pct = 100.0f * m_spreadhist[i] / m_spreadcount;
+    float from = i * m_spreadbinwidth * scale;
+    if (i < BMS_SPREAD_BINS-1)
+      writer->printf("  %7.1f - %7.1f%-2s %8u %5.1f%% ", from, from + m_spreadbinwidth * scale, unit, (unsigned int)m_spreadhist[i], pct);
+    else
+      writer->printf("  %7.1f +         %-2s %8u %5.1f%% ", from, unit, (unsigned int)m_spreadhist[i], pct);
+    for (int k=0; k < (int)(pct/4 + 0.5f); k++)
+      writer->printf("#");
+    writer->puts("");
+    }
+  writer->printf("  Sets: %u, max spread: %.1f%s\n", (unsigned int)m_spreadcount, m_spreadmax * scale, unit);
+  }
@@ -0,0 +1,134 @@
+/*
+;    Project:       Open Vehicle Monitor System
+;    Date:          16th October 2026
+;
+;    (C) 2026       Mark Webb-Johnson
+;
+; Permission is hereby granted, free of charge, to any person obtaining a copy
+; of this software and associated documentation files (the "Software"), to deal
+; in the Software without restriction, including without limitation the rights
+; to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+; copies of the Software, and to permit persons to whom the Software is
+; furnished to do so, subject to the following conditions:
+;
+; The above copyright notice and this permission notice shall be included in
+; all copies or substantial portions of the Software.
+;
+; THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+; IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+; FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+; AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+; LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+; OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+; THE SOFTWARE.
+*/
+
+#ifndef __VEHICLE_BMSSTATS_H__
+#define __VEHICLE_BMSSTATS_H__
+
+#include <stdint.h>
+
+class OvmsWriter;
+
+#define BMS_SPREAD_BINS             16      // Cell spread histogram bins (last = overflow)
+
+// Dirty flags: per cell vectors changed by the last Set()/Update()
+#define BMS_DIRTY_MINS              0x01
+#define BMS_DIRTY_MAXS              0x02
+#define BMS_DIRTY_DEVMAXS           0x04
+#define BMS_DIRTY_ALERTS            0x08
+#define BMS_DIRTY_ALL               0x0f
+
+/**
+ * OvmsBmsCellStats: statistics engine for a set of BMS cell readings
+ *  (voltages, temperatures, capacities, …)
+ *
+ * Readings are collected by Set(). When all cells have been set, Update()
+ *  computes min/max/avg/stddev of the set, per cell maximum deviations and
+ *  deviation alert levels, and adds the cell spread (max-min) to the spread
+ *  histogram. Per cell vectors are kept as separate arrays (structure of
+ *  arrays) and processed by simple branch free loops, so the compiler can
+ *  keep everything in registers (and vectorize where the target supports it).
+ *
+ * Dirty flags tell the caller which per cell vectors have changed and need
+ *  to be published to metrics.
+ *
+ * Not thread safe, to be used from the vehicle task.
+ */
+class OvmsBmsCellStats
+  {
+  public:
+    OvmsBmsCellStats();
+    ~OvmsBmsCellStats();
+
+  public:
+    void SetArrangement(int readings, int readingspermodule);
+    void SetLimits(float min, float max);
+    void SetPrecision(int digits);
+    void SetSpreadBinWidth(float width);
+
+  public:
+    bool Set(int index, float value);                 // true = set complete
+    void Update(float thr_warn, float thr_alert);     // compute set statistics
+    void Restart();                                   // restart collecting a set
+    void Reset();                                     // reset statistics
+
+  public:
+    int GetReadings() { return m_readings; }
+    int GetReadingsPerModule() { return m_readingspermodule; }
+    bool HasSet() { return m_hasset; }
+    float* GetValues() { return m_values; }
+    float* GetMins() { return m_mins; }
+    float* GetMaxs() { return m_maxs; }
+    float* GetDevMaxs() { return m_devmaxs; }
+    short* GetAlerts() { return m_alerts; }
+    float GetMin() { return m_min; }
+    float GetMax() { return m_max; }
+    int GetMinCell() { return m_mincell; }
+    int GetMaxCell() { return m_maxcell; }
+    float GetAvg() { return m_avg; }
+    float GetStddev() { return m_stddev; }
+    int GetDirty() { return m_dirty; }
+    void ClearDirty() { m_dirty = 0; }
+    int GetNewAlerts() { return m_newalerts; }
+    void ClearNewAlerts() { m_newalerts = 0; }
+
+  public:
+    void SpreadHistogram(OvmsWriter* writer, float scale, const char* unit);
+
+  protected:
+    void Free();
+
+  protected:
+    int         m_readings;             // Number of cells
+    int         m_readingspermodule;    // Number of cells per module
+    float       m_limitmin;             // Plausibility limits for Set()
+    float       m_limitmax;
+    float       m_prec;                 // Rounding: 10^digits
+    float       m_invprec;
+
+    float*      m_values;               // Current values
+    float*      m_mins;                 // Minimum values seen (since reset)
+    float*      m_maxs;                 // Maximum values seen (since reset)
+    float*      m_devmaxs;              // Maximum deviations from average seen (since reset)
+    short*      m_alerts;               // Deviation alert levels (0/1/2 = ok/warn/alert, since reset)
+    uint32_t*   m_setbits;              // Cells set in current set
+    int         m_setcount;             // Number of cells set in current set
+    bool        m_hasset;               // True once a complete set has been seen
+
+    float       m_min;                  // Set statistics (last complete set)
+    float       m_max;
+    int         m_mincell;              // 1 based, 0 = none
+    int         m_maxcell;
+    float       m_avg;
+    float       m_stddev;
+    int         m_dirty;                // BMS_DIRTY_* flags
+    int         m_newalerts;            // New alerts since ClearNewAlerts()
+
+    float       m_spreadbinwidth;       // Spread histogram bin width
+    uint32_t    m_spreadhist[BMS_SPREAD_BINS];
+    uint32_t    m_spreadcount;
+    float       m_spreadmax;
+  };
+
+#endif // __VEHICLE_BMSSTATS_H__
@@ -31,15 +31,22 @@
 #include "ovms_log.h"
 static const char *TAG = "vehicle_dbc";
 
+#include <algorithm>
 #include "vehicle_dbc.h"
 #include "dbc_app.h"
 
+#define DBC_TX_TIMER_MS   10
+
 OvmsVehicleDBC::OvmsVehicleDBC()
   {
+  m_tx_timer = NULL;
+  m_tx_task = NULL;
+  m_tx_shutdown = NULL;
   }
 
 OvmsVehicleDBC::~OvmsVehicleDBC()
   {
+  ClearTxFrames();
   if (m_can1) m_can1->DetachDBC();
   if (m_can2) m_can2->DetachDBC();
   if (m_can3) m_can3->DetachDBC();
@@ -84,28 +91,243 @@ void OvmsVehicleDBC::IncomingFrame(canbus* bus, CAN_frame_t* frame)
   {
   dbcfile* dbc = bus->GetDBC();
   if (dbc==NULL) return;
+  if ((bus->m_busnumber < 0)||(bus->m_busnumber >= 4)) return;
+
+  // (Re-)Compile the decoder on first use or after the bus DBC has been
+  // replaced or edited. This is only called from the vehicle rx task.
+  dbcDecodePlan& plan = m_dbcplan[bus->m_busnumber];
+  if (!plan.IsCurrent(dbc))
+    {
+    plan.Compile(dbc);
+    ESP_LOGI(TAG, "Compiled DBC decoder for can%d: %d messages, %d signals",
+      bus->m_busnumber+1, plan.GetMessageCount(), plan.GetSignalCount());
+    }
+
+  plan.Decode(frame);
+  }
+
+OvmsVehicleDBC::dbc_txframe_t* OvmsVehicleDBC::FindTxFrame(uint32_t msgid)
+  {
+  for (dbc_txframe_t* tx : m_tx_frames)
+    {
+    if (tx->msgid == msgid) return tx;
+    }
+  return NULL;
+  }
+
+bool OvmsVehicleDBC::PrepareTxFrame(dbc_txframe_t* tx)
+  {
+  // (Re-)Compile the builder if the bus DBC has been replaced or edited:
+  dbcfile* dbc = tx->bus->GetDBC();
+  if (dbc == NULL) return false;
+  if (dbc == tx->dbc && dbc->GetGeneration() == tx->generation)
+    return (tx->builder.GetMessage() != NULL);
+
+  tx->dbc = dbc;
+  tx->generation = dbc->GetGeneration();
+  dbcMessage* msg = dbc->m_messages.FindMessage(tx->msgid);
+  tx->builder.Compile(msg);
+  if (msg == NULL)
+    {
+    ESP_LOGW(TAG, "TX frame %#x: message not defined in DBC %s", tx->msgid, dbc->GetName().c_str());
+    return false;
+    }
+  for (auto& v : tx->values)
+    tx->builder.SetValue(v.first.c_str(), v.second);
+  for (auto& m : tx->sources)
+    tx->builder.SetSource(m.first.c_str(), m.second);
+
+  if (tx->onchange)
+    {
+    std::vector<OvmsMetric*> metrics;
+    tx->builder.GetSources(metrics);
+    for (OvmsMetric* metric : metrics)
+      {
+      if (std::find(m_tx_listening.begin(), m_tx_listening.end(), metric) != m_tx_listening.end())
+        continue;
+      m_tx_listening.push_back(metric);
+      using std::placeholders::_1;
+      MyMetrics.RegisterListener(TAG, metric->m_name, std::bind(&OvmsVehicleDBC::TxMetricModified, this, _1));
+      }
+    }
+  return true;
+  }
+
+void OvmsVehicleDBC::SendTxFrame(dbc_txframe_t* tx)
+  {
+  if (!PrepareTxFrame(tx)) return;
+  CAN_frame_t frame;
+  tx->builder.Build(&frame);
+  frame.origin = tx->bus;
+  frame.Write();
+  }
+
+bool OvmsVehicleDBC::AddTxFrame(int bus, uint32_t msgid, uint32_t period_ms, bool onchange /*=false*/)
+  {
+  canbus* txbus;
+  switch (bus)
+    {
+    case 1: txbus = m_can1; break;
+    case 2: txbus = m_can2; break;
+    case 3: txbus = m_can3; break;
+    case 4: txbus = m_can4; break;
+    default: txbus = NULL; break;
+    }
+  if (txbus == NULL || txbus->GetDBC() == NULL)
+    {
+    ESP_LOGE(TAG, "AddTxFrame: can%d not registered with a DBC", bus);
+    return false;
+    }
+
+  OvmsMutexLock lock(&m_tx_mutex);
+  dbc_txframe_t* tx = FindTxFrame(msgid);
+  if (tx == NULL)
+    {
+    tx = new dbc_txframe_t;
+    tx->msgid = msgid;
+    m_tx_frames.push_back(tx);
+    }
+  tx->bus = txbus;
+  tx->dbc = NULL;
+  tx->generation = 0;
+  tx->period = (period_ms + DBC_TX_TIMER_MS - 1) / DBC_TX_TIMER_MS;
+  tx->countdown = tx->period;
+  tx->onchange = onchange;
+  if (!PrepareTxFrame(tx))
+    {
+    m_tx_frames.erase(std::find(m_tx_frames.begin(), m_tx_frames.end(), tx));
+    delete tx;
+    return false;
+    }
 
-  dbcMessage* msg = dbc->m_messages.FindMessage(frame->FIR.B.FF, frame->MsgID);
-  if (msg)
+  if (tx->period && m_tx_timer == NULL)
+    {
+    xTaskCreatePinnedToCore(TxTask, "OVMS DBC TX", 4096, (void*)this, 10, &m_tx_task, CORE(1));
+    TickType_t ticks = DBC_TX_TIMER_MS / portTICK_PERIOD_MS;
+    if (ticks < 1) ticks = 1;
+    m_tx_timer = xTimerCreate("DBC TX timer", ticks, pdTRUE, this, TxTimerCallback);
+    xTimerStart(m_tx_timer, 0);
+    }
+  return true;
+  }
+
+bool OvmsVehicleDBC::SetTxValue(uint32_t msgid, const char* signal, double value)
+  {
+  OvmsMutexLock lock(&m_tx_mutex);
+  dbc_txframe_t* tx = FindTxFrame(msgid);
+  if (tx == NULL || !tx->builder.SetValue(signal, value)) return false;
+  tx->values[signal] = value;
+  tx->sources.erase(signal);
+  return true;
+  }
+
+bool OvmsVehicleDBC::SetTxSource(uint32_t msgid, const char* signal, OvmsMetric* metric)
+  {
+  OvmsMutexLock lock(&m_tx_mutex);
+  dbc_txframe_t* tx = FindTxFrame(msgid);
+  if (tx == NULL || !tx->builder.SetSource(signal, metric)) return false;
+  tx->sources[signal] = metric;
+  tx->values.erase(signal);
+  tx->generation = 0; // recompile to update the listeners
+  return true;
+  }
+
+bool OvmsVehicleDBC::TransmitTxFrame(uint32_t msgid)
+  {
+  OvmsMutexLock lock(&m_tx_mutex);
+  dbc_txframe_t* tx = FindTxFrame(msgid);
+  if (tx == NULL) return false;
+  SendTxFrame(tx);
+  return true;
+  }
+
+static void TxTimerSync(void* param, uint32_t arg)
+  {
+  xSemaphoreGive((SemaphoreHandle_t)param);
+  }
+
+void OvmsVehicleDBC::ClearTxFrames()
+  {
+  if (m_tx_timer)
+    {
+    xTimerStop(m_tx_timer, portMAX_DELAY);
+    xTimerDelete(m_tx_timer, portMAX_DELAY);
+    m_tx_timer = NULL;
+    // Wait for the timer service task to process the commands queued before,
+    // so no callback can be running or pending when we continue:
+    SemaphoreHandle_t sync = xSemaphoreCreateBinary();
+    if (xTimerPendFunctionCall(TxTimerSync, sync, 0, portMAX_DELAY) == pdPASS)
+      xSemaphoreTake(sync, portMAX_DELAY);
+    vSemaphoreDelete(sync);
+    }
+  if (m_tx_task)
+    {
+    // Let the task exit on its own, so it cannot be stopped while holding m_tx_mutex:
+    m_tx_shutdown = xSemaphoreCreateBinary();
+    xTaskNotifyGive(m_tx_task);
+    xSemaphoreTake(m_tx_shutdown, portMAX_DELAY);
+    vSemaphoreDelete(m_tx_shutdown);
+    m_tx_shutdown = NULL;
+    m_tx_task = NULL;
+    }
+  MyMetrics.DeregisterListener(TAG);
+
+  OvmsMutexLock lock(&m_tx_mutex);
+  for (dbc_txframe_t* tx : m_tx_frames)
+    delete tx;
+  m_tx_frames.clear();
+  m_tx_listening.clear();
+  }
+
+void OvmsVehicleDBC::TxMetricModified(OvmsMetric* metric)
+  {
+  OvmsMutexLock lock(&m_tx_mutex);
+  for (dbc_txframe_t* tx : m_tx_frames)
+    {
+    if (tx->onchange && tx->builder.IsSource(metric))
+      SendTxFrame(tx);
+    }
+  }
+
+/**
+ * TxTimerCallback: runs in the timer service task, so must not block;
+ *  just wakes up the TX task
+ */
+void OvmsVehicleDBC::TxTimerCallback(TimerHandle_t timer)
+  {
+  OvmsVehicleDBC* vehicle = (OvmsVehicleDBC*)pvTimerGetTimerID(timer);
+  xTaskNotifyGive(vehicle->m_tx_task);
+  }
+
+void OvmsVehicleDBC::TxTask(void *param)
+  {
+  OvmsVehicleDBC* me = (OvmsVehicleDBC*)param;
+  while (true)
+    {
+    // Timer ticks missed while busy accumulate in the notification value:
+    uint32_t ticks = ulTaskNotifyTake(pdTRUE, portMAX_DELAY);
+    if (me->m_tx_shutdown)
+      break;
+    me->TxTicks(ticks);
+    }
+  xSemaphoreGive(me->m_tx_shutdown);
+  vTaskDelete(NULL);
+  }
+
+void OvmsVehicleDBC::TxTicks(uint32_t ticks)
+  {
+  OvmsMutexLock lock(&m_tx_mutex);
+  for (dbc_txframe_t* tx : m_tx_frames)
     {
-    dbcSignal* mux = msg->GetMultiplexorSignal();
-    uint32_t muxval;
-    if (mux)
+    if (tx->period == 0) continue;
+    if (tx->countdown <= ticks)
       {
-      dbcNumber r = mux->Decode(frame);
-      muxval = r.GetSignedInteger();
+      tx->countdown = tx->period;
+      SendTxFrame(tx);
       }
-    for (dbcSignal* sig : msg->m_signals)
+    else
       {
-      OvmsMetric* m = sig->GetMetric();
-      if (m)
-        {
-        if ((mux==NULL)||(sig->GetMultiplexSwitchvalue() == muxval))
-          {
-          dbcNumber r = sig->Decode(frame);
-          m->SetValue(r);
-          }
-        }
+      tx->countdown -= ticks;
       }
     }
   }
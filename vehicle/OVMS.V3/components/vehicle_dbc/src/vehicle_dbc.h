@@ -31,8 +31,13 @@
 #ifndef __VEHICLE_DBC_H__
 #define __VEHICLE_DBC_H__
 
+#include <map>
+#include "freertos/FreeRTOS.h"
+#include "freertos/timers.h"
+#include "freertos/semphr.h"
 #include "vehicle.h"
 #include "dbc.h"
+#include "ovms_mutex.h"
 
 using namespace std;
 
@@ -53,6 +58,49 @@ class OvmsVehicleDBC : public OvmsVehicle
 
   protected:
     virtual void IncomingFrame(canbus* bus, CAN_frame_t* frame);
+
+  protected:
+    dbcDecodePlan m_dbcplan[4];       // compiled decoders per bus (m_busnumber)
+
+  public:
+    // DBC driven frame transmission:
+    //  period_ms: periodic transmission interval (0 = none, resolution 10 ms)
+    //  onchange: transmit when a value source metric is modified
+    bool AddTxFrame(int bus, uint32_t msgid, uint32_t period_ms, bool onchange=false);
+    bool SetTxValue(uint32_t msgid, const char* signal, double value);
+    bool SetTxSource(uint32_t msgid, const char* signal, OvmsMetric* metric);
+    bool TransmitTxFrame(uint32_t msgid);
+    void ClearTxFrames();
+
+  protected:
+    typedef struct
+      {
+      canbus* bus;
+      uint32_t msgid;
+      dbcfile* dbc;
+      uint32_t generation;              // dbcfile generation the builder was compiled for
+      dbcFrameBuilder builder;
+      std::map<std::string, double> values;
+      std::map<std::string, OvmsMetric*> sources;
+      uint32_t period;                  // in ticks of the tx timer, 0 = none
+      uint32_t countdown;
+      bool onchange;
+      } dbc_txframe_t;
+    dbc_txframe_t* FindTxFrame(uint32_t msgid);
+    bool PrepareTxFrame(dbc_txframe_t* tx);
+    void SendTxFrame(dbc_txframe_t* tx);
+    void TxMetricModified(OvmsMetric* metric);
+    void TxTicks(uint32_t ticks);
+    static void TxTimerCallback(TimerHandle_t timer);
+    static void TxTask(void *param);
+
+  protected:
+    OvmsMutex m_tx_mutex;
+    std::vector<dbc_txframe_t*> m_tx_frames;
+    std::vector<OvmsMetric*> m_tx_listening;
+    TimerHandle_t m_tx_timer;           // only notifies m_tx_task
+    TaskHandle_t m_tx_task;             // sends the periodic frames
+    SemaphoreHandle_t m_tx_shutdown;    // set on task shutdown, given on task exit
   };
 
 class OvmsVehiclePureDBC : public OvmsVehicleDBC
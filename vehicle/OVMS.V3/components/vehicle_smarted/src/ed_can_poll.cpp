@@ -64,6 +64,7 @@ const PROGMEM byte rqChargerTemperatures[4]       = {0x03, 0x22, 0x02, 0x23};
 static const char *TAG = "v-smarted";
 
 #include <stdio.h>
+#include <float.h>
 #include <algorithm>
 #include <string>
 #include <iomanip>
@@ -114,21 +115,9 @@ static const OvmsVehicle::poll_pid_t smarted_polls[] =
 
 void OvmsVehicleSmartED::ObdInitPoll() {
   
-  m_bms_capacitys = NULL;
-  m_bms_cmins = NULL;
-  m_bms_cmaxs = NULL;
-  m_bms_cdevmaxs = NULL;
-  m_bms_calerts = NULL;
-  m_bms_calerts_new = 0;
-  m_bms_has_capacitys = false;
-
-  m_bms_bitset_c.clear();
-  m_bms_bitset_cc = 0;
-  m_bms_readings_c = 0;
-  m_bms_readingspermodule_c = 0;
-
-  m_bms_limit_cmin = 1000;
-  m_bms_limit_cmax = 22000;
+  m_bms_c.SetLimits(1000, 22000);
+  m_bms_c.SetPrecision(1);
+  m_bms_c.SetSpreadBinWidth(50);
 
   mt_v_bat_pack_cmin = new OvmsMetricFloat("xse.v.b.p.capacity.min", SM_STALE_HIGH, Other);
   mt_v_bat_pack_cmax = new OvmsMetricFloat("xse.v.b.p.capacity.max", SM_STALE_HIGH, Other);
@@ -626,111 +615,44 @@ void OvmsVehicleSmartED::PollReply_NLG6_ChargerTemperatures(const char* reply_da
 
 // BMS helpers
 void OvmsVehicleSmartED::BmsSetCellArrangementCapacity(int readings, int readingspermodule) {
-  if (m_bms_capacitys != NULL) delete m_bms_capacitys;
-  m_bms_capacitys = new float[readings];
-  if (m_bms_cmins != NULL) delete m_bms_cmins;
-  m_bms_cmins = new float[readings];
-  if (m_bms_cmaxs != NULL) delete m_bms_cmaxs;
-  m_bms_cmaxs = new float[readings];
-  if (m_bms_cdevmaxs != NULL) delete m_bms_cdevmaxs;
-  m_bms_cdevmaxs = new float[readings];
-
-  m_bms_bitset_c.clear();
-  m_bms_bitset_c.reserve(readings);
-
-  m_bms_readings_c = readings;
-  m_bms_readingspermodule_c = readingspermodule;
-
+  m_bms_c.SetArrangement(readings, readingspermodule);
   BmsResetCellCapacitys();
 }
   
 void OvmsVehicleSmartED::BmsSetCellCapacity(int index, float value) {
-  // ESP_LOGI(TAG,"BmsSetCellCapacity(%d,%f) c=%d", index, value, m_bms_bitset_cc);
-  if ((index<0)||(index>=m_bms_readings_c)) return;
-  if ((value<m_bms_limit_cmin)||(value>m_bms_limit_cmax)) return;
-  m_bms_capacitys[index] = value;
-
-  if (! m_bms_has_capacitys)
-    {
-    m_bms_cmins[index] = value;
-    m_bms_cmaxs[index] = value;
-    }
-  else if (m_bms_cmins[index] > value)
-    m_bms_cmins[index] = value;
-  else if (m_bms_cmaxs[index] < value)
-    m_bms_cmaxs[index] = value;
-
-  if (m_bms_bitset_c[index] == false) m_bms_bitset_cc++;
-  if (m_bms_bitset_cc == m_bms_readings_c) {
-    // get min, max, avg & standard deviation:
-    double sum=0, sqrsum=0, avg, stddev=0;
-    float min=0, max=0;
-    int cmin=0, cmax=0;
-    for (int i=0; i<m_bms_readings_c; i++) {
-      sum += m_bms_capacitys[i];
-      sqrsum += SQR(m_bms_capacitys[i]);
-      if (min==0 || m_bms_capacitys[i]<min) {
-        min = m_bms_capacitys[i];
-        cmin = i+1;
-      }
-      if (max==0 || m_bms_capacitys[i]>max) {
-        max = m_bms_capacitys[i];
-        cmax = i+1;
-      }
-    }
-    avg = sum / m_bms_readings_c;
-    stddev = sqrt(LIMIT_MIN((sqrsum / m_bms_readings_c) - SQR(avg), 0));
-    // check cell deviations:
-    float dev;
-    for (int i=0; i<m_bms_readings_c; i++) {
-      dev = ROUNDPREC(m_bms_capacitys[i] - avg, 1);
-      if (ABS(dev) > ABS(m_bms_cdevmaxs[i]))
-        m_bms_cdevmaxs[i] = dev;
-    }
-    // publish to metrics:
-    avg = ROUNDPREC(avg, 1);
-    stddev = ROUNDPREC(stddev, 1);
-    mt_v_bat_pack_cmin->SetValue(min);
-    mt_v_bat_pack_cmax->SetValue(max);
-    mt_v_bat_pack_cavg->SetValue(avg);
-    mt_v_bat_pack_cstddev->SetValue(stddev);
-    mt_v_bat_pack_cmin_cell->SetValue(cmin);
-    mt_v_bat_pack_cmax_cell->SetValue(cmax);
-    if (stddev > mt_v_bat_pack_cstddev_max->AsFloat())
-      mt_v_bat_pack_cstddev_max->SetValue(stddev);
-    mt_v_bat_cell_capacity->SetElemValues(0, m_bms_readings_c, m_bms_capacitys);
-    mt_v_bat_cell_cmin->SetElemValues(0, m_bms_readings_c, m_bms_cmins);
-    mt_v_bat_cell_cmax->SetElemValues(0, m_bms_readings_c, m_bms_cmaxs);
-    mt_v_bat_cell_cdevmax->SetElemValues(0, m_bms_readings_c, m_bms_cdevmaxs);
-    StandardMetrics.ms_v_bat_soh->SetValue((min/360.0)*1.9230769);
-    // complete:
-    m_bms_has_capacitys = true;
-    m_bms_bitset_c.clear();
-    m_bms_bitset_c.resize(m_bms_readings_c);
-    m_bms_bitset_cc = 0;
-  }
-  else {
-    m_bms_bitset_c[index] = true;
-  }
+  if (!m_bms_c.Set(index, value))
+    return;
+  // no capacity deviation alerts:
+  m_bms_c.Update(FLT_MAX, FLT_MAX);
+  // publish to metrics:
+  int n = m_bms_c.GetReadings();
+  int dirty = m_bms_c.GetDirty();
+  mt_v_bat_pack_cmin->SetValue(m_bms_c.GetMin());
+  mt_v_bat_pack_cmax->SetValue(m_bms_c.GetMax());
+  mt_v_bat_pack_cavg->SetValue(m_bms_c.GetAvg());
+  mt_v_bat_pack_cstddev->SetValue(m_bms_c.GetStddev());
+  mt_v_bat_pack_cmin_cell->SetValue(m_bms_c.GetMinCell());
+  mt_v_bat_pack_cmax_cell->SetValue(m_bms_c.GetMaxCell());
+  if (m_bms_c.GetStddev() > mt_v_bat_pack_cstddev_max->AsFloat())
+    mt_v_bat_pack_cstddev_max->SetValue(m_bms_c.GetStddev());
+  mt_v_bat_cell_capacity->SetElemValues(0, n, m_bms_c.GetValues());
+  if (dirty & BMS_DIRTY_MINS)
+    mt_v_bat_cell_cmin->SetElemValues(0, n, m_bms_c.GetMins());
+  if (dirty & BMS_DIRTY_MAXS)
+    mt_v_bat_cell_cmax->SetElemValues(0, n, m_bms_c.GetMaxs());
+  if (dirty & BMS_DIRTY_DEVMAXS)
+    mt_v_bat_cell_cdevmax->SetElemValues(0, n, m_bms_c.GetDevMaxs());
+  m_bms_c.ClearDirty();
+  StandardMetrics.ms_v_bat_soh->SetValue((m_bms_c.GetMin()/360.0)*1.9230769);
 }
 
 void OvmsVehicleSmartED::BmsRestartCellCapacitys() {
-  m_bms_bitset_c.clear();
-  m_bms_bitset_c.resize(m_bms_readings_c);
-  m_bms_bitset_cc = 0;
+  m_bms_c.Restart();
 }
 
 void OvmsVehicleSmartED::BmsResetCellCapacitys() {
-  if (m_bms_readings_c > 0) {
-    m_bms_bitset_c.clear();
-    m_bms_bitset_c.resize(m_bms_readings_c);
-    m_bms_bitset_cc = 0;
-    m_bms_has_capacitys = false;
-    for (int k=0; k<m_bms_readings_c; k++) {
-      m_bms_cmins[k] = 0;
-      m_bms_cmaxs[k] = 0;
-      m_bms_cdevmaxs[k] = 0;
-    }
+  if (m_bms_c.GetReadings() > 0) {
+    m_bms_c.Reset();
     mt_v_bat_cell_cmin->ClearValue();
     mt_v_bat_cell_cmax->ClearValue();
     mt_v_bat_cell_cdevmax->ClearValue();
@@ -747,7 +669,7 @@ void OvmsVehicleSmartED::BmsResetCellStats() {
 void OvmsVehicleSmartED::BmsDiag(int verbosity, OvmsWriter* writer) {
   metric_unit_t rangeUnit = (MyConfig.GetParamValue("vehicle", "units.distance") == "M") ? Miles : Kilometers;
 
-  if (!m_bms_has_capacitys) {
+  if (!m_bms_c.HasSet()) {
     writer->puts("No BMS status data available");
     return;
   }
@@ -850,7 +772,7 @@ void OvmsVehicleSmartED::BmsDiag(int verbosity, OvmsWriter* writer) {
   
   writer->puts(" # ;mV   ;As/10");
   for(int16_t n = 0; n < CELLCOUNT; n++){
-    writer->printf("%3d; %4.0f; %5.0f\n", n+1, m_bms_voltages[n]*1000 - mt_myBMS_ADCvoltsOffset->AsInt(), m_bms_capacitys[n]);
+    writer->printf("%3d; %4.0f; %5.0f\n", n+1, m_bms_v.GetValues()[n]*1000 - mt_myBMS_ADCvoltsOffset->AsInt(), m_bms_c.GetValues()[n]);
   }
   writer->puts("-------------------------------------------");
   writer->puts("Individual Cell Statistics:");
@@ -873,7 +795,7 @@ void OvmsVehicleSmartED::BmsDiag(int verbosity, OvmsWriter* writer) {
 void OvmsVehicleSmartED::printRPTdata(int verbosity, OvmsWriter* writer) {
   metric_unit_t rangeUnit = (MyConfig.GetParamValue("vehicle", "units.distance") == "M") ? Miles : Kilometers;
   
-  if (!m_bms_has_capacitys) {
+  if (!m_bms_c.HasSet()) {
     writer->puts("No BMS status data available");
     return;
   }
@@ -240,19 +240,7 @@ class OvmsVehicleSmartED : public OvmsVehicle
 
   // BMS helpers
   protected:
-    float* m_bms_capacitys;                   // BMS Capacity (current value)
-    float* m_bms_cmins;                       // BMS minimum Capacity seen (since reset)
-    float* m_bms_cmaxs;                       // BMS maximum Capacity seen (since reset)
-    float* m_bms_cdevmaxs;                    // BMS maximum capacity deviations seen (since reset)
-    short* m_bms_calerts;                     // BMS capacity deviation alerts (since reset)
-    int m_bms_calerts_new;                    // BMS new capacity alerts since last notification
-    bool m_bms_has_capacitys;                 // True if BMS has a complete set of capacity values
-    std::vector<bool> m_bms_bitset_c;         // BMS tracking: true if corresponding capacity set
-    int m_bms_bitset_cc;                      // BMS tracking: count of unique capacity values set
-    int m_bms_readings_c;                     // Number of BMS capacity readings expected
-    int m_bms_readingspermodule_c;            // Number of BMS capacity readings per module
-    float m_bms_limit_cmin;                   // Minimum capacity limit (for sanity checking)
-    float m_bms_limit_cmax;                   // Maximum capacity limit (for sanity checking)
+    OvmsBmsCellStats m_bms_c;                 // BMS cell capacity statistics [As/10]
 
   protected:
     OvmsMetricFloat*  mt_v_bat_pack_cmin;                 // Cell capacity - weakest cell in pack [As]
@@ -337,7 +337,8 @@ void Boot::Restart(bool hard)
   #undef bind  // Kludgy, but works
   using std::placeholders::_1;
   using std::placeholders::_2;
-  MyEvents.RegisterEvent(TAG,"ticker.1", std::bind(&Boot::Ticker1, this, _1, _2));
+  using std::placeholders::_3;
+  MyEvents.RegisterEvent(TAG, EVENT_ID_TICKER_1, std::bind(&Boot::Ticker1, this, _1, _2, _3));
   }
 
 void Boot::RestartPending(const char* tag)
@@ -354,7 +355,7 @@ void Boot::RestartReady(const char* tag)
     m_restart_timer = 2;
   }
 
-void Boot::Ticker1(std::string event, void* data)
+void Boot::Ticker1(event_id_t id, const char* event, void* data)
   {
   if (m_restart_timer > 0)
     {
@@ -43,6 +43,7 @@ OvmsBuffer::OvmsBuffer(size_t size, void* userdata)
   m_tail = 0;
   m_size = size;
   m_used = 0;
+  m_scanned = 0;
   m_userdata = userdata;
   }
 
@@ -71,6 +72,7 @@ void OvmsBuffer::EmptyAll()
   m_head = 0;
   m_tail = 0;
   m_used = 0;
+  m_scanned = 0;
   }
 
 bool OvmsBuffer::Push(uint8_t byte)
@@ -88,13 +90,16 @@ bool OvmsBuffer::Push(uint8_t *byte, size_t count)
   {
   if ((m_size-m_used)<count) return false;
 
+  // Copy in up to two segments: head..end, then start of buffer
+  size_t seg = m_size - m_head;
+  if (seg > count) seg = count;
+  memcpy(m_buffer+m_head, byte, seg);
+  if (count > seg)
+    memcpy(m_buffer, byte+seg, count-seg);
+
+  m_head += count;
+  if (m_head >= m_size) m_head -= m_size;
   m_used += count;
-  for (size_t k=0;k<count;k++)
-    {
-    // ESP_LOGI(TAG, "Push() %02x at %d",byte[k],m_head);
-    m_buffer[m_head++] = byte[k];
-    if (m_head >= m_size) m_head=0;
-    }
 
   return true;
   }
@@ -103,24 +108,16 @@ uint8_t OvmsBuffer::Pop()
   {
   if (m_used==0) return 0;
 
-  m_used--;
-  uint8_t result = m_buffer[m_tail++];
-  if (m_tail >= m_size) m_tail=0;
+  uint8_t result = m_buffer[m_tail];
+  Consume(1);
 
   return result;
   }
 
 size_t OvmsBuffer::Pop(size_t count, uint8_t *dest)
   {
-  size_t done = 0;
-
-  while ((m_used>0)&&(done < count))
-    {
-    m_used--;
-    dest[done++] = m_buffer[m_tail++];
-    if (m_tail >= m_size) m_tail=0;
-    }
-
+  size_t done = Peek(count, dest);
+  Consume(done);
   return done;
   }
 
@@ -133,45 +130,89 @@ uint8_t OvmsBuffer::Peek()
 
 size_t OvmsBuffer::Peek(size_t count, uint8_t *dest)
   {
-  size_t done = 0;
+  if (count > m_used) count = m_used;
+
+  // Copy out up to two segments: tail..end, then start of buffer
+  size_t seg = m_size - m_tail;
+  if (seg > count) seg = count;
+  memcpy(dest, m_buffer+m_tail, seg);
+  if (count > seg)
+    memcpy(dest+seg, m_buffer, count-seg);
+
+  return count;
+  }
+
+size_t OvmsBuffer::ReadableSpan(uint8_t** data)
+  {
+  *data = m_buffer + m_tail;
+  size_t seg = m_size - m_tail;
+  return (seg < m_used) ? seg : m_used;
+  }
 
-  size_t tail = m_tail;
-  while ((done<m_used)&&(done<count))
+void OvmsBuffer::Consume(size_t count)
+  {
+  if (count > m_used) count = m_used;
+
+  m_tail += count;
+  if (m_tail >= m_size) m_tail -= m_size;
+  m_used -= count;
+  m_scanned = (m_scanned > count) ? m_scanned-count : 0;
+  if (m_used == 0)
     {
-    dest[done++] = m_buffer[tail++];
-    if (tail >= m_size) tail=0;
+    // Reset to start, maximizes the contiguous writable span:
+    m_head = m_tail = 0;
     }
+  }
 
-  return done;
+size_t OvmsBuffer::WritableSpan(uint8_t** data)
+  {
+  *data = m_buffer + m_head;
+  size_t seg = m_size - m_head;
+  size_t free = m_size - m_used;
+  return (seg < free) ? seg : free;
+  }
+
+void OvmsBuffer::Produce(size_t count)
+  {
+  if (count > m_size - m_used) count = m_size - m_used;
+
+  m_head += count;
+  if (m_head >= m_size) m_head -= m_size;
+  m_used += count;
   }
 
 void OvmsBuffer::Diagnostics()
   {
-  size_t hl = HasLine();
+  int hl = HasLine();
   ESP_LOGI(TAG, "OvmsBuffer has %d/%d bytes (head %d, tail %d), hasline %d",
     m_used,m_size,m_head,m_tail,hl);
   }
 
 int OvmsBuffer::HasLine()
   {
-  size_t tail = m_tail;
-
   if (m_used==0) return -1;
 
-  // ESP_LOGI(TAG, "HasLine() with tail at %d (%d used)",m_tail,m_used);
-  for (size_t done=0;done<m_used;done++)
+  // Continue scanning where the last call stopped, as
+  // bytes already scanned cannot have changed since:
+  size_t pos = m_tail + m_scanned;
+  if (pos >= m_size) pos -= m_size;
+  while (m_scanned < m_used)
     {
-    // ESP_LOGI(TAG, "HasLine() at tail %d is %02x (%d done)",tail,m_buffer[tail],done);
-    if ((m_buffer[tail]=='\r')||(m_buffer[tail]=='\n'))
+    size_t seg = m_size - pos;
+    if (seg > m_used - m_scanned) seg = m_used - m_scanned;
+    const uint8_t *p = m_buffer+pos, *e = p+seg;
+    for (; p < e; p++)
       {
-      // ESP_LOGI(TAG, "HasLine() found a CR/LF at tail %d (done=%d)",tail,done);
-      return done;
+      if ((*p == '\r')||(*p == '\n'))
+        {
+        m_scanned += p - (m_buffer+pos);
+        return m_scanned;
+        }
       }
-    tail++;
-    if (tail >= m_size) tail=0;
+    m_scanned += seg;
+    pos = 0;
     }
 
-  // ESP_LOGI(TAG, "HasLine() didnt find a CR/LF");
   return -1;
   }
 
@@ -180,13 +221,34 @@ std::string OvmsBuffer::ReadLine()
   int hl = HasLine();
   if (hl<0) return std::string("");
 
-  uint8_t result[hl+1];
-  Pop(hl, result);
+  std::string result(hl, '\0');
+  Pop(hl, (uint8_t*)&result[0]);
+
+  if (Peek() == '\r') Pop();
+  if (Peek() == '\n') Pop();
+
+  return result;
+  }
+
+/**
+ * ReadLine: read the next line into dest (zero terminated, without CR/LF)
+ *  Lines not fitting into dest are truncated, the rest is discarded.
+ *  Returns the line length (before truncation) or -1 if no line available.
+ */
+int OvmsBuffer::ReadLine(char* dest, size_t size)
+  {
+  int hl = HasLine();
+  if (hl<0 || size==0) return -1;
+
+  size_t n = ((size_t)hl < size) ? hl : size-1;
+  Pop(n, (uint8_t*)dest);
+  dest[n] = 0;
+  Consume(hl - n);
 
   if (Peek() == '\r') Pop();
   if (Peek() == '\n') Pop();
 
-  return std::string((char*)result,hl);
+  return hl;
   }
 
 int OvmsBuffer::PollSocket(int sock, long timeoutms)
@@ -207,23 +269,20 @@ int OvmsBuffer::PollSocket(int sock, long timeoutms)
   // ESP_LOGI(TAG, "Polling Socket select result %d",result);
   if (result <= 0) return -1;
 
-  // We have some data ready to read
-  size_t avail = FreeSpace();
+  // We have some data ready to read, read directly into the buffer:
+  uint8_t *buf;
+  size_t avail = WritableSpan(&buf);
   if (avail==0) return 0;
-  // ESP_LOGI(TAG,"Polling Socket allocating %d bytes",avail);
-  uint8_t *buf = new uint8_t[avail];
-  size_t n = read(sock, buf, avail);
+  ssize_t n = read(sock, buf, avail);
   // ESP_LOGI(TAG,"Polling Socket read %d bytes",n);
-  // MyCommandApp.HexDump(TAG, "PollSocket", (const char*)buf, n);
   if (n == 0)
     {
     n = -1;
     }
   else if (n > 0)
     {
-    Push(buf,n);
+    Produce(n);
     }
-  delete [] buf;
   return n;
   }
 
@@ -55,9 +55,19 @@ class OvmsBuffer
     size_t Peek(size_t count, uint8_t *dest);
     void Diagnostics();
 
+  public:
+    // Zero copy access: get the contiguous readable/writable region
+    // (may be less than UsedSpace()/FreeSpace() on wrap), then
+    // Consume()/Produce() the number of bytes actually read/written.
+    size_t ReadableSpan(uint8_t** data);
+    void Consume(size_t count);
+    size_t WritableSpan(uint8_t** data);
+    void Produce(size_t count);
+
   public:
     int HasLine();
     std::string ReadLine();
+    int ReadLine(char* dest, size_t size);
 
   public:
     int PollSocket(int sock, long timeoutms);
@@ -67,10 +77,11 @@ class OvmsBuffer
 
   protected:
     uint8_t *m_buffer;
-    int m_head;
-    int m_tail;
+    size_t m_head;
+    size_t m_tail;
     size_t m_size;
     size_t m_used;
+    size_t m_scanned;         // HasLine(): bytes from tail known to contain no CR/LF
   };
 
 #endif //#ifndef __OVMS_BUFFER_H__
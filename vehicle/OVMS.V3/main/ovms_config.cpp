@@ -36,6 +36,7 @@ static const char *TAG = "config";
 #include <sys/types.h>
 #include <string.h>
 #include <sstream>
+#include <list>
 #include <dirent.h>
 #include "crypt_base64.h"
 #include "ovms_config.h"
@@ -49,12 +50,38 @@ static const char *TAG = "config";
 #endif // CONFIG_OVMS_SC_ZIP
 
 #define OVMS_CONFIGPATH "/store/ovms_config"
+#define OVMS_CONFIGTMP  ".tmp"
+#define OVMS_CONFIGEND  "#end"        // completion marker, last line of param files
 #define OVMS_MAXVALSIZE 2500
 //#define OVMS_PERSIST_METADATA
 
 
 OvmsConfig MyConfig __attribute__ ((init_priority (1400)));
 
+/**
+ * config_file_complete: check param file for the completion marker line
+ */
+static bool config_file_complete(const std::string& path)
+  {
+  FILE* f = fopen(path.c_str(), "r");
+  if (!f) return false;
+  const size_t marklen = strlen(OVMS_CONFIGEND "\n");
+  char buf[16];
+  size_t len = 0;
+  if (fseek(f, 0, SEEK_END) == 0)
+    {
+    long size = ftell(f);
+    long pos = (size > (long)marklen) ? size - (long)marklen - 1 : 0;
+    if (size >= (long)marklen && fseek(f, pos, SEEK_SET) == 0)
+      len = fread(buf, 1, size - pos, f);
+    }
+  fclose(f);
+  // marker needs to be a line of its own:
+  if (len < marklen || memcmp(buf + len - marklen, OVMS_CONFIGEND "\n", marklen) != 0)
+    return false;
+  return (len == marklen || buf[len - marklen - 1] == '\n');
+  }
+
 void store_mount(int verbosity, OvmsWriter* writer, OvmsCommand* cmd, int argc, const char* const* argv)
   {
   MyConfig.mount();
@@ -134,6 +161,11 @@ void config_set(int verbosity, OvmsWriter* writer, OvmsCommand* cmd, int argc, c
   writer->puts("Parameter has been set.");
   }
 
+void config_status(int verbosity, OvmsWriter* writer, OvmsCommand* cmd, int argc, const char* const* argv)
+  {
+  MyConfig.Status(writer);
+  }
+
 void config_rm(int verbosity, OvmsWriter* writer, OvmsCommand* cmd, int argc, const char* const* argv)
   {
   if (!MyConfig.ismounted()) return;
@@ -219,6 +251,12 @@ OvmsConfig::OvmsConfig()
   ESP_LOGI(TAG, "Initialising CONFIG (1400)");
 
   m_mounted = false;
+  m_lookups = 0;
+  m_lookups_last = 0;
+  m_lookups_rate = 0;
+  m_txn_commits = 0;
+  m_txn_writes = 0;
+  m_txn_coalesced = 0;
 
   OvmsCommand* cmd_store = MyCommandApp.RegisterCommand("store","STORE framework");
   cmd_store->RegisterCommand("mount","Mount STORE",store_mount);
@@ -228,6 +266,7 @@ OvmsConfig::OvmsConfig()
   cmd_config->RegisterCommand("list","Show configuration parameters/instances",config_list,"[<param>]",0,1, true, config_validate);
   cmd_config->RegisterCommand("set","Set parameter:instance=value",config_set,"<param> <instance> <value>",3,3, true, config_validate);
   cmd_config->RegisterCommand("rm","Remove parameter:instance",config_rm,"<param> {<instance> | *}",2,2, true, config_validate);
+  cmd_config->RegisterCommand("status","Show configuration store status",config_status);
 
 #ifdef CONFIG_OVMS_SC_ZIP
   cmd_config->RegisterCommand("backup", "Backup to file", config_backup,
@@ -248,6 +287,11 @@ OvmsConfig::OvmsConfig()
   RegisterParam("password", "Password store", true, false);
   RegisterParam("module", "Module configuration", true, true);
   RegisterParam("usr", "Custom plugin configuration", true, true);
+
+  #undef bind  // Kludgy, but works
+  using std::placeholders::_1;
+  using std::placeholders::_2;
+  MyEvents.RegisterEvent(TAG, "ticker.10", std::bind(&OvmsConfig::Ticker10, this, _1, _2));
   }
 
 OvmsConfig::~OvmsConfig()
@@ -285,20 +329,50 @@ esp_err_t OvmsConfig::mount()
     ESP_LOGE(TAG, "Error: Cannot open config store directory");
     return ESP_ERR_NOT_FOUND;
     }
+  std::list<std::string> tmpfiles;
   while ((dp = readdir(dir)) != NULL)
     {
+    // Collect left over temporary files of interrupted writes:
+    if (endsWith(std::string(dp->d_name), OVMS_CONFIGTMP))
+      {
+      tmpfiles.push_back(dp->d_name);
+      continue;
+      }
     // Register the param in case this was not already done
     if (CachedParam(dp->d_name) == NULL)
       RegisterParam(dp->d_name, "", true, false);
     }
   closedir(dir);
 
+  // Recover interrupted writes: the param file is removed only after the
+  //  temporary file has been written completely, but it may not have existed
+  //  before, so the temporary file also needs to carry the completion marker
+  for (auto it = tmpfiles.begin(); it != tmpfiles.end(); ++it)
+    {
+    std::string name = it->substr(0, it->size() - strlen(OVMS_CONFIGTMP));
+    std::string path = std::string(OVMS_CONFIGPATH) + "/" + name;
+    std::string tmppath = path + OVMS_CONFIGTMP;
+    if (stat(path.c_str(), &ds) != 0 && config_file_complete(tmppath) &&
+        rename(tmppath.c_str(), path.c_str()) == 0)
+      {
+      ESP_LOGW(TAG, "Recovered config param '%s' from interrupted write", name.c_str());
+      if (CachedParam(name) == NULL)
+        RegisterParam(name, "", true, false);
+      }
+    else
+      {
+      ESP_LOGW(TAG, "Discarding incomplete write of config param '%s'", name.c_str());
+      unlink(tmppath.c_str());
+      }
+    }
+
   // load & upgrade params:
   for (ConfigMap::iterator it=MyConfig.m_map.begin(); it!=MyConfig.m_map.end(); ++it)
     {
     it->second->Load();
     }
   upgrade();
+  RefreshHandles("");
 
   MyEvents.SignalEvent("config.mounted", NULL);
   return ESP_OK;
@@ -313,6 +387,7 @@ esp_err_t OvmsConfig::unmount()
     {
     esp_vfs_fat_spiflash_unmount("/store", m_store_wlh);
     m_mounted = false;
+    RefreshHandles("");
     MyEvents.SignalEvent("config.unmounted", NULL);
     }
 
@@ -326,6 +401,8 @@ bool OvmsConfig::ismounted()
 
 void OvmsConfig::upgrade()
   {
+  OvmsConfigTransaction txn;
+
   // Migrate password/changed → module/init:
   if (GetParamValueBool("password", "changed") == true)
     {
@@ -366,6 +443,7 @@ void OvmsConfig::RegisterParam(std::string name, std::string title, bool writabl
     {
     OvmsConfigParam* p = new OvmsConfigParam(name, title, writable, readable);
     m_map[name] = p;
+    RefreshHandles(name);
     }
   else
     {
@@ -380,8 +458,13 @@ void OvmsConfig::DeregisterParam(std::string name)
   if (k != m_map.end())
     {
     k->second->DeleteParam();
+    m_txn_lock.Lock();
+    for (auto& td : m_txn_dirty)
+      td.second.erase(k->second);
+    m_txn_lock.Unlock();
     delete k->second;
     m_map.erase(k);
+    RefreshHandles(name);
     }
   }
 
@@ -446,6 +529,7 @@ void OvmsConfig::DeleteInstance(std::string param, std::string instance)
 
 std::string OvmsConfig::GetParamValue(std::string param, std::string instance, std::string defvalue)
   {
+  m_lookups++;
   OvmsConfigParam *p = CachedParam(param);
   if (p && p->IsDefined(instance))
     {
@@ -511,6 +595,7 @@ bool OvmsConfig::GetParamValueBool(std::string param, std::string instance, bool
 
 bool OvmsConfig::IsDefined(std::string param, std::string instance)
   {
+  m_lookups++;
   OvmsConfigParam *p = CachedParam(param);
   if (p == NULL) return false;
   return p->IsDefined(instance);
@@ -773,6 +858,274 @@ void OvmsConfig::SupportSummary(OvmsWriter* writer)
     }
   }
 
+void OvmsConfig::Status(OvmsWriter* writer)
+  {
+  int instances = 0;
+  for (ConfigMap::iterator mi=m_map.begin(); mi!=m_map.end(); ++mi)
+    instances += mi->second->m_map.size();
+  writer->printf("Store: %s\n", m_mounted ? "mounted" : "not mounted");
+  writer->printf("Params: %d, instances: %d\n", (int)m_map.size(), instances);
+  OvmsRecMutexLock lock(&m_handles_lock);
+  writer->printf("Cached handles: %d\n", (int)m_handles.size());
+  writer->printf("Uncached lookups: %u total, %.1f/s\n", m_lookups, m_lookups_rate);
+  OvmsMutexLock txnlock(&m_txn_lock);
+  int pending = 0;
+  for (auto& td : m_txn_dirty)
+    pending += td.second.size();
+  writer->printf("Transactions: %d open, %d params pending, %u commits\n",
+    (int)m_txn_levels.size(), pending, m_txn_commits);
+  writer->printf("Param files written: %u, writes saved by coalescing: %u\n",
+    m_txn_writes, m_txn_coalesced);
+  }
+
+void OvmsConfig::Ticker10(std::string event, void* data)
+  {
+  uint32_t lookups = m_lookups;
+  m_lookups_rate = (float)(lookups - m_lookups_last) / 10;
+  m_lookups_last = lookups;
+  }
+
+void OvmsConfig::BeginTransaction()
+  {
+  OvmsMutexLock lock(&m_txn_lock);
+  m_txn_levels[xTaskGetCurrentTaskHandle()]++;
+  }
+
+/**
+ * CommitTransaction: close transaction of the current task
+ *  On the outermost commit, all dirty params are written (once per param)
+ *  and signalled by one config.changed event per param, followed by a
+ *  config.committed event listing all changed "<param>/<instance>" lines.
+ *  Params changed by other tasks' open transactions are left to their commits.
+ */
+void OvmsConfig::CommitTransaction()
+  {
+  std::set<OvmsConfigParam*> dirty;
+  std::string changes;
+    {
+    OvmsMutexLock lock(&m_txn_lock);
+    TaskHandle_t task = xTaskGetCurrentTaskHandle();
+    auto it = m_txn_levels.find(task);
+    if (it == m_txn_levels.end())
+      return;
+    if (--it->second > 0)
+      return;
+    m_txn_levels.erase(it);
+    auto td = m_txn_dirty.find(task);
+    if (td == m_txn_dirty.end())
+      return;
+    dirty.swap(td->second);
+    m_txn_dirty.erase(td);
+    if (dirty.empty())
+      return;
+    m_txn_commits++;
+    for (OvmsConfigParam* p : dirty)
+      {
+      for (const std::string& instance : p->m_changed)
+        {
+        changes.append(p->GetName());
+        changes.append("/");
+        changes.append(instance);
+        changes.append("\n");
+        }
+      p->m_changed.clear();
+      }
+    }
+
+  for (OvmsConfigParam* p : dirty)
+    {
+    p->RewriteConfig();
+    MyEvents.SignalEvent("config.changed", p);
+    }
+  MyEvents.SignalEvent("config.committed", (void*)strdup(changes.c_str()), EventStdFree);
+  }
+
+bool OvmsConfig::InTransaction()
+  {
+  OvmsMutexLock lock(&m_txn_lock);
+  auto it = m_txn_levels.find(xTaskGetCurrentTaskHandle());
+  return (it != m_txn_levels.end());
+  }
+
+void OvmsConfig::TransactionChanged(OvmsConfigParam* param, const std::string& instance)
+  {
+  OvmsMutexLock lock(&m_txn_lock);
+  if (!m_txn_dirty[xTaskGetCurrentTaskHandle()].insert(param).second)
+    m_txn_coalesced++;
+  param->m_changed.insert(instance);
+  }
+
+void OvmsConfig::RegisterHandle(OvmsConfigHandle* handle)
+  {
+  OvmsRecMutexLock lock(&m_handles_lock);
+  m_handles.insert(ConfigHandleMap::value_type(handle->GetParam(), handle));
+  handle->Refresh();
+  }
+
+void OvmsConfig::DeregisterHandle(OvmsConfigHandle* handle)
+  {
+  OvmsRecMutexLock lock(&m_handles_lock);
+  auto range = m_handles.equal_range(handle->GetParam());
+  for (auto it = range.first; it != range.second; ++it)
+    {
+    if (it->second == handle)
+      {
+      m_handles.erase(it);
+      break;
+      }
+    }
+  }
+
+/**
+ * RefreshHandles: update handles of a param after changes
+ *  param: name of changed param, empty = all handles
+ */
+void OvmsConfig::RefreshHandles(const std::string& param)
+  {
+  OvmsRecMutexLock lock(&m_handles_lock);
+  if (param.empty())
+    {
+    for (auto it = m_handles.begin(); it != m_handles.end(); ++it)
+      it->second->Refresh();
+    }
+  else
+    {
+    auto range = m_handles.equal_range(param);
+    for (auto it = range.first; it != range.second; ++it)
+      it->second->Refresh();
+    }
+  }
+
+OvmsConfigHandle::OvmsConfigHandle(const char* param, const char* instance)
+  : m_param(param), m_instance(instance)
+  {
+  m_attached = false;
+  m_defined = false;
+  }
+
+OvmsConfigHandle::~OvmsConfigHandle()
+  {
+  if (m_attached)
+    MyConfig.DeregisterHandle(this);
+  }
+
+void OvmsConfigHandle::Attach()
+  {
+  MyConfig.LockHandles();
+  if (!m_attached)
+    {
+    m_attached = true;
+    MyConfig.RegisterHandle(this);
+    }
+  MyConfig.UnlockHandles();
+  }
+
+void OvmsConfigHandle::Refresh()
+  {
+  // Note: called with handles locked; CachedParam() is used directly, so
+  //  refreshes don't count as uncached lookups
+  OvmsConfigParam* p = MyConfig.CachedParam(m_param);
+  m_defined = (p && p->IsDefined(m_instance));
+  if (m_defined)
+    Parse(true, p->GetValue(m_instance));
+  else
+    Parse(false, std::string());
+  }
+
+bool OvmsConfigHandle::IsDefined()
+  {
+  if (!m_attached) Attach();
+  return m_defined;
+  }
+
+OvmsConfigInt::OvmsConfigInt(const char* param, const char* instance, int defvalue)
+  : OvmsConfigHandle(param, instance)
+  {
+  m_default = m_value = defvalue;
+  }
+
+void OvmsConfigInt::SetDefault(int defvalue)
+  {
+  MyConfig.LockHandles();
+  m_default = defvalue;
+  if (m_attached) Refresh();
+  else m_value = defvalue;
+  MyConfig.UnlockHandles();
+  }
+
+void OvmsConfigInt::Parse(bool defined, const std::string& value)
+  {
+  m_value = (value.empty()) ? m_default : atoi(value.c_str());
+  }
+
+OvmsConfigFloat::OvmsConfigFloat(const char* param, const char* instance, float defvalue)
+  : OvmsConfigHandle(param, instance)
+  {
+  m_default = m_value = defvalue;
+  }
+
+void OvmsConfigFloat::SetDefault(float defvalue)
+  {
+  MyConfig.LockHandles();
+  m_default = defvalue;
+  if (m_attached) Refresh();
+  else m_value = defvalue;
+  MyConfig.UnlockHandles();
+  }
+
+void OvmsConfigFloat::Parse(bool defined, const std::string& value)
+  {
+  m_value = (value.empty()) ? m_default : atof(value.c_str());
+  }
+
+OvmsConfigBool::OvmsConfigBool(const char* param, const char* instance, bool defvalue)
+  : OvmsConfigHandle(param, instance)
+  {
+  m_default = m_value = defvalue;
+  }
+
+void OvmsConfigBool::SetDefault(bool defvalue)
+  {
+  MyConfig.LockHandles();
+  m_default = defvalue;
+  if (m_attached) Refresh();
+  else m_value = defvalue;
+  MyConfig.UnlockHandles();
+  }
+
+void OvmsConfigBool::Parse(bool defined, const std::string& value)
+  {
+  m_value = (value.empty()) ? m_default : strtobool(value);
+  }
+
+OvmsConfigString::OvmsConfigString(const char* param, const char* instance, const char* defvalue)
+  : OvmsConfigHandle(param, instance), m_default(defvalue), m_value(defvalue)
+  {
+  }
+
+std::string OvmsConfigString::Value()
+  {
+  if (!m_attached) Attach();
+  MyConfig.LockHandles();
+  std::string value = m_value;
+  MyConfig.UnlockHandles();
+  return value;
+  }
+
+bool OvmsConfigString::Equals(const char* value)
+  {
+  if (!m_attached) Attach();
+  MyConfig.LockHandles();
+  bool equal = (m_value == value);
+  MyConfig.UnlockHandles();
+  return equal;
+  }
+
+void OvmsConfigString::Parse(bool defined, const std::string& value)
+  {
+  m_value = (defined) ? value : m_default;
+  }
+
 OvmsConfigParam::OvmsConfigParam(std::string name, std::string title, bool writable, bool readable)
   {
   m_name = name;
@@ -847,8 +1200,7 @@ void OvmsConfigParam::SetValue(std::string instance, std::string value)
   if (m_map.find(instance) == m_map.end() || m_map[instance] != value)
     {
     m_map[instance] = value;
-    RewriteConfig();
-    MyEvents.SignalEvent("config.changed", this);
+    Changed(instance);
     }
   }
 
@@ -860,6 +1212,8 @@ void OvmsConfigParam::DeleteParam()
   path.append("/");
   path.append(m_name);
   unlink(path.c_str());
+  m_map.clear();
+  MyConfig.RefreshHandles(m_name);
   MyEvents.SignalEvent("config.changed", this);
   }
 
@@ -870,10 +1224,13 @@ bool OvmsConfigParam::DeleteInstance(std::string instance)
   if (k != m_map.end())
     {
     m_map.erase(k);
-    RewriteConfig();
+    Changed(instance);
     ret = true;
     }
-  MyEvents.SignalEvent("config.changed", this);
+  else if (!MyConfig.InTransaction())
+    {
+    MyEvents.SignalEvent("config.changed", this);
+    }
   return ret;
   }
 
@@ -918,6 +1275,14 @@ std::string OvmsConfigParam::GetName()
   return m_name;
   }
 
+/**
+ * RewriteConfig: write param file
+ *  The file is written to a temporary file first, which then replaces the
+ *  param file. FAT can't rename onto an existing file, so the param file is
+ *  removed before the rename; mount() recovers from interruptions in between.
+ *  The last line is a completion marker, so mount() can tell a complete
+ *  temporary file from a partial one. LoadConfig() ignores it (no separator).
+ */
 void OvmsConfigParam::RewriteConfig()
   {
   OvmsMutexLock store_lock(&MyConfig.m_store_lock);
@@ -925,9 +1290,10 @@ void OvmsConfigParam::RewriteConfig()
   std::string path(OVMS_CONFIGPATH);
   path.append("/");
   path.append(m_name);
-  FILE* f = fopen(path.c_str(), "w");
+  std::string tmppath = path + OVMS_CONFIGTMP;
+  FILE* f = fopen(tmppath.c_str(), "w");
   if (!f)
-    ESP_LOGE(TAG, "RewriteConfig: can't open '%s': %s", path.c_str(), strerror(errno));
+    ESP_LOGE(TAG, "RewriteConfig: can't open '%s': %s", tmppath.c_str(), strerror(errno));
   else
     {
 #ifdef OVMS_PERSIST_METADATA
@@ -940,8 +1306,17 @@ void OvmsConfigParam::RewriteConfig()
       {
       fprintf(f,"%s\t%s\n",it->first.c_str(),it->second.c_str());
       }
+    fputs(OVMS_CONFIGEND "\n", f);
     if (fclose(f))
-      ESP_LOGE(TAG, "RewriteConfig: error writing '%s': %s", path.c_str(), strerror(errno));
+      {
+      ESP_LOGE(TAG, "RewriteConfig: error writing '%s': %s", tmppath.c_str(), strerror(errno));
+      unlink(tmppath.c_str());
+      return;
+      }
+    unlink(path.c_str());
+    if (rename(tmppath.c_str(), path.c_str()) != 0)
+      ESP_LOGE(TAG, "RewriteConfig: can't rename '%s': %s", tmppath.c_str(), strerror(errno));
+    MyConfig.m_txn_writes++;
     }
   }
 
@@ -953,6 +1328,24 @@ void OvmsConfigParam::Load()
 void OvmsConfigParam::Save()
   {
   if (m_name != "")
+    {
+    Changed("*");
+    }
+  }
+
+/**
+ * Changed: handle instance change
+ *  Outside of a transaction, the param file is rewritten & the change is
+ *  signalled immediately, within a transaction both are done on commit.
+ */
+void OvmsConfigParam::Changed(const std::string& instance)
+  {
+  MyConfig.RefreshHandles(m_name);
+  if (MyConfig.InTransaction())
+    {
+    MyConfig.TransactionChanged(this, instance);
+    }
+  else
     {
     RewriteConfig();
     MyEvents.SignalEvent("config.changed", this);
@@ -33,6 +33,7 @@
 
 #include "string"
 #include "map"
+#include "set"
 #include "esp_err.h"
 #include "esp_vfs_fat.h"
 #include "wear_levelling.h"
@@ -43,6 +44,8 @@ typedef NameStringMap ConfigParamMap;
 
 class OvmsConfigParam
   {
+  friend class OvmsConfig;
+
   public:
     OvmsConfigParam(std::string name, std::string title, bool writable, bool readable);
     ~OvmsConfigParam();
@@ -67,6 +70,7 @@ class OvmsConfigParam
   protected:
     void RewriteConfig();
     void LoadConfig();
+    void Changed(const std::string& instance);
 
   protected:
     std::string m_name;
@@ -77,10 +81,122 @@ class OvmsConfigParam
 
   public:
     ConfigParamMap m_map;
+    std::set<std::string> m_changed;    // Instances changed in open transaction
   };
 
 typedef NameMap<OvmsConfigParam*> ConfigMap;
 
+/**
+ * Typed config value handles:
+ *  A handle parses its param instance value once and keeps the result. It is
+ *  refreshed on changes of its param only, so reading it in a hot path costs no
+ *  string construction, map lookups or conversions. Handles attach to MyConfig
+ *  on first access, so they may be static or class members. Example:
+ *
+ *    OvmsConfigFloat m_cfg_12v_ref("vehicle", "12v.ref", 12.6);
+ *    float dref = m_cfg_12v_ref;
+ *
+ *  Semantics match the corresponding OvmsConfig::GetParamValue… methods.
+ */
+class OvmsConfigHandle
+  {
+  friend class OvmsConfig;
+
+  public:
+    OvmsConfigHandle(const char* param, const char* instance);
+    virtual ~OvmsConfigHandle();
+
+  public:
+    const std::string& GetParam() { return m_param; }
+    const std::string& GetInstance() { return m_instance; }
+    bool IsDefined();
+
+  protected:
+    void Attach();
+    void Refresh();
+    virtual void Parse(bool defined, const std::string& value) = 0;
+
+  protected:
+    std::string m_param;
+    std::string m_instance;
+    bool m_attached;
+    bool m_defined;
+  };
+
+class OvmsConfigInt : public OvmsConfigHandle
+  {
+  public:
+    OvmsConfigInt(const char* param, const char* instance, int defvalue = 0);
+
+  public:
+    int Value() { if (!m_attached) Attach(); return m_value; }
+    operator int() { return Value(); }
+    void SetDefault(int defvalue);
+
+  protected:
+    void Parse(bool defined, const std::string& value);
+
+  protected:
+    int m_default;
+    volatile int m_value;
+  };
+
+class OvmsConfigFloat : public OvmsConfigHandle
+  {
+  public:
+    OvmsConfigFloat(const char* param, const char* instance, float defvalue = 0);
+
+  public:
+    float Value() { if (!m_attached) Attach(); return m_value; }
+    operator float() { return Value(); }
+    void SetDefault(float defvalue);
+
+  protected:
+    void Parse(bool defined, const std::string& value);
+
+  protected:
+    float m_default;
+    volatile float m_value;
+  };
+
+class OvmsConfigBool : public OvmsConfigHandle
+  {
+  public:
+    OvmsConfigBool(const char* param, const char* instance, bool defvalue = false);
+
+  public:
+    bool Value() { if (!m_attached) Attach(); return m_value; }
+    operator bool() { return Value(); }
+    void SetDefault(bool defvalue);
+
+  protected:
+    void Parse(bool defined, const std::string& value);
+
+  protected:
+    bool m_default;
+    volatile bool m_value;
+  };
+
+class OvmsConfigString : public OvmsConfigHandle
+  {
+  public:
+    OvmsConfigString(const char* param, const char* instance, const char* defvalue = "");
+
+  public:
+    std::string Value();
+    operator std::string() { return Value(); }
+    bool Equals(const char* value);
+
+  protected:
+    void Parse(bool defined, const std::string& value);
+
+  protected:
+    std::string m_default;
+    std::string m_value;
+  };
+
+typedef std::multimap<std::string, OvmsConfigHandle*> ConfigHandleMap;
+
 typedef enum
   {
   Encoding_HEX = 0,
@@ -89,6 +205,8 @@ typedef enum
 
 class OvmsConfig
   {
+  friend class OvmsConfigParam;
+
   public:
     OvmsConfig();
     ~OvmsConfig();
@@ -128,15 +246,45 @@ class OvmsConfig
 
   public:
     void SupportSummary(OvmsWriter* writer);
+    void Status(OvmsWriter* writer);
+
+  public:
+    void BeginTransaction();
+    void CommitTransaction();
+    bool InTransaction();
+    void TransactionChanged(OvmsConfigParam* param, const std::string& instance);
+
+  public:
+    void RegisterHandle(OvmsConfigHandle* handle);
+    void DeregisterHandle(OvmsConfigHandle* handle);
+    void RefreshHandles(const std::string& param);
+    void LockHandles() { m_handles_lock.Lock(); }
+    void UnlockHandles() { m_handles_lock.Unlock(); }
 
   protected:
     void upgrade();
+    void Ticker10(std::string event, void* data);
 
   protected:
     bool m_mounted;
     esp_vfs_fat_mount_config_t m_store_fat;
     wl_handle_t m_store_wlh;
 
+  protected:
+    OvmsMutex m_txn_lock;
+    std::map<TaskHandle_t, int> m_txn_levels;   // Transaction nesting per task
+    std::map<TaskHandle_t, std::set<OvmsConfigParam*>> m_txn_dirty;  // Params to flush on commit, per task
+    uint32_t m_txn_commits;
+    uint32_t m_txn_writes;                      // Param files written
+    uint32_t m_txn_coalesced;                   // Changes saved by coalescing
+
+  protected:
+    ConfigHandleMap m_handles;
+    OvmsRecMutex m_handles_lock;
+    uint32_t m_lookups;                 // Uncached lookups (GetParamValue…, IsDefined)
+    uint32_t m_lookups_last;
+    float m_lookups_rate;               // Uncached lookups per second (10 second average)
+
   public:
     ConfigMap m_map;
     OvmsMutex m_store_lock;
@@ -144,4 +292,23 @@ class OvmsConfig
 
 extern OvmsConfig MyConfig;
 
+/**
+ * OvmsConfigTransaction: batch config changes (scoped)
+ *  Changes done by the current task within the scope are applied to the params
+ *  and handles immediately, but the param files are written once per param and
+ *  the change events are sent on the (outermost) commit. Transactions may be nested.
+ */
+class OvmsConfigTransaction
+  {
+  public:
+    OvmsConfigTransaction() { MyConfig.BeginTransaction(); m_open = true; }
+    ~OvmsConfigTransaction() { Commit(); }
+
+  public:
+    void Commit() { if (m_open) { m_open = false; MyConfig.CommitTransaction(); } }
+
+  protected:
+    bool m_open;
+  };
+
 #endif //#ifndef __CONFIG_H__
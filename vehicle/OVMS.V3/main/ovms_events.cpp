@@ -35,7 +35,9 @@ static const char *TAG = "events";
 #include <stdio.h>
 #include <esp_event_loop.h>
 #include <esp_task_wdt.h>
+#include "esp_timer.h"
 #include "ovms_module.h"
+#include "ovms_malloc.h"
 #include "ovms_events.h"
 #include "ovms_command.h"
 #include "ovms_script.h"
@@ -49,6 +51,23 @@ void EventStdFree(const char* event, void* data)
   free(data);
   }
 
+static uint32_t EventHash(const char* event)
+  {
+  // FNV-1a
+  uint32_t hash = 2166136261u;
+  for (const char* p = event; *p; p++)
+    hash = (hash ^ (uint8_t)*p) * 16777619u;
+  return hash;
+  }
+
+static const char* QueueEventName(event_queue_t* msg)
+  {
+  if (msg->body.signal.event != NULL)
+    return msg->body.signal.event;
+  const char* name = MyEvents.GetEventName(msg->body.signal.id);
+  return name ? name : "?";
+  }
+
 void EventLaunchTask(void *pvParameters)
   {
   OvmsEvents* me = (OvmsEvents*)pvParameters;
@@ -72,12 +91,15 @@ void event_status(int verbosity, OvmsWriter* writer, OvmsCommand* cmd, int argc,
     MyEvents.Map().size(),
     uxQueueMessagesWaiting(MyEvents.m_taskqueue),
     CONFIG_OVMS_HW_EVENT_QUEUE_SIZE);
+  writer->printf("Event registry has %d/%d names\n",
+    MyEvents.GetEventCount()-1, EVENT_ID_MAX-1);
 
   EventCallbackEntry* cbe = MyEvents.m_current_callback;
   if (cbe != NULL)
     {
     writer->printf("Currently dispatching:\n");
-    writer->printf("  Event: %s\n",MyEvents.m_current_event.c_str());
+    const char* current = MyEvents.m_current_event;
+    writer->printf("  Event: %s\n",current ? current : "-");
     writer->printf("  To:    %s\n",cbe->m_caller.c_str());
     writer->printf("  For:   %u second(s)\n",monotonictime-MyEvents.m_current_started);
     }
@@ -135,11 +157,36 @@ void event_raise(int verbosity, OvmsWriter* writer, OvmsCommand* cmd, int argc,
     }
   }
 
+void event_benchmark(int verbosity, OvmsWriter* writer, OvmsCommand* cmd, int argc, const char* const* argv)
+  {
+  int count = (argc > 0) ? atoi(argv[0]) : 10000;
+  if (count < 1)
+    {
+    writer->puts("Error: invalid count");
+    return;
+    }
+  MyEvents.Benchmark(writer, count);
+  }
+
 OvmsEvents::OvmsEvents()
   {
   ESP_LOGI(TAG, "Initialising EVENTS (1200)");
 
   m_current_callback = NULL;
+  m_current_event = NULL;
+  m_current_started = 0;
+
+  // Event registry: ID 0 is reserved for "not interned"
+  m_events = (EventRecord**)ExternalRamCalloc(EVENT_ID_MAX, sizeof(EventRecord*));
+  m_event_hash = (event_id_t*)ExternalRamCalloc(EVENT_ID_HASHSIZE, sizeof(event_id_t));
+  m_event_count = 1;
+  GetEventId("*");
+  GetEventId("ticker.1");
+  GetEventId("ticker.10");
+  GetEventId("ticker.60");
+  GetEventId("ticker.300");
+  GetEventId("ticker.600");
+  GetEventId("ticker.3600");
 
 #ifdef CONFIG_OVMS_DEV_DEBUGEVENTS
   m_trace = true;
@@ -154,6 +201,7 @@ OvmsEvents::OvmsEvents()
   cmd_event->RegisterCommand("status","Show status of event system",event_status);
   cmd_event->RegisterCommand("list","List registered events",event_list,"[<key>]", 0, 1);
   cmd_event->RegisterCommand("raise","Raise a textual event",event_raise,"[-d<delay_ms>] <event>", 1, 2, true, event_validate);
+  cmd_event->RegisterCommand("benchmark","Measure event signal & dispatch rate",event_benchmark,"[<count>]", 0, 1);
   OvmsCommand* cmd_eventtrace = cmd_event->RegisterCommand("trace","EVENT trace framework");
   cmd_eventtrace->RegisterCommand("on","Turn event tracing ON",event_trace);
   cmd_eventtrace->RegisterCommand("off","Turn event tracing OFF",event_trace);
@@ -194,84 +242,162 @@ void OvmsEvents::EventTask()
 
 void OvmsEvents::HandleQueueSignalEvent(event_queue_t* msg)
   {
-  m_current_event = std::string(msg->body.signal.event);
+  event_id_t id = msg->body.signal.id;
+  EventRecord* rec = (id != EVENT_ID_NONE) ? m_events[id] : NULL;
+  EventCallbackList* el = NULL;
+  std::string dynname;
+  bool ticker;
 
-  // Log everything but the excessively verbose ticker signals
-  if (m_current_event.compare(0,7,"ticker.") != 0)
+  if (rec)
     {
-    if (m_trace)
-      ESP_LOGI(TAG, "Signal(%s)",m_current_event.c_str());
-    else
-      ESP_LOGD(TAG, "Signal(%s)",m_current_event.c_str());
+    el = rec->m_listeners;
+    ticker = rec->m_ticker;
     }
-
-  auto k = m_map.find(m_current_event);
-  if (k != m_map.end())
+  else
     {
-    EventCallbackList* el = k->second;
-    if (el)
-      {
-      for (EventCallbackList::iterator itc=el->begin(); itc!=el->end(); ++itc)
-        {
-        m_current_started = monotonictime;
-        m_current_callback = *itc;
-        m_current_callback->m_callback(m_current_event, msg->body.signal.data);
-        m_current_callback = NULL;
-        }
-      }
+    // Not interned: fall back to the name map
+    dynname = msg->body.signal.event;
+    auto k = m_map.find(dynname);
+    if (k != m_map.end()) el = k->second;
+    ticker = (dynname.compare(0,7,"ticker.") == 0);
     }
+  const std::string& name = rec ? rec->m_name : dynname;
+  m_current_event = name.c_str();
 
-  k = m_map.find("*");
-  if (k != m_map.end())
+  // Log everything but the excessively verbose ticker signals
+  if (!ticker)
     {
-    EventCallbackList* el = k->second;
-    if (el)
-      {
-      for (EventCallbackList::iterator itc=el->begin(); itc!=el->end(); ++itc)
-        {
-        m_current_started = monotonictime;
-        m_current_callback = *itc;
-        m_current_callback->m_callback(m_current_event, msg->body.signal.data);
-        m_current_callback = NULL;
-        }
-      }
+    if (m_trace)
+      ESP_LOGI(TAG, "Signal(%s)",m_current_event);
+    else
+      ESP_LOGD(TAG, "Signal(%s)",m_current_event);
     }
 
-  MyScripts.EventScript(m_current_event, msg->body.signal.data);
+  if (el)
+    DispatchEvent(el, id, m_current_event, name, msg->body.signal.data);
+
+  el = m_events[EVENT_ID_ANY]->m_listeners;
+  if (el)
+    DispatchEvent(el, id, m_current_event, name, msg->body.signal.data);
 
-  m_current_event.clear();
+  MyScripts.EventScript(id, name, msg->body.signal.data);
+
+  m_current_event = NULL;
   FreeQueueSignalEvent(msg);
   }
 
+void OvmsEvents::DispatchEvent(EventCallbackList* el, event_id_t id, const char* name, const std::string& sname, void* data)
+  {
+  for (EventCallbackList::iterator itc=el->begin(); itc!=el->end(); ++itc)
+    {
+    m_current_started = monotonictime;
+    m_current_callback = *itc;
+    if (m_current_callback->m_idcallback)
+      m_current_callback->m_idcallback(id, name, data);
+    else
+      m_current_callback->m_callback(sname, data);
+    m_current_callback = NULL;
+    }
+  }
+
 void OvmsEvents::FreeQueueSignalEvent(event_queue_t* msg)
   {
   if (msg->body.signal.donefn != NULL)
     {
-    msg->body.signal.donefn(msg->body.signal.event, msg->body.signal.data);
+    msg->body.signal.donefn(QueueEventName(msg), msg->body.signal.data);
     }
   free(msg->body.signal.event);
   }
 
-void OvmsEvents::RegisterEvent(std::string caller, std::string event, EventCallback callback)
+/**
+ * InternEvent: find (and optionally create) the registry entry for an event name.
+ *  Must be called with m_events_mutex held. Returns EVENT_ID_NONE if the name
+ *  is unknown and create is false, or if the registry is full.
+ */
+event_id_t OvmsEvents::InternEvent(const char* event, uint32_t hash, bool create)
+  {
+  uint32_t slot = hash & (EVENT_ID_HASHSIZE-1);
+  event_id_t id;
+  while ((id = m_event_hash[slot]) != EVENT_ID_NONE)
+    {
+    if (strcmp(m_events[id]->m_name.c_str(), event) == 0)
+      return id;
+    slot = (slot+1) & (EVENT_ID_HASHSIZE-1);
+    }
+
+  if (!create)
+    return EVENT_ID_NONE;
+  if (m_event_count >= EVENT_ID_MAX)
+    {
+    ESP_LOGW(TAG, "Event registry full, '%s' not interned", event);
+    return EVENT_ID_NONE;
+    }
+
+  id = m_event_count;
+  EventRecord* rec = new EventRecord(event, id);
+  auto k = m_map.find(rec->m_name);
+  if (k != m_map.end())
+    rec->m_listeners = k->second;
+  m_events[id] = rec;
+  m_event_hash[slot] = id;
+  m_event_count++;
+  return id;
+  }
+
+event_id_t OvmsEvents::GetEventId(const char* event, bool create /*=true*/)
+  {
+  uint32_t hash = EventHash(event);
+  OvmsMutexLock lock(&m_events_mutex);
+  return InternEvent(event, hash, create);
+  }
+
+const char* OvmsEvents::GetEventName(event_id_t id)
+  {
+  if (id == EVENT_ID_NONE || id >= m_event_count)
+    return NULL;
+  return m_events[id]->m_name.c_str();
+  }
+
+void OvmsEvents::AddEventListener(const std::string& event, EventCallbackEntry* entry)
   {
+  OvmsMutexLock lock(&m_events_mutex);
+  EventCallbackList* el;
   auto k = m_map.find(event);
   if (k == m_map.end())
     {
-    m_map[event] = new EventCallbackList();
-    k = m_map.find(event);
+    el = new EventCallbackList();
+    m_map[event] = el;
     }
-  if (k == m_map.end())
+  else
     {
-    ESP_LOGE(TAG, "Problem registering event %s for caller %s",event.c_str(),caller.c_str());
-    return;
+    el = k->second;
     }
+  el->push_back(entry);
+
+  event_id_t id = InternEvent(event.c_str(), EventHash(event.c_str()), true);
+  if (id != EVENT_ID_NONE)
+    m_events[id]->m_listeners = el;
+  }
+
+void OvmsEvents::RegisterEvent(std::string caller, std::string event, EventCallback callback)
+  {
+  AddEventListener(event, new EventCallbackEntry(caller,callback));
+  }
 
-  EventCallbackList *el = k->second;
-  el->push_back(new EventCallbackEntry(caller,callback));
+void OvmsEvents::RegisterEvent(std::string caller, event_id_t id, EventIdCallback callback)
+  {
+  const char* event = GetEventName(id);
+  if (event == NULL)
+    {
+    ESP_LOGE(TAG, "Problem registering event id %u for caller %s",id,caller.c_str());
+    return;
+    }
+  AddEventListener(event, new EventCallbackEntry(caller,callback));
   }
 
 void OvmsEvents::DeregisterEvent(std::string caller)
   {
+  OvmsMutexLock lock(&m_events_mutex);
   EventMap::iterator itm=m_map.begin();
   while (itm!=m_map.end())
     {
@@ -292,6 +418,9 @@ void OvmsEvents::DeregisterEvent(std::string caller)
       }
     if (el->empty())
       {
+      event_id_t id = InternEvent(itm->first.c_str(), EventHash(itm->first.c_str()), false);
+      if (id != EVENT_ID_NONE)
+        m_events[id]->m_listeners = NULL;
       itm = m_map.erase(itm);
       delete el;
       }
@@ -310,15 +439,16 @@ static void SignalScheduledEvent(TimerHandle_t timer)
     EventCallbackEntry* cbe = MyEvents.m_current_callback;
     if (cbe != NULL)
       {
+      const char* current = MyEvents.m_current_event;
       ESP_LOGE(TAG, "SignalScheduledEvent: queue overflow (running %s->%s for %u sec), event '%s' dropped",
-       MyEvents.m_current_event.c_str(),
+       current ? current : "-",
        cbe->m_caller.c_str(),
        monotonictime-MyEvents.m_current_started,
-       msg->body.signal.event);
+       QueueEventName(msg));
       }
     else
       {
-      ESP_LOGE(TAG, "SignalScheduledEvent: queue overflow, event '%s' dropped", msg->body.signal.event);
+      ESP_LOGE(TAG, "SignalScheduledEvent: queue overflow, event '%s' dropped", QueueEventName(msg));
       }
     MyEvents.FreeQueueSignalEvent(msg);
     }
@@ -372,57 +502,95 @@ bool OvmsEvents::ScheduleEvent(event_queue_t* msg, uint32_t delay_ms)
   return true;
   }
 
-void OvmsEvents::SignalEvent(std::string event, void* data, event_signal_done_fn callback /*=NULL*/,
-                             uint32_t delay_ms /*=0*/)
+bool OvmsEvents::QueueSignalEvent(event_queue_t* msg, uint32_t delay_ms)
   {
-  event_queue_t msg;
-  memset(&msg, 0, sizeof(msg));
-
-  msg.type = EVENT_signal;
-  msg.body.signal.event = (char*)ExternalRamMalloc(event.size()+1);
-  strcpy(msg.body.signal.event, event.c_str());
-  msg.body.signal.data = data;
-  msg.body.signal.donefn = callback;
-
   if (delay_ms == 0)
     {
-    if (xQueueSend(m_taskqueue, &msg, 0) != pdTRUE)
+    if (xQueueSend(m_taskqueue, msg, 0) != pdTRUE)
       {
-      EventCallbackEntry* cbe = MyEvents.m_current_callback;
+      EventCallbackEntry* cbe = m_current_callback;
       if (cbe != NULL)
         {
+        const char* current = m_current_event;
         ESP_LOGE(TAG, "SignalEvent: queue overflow (running %s->%s for %u sec), event '%s' dropped",
-          MyEvents.m_current_event.c_str(),
+          current ? current : "-",
           cbe->m_caller.c_str(),
-          monotonictime-MyEvents.m_current_started,
-          msg.body.signal.event);
+          monotonictime-m_current_started,
+          QueueEventName(msg));
         }
       else
         {
-        ESP_LOGE(TAG, "SignalEvent: queue overflow, event '%s' dropped", msg.body.signal.event);
+        ESP_LOGE(TAG, "SignalEvent: queue overflow, event '%s' dropped", QueueEventName(msg));
         }
-      FreeQueueSignalEvent(&msg);
+      FreeQueueSignalEvent(msg);
+      return false;
       }
     }
   else
     {
-    if (ScheduleEvent(&msg, delay_ms) != true)
+    if (ScheduleEvent(msg, delay_ms) != true)
       {
-      ESP_LOGE(TAG, "SignalEvent: no timer available, event '%s' dropped", msg.body.signal.event);
-      FreeQueueSignalEvent(&msg);
+      ESP_LOGE(TAG, "SignalEvent: no timer available, event '%s' dropped", QueueEventName(msg));
+      FreeQueueSignalEvent(msg);
+      return false;
       }
     }
+  return true;
   }
 
-void OvmsEvents::SignalEvent(std::string event, void* data, size_t length,
+void OvmsEvents::SignalEvent(event_id_t id, void* data, event_signal_done_fn callback /*=NULL*/,
                              uint32_t delay_ms /*=0*/)
   {
   event_queue_t msg;
   memset(&msg, 0, sizeof(msg));
 
   msg.type = EVENT_signal;
-  msg.body.signal.event = (char*)ExternalRamMalloc(event.size()+1);
-  strcpy(msg.body.signal.event, event.c_str());
+  msg.body.signal.id = id;
+  msg.body.signal.data = data;
+  msg.body.signal.donefn = callback;
+
+  if (GetEventName(id) == NULL)
+    {
+    ESP_LOGE(TAG, "SignalEvent: unknown event id %u dropped", id);
+    if (callback) callback("?", data);
+    return;
+    }
+
+  QueueSignalEvent(&msg, delay_ms);
+  }
+
+void OvmsEvents::SignalEvent(const char* event, void* data, event_signal_done_fn callback /*=NULL*/,
+                             uint32_t delay_ms /*=0*/)
+  {
+  event_queue_t msg;
+  memset(&msg, 0, sizeof(msg));
+
+  msg.type = EVENT_signal;
+  msg.body.signal.id = GetEventId(event, false);
+  if (msg.body.signal.id == EVENT_ID_NONE)
+    {
+    msg.body.signal.event = (char*)ExternalRamMalloc(strlen(event)+1);
+    strcpy(msg.body.signal.event, event);
+    }
+  msg.body.signal.data = data;
+  msg.body.signal.donefn = callback;
+
+  QueueSignalEvent(&msg, delay_ms);
+  }
+
+void OvmsEvents::SignalEvent(const char* event, void* data, size_t length,
+                             uint32_t delay_ms /*=0*/)
+  {
+  event_queue_t msg;
+  memset(&msg, 0, sizeof(msg));
+
+  msg.type = EVENT_signal;
+  msg.body.signal.id = GetEventId(event, false);
+  if (msg.body.signal.id == EVENT_ID_NONE)
+    {
+    msg.body.signal.event = (char*)ExternalRamMalloc(strlen(event)+1);
+    strcpy(msg.body.signal.event, event);
+    }
   if (data != NULL)
     {
     msg.body.signal.data = ExternalRamMalloc(length);
@@ -435,22 +603,93 @@ void OvmsEvents::SignalEvent(std::string event, void* data, size_t length,
     msg.body.signal.donefn = NULL;
     }
 
-  if (delay_ms == 0)
+  QueueSignalEvent(&msg, delay_ms);
+  }
+
+void OvmsEvents::SignalEvent(std::string event, void* data, event_signal_done_fn callback /*=NULL*/,
+                             uint32_t delay_ms /*=0*/)
+  {
+  SignalEvent(event.c_str(), data, callback, delay_ms);
+  }
+
+void OvmsEvents::SignalEvent(std::string event, void* data, size_t length,
+                             uint32_t delay_ms /*=0*/)
+  {
+  SignalEvent(event.c_str(), data, length, delay_ms);
+  }
+
+/**
+ * Benchmark: measure the per event cost of signal encoding & listener dispatch
+ *  (excluding the queue transfer and event scripts) for the former string based
+ *  implementation, the string API shim and signalling by ID.
+ */
+void OvmsEvents::Benchmark(OvmsWriter* writer, int count)
+  {
+  static const char* name = "benchmark.event";
+  uint32_t calls = 0;
+  int64_t start, elapsed;
+  event_queue_t msg;
+
+  EventCallbackList strlist, idlist;
+  strlist.push_back(new EventCallbackEntry("benchmark",
+    [&calls](std::string event, void* data) { calls++; }));
+  idlist.push_back(new EventCallbackEntry("benchmark",
+    [&calls](event_id_t id, const char* event, void* data) { calls++; }));
+  EventMap map;
+  map[name] = &strlist;
+
+  writer->printf("Signalling %d events per test:\n", count);
+
+  // Former implementation: name copy per signal, std::string & two map lookups per dispatch
+  start = esp_timer_get_time();
+  for (int i=0; i<count; i++)
     {
-    if (xQueueSend(m_taskqueue, &msg, 0) != pdTRUE)
-      {
-      ESP_LOGE(TAG, "SignalEvent: queue overflow, event '%s' dropped", msg.body.signal.event);
-      FreeQueueSignalEvent(&msg);
-      }
+    msg.body.signal.event = (char*)ExternalRamMalloc(strlen(name)+1);
+    strcpy(msg.body.signal.event, name);
+    std::string current = std::string(msg.body.signal.event);
+    if (current.compare(0,7,"ticker.") != 0) {}
+    auto k = map.find(current);
+    if (k != map.end())
+      for (auto itc=k->second->begin(); itc!=k->second->end(); ++itc)
+        (*itc)->m_callback(current, NULL);
+    k = map.find("*");
+    free(msg.body.signal.event);
     }
-  else
+  elapsed = esp_timer_get_time() - start;
+  writer->printf("  %-30s %8lld events/s\n", "string (former)",
+    elapsed ? (long long)count * 1000000LL / elapsed : 0LL);
+
+  // String API shim: name looked up on each signal, std::string listener
+  start = esp_timer_get_time();
+  for (int i=0; i<count; i++)
     {
-    if (ScheduleEvent(&msg, delay_ms) != true)
-      {
-      ESP_LOGE(TAG, "SignalEvent: no timer available, event '%s' dropped", msg.body.signal.event);
-      FreeQueueSignalEvent(&msg);
-      }
+    msg.body.signal.id = GetEventId(name);
+    EventRecord* rec = m_events[msg.body.signal.id];
+    for (auto itc=strlist.begin(); itc!=strlist.end(); ++itc)
+      (*itc)->m_callback(rec->m_name, NULL);
+    }
+  elapsed = esp_timer_get_time() - start;
+  writer->printf("  %-30s %8lld events/s\n", "string (interned)",
+    elapsed ? (long long)count * 1000000LL / elapsed : 0LL);
+
+  // Signal by ID, ID listener
+  event_id_t id = GetEventId(name);
+  start = esp_timer_get_time();
+  for (int i=0; i<count; i++)
+    {
+    msg.body.signal.id = id;
+    EventRecord* rec = m_events[msg.body.signal.id];
+    for (auto itc=idlist.begin(); itc!=idlist.end(); ++itc)
+      (*itc)->m_idcallback(rec->m_id, rec->m_name.c_str(), NULL);
     }
+  elapsed = esp_timer_get_time() - start;
+  writer->printf("  %-30s %8lld events/s\n", "id",
+    elapsed ? (long long)count * 1000000LL / elapsed : 0LL);
+
+  writer->printf("%u listener calls\n", calls);
+
+  delete strlist.front();
+  delete idlist.front();
   }
 
 esp_err_t OvmsEvents::ReceiveSystemEvent(void *ctx, system_event_t *event)
@@ -552,6 +791,20 @@ EventCallbackEntry::EventCallbackEntry(std::string caller, EventCallback callbac
   m_callback = callback;
   }
 
+EventCallbackEntry::EventCallbackEntry(std::string caller, EventIdCallback callback)
+  {
+  m_caller = caller;
+  m_idcallback = callback;
+  }
+
+EventRecord::EventRecord(const char* name, event_id_t id)
+  {
+  m_name = name;
+  m_id = id;
+  m_ticker = (strncmp(name, "ticker.", 7) == 0);
+  m_listeners = NULL;
+  }
+
 EventCallbackEntry::~EventCallbackEntry()
   {
   }
@@ -43,22 +43,61 @@
 #include "ovms_command.h"
 #include "ovms_mutex.h"
 
+// Event IDs: every event name listened to is interned into the registry
+// on registration and gets a fixed numeric ID. Signalling and dispatching
+// by ID needs no string copies or heap allocations. Signalling by name only
+// looks the name up, so dynamic names (i.e. from scripts) cannot fill the
+// registry; names without an ID are queued & dispatched as strings.
+// IDs below EVENT_ID_USER are pre-registered for the high frequency events.
+typedef uint16_t event_id_t;
+
+#define EVENT_ID_MAX              512     // Registry capacity (names beyond this use the string path)
+#define EVENT_ID_HASHSIZE         1024    // Name lookup hash table size (power of 2, > EVENT_ID_MAX)
+
+enum
+  {
+  EVENT_ID_NONE = 0,          // Not interned (dynamic name, registry full)
+  EVENT_ID_ANY,               // "*"
+  EVENT_ID_TICKER_1,          // "ticker.1"
+  EVENT_ID_TICKER_10,         // "ticker.10"
+  EVENT_ID_TICKER_60,         // "ticker.60"
+  EVENT_ID_TICKER_300,        // "ticker.300"
+  EVENT_ID_TICKER_600,        // "ticker.600"
+  EVENT_ID_TICKER_3600,       // "ticker.3600"
+  EVENT_ID_USER               // First dynamically assigned ID
+  };
+
 typedef std::function<void(std::string,void*)> EventCallback;
+typedef std::function<void(event_id_t,const char*,void*)> EventIdCallback;
 
 class EventCallbackEntry
   {
   public:
     EventCallbackEntry(std::string caller, EventCallback callback);
+    EventCallbackEntry(std::string caller, EventIdCallback callback);
     virtual ~EventCallbackEntry();
 
   public:
     std::string m_caller;
     EventCallback m_callback;
+    EventIdCallback m_idcallback;
   };
 
 typedef std::list<EventCallbackEntry*> EventCallbackList;
 typedef NameMap<EventCallbackList*> EventMap;
 
+class EventRecord
+  {
+  public:
+    EventRecord(const char* name, event_id_t id);
+
+  public:
+    std::string m_name;
+    event_id_t m_id;
+    bool m_ticker;                    // Excluded from logging
+    EventCallbackList* m_listeners;   // Shared with the EventMap entry, NULL if none
+  };
+
 typedef void (*event_signal_done_fn)(const char* event, void* data);
 
 extern void EventStdFree(const char* event, void* data);
@@ -75,7 +114,8 @@ typedef struct
     {
     struct
       {
-      char* event;
+      char* event;            // Allocated name, only used if id is EVENT_ID_NONE
+      event_id_t id;
       void* data;
       event_signal_done_fn donefn;
       } signal;
@@ -93,10 +133,19 @@ class OvmsEvents
 
   public:
     void RegisterEvent(std::string caller, std::string event, EventCallback callback);
+    void RegisterEvent(std::string caller, event_id_t id, EventIdCallback callback);
     void DeregisterEvent(std::string caller);
+    void SignalEvent(event_id_t id, void* data, event_signal_done_fn callback = NULL, uint32_t delay_ms = 0);
+    void SignalEvent(const char* event, void* data, event_signal_done_fn callback = NULL, uint32_t delay_ms = 0);
+    void SignalEvent(const char* event, void* data, size_t length, uint32_t delay_ms = 0);
     void SignalEvent(std::string event, void* data, event_signal_done_fn callback = NULL, uint32_t delay_ms = 0);
     void SignalEvent(std::string event, void* data, size_t length, uint32_t delay_ms = 0);
 
+  public:
+    event_id_t GetEventId(const char* event, bool create=true);
+    const char* GetEventName(event_id_t id);
+    int GetEventCount() { return m_event_count; }
+
   public:
     void EventTask();
     void HandleQueueSignalEvent(event_queue_t* msg);
@@ -104,12 +153,21 @@ class OvmsEvents
     static esp_err_t ReceiveSystemEvent(void *ctx, system_event_t *event);
     void SignalSystemEvent(system_event_t *event);
     const EventMap& Map() { return m_map; }
+    void Benchmark(OvmsWriter* writer, int count);
 
   protected:
     bool ScheduleEvent(event_queue_t* msg, uint32_t delay_ms);
+    bool QueueSignalEvent(event_queue_t* msg, uint32_t delay_ms);
+    event_id_t InternEvent(const char* event, uint32_t hash, bool create);
+    void AddEventListener(const std::string& event, EventCallbackEntry* entry);
+    void DispatchEvent(EventCallbackList* el, event_id_t id, const char* name, const std::string& sname, void* data);
 
   protected:
     EventMap m_map;
+    EventRecord** m_events;
+    event_id_t* m_event_hash;
+    int m_event_count;
+    OvmsMutex m_events_mutex;
     TimerList m_timers;
     OvmsMutex m_timers_mutex;
 
@@ -120,7 +178,7 @@ class OvmsEvents
 
   public:
     EventCallbackEntry* m_current_callback;
-    std::string m_current_event;
+    const char* m_current_event;
     uint32_t m_current_started;
   };
 
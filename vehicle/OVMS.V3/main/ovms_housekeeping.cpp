@@ -67,6 +67,8 @@ static const char *TAG = "housekeeping";
 #define AUTO_INIT_INHIBIT_CRASHCOUNT    5
 
 static int tick = 0;
+static OvmsConfigFloat cfg_factor12v("system.adc", "factor12v", 0);
+static OvmsConfigFloat cfg_12v_ref("vehicle", "12v.ref", 12.6);
 
 void HousekeepingUpdate12V()
   {
@@ -78,7 +80,7 @@ void HousekeepingUpdate12V()
     return;
 
   // Allow the user to adjust the ADC conversion factor
-  float f = MyConfig.GetParamValueFloat("system.adc","factor12v");
+  float f = cfg_factor12v;
   if (f == 0) f = 195.7;
   float v = (float)MyPeripherals->m_esp32adc->read() / f;
   // smooth out ADC errors & noise:
@@ -88,7 +90,7 @@ void HousekeepingUpdate12V()
   if (v < 1.0) v=0;
   m1->SetValue(v);
   if (StandardMetrics.ms_v_bat_12v_voltage_ref->AsFloat() == 0)
-    StandardMetrics.ms_v_bat_12v_voltage_ref->SetValue(MyConfig.GetParamValueFloat("vehicle","12v.ref", 12.6));
+    StandardMetrics.ms_v_bat_12v_voltage_ref->SetValue(cfg_12v_ref);
 #endif // #ifdef CONFIG_OVMS_COMP_ADC
   }
 
@@ -98,17 +100,17 @@ void HousekeepingTicker1( TimerHandle_t timer )
   StandardMetrics.ms_m_monotonic->SetValue((int)monotonictime);
 
   HousekeepingUpdate12V();
-  MyEvents.SignalEvent("ticker.1", NULL);
+  MyEvents.SignalEvent(EVENT_ID_TICKER_1, NULL);
 
   tick++;
-  if ((tick % 10)==0) MyEvents.SignalEvent("ticker.10", NULL);
-  if ((tick % 60)==0) MyEvents.SignalEvent("ticker.60", NULL);
-  if ((tick % 300)==0) MyEvents.SignalEvent("ticker.300", NULL);
-  if ((tick % 600)==0) MyEvents.SignalEvent("ticker.600", NULL);
+  if ((tick % 10)==0) MyEvents.SignalEvent(EVENT_ID_TICKER_10, NULL);
+  if ((tick % 60)==0) MyEvents.SignalEvent(EVENT_ID_TICKER_60, NULL);
+  if ((tick % 300)==0) MyEvents.SignalEvent(EVENT_ID_TICKER_300, NULL);
+  if ((tick % 600)==0) MyEvents.SignalEvent(EVENT_ID_TICKER_600, NULL);
   if ((tick % 3600)==0)
     {
     tick = 0;
-    MyEvents.SignalEvent("ticker.3600", NULL);
+    MyEvents.SignalEvent(EVENT_ID_TICKER_3600, NULL);
     }
   }
 
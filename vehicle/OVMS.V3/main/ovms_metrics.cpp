@@ -38,6 +38,7 @@ static const char *TAG = "metrics";
 #include "ovms_metrics.h"
 #include "ovms_command.h"
 #include "ovms_script.h"
+#include "ovms_malloc.h"
 #include "string.h"
 
 using namespace std;
@@ -281,6 +282,8 @@ OvmsMetrics::OvmsMetrics()
   ESP_LOGI(TAG, "Initialising METRICS (1810)");
 
   m_nextmodifier = 1;
+  memset(m_journal, 0, sizeof(m_journal));
+  m_journalmask = 0;
   m_first = NULL;
   m_trace = false;
 
@@ -329,8 +332,154 @@ OvmsMetrics::~OvmsMetrics()
     }
   }
 
+OvmsMetricIndex::OvmsMetricIndex(size_t capacity)
+  {
+  size_t cap = 16;
+  while (cap < capacity) cap <<= 1;
+  m_table = NewTable(cap);
+  m_count = 0;
+  m_incomplete = false;
+  }
+
+OvmsMetricIndex::~OvmsMetricIndex()
+  {
+  free(m_table);
+  }
+
+OvmsMetricIndex::table_t* OvmsMetricIndex::NewTable(size_t capacity)
+  {
+  table_t* t = (table_t*) ExternalRamCalloc(1, sizeof(table_t) + capacity * sizeof(slot_t));
+  if (t == NULL)
+    {
+    ESP_LOGE(TAG, "Metric index: cannot allocate %u slots", capacity);
+    return NULL;
+    }
+  t->capacity = capacity;
+  return t;
+  }
+
+uint32_t OvmsMetricIndex::Hash(const char* name)
+  {
+  // FNV-1a
+  uint32_t hash = 2166136261u;
+  while (*name)
+    {
+    hash ^= (uint8_t) *name++;
+    hash *= 16777619u;
+    }
+  return hash;
+  }
+
+void OvmsMetricIndex::Grow()
+  {
+  table_t* ot = m_table;
+  table_t* nt = NewTable(ot ? ot->capacity << 1 : 16);
+  if (nt == NULL)
+    return; // keep the old table
+  m_table = nt;
+  if (ot == NULL)
+    return;
+  size_t mask = nt->capacity - 1;
+  for (size_t i = 0; i < ot->capacity; i++)
+    {
+    if (ot->slots[i].metric == NULL)
+      continue;
+    size_t pos = ot->slots[i].hash & mask;
+    while (nt->slots[pos].metric != NULL)
+      pos = (pos + 1) & mask;
+    nt->slots[pos] = ot->slots[i];
+    }
+  free(ot);
+  ESP_LOGD(TAG, "Metric index grown to %u slots", nt->capacity);
+  }
+
+bool OvmsMetricIndex::Insert(const char* name, OvmsMetric* metric)
+  {
+  OvmsMutexLock lock(&m_mutex);
+  if (!m_table || (m_count + 1) * 2 > m_table->capacity)
+    Grow();
+
+  // Keep at least one free slot, probes terminate on free slots:
+  table_t* t = m_table;
+  if (!t || m_count + 1 >= t->capacity)
+    {
+    m_incomplete = true;
+    return false;
+    }
+
+  size_t mask = t->capacity - 1;
+  uint32_t hash = Hash(name);
+  size_t pos = hash & mask;
+  while (t->slots[pos].metric != NULL)
+    {
+    if (t->slots[pos].hash == hash && strcmp(t->slots[pos].name, name) == 0)
+      {
+      // Duplicate name: the newest registration wins (as with the list order)
+      t->slots[pos].metric = metric;
+      return true;
+      }
+    pos = (pos + 1) & mask;
+    }
+  t->slots[pos].hash = hash;
+  t->slots[pos].name = name;
+  t->slots[pos].metric = metric;
+  m_count++;
+  return true;
+  }
+
+void OvmsMetricIndex::Remove(const char* name, OvmsMetric* metric)
+  {
+  OvmsMutexLock lock(&m_mutex);
+  table_t* t = m_table;
+  if (!t) return;
+  size_t mask = t->capacity - 1;
+  size_t pos = Hash(name) & mask;
+  while (t->slots[pos].metric != metric)
+    {
+    if (t->slots[pos].metric == NULL)
+      return; // not indexed
+    pos = (pos + 1) & mask;
+    }
+
+  // Backward shift deletion: move following cluster members into the gap
+  // if their home position does not lie cyclically within (gap, current]
+  size_t gap = pos;
+  for (size_t cur = (gap + 1) & mask; t->slots[cur].metric != NULL; cur = (cur + 1) & mask)
+    {
+    size_t home = t->slots[cur].hash & mask;
+    if (((cur - home) & mask) >= ((cur - gap) & mask))
+      {
+      t->slots[gap] = t->slots[cur];
+      gap = cur;
+      }
+    }
+  t->slots[gap].metric = NULL;
+  t->slots[gap].name = NULL;
+  t->slots[gap].hash = 0;
+  m_count--;
+  }
+
+OvmsMetric* OvmsMetricIndex::Find(const char* name)
+  {
+  OvmsMutexLock lock(&m_mutex);
+  table_t* t = m_table;
+  if (!t) return NULL;
+  size_t mask = t->capacity - 1;
+  uint32_t hash = Hash(name);
+  for (size_t pos = hash & mask; ; pos = (pos + 1) & mask)
+    {
+    OvmsMetric* m = t->slots[pos].metric;
+    if (m == NULL)
+      return NULL;
+    if (t->slots[pos].hash == hash && strcmp(t->slots[pos].name, name) == 0)
+      return m;
+    }
+  }
+
 void OvmsMetrics::RegisterMetric(OvmsMetric* metric)
   {
+  m_index.Insert(metric->m_name, metric);
+
   // Quick simple check for if we are the first metric.
   if (m_first == NULL)
     {
@@ -365,22 +514,40 @@ void OvmsMetrics::RegisterMetric(OvmsMetric* metric)
 
 void OvmsMetrics::DeregisterMetric(OvmsMetric* metric)
   {
+  OvmsMetric* prev = NULL;
   if (m_first == metric)
     {
     m_first = metric->m_next;
-    delete metric;
-    return;
     }
-
-  for (OvmsMetric* m=m_first;m!=NULL;m=m->m_next)
+  else
     {
-    if (m->m_next == metric)
+    for (prev=m_first; prev!=NULL; prev=prev->m_next)
       {
-      m->m_next = metric->m_next;
-      delete metric;
-      return;
+      if (prev->m_next == metric) break;
       }
+    if (prev == NULL) return;
+    prev->m_next = metric->m_next;
+    }
+
+  m_index.Remove(metric->m_name, metric);
+
+  // Invalidate journals, they may hold the metric:
+  for (size_t i = 0; i < METRICS_MAX_MODIFIERS; i++)
+    {
+    OvmsMetricJournal* j = m_journal[i];
+    if (!j) continue;
+    if (j->scanpos == metric)
+      j->scanpos = metric->m_next;
+    j->overflow = true;
     }
+
+  // Re-index a duplicate of the same name (adjacent by sort order) if any:
+  if (prev && strcmp(prev->m_name, metric->m_name) == 0)
+    m_index.Insert(prev->m_name, prev);
+  else if (metric->m_next && strcmp(metric->m_next->m_name, metric->m_name) == 0)
+    m_index.Insert(metric->m_next->m_name, metric->m_next);
+
+  delete metric;
   }
 
 bool OvmsMetrics::Set(const char* metric, const char* value)
@@ -421,9 +588,14 @@ bool OvmsMetrics::SetFloat(const char* metric, float value)
 
 OvmsMetric* OvmsMetrics::Find(const char* metric)
   {
+  if (m_index.IsComplete())
+    return m_index.Find(metric);
+
+  // Index out of memory: walk the list (newest registration first)
   for (OvmsMetric* m=m_first; m != NULL; m=m->m_next)
     {
-    if (strcmp(m->m_name,metric)==0) return m;
+    if (strcmp(m->m_name, metric) == 0)
+      return m;
     }
   return NULL;
   }
@@ -559,6 +731,90 @@ size_t OvmsMetrics::RegisterModifier()
   return m_nextmodifier++;
   }
 
+bool OvmsMetrics::RegisterJournal(size_t modifier, size_t size)
+  {
+  if (modifier >= METRICS_MAX_MODIFIERS)
+    return false;
+  if (m_journal[modifier])
+    return true;
+
+  OvmsMetricJournal* j = new OvmsMetricJournal;
+  j->queue = xQueueCreate(size, sizeof(OvmsMetric*));
+  j->scanpos = NULL;
+  j->overflow = true; // begin with a full scan
+  j->overflows = 0;
+  m_journal[modifier] = j;
+  m_journalmask |= 1ul << modifier;
+  return true;
+  }
+
+void OvmsMetrics::JournalModified(OvmsMetric* metric, unsigned long newbits)
+  {
+  unsigned long bits = newbits & m_journalmask;
+  for (size_t i = 0; bits; i++, bits >>= 1)
+    {
+    if ((bits & 1) == 0)
+      continue;
+    OvmsMetricJournal* j = m_journal[i];
+    if (!j->overflow && xQueueSend(j->queue, &metric, 0) != pdTRUE)
+      {
+      j->overflow = true;
+      j->overflows++;
+      }
+    }
+  }
+
+/**
+ * NextModified: get the next metric modified since the last call, clear
+ *  the modifier flag and return the metric, or NULL if there are no more.
+ *  Modifiers without a journal fall back to scanning the registry.
+ */
+OvmsMetric* OvmsMetrics::NextModified(size_t modifier)
+  {
+  OvmsMetric* m;
+  OvmsMetricJournal* j = (modifier < METRICS_MAX_MODIFIERS) ? m_journal[modifier] : NULL;
+  if (!j)
+    {
+    for (m = m_first; m; m = m->m_next)
+      {
+      if (m->IsModifiedAndClear(modifier))
+        return m;
+      }
+    return NULL;
+    }
+
+  if (j->overflow)
+    {
+    // Journal incomplete: discard and do a full scan
+    xQueueReset(j->queue);
+    j->scanpos = m_first;
+    j->overflow = false;
+    }
+
+  while (j->scanpos)
+    {
+    m = j->scanpos;
+    j->scanpos = m->m_next;
+    if (m->IsModifiedAndClear(modifier))
+      return m;
+    }
+
+  while (xQueueReceive(j->queue, &m, 0) == pdTRUE)
+    {
+    // Note: metrics may have been cleared by other means in between
+    if (m->IsModifiedAndClear(modifier))
+      return m;
+    }
+
+  return NULL;
+  }
+
+uint32_t OvmsMetrics::GetJournalOverflows(size_t modifier)
+  {
+  OvmsMetricJournal* j = (modifier < METRICS_MAX_MODIFIERS) ? m_journal[modifier] : NULL;
+  return j ? j->overflows : 0;
+  }
+
 OvmsMetric::OvmsMetric(const char* name, uint16_t autostale, metric_unit_t units, bool persist)
   {
   m_defined = NeverDefined;
@@ -645,7 +901,9 @@ void OvmsMetric::SetModified(bool changed)
   m_lastmodified = monotonictime;
   if (changed)
     {
-    m_modified = ULONG_MAX;
+    unsigned long prev = m_modified.exchange(ULONG_MAX);
+    if (prev != ULONG_MAX)
+      MyMetrics.JournalModified(this, ~prev);
     MyMetrics.NotifyModified(this);
     }
   }
@@ -49,6 +49,7 @@
 #endif
 
 #define METRICS_MAX_MODIFIERS 32
+#define METRICS_JOURNAL_SIZE  128
 
 using namespace std;
 
@@ -658,6 +659,73 @@ class OvmsMetricVector : public OvmsMetric
   };
 
 
+/**
+ * OvmsMetricIndex: hash index for metric lookups by name
+ *  - open addressing with linear probing on FNV-1a hashes, load factor <= 50%
+ *  - deletion by backward shifting, so there are no tombstones to clean up
+ *  - the sorted m_first/m_next list stays the authoritative iteration order,
+ *    the index only replaces the strcmp walk in OvmsMetrics::Find()
+ *  - all operations take m_mutex: backward shifting moves slots under
+ *    concurrent probes, so lookups need to be serialized with Remove()
+ *  - if a table cannot be allocated, the old table is kept as long as it
+ *    has room; beyond that the index is marked incomplete and
+ *    OvmsMetrics::Find() falls back to the list walk
+ */
+class OvmsMetricIndex
+  {
+  public:
+    OvmsMetricIndex(size_t capacity = 512);
+    ~OvmsMetricIndex();
+
+  public:
+    static uint32_t Hash(const char* name);
+    bool Insert(const char* name, OvmsMetric* metric);
+    void Remove(const char* name, OvmsMetric* metric);
+    OvmsMetric* Find(const char* name);
+    size_t Size() { return m_count; }
+    size_t Capacity() { OvmsMutexLock lock(&m_mutex); return m_table ? m_table->capacity : 0; }
+    bool IsComplete() { return !m_incomplete; }
+
+  protected:
+    typedef struct
+      {
+      uint32_t hash;
+      const char* name;
+      OvmsMetric* metric;
+      } slot_t;
+    typedef struct
+      {
+      size_t capacity;                  // power of 2
+      slot_t slots[];
+      } table_t;
+
+    static table_t* NewTable(size_t capacity);
+    void Grow();
+
+  protected:
+    OvmsMutex m_mutex;
+    table_t* m_table;
+    size_t m_count;
+    bool m_incomplete;                  // an Insert() failed (out of memory)
+  };
+
+
+/**
+ * OvmsMetricJournal: change journal for a metrics modifier
+ *  - SetModified() queues a metric once per clear->modified transition of the
+ *    modifier's flag, so consumers fetch changed metrics via NextModified()
+ *    instead of scanning the full registry
+ *  - on queue overflow, the consumer falls back to a single full scan
+ */
+typedef struct
+  {
+  QueueHandle_t queue;
+  OvmsMetric* scanpos;                  // full scan in progress if != NULL
+  bool overflow;
+  uint32_t overflows;
+  } OvmsMetricJournal;
+
+
 typedef std::function<void(OvmsMetric*)> MetricCallback;
 
 class MetricCallbackEntry
@@ -690,6 +758,7 @@ class OvmsMetrics
     bool SetBool(const char* metric, bool value);
     bool SetFloat(const char* metric, float value);
     OvmsMetric* Find(const char* metric);
+    size_t GetIndexSize() { return m_index.Size(); }
 
     OvmsMetricString *InitString(const char* metric, uint16_t autostale=0, const char* value=NULL, metric_unit_t units = Other, bool persist = false);
     OvmsMetricInt *InitInt(const char* metric, uint16_t autostale=0, int value=0, metric_unit_t units = Other, bool persist = false);
@@ -733,9 +802,18 @@ class OvmsMetrics
 
   public:
     size_t RegisterModifier();
+    bool RegisterJournal(size_t modifier, size_t size = METRICS_JOURNAL_SIZE);
+    void JournalModified(OvmsMetric* metric, unsigned long newbits);
+    OvmsMetric* NextModified(size_t modifier);
+    uint32_t GetJournalOverflows(size_t modifier);
 
   protected:
     size_t m_nextmodifier;
+    OvmsMetricJournal* m_journal[METRICS_MAX_MODIFIERS];
+    std::atomic_ulong m_journalmask;
+
+  protected:
+    OvmsMetricIndex m_index;
 
   public:
     OvmsMetric* m_first;
@@ -46,6 +46,7 @@ static const char *TAG = "test";
 #include "ovms_config.h"
 #include "can.h"
 #include "strverscmp.h"
+#include "ovms_buffer.h"
 
 void test_deepsleep(int verbosity, OvmsWriter* writer, OvmsCommand* cmd, int argc, const char* const* argv)
   {
@@ -358,6 +359,233 @@ void test_string(int verbosity, OvmsWriter* writer, OvmsCommand* cmd, int argc,
   writer->puts("finished");
   }
 
+// Metric list node for test_metricfind: a separate allocation per name,
+// so the walk chases pointers like the OvmsMetric m_next chain
+struct test_metricnode
+  {
+  std::string name;
+  test_metricnode* next;
+  };
+
+void test_metricfind(int verbosity, OvmsWriter* writer, OvmsCommand* cmd, int argc, const char* const* argv)
+  {
+  static const int defcounts[] = { 200, 500, 2000 };
+  const int lookups = 1000;
+  int runs = (argc > 0) ? argc : 3;
+
+  // Registry: former list walk on the m_next chain vs. MyMetrics.Find():
+  std::vector<const char*> regnames;
+  for (OvmsMetric* m = MyMetrics.m_first; m != NULL; m = m->m_next)
+    regnames.push_back(m->m_name);
+  if (!regnames.empty())
+    {
+    int count = regnames.size();
+    int64_t started = esp_timer_get_time();
+    int found_list = 0;
+    for (int i = 0; i < lookups; i++)
+      {
+      const char* key = regnames[(i * 7919) % count];
+      for (OvmsMetric* m = MyMetrics.m_first; m != NULL; m = m->m_next)
+        {
+        if (strcmp(m->m_name, key) == 0)
+          {
+          found_list++;
+          break;
+          }
+        }
+      }
+    int64_t time_list = esp_timer_get_time() - started;
+
+    started = esp_timer_get_time();
+    int found_index = 0;
+    for (int i = 0; i < lookups; i++)
+      {
+      if (MyMetrics.Find(regnames[(i * 7919) % count]))
+        found_index++;
+      }
+    int64_t time_index = esp_timer_get_time() - started;
+
+    writer->printf("Registry %4d metrics: list %lldus, index %lldus for %d lookups (found %d/%d)\n",
+      count, time_list, time_index, lookups, found_list, found_index);
+    }
+
+  for (int r = 0; r < runs; r++)
+    {
+    int count = (argc > 0) ? atoi(argv[r]) : defcounts[r];
+    if (count <= 0)
+      continue;
+
+    // Synthetic metric names, chained in list (sorted) order:
+    std::vector<test_metricnode*> nodes(count);
+    char buf[32];
+    for (int k = count-1; k >= 0; k--)
+      {
+      snprintf(buf, sizeof(buf), "x.test.metric.%05d", k);
+      nodes[k] = new test_metricnode{ buf, (k < count-1) ? nodes[k+1] : NULL };
+      }
+
+    OvmsMetricIndex index(count*2);
+    for (auto n : nodes)
+      index.Insert(n->name.c_str(), (OvmsMetric*) n);
+
+    int64_t started = esp_timer_get_time();
+    int found_list = 0;
+    for (int i = 0; i < lookups; i++)
+      {
+      const char* key = nodes[(i * 7919) % count]->name.c_str();
+      for (test_metricnode* n = nodes[0]; n != NULL; n = n->next)
+        {
+        if (strcmp(n->name.c_str(), key) == 0)
+          {
+          found_list++;
+          break;
+          }
+        }
+      }
+    int64_t time_list = esp_timer_get_time() - started;
+
+    started = esp_timer_get_time();
+    int found_index = 0;
+    for (int i = 0; i < lookups; i++)
+      {
+      if (index.Find(nodes[(i * 7919) % count]->name.c_str()))
+        found_index++;
+      }
+    int64_t time_index = esp_timer_get_time() - started;
+
+    writer->printf("%5d metrics: list %lldus, index %lldus for %d lookups (found %d/%d, %u slots)\n",
+      count, time_list, time_index, lookups, found_list, found_index, index.Capacity());
+
+    for (auto n : nodes)
+      delete n;
+    }
+
+  writer->printf("Registry: %u metrics indexed\n", MyMetrics.GetIndexSize());
+  }
+
+// Reference implementation for test_buffer: the former byte-by-byte OvmsBuffer
+// (per byte wrap checks, line scan restarting at the tail on every call)
+class test_bytebuffer
+  {
+  public:
+    test_bytebuffer(size_t size) { m_buffer = new uint8_t[size]; m_size = size; m_head = m_tail = m_used = 0; }
+    ~test_bytebuffer() { delete [] m_buffer; }
+    bool Push(uint8_t *byte, size_t count)
+      {
+      if ((m_size-m_used)<count) return false;
+      m_used += count;
+      for (size_t k=0;k<count;k++)
+        {
+        m_buffer[m_head++] = byte[k];
+        if (m_head >= m_size) m_head=0;
+        }
+      return true;
+      }
+    size_t Pop(size_t count, uint8_t *dest)
+      {
+      size_t done = 0;
+      while ((m_used>0)&&(done < count))
+        {
+        m_used--;
+        dest[done++] = m_buffer[m_tail++];
+        if (m_tail >= m_size) m_tail=0;
+        }
+      return done;
+      }
+    uint8_t Peek() { return (m_used==0) ? 0 : m_buffer[m_tail]; }
+    int HasLine()
+      {
+      size_t tail = m_tail;
+      for (size_t done=0;done<m_used;done++)
+        {
+        if ((m_buffer[tail]=='\r')||(m_buffer[tail]=='\n')) return done;
+        tail++;
+        if (tail >= m_size) tail=0;
+        }
+      return -1;
+      }
+    std::string ReadLine()
+      {
+      int hl = HasLine();
+      if (hl<0) return std::string("");
+      std::string result(hl, '\0');
+      Pop(hl, (uint8_t*)&result[0]);
+      uint8_t c;
+      if (Peek() == '\r') Pop(1, &c);
+      if (Peek() == '\n') Pop(1, &c);
+      return result;
+      }
+    size_t UsedSpace() { return m_used; }
+
+  protected:
+    uint8_t *m_buffer;
+    size_t m_size, m_head, m_tail, m_used;
+  };
+
+template <class B> static size_t test_buffer_feed(B& buf, const std::string& stream, size_t chunk)
+  {
+  // Feed UART sized chunks, process lines after each chunk like the modem
+  // task does. Unterminated data (PPP frames) is drained when nearly full.
+  size_t lines = 0;
+  uint8_t sink[256];
+  for (size_t pos = 0; pos < stream.size(); pos += chunk)
+    {
+    size_t len = std::min(chunk, stream.size() - pos);
+    while (!buf.Push((uint8_t*)stream.data() + pos, len))
+      buf.Pop(sizeof(sink), sink);
+    while (buf.HasLine() >= 0)
+      {
+      buf.ReadLine();
+      lines++;
+      }
+    }
+  return lines;
+  }
+
+void test_buffer(int verbosity, OvmsWriter* writer, OvmsCommand* cmd, int argc, const char* const* argv)
+  {
+  int kbytes = (argc > 0) ? atoi(argv[0]) : 64;
+  if (kbytes <= 0) kbytes = 64;
+
+  // Simulated SIM5360 session: AT responses, GPS/SMS lines and unterminated PPP frames
+  static const char* const lines[] =
+    {
+    "AT+CSQ\r\r\n+CSQ: 17,99\r\n\r\nOK\r\n",
+    "\r\n+CREG: 1,5\r\n\r\nOK\r\n",
+    "\r\n+CGPSINFO: 5130.123456,N,00007.654321,W,220720,101530.0,46.5,0.0,123.4\r\n",
+    "\r\n+CMGL: 1,\"REC UNREAD\",\"+441234567890\",\"\",\"20/07/22,10:15:30+04\"\r\n"
+      "A rather long text message body to simulate an SMS listing on the command channel\r\n\r\nOK\r\n",
+    };
+  std::string stream;
+  std::string ppp(1500, 0);
+  for (size_t k = 0; k < ppp.size(); k++)
+    ppp[k] = (k == 0 || k == ppp.size()-1) ? 0x7e : (0x20 + (k*37) % 0x5e);
+  for (int k = 0; stream.size() < (size_t)kbytes*1024; k++)
+    {
+    stream.append(lines[k % 4]);
+    if ((k % 4) == 3) stream.append(ppp);
+    }
+
+  writer->printf("Stream: %u bytes, 128 byte chunks, 2048 byte buffer\n", stream.size());
+
+  int64_t started = esp_timer_get_time();
+  test_bytebuffer* bref = new test_bytebuffer(2048);
+  size_t lines_ref = test_buffer_feed(*bref, stream, 128);
+  delete bref;
+  int64_t time_ref = esp_timer_get_time() - started;
+
+  started = esp_timer_get_time();
+  OvmsBuffer* bnew = new OvmsBuffer(2048);
+  size_t lines_new = test_buffer_feed(*bnew, stream, 128);
+  delete bnew;
+  int64_t time_new = esp_timer_get_time() - started;
+
+  writer->printf("Bytewise: %7lldus = %5lld kB/s (%u lines)\n",
+    time_ref, time_ref ? (int64_t)stream.size()*1000000/1024/time_ref : 0, lines_ref);
+  writer->printf("Buffer:   %7lldus = %5lld kB/s (%u lines)\n",
+    time_new, time_new ? (int64_t)stream.size()*1000000/1024/time_new : 0, lines_new);
+  }
+
 class TestFrameworkInit
   {
   public: TestFrameworkInit();
@@ -384,4 +612,6 @@ TestFrameworkInit::TestFrameworkInit()
   cmd_test->RegisterCommand("mkstemp", "Test mkstemp function", test_mkstemp, "<file>", 1, 1);
   cmd_test->RegisterCommand("string", "Test std::string memory corruption", test_string, "<loopcnt> <mode>\n"
     "mode: 1=m.AsJSON, 2=m.AsString, 3=m.name, 4=const cfg string, 5=const local cstr, 6=const local string", 2, 2);
+  cmd_test->RegisterCommand("metricfind", "Benchmark metric lookup by name (list vs. index)", test_metricfind, "[<#metrics> ...]", 0, 5);
+  cmd_test->RegisterCommand("buffer", "Benchmark OvmsBuffer line processing (bytewise vs. block copy)", test_buffer, "[<#kbytes>]", 0, 1);
   }
@@ -0,0 +1,124 @@
+#!/usr/bin/env python3
+#
+# Convert an OVMS binary CAN log (OBL, "can log start vfs obl ...") to CRTD
+#
+# Usage: obl2crtd.py <file.obl> [<file.crtd>]
+#
+# See components/can/src/canformat_obl.h for the format specification.
+#
+
+import struct
+import sys
+import zlib
+
+TYPENAMES = ["RX", "TX", "TX_Queue", "TX_Fail", "Error", "Status", "Comment", "Info", "Event"]
+
+
+def varint(data, pos):
+    v = shift = 0
+    while True:
+        b = data[pos]
+        pos += 1
+        v |= (b & 0x7f) << shift
+        if not b & 0x80:
+            return v, pos
+        shift += 7
+
+
+def bus_char(busflags):
+    bus = busflags & 0x07
+    return '1' if bus == 7 else chr(ord('1') + bus)
+
+
+def decode_block(raw, base, out):
+    pos, ts, dictionary = 0, base, []
+    while pos < len(raw):
+        tag = raw[pos]
+        pos += 1
+        delta, pos = varint(raw, pos)
+        ts += delta
+        stamp = "%d.%06d" % (ts // 1000000, ts % 1000000)
+        rtype = tag & 0x0f
+        if rtype <= 3:
+            if tag & 0x10:
+                msgid, npos = varint(raw, pos + 1)
+                dictionary.append([raw[pos], msgid, None])
+                entry, pos = dictionary[-1], npos
+            else:
+                entry, pos = dictionary[raw[pos]], pos + 1
+            busflags, msgid = entry[0], entry[1]
+            if tag & 0x40:
+                data = b""
+                pos += 1
+            elif tag & 0x20:
+                changes = raw[pos]
+                pos += 1
+                data = bytearray(entry[2])
+                for k in range(len(data)):
+                    if changes & (1 << k):
+                        data[k] = raw[pos]
+                        pos += 1
+                entry[2] = bytes(data)
+            else:
+                dlc = raw[pos]
+                data = raw[pos + 1:pos + 1 + dlc]
+                pos += 1 + dlc
+                entry[2] = bytes(data)
+            ext = busflags & 0x08
+            frame = "%s%s %0*X" % ("R" if rtype == 0 else "T", "29" if ext else "11", 8 if ext else 3, msgid)
+            if rtype in (2, 3):
+                line = "%s %sCER %s %s" % (stamp, bus_char(busflags), TYPENAMES[rtype], frame)
+            else:
+                line = "%s %s%s" % (stamp, bus_char(busflags), frame)
+            out.write(line + "".join(" %02X" % b for b in data) + "\n")
+        elif rtype <= 5:
+            busflags = raw[pos]
+            pos += 1
+            vals = []
+            for _ in range(11):
+                v, pos = varint(raw, pos)
+                vals.append(v)
+            out.write("%s %s%s %s intr=%d rxpkt=%d txpkt=%d errflags=%#x rxerr=%d txerr=%d rxovr=%d txovr=%d "
+                      "txdelay=%d wdgreset=%d errreset=%d\n" % (
+                          stamp, bus_char(busflags), "CER" if rtype == 4 else "CST", TYPENAMES[rtype],
+                          vals[0], vals[1], vals[2], vals[6], vals[7], vals[8], vals[4], vals[5], vals[3],
+                          vals[9], vals[10]))
+        else:
+            busflags = raw[pos]
+            length, pos = varint(raw, pos + 1)
+            text = raw[pos:pos + length].decode("utf-8", "replace")
+            pos += length
+            out.write("%s %s%s %s %s\n" % (stamp, bus_char(busflags), "CEV" if rtype == 8 else "CXX",
+                                            TYPENAMES[rtype], text))
+
+
+def convert(data, out):
+    pos = 0
+    while pos + 4 <= len(data):
+        if data[pos:pos + 4] == b"OBL1":
+            sec, usec = struct.unpack_from("<II", data, pos + 8)
+            out.write("%d.%06d CXX OVMS CRTD\n" % (sec, usec))
+            pos += 16
+        elif data[pos:pos + 2] == b"OB":
+            flags, records, rawlen, storedlen, sec, usec = struct.unpack_from("<BxHHIII", data, pos + 2)
+            stored = data[pos + 20:pos + 20 + storedlen]
+            pos += 20 + storedlen
+            raw = zlib.decompress(stored, -12) if flags & 1 else stored
+            decode_block(raw, sec * 1000000 + usec, out)
+        elif data[pos:pos + 2] == b"OI":
+            stride, entries = struct.unpack_from("<HI", data, pos + 2)
+            pos += 8 + entries * 16 + 8
+        else:
+            pos += 1
+
+
+if __name__ == "__main__":
+    if len(sys.argv) < 2:
+        sys.exit("Usage: %s <file.obl> [<file.crtd>]" % sys.argv[0])
+    with open(sys.argv[1], "rb") as f:
+        obl = f.read()
+    if len(sys.argv) > 2:
+        with open(sys.argv[2], "w") as f:
+            convert(obl, f)
+    else:
+        convert(obl, sys.stdout)